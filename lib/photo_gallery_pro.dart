@@ -1,19 +1,64 @@
+import 'dart:async';
+
 import 'package:flutter/services.dart';
 import 'package:flutter/foundation.dart';
 import 'src/album.dart';
+import 'src/duplicate_groups.dart';
+import 'src/library_root.dart';
 import 'src/media.dart';
+import 'src/media_sort.dart';
+import 'src/packed_media_list.dart';
+import 'src/performance_stats.dart';
 import 'src/thumbnail.dart';
+import 'src/thumbnail_cache_stats.dart';
+import 'src/thumbnail_format.dart';
+import 'src/thumbnail_result.dart';
+import 'src/thumbnail_texture.dart';
+import 'src/timeline_bucket.dart';
 import 'photo_gallery_pro_platform_interface.dart';
 import 'package:photo_gallery_pro/src/media_type.dart';
 
 export 'src/album.dart';
+export 'src/blur_hash.dart';
+export 'src/duplicate_groups.dart';
+export 'src/library_root.dart';
 export 'src/media.dart';
+export 'src/media_sort.dart';
+export 'src/packed_media_list.dart';
+export 'src/performance_stats.dart';
+export 'src/prefetch_stats.dart';
 export 'src/thumbnail.dart';
+export 'src/thumbnail_cache_stats.dart';
+export 'src/thumbnail_format.dart';
+export 'src/thumbnail_result.dart';
+export 'src/thumbnail_texture.dart';
+export 'src/timeline_bucket.dart';
 export 'src/media_type.dart';
 
 class PhotoGalleryPro {
   static const MethodChannel _channel = MethodChannel('photo_gallery_pro');
 
+  /// Shared by all [getThumbnails] requests; events carry their token.
+  static final Stream<dynamic> _thumbnailEvents = const EventChannel(
+    'photo_gallery_pro/thumbnails',
+  ).receiveBroadcastStream();
+
+  static int _nextThumbnailToken = 0;
+
+  /// Shared by all [streamMediaInAlbum] requests; events carry their token.
+  static final Stream<dynamic> _mediaEvents = const EventChannel(
+    'photo_gallery_pro/media',
+  ).receiveBroadcastStream();
+
+  static int _nextMediaStreamToken = 0;
+
+  /// Shared by all [findDuplicates] requests; events carry their token.
+  static final Stream<dynamic> _duplicateEvents = const EventChannel(
+    'photo_gallery_pro/duplicates',
+  ).receiveBroadcastStream();
+
+  static int _nextDuplicatesToken = 0;
+
   Future<String?> getPlatformVersion() {
     return PhotoGalleryProPlatform.instance.getPlatformVersion();
   }
@@ -31,26 +76,171 @@ class PhotoGalleryPro {
         .toList();
   }
 
+  /// Changes how the library is walked for albums (Linux only).
+  ///
+  /// Folders are followed at most [maxDepth] levels below each library root
+  /// (negative for no limit), and dot-folders are skipped unless
+  /// [skipHidden] is false. The library is rescanned in the background; the
+  /// current albums stay available meanwhile.
+  Future<void> setScanOptions({
+    int maxDepth = 16,
+    bool skipHidden = true,
+  }) async {
+    await _channel.invokeMethod('setScanOptions', {
+      'maxDepth': maxDepth,
+      'skipHidden': skipHidden,
+    });
+  }
+
+  /// Bounds the work spent decoding one image for a thumbnail (Linux only).
+  ///
+  /// An image that would decode to more than [maxPixels] pixels fails with
+  /// the error code `IMAGE_TOO_LARGE` before any pixels are allocated; JPEGs
+  /// count at the reduced size they are decoded at. A decode that takes
+  /// longer than [timeout] fails with `DECODE_TIMEOUT`. Pass 0 or
+  /// [Duration.zero] to remove a bound.
+  Future<void> setDecodeLimits({
+    int maxPixels = 50000000,
+    Duration timeout = const Duration(seconds: 10),
+  }) async {
+    await _channel.invokeMethod('setDecodeLimits', {
+      'maxPixels': maxPixels,
+      'timeoutMs': timeout.inMilliseconds,
+    });
+  }
+
+  /// Replaces the folders albums are listed from (Linux only).
+  ///
+  /// Every folder below a root is an album. Roots are indexed concurrently
+  /// and a root that is given again unchanged keeps its index, so calling
+  /// this at every start is cheap. A new root without a saved index whose
+  /// first scan takes over a second is left out of album lists until that
+  /// scan is done, unless no root is ready yet. Roots may not overlap. Album
+  /// IDs are derived from absolute paths and stay the same across runs. The
+  /// default is the Pictures directory.
+  Future<void> setLibraryRoots(List<LibraryRoot> roots) async {
+    await _channel.invokeMethod('setLibraryRoots', {
+      'roots': roots.map((root) => root.toMap()).toList(),
+    });
+  }
+
   /// Fetches media files from a specific album
+  ///
+  /// On Linux, pass [offset] and [limit] to fetch one page at a time and
+  /// [sortBy]/[descending] to have the platform sort the album; only the
+  /// requested page is sent over the channel. Without [limit] the whole
+  /// album is returned.
+  ///
+  /// With [packed], Linux sends the page as a single buffer and returns a
+  /// [PackedMediaList] that builds each [Media] on first access, which is
+  /// much cheaper for large albums. Platforms without it return a plain list.
   Future<List<Media>> getMediaInAlbum(
     String albumId, {
     MediaType type = MediaType.image,
+    int offset = 0,
+    int? limit,
+    MediaSortBy? sortBy,
+    bool descending = false,
+    bool packed = false,
   }) async {
-    final List<dynamic> mediaFiles = await _channel.invokeMethod(
+    final dynamic mediaFiles = await _channel.invokeMethod(
       'getMediaInAlbum',
-      {'albumId': albumId, 'mediaType': type.toString().split('.').last},
+      {
+        'albumId': albumId,
+        'mediaType': type.toString().split('.').last,
+        if (offset > 0) 'offset': offset,
+        if (limit != null) 'limit': limit,
+        if (sortBy != null) 'sortBy': sortBy.name,
+        if (descending) 'descending': true,
+        if (packed) 'encoding': 'packed',
+      },
     );
 
-    return mediaFiles
+    if (mediaFiles is Uint8List) {
+      return PackedMediaList.fromBytes(mediaFiles);
+    }
+    return (mediaFiles as List<dynamic>)
         .cast<Map<dynamic, dynamic>>()
         .map((map) => Media.fromJson(Map<String, dynamic>.from(map)))
         .toList();
   }
 
+  /// Streams the media of an album in chunks as they are found (Linux only).
+  ///
+  /// Each event holds up to [chunkSize] items, so the first items can be
+  /// shown before a large album has been fully enumerated. [sortBy] and
+  /// [descending] order the items as in [getMediaInAlbum]. Cancelling the
+  /// subscription stops the native enumeration.
+  Stream<List<Media>> streamMediaInAlbum(
+    String albumId, {
+    MediaType type = MediaType.image,
+    MediaSortBy? sortBy,
+    bool descending = false,
+    int chunkSize = 256,
+  }) {
+    final token = 'media-${_nextMediaStreamToken++}';
+    StreamSubscription<dynamic>? subscription;
+    var done = false;
+    late final StreamController<List<Media>> controller;
+
+    void finish() {
+      done = true;
+      subscription?.cancel();
+      controller.close();
+    }
+
+    controller = StreamController<List<Media>>(
+      onListen: () {
+        subscription = _mediaEvents.listen((event) {
+          final map = Map<String, dynamic>.from(event as Map);
+          if (map['token'] != token) return;
+          if (map['done'] == true) {
+            finish();
+            return;
+          }
+          controller.add((map['media'] as List<dynamic>)
+              .cast<Map<dynamic, dynamic>>()
+              .map((media) => Media.fromJson(Map<String, dynamic>.from(media)))
+              .toList());
+        }, onError: controller.addError);
+
+        _channel.invokeMethod('streamMediaInAlbum', {
+          'albumId': albumId,
+          'mediaType': type.toString().split('.').last,
+          'token': token,
+          if (sortBy != null) 'sortBy': sortBy.name,
+          if (descending) 'descending': true,
+          if (chunkSize != 256) 'chunkSize': chunkSize,
+        }).catchError((Object error, StackTrace stackTrace) {
+          controller.addError(error, stackTrace);
+          finish();
+        });
+      },
+      onCancel: () async {
+        await subscription?.cancel();
+        if (!done) {
+          done = true;
+          await _channel.invokeMethod('cancelMediaStream', {'token': token});
+        }
+      },
+    );
+    return controller.stream;
+  }
+
   /// Generates or fetches a thumbnail for a specific media item
+  ///
+  /// [format] and [quality] select the encoding of the returned bytes; see
+  /// [ThumbnailFormat] for platform support. [quality] (0-100) applies to the
+  /// lossy formats only.
+  ///
+  /// For videos, [videoPosition] picks the frame (Linux only); by default a
+  /// frame about one second in is used.
   Future<Thumbnail> getThumbnail(
     String mediaId, {
     MediaType? type,
+    ThumbnailFormat format = ThumbnailFormat.png,
+    int? quality,
+    Duration? videoPosition,
   }) async {
     try {
       final result = await _channel.invokeMethod(
@@ -58,6 +248,10 @@ class PhotoGalleryPro {
         {
           'mediaId': mediaId,
           if (type != null) 'mediaType': type.toString().split('.').last,
+          if (format != ThumbnailFormat.png) 'format': format.name,
+          if (quality != null) 'quality': quality,
+          if (videoPosition != null)
+            'videoPosition': videoPosition.inMilliseconds,
         },
       );
 
@@ -75,18 +269,315 @@ class PhotoGalleryPro {
     }
   }
 
+  /// Requests thumbnails for many media items in one platform call (Linux only).
+  ///
+  /// Results are emitted as soon as each thumbnail is ready, not in request
+  /// order. Requests with a higher [priority] are started first. Cancelling
+  /// the subscription, or calling [cancelThumbnails] with the same [token],
+  /// drops the thumbnails that have not started decoding yet.
+  ///
+  /// With [placeholders], each item whose placeholder the index already has
+  /// is first emitted as a [ThumbnailResult.placeholder] without a
+  /// thumbnail, before any decoding starts; its thumbnail follows later.
+  Stream<ThumbnailResult> getThumbnails(
+    List<String> mediaIds, {
+    int priority = 0,
+    String? token,
+    int width = 512,
+    int height = 512,
+    ThumbnailFormat format = ThumbnailFormat.png,
+    int? quality,
+    bool placeholders = false,
+  }) {
+    final requestToken = token ?? 'thumbnails-${_nextThumbnailToken++}';
+    StreamSubscription<dynamic>? subscription;
+    var done = false;
+    late final StreamController<ThumbnailResult> controller;
+
+    controller = StreamController<ThumbnailResult>(
+      onListen: () {
+        subscription = _thumbnailEvents.listen((event) {
+          final map = Map<String, dynamic>.from(event as Map);
+          if (map['token'] != requestToken) return;
+          if (map['done'] == true) {
+            done = true;
+            subscription?.cancel();
+            controller.close();
+            return;
+          }
+          controller.add(ThumbnailResult.fromPlatformData(map));
+        }, onError: controller.addError);
+
+        _channel.invokeMethod('getThumbnails', {
+          'mediaIds': mediaIds,
+          'token': requestToken,
+          'priority': priority,
+          'width': width,
+          'height': height,
+          'format': format.name,
+          if (quality != null) 'quality': quality,
+          if (placeholders) 'placeholders': true,
+        }).then((queued) {
+          if (queued == 0 && !done) {
+            done = true;
+            subscription?.cancel();
+            controller.close();
+          }
+        }, onError: (Object error, StackTrace stackTrace) {
+          done = true;
+          subscription?.cancel();
+          controller.addError(error, stackTrace);
+          controller.close();
+        });
+      },
+      onCancel: () async {
+        await subscription?.cancel();
+        if (!done) {
+          done = true;
+          await cancelThumbnails(requestToken);
+        }
+      },
+    );
+    return controller.stream;
+  }
+
+  /// Drops queued thumbnails of a [getThumbnails] request (Linux only).
+  Future<void> cancelThumbnails(String token) async {
+    await _channel.invokeMethod('cancelThumbnails', {'token': token});
+  }
+
+  /// Shows a thumbnail in a native texture instead of returning its bytes
+  /// (Linux only).
+  ///
+  /// The decoded pixels are read by the engine directly, so nothing is
+  /// copied through the platform channel. Every texture obtained here must be
+  /// released with [releaseThumbnailTexture]; textures are pooled and their
+  /// total memory is capped, so unreleased textures eventually make this fail
+  /// with a `TEXTURE_BUDGET_EXCEEDED` error.
+  Future<ThumbnailTexture> getThumbnailTexture(
+    String mediaId, {
+    int width = 512,
+    int height = 512,
+  }) async {
+    final Map<dynamic, dynamic> result = await _channel.invokeMethod(
+      'getThumbnailTexture',
+      {'mediaId': mediaId, 'width': width, 'height': height},
+    );
+    return ThumbnailTexture.fromJson(Map<String, dynamic>.from(result));
+  }
+
+  /// Returns a texture from [getThumbnailTexture] to the pool (Linux only).
+  Future<void> releaseThumbnailTexture(int textureId) async {
+    await _channel.invokeMethod('releaseThumbnailTexture', {
+      'textureId': textureId,
+    });
+  }
+
   /// Fetches the album thumbnail for the given album ID.
+  ///
+  /// [format] and [quality] behave as for [getThumbnail].
   Future<Thumbnail> getAlbumThumbnail(
     String albumId, {
     MediaType type = MediaType.image,
+    ThumbnailFormat format = ThumbnailFormat.png,
+    int? quality,
   }) async {
     final dynamic thumbnailData = await _channel.invokeMethod(
       'getAlbumThumbnail',
-      {'albumId': albumId, 'mediaType': type.toString().split('.').last},
+      {
+        'albumId': albumId,
+        'mediaType': type.toString().split('.').last,
+        if (format != ThumbnailFormat.png) 'format': format.name,
+        if (quality != null) 'quality': quality,
+      },
     );
     return Thumbnail.fromPlatformData(thumbnailData);
   }
 
+  /// Drops cached thumbnails (Linux only).
+  ///
+  /// When [includeDisk] is true, thumbnails this plugin wrote to the shared
+  /// on-disk thumbnail store are removed as well.
+  Future<void> clearThumbnailCache({bool includeDisk = false}) async {
+    await _channel.invokeMethod('clearThumbnailCache', {
+      'includeDisk': includeDisk,
+    });
+  }
+
+  /// Reports the items of an album a grid shows, from [firstIndex] to
+  /// [lastIndex] in the order of [getMediaInAlbum] with the same [type],
+  /// [sortBy] and [descending] (Linux only).
+  ///
+  /// Thumbnails of [width]x[height] are then generated in the background for
+  /// where the grid is heading: [velocity] is its scroll speed in items per
+  /// second, negative towards the start of the album, and faster scrolling
+  /// looks further ahead. Thumbnails the grid asks for always take priority.
+  /// Each call replaces the previous viewport. Returns the number of items
+  /// queued; albums outside the library roots are not prefetched.
+  Future<int> setViewport(
+    String albumId,
+    int firstIndex,
+    int lastIndex, {
+    double velocity = 0,
+    MediaType type = MediaType.image,
+    MediaSortBy? sortBy,
+    bool descending = false,
+    int width = 512,
+    int height = 512,
+  }) async {
+    final int queued = await _channel.invokeMethod('setViewport', {
+      'albumId': albumId,
+      'firstIndex': firstIndex,
+      'lastIndex': lastIndex,
+      'velocity': velocity,
+      'mediaType': type.toString().split('.').last,
+      if (sortBy != null) 'sortBy': sortBy.name,
+      if (descending) 'descending': true,
+      'width': width,
+      'height': height,
+    });
+    return queued;
+  }
+
+  /// Returns hit/miss counters of the thumbnail cache (Linux only).
+  Future<ThumbnailCacheStats> getThumbnailCacheStats() async {
+    final Map<dynamic, dynamic> stats = await _channel.invokeMethod(
+      'getThumbnailCacheStats',
+    );
+    return ThumbnailCacheStats.fromJson(Map<String, dynamic>.from(stats));
+  }
+
+  /// Counts the media of the whole library per day, month or year, newest
+  /// first (Linux only).
+  ///
+  /// Only non-empty spans are returned. [type] limits the count to images or
+  /// videos.
+  Future<List<TimelineBucket>> getTimeline({
+    TimelineGranularity granularity = TimelineGranularity.day,
+    MediaType? type,
+  }) async {
+    final Map<dynamic, dynamic> timeline = await _channel.invokeMethod(
+      'getTimeline',
+      {
+        'granularity': granularity.name,
+        if (type != null) 'mediaType': type.toString().split('.').last,
+      },
+    );
+    return TimelineBucket.listFromPlatformData(timeline);
+  }
+
+  /// Lists the media of the whole library dated from [start] up to, but not
+  /// including, [end], newest first (Linux only).
+  ///
+  /// Pass a [TimelineBucket]'s bounds to fill that bucket a page at a time
+  /// with [offset] and [limit].
+  Future<List<Media>> getMediaInRange(
+    DateTime start,
+    DateTime end, {
+    int offset = 0,
+    int? limit,
+    MediaType? type,
+  }) async {
+    final List<dynamic> media = await _channel.invokeMethod(
+      'getMediaInRange',
+      {
+        'start': start.millisecondsSinceEpoch ~/ 1000,
+        'end': end.millisecondsSinceEpoch ~/ 1000,
+        if (offset != 0) 'offset': offset,
+        if (limit != null) 'limit': limit,
+        if (type != null) 'mediaType': type.toString().split('.').last,
+      },
+    );
+    return media
+        .cast<Map<dynamic, dynamic>>()
+        .map((item) => Media.fromJson(Map<String, dynamic>.from(item)))
+        .toList();
+  }
+
+  /// Groups images that look alike (Linux only).
+  ///
+  /// Each image is reduced to a 64-bit perceptual hash in the background, and
+  /// images whose hashes differ in at most [maxDistance] bits (0 to 64) are
+  /// grouped, so resaved, rescaled and lightly edited copies are found as
+  /// well as exact ones. Only groups of two or more are returned. [albumId]
+  /// limits the search to one album.
+  ///
+  /// Waits for images that have not been hashed yet, for at most [timeout]
+  /// or until [cancelFindDuplicates] is called with the same [token];
+  /// [onProgress] reports how many of the images in scope are hashed
+  /// meanwhile. If it stops waiting early, the groups among the images hashed
+  /// so far are returned and [DuplicateGroups.complete] is false. Hashes are
+  /// kept, so calling again later picks up where the index got to.
+  Future<DuplicateGroups> findDuplicates({
+    String? albumId,
+    int maxDistance = 6,
+    String? token,
+    Duration timeout = const Duration(minutes: 2),
+    void Function(int hashed, int total)? onProgress,
+  }) async {
+    final requestToken = token ??
+        (onProgress != null ? 'duplicates-${_nextDuplicatesToken++}' : null);
+    StreamSubscription<dynamic>? subscription;
+    if (onProgress != null) {
+      subscription = _duplicateEvents.listen((event) {
+        final map = Map<String, dynamic>.from(event as Map);
+        if (map['token'] != requestToken) return;
+        onProgress(map['hashed'] as int, map['total'] as int);
+      });
+    }
+    try {
+      final Map<dynamic, dynamic> result = await _channel.invokeMethod(
+        'findDuplicates',
+        {
+          if (albumId != null) 'albumId': albumId,
+          'maxDistance': maxDistance,
+          'timeoutMs': timeout.inMilliseconds,
+          if (requestToken != null) 'token': requestToken,
+        },
+      );
+      return DuplicateGroups.fromPlatformData(result);
+    } finally {
+      await subscription?.cancel();
+    }
+  }
+
+  /// Stops a [findDuplicates] call with [token] from waiting for the index
+  /// (Linux only). The call then completes with the groups found so far.
+  Future<void> cancelFindDuplicates(String token) async {
+    await _channel.invokeMethod('cancelFindDuplicates', {'token': token});
+  }
+
+  /// Returns where the plugin spends its time (Linux only): latency
+  /// percentiles per method and per stage of producing thumbnails, queue
+  /// depths and cache hit rates.
+  ///
+  /// If [tracePath] is given, the most recent timed sections are also written
+  /// there as a Chrome trace, which can be opened in Perfetto
+  /// (ui.perfetto.dev) or chrome://tracing. When [reset] is true the counters
+  /// start over afterwards.
+  Future<PerformanceStats> getPerformanceStats({
+    String? tracePath,
+    bool reset = false,
+  }) async {
+    final Map<dynamic, dynamic> stats = await _channel.invokeMethod(
+      'getPerformanceStats',
+      {
+        if (tracePath != null) 'tracePath': tracePath,
+        'reset': reset,
+      },
+    );
+    return PerformanceStats.fromJson(Map<String, dynamic>.from(stats));
+  }
+
+  /// Turns the counters behind [getPerformanceStats] on or off (Linux only).
+  ///
+  /// They are on by default and cheap enough to leave on.
+  Future<void> setPerformanceStatsEnabled(bool enabled) async {
+    await _channel.invokeMethod('setPerformanceStatsEnabled', {
+      'enabled': enabled,
+    });
+  }
+
   /// Checks if the app has required permissions
   Future<bool> hasPermission() async {
     return await _channel.invokeMethod('hasPermission') ?? false;
@@ -16,19 +16,33 @@ class Album {
   /// Type of media in the album (image or video)
   final MediaType type;
 
+  /// Modification time of the album's newest item, when the platform
+  /// reports it (Linux only)
+  final DateTime? lastModified;
+
+  /// Absolute path of the album's folder (Linux only)
+  final String? path;
+
   const Album({
     required this.id,
     required this.name,
     required this.count,
     required this.type,
+    this.lastModified,
+    this.path,
   });
 
   factory Album.fromJson(Map<String, dynamic> json) {
+    final lastModified = json['lastModified'] as int? ?? 0;
     return Album(
       id: json['id']?.toString() ?? '',
       name: json['name']?.toString() ?? '',
       count: json['count'] as int? ?? 0,
       type: json['type'] == 'image' ? MediaType.image : MediaType.video,
+      lastModified: lastModified > 0
+          ? DateTime.fromMillisecondsSinceEpoch(lastModified * 1000)
+          : null,
+      path: json['path']?.toString(),
     );
   }
 
@@ -0,0 +1,115 @@
+import 'dart:math' as math;
+import 'dart:typed_data';
+
+/// Decoder for the BlurHash strings in [Media.placeholder] (Linux only).
+///
+/// A BlurHash holds the average colour and a few low-frequency components
+/// of an image in a couple of dozen characters, so a blurred stand-in can
+/// be painted before the thumbnail has been decoded. See https://blurha.sh.
+class BlurHash {
+  BlurHash._();
+
+  static const String _digits =
+      '0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz'
+      '#\$%*+,-.:;=?@[]^_{|}~';
+
+  /// Returns the [width] x [height] RGBA pixels of the blurred image [hash]
+  /// describes, e.g. for `decodeImageFromPixels`. A few pixels across are
+  /// enough; the result is meant to be scaled up. [punch] strengthens the
+  /// contrast.
+  ///
+  /// Throws a [FormatException] if [hash] is not a BlurHash.
+  static Uint8List decode(
+    String hash,
+    int width,
+    int height, {
+    double punch = 1,
+  }) {
+    if (hash.length < 6) {
+      throw FormatException('BlurHash too short', hash);
+    }
+    final sizeFlag = _decode83(hash, 0, 1);
+    final componentsX = sizeFlag % 9 + 1;
+    final componentsY = sizeFlag ~/ 9 + 1;
+    if (hash.length != 4 + 2 * componentsX * componentsY) {
+      throw FormatException('BlurHash has the wrong length', hash);
+    }
+
+    final maximum = (_decode83(hash, 1, 2) + 1) / 166 * punch;
+    final colors = List<List<double>>.generate(
+      componentsX * componentsY,
+      (i) => i == 0
+          ? _decodeDc(_decode83(hash, 2, 6))
+          : _decodeAc(_decode83(hash, 4 + i * 2, 6 + i * 2), maximum),
+    );
+
+    final pixels = Uint8List(width * height * 4);
+    for (var y = 0; y < height; y++) {
+      for (var x = 0; x < width; x++) {
+        var r = 0.0, g = 0.0, b = 0.0;
+        for (var j = 0; j < componentsY; j++) {
+          for (var i = 0; i < componentsX; i++) {
+            final basis = math.cos(math.pi * x * i / width) *
+                math.cos(math.pi * y * j / height);
+            final color = colors[i + j * componentsX];
+            r += color[0] * basis;
+            g += color[1] * basis;
+            b += color[2] * basis;
+          }
+        }
+        final offset = (y * width + x) * 4;
+        pixels[offset] = _linearToSrgb(r);
+        pixels[offset + 1] = _linearToSrgb(g);
+        pixels[offset + 2] = _linearToSrgb(b);
+        pixels[offset + 3] = 255;
+      }
+    }
+    return pixels;
+  }
+
+  static int _decode83(String hash, int start, int end) {
+    var value = 0;
+    for (var i = start; i < end; i++) {
+      final digit = _digits.indexOf(hash[i]);
+      if (digit < 0) {
+        throw FormatException('Invalid BlurHash character', hash, i);
+      }
+      value = value * 83 + digit;
+    }
+    return value;
+  }
+
+  static List<double> _decodeDc(int value) => [
+        _srgbToLinear(value >> 16),
+        _srgbToLinear(value >> 8 & 0xff),
+        _srgbToLinear(value & 0xff),
+      ];
+
+  static List<double> _decodeAc(int value, double maximum) {
+    double component(int quantised) {
+      final v = (quantised - 9) / 9;
+      return v.sign * v * v * maximum;
+    }
+
+    return [
+      component(value ~/ (19 * 19)),
+      component(value ~/ 19 % 19),
+      component(value % 19),
+    ];
+  }
+
+  static double _srgbToLinear(int value) {
+    final v = value / 255;
+    return v <= 0.04045
+        ? v / 12.92
+        : math.pow((v + 0.055) / 1.055, 2.4).toDouble();
+  }
+
+  static int _linearToSrgb(double value) {
+    final v = value.clamp(0.0, 1.0);
+    final srgb = v <= 0.0031308
+        ? v * 12.92
+        : 1.055 * math.pow(v, 1 / 2.4).toDouble() - 0.055;
+    return (srgb * 255 + 0.5).floor();
+  }
+}
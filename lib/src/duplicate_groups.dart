@@ -0,0 +1,34 @@
+import 'package:meta/meta.dart';
+
+import 'media.dart';
+
+/// What [PhotoGalleryPro.findDuplicates] found.
+@immutable
+class DuplicateGroups {
+  /// Images that look alike, two or more to a group
+  final List<List<Media>> groups;
+
+  /// Whether every image in scope had been hashed. False when the search
+  /// timed out or was cancelled first; [groups] then only cover the images
+  /// hashed so far.
+  final bool complete;
+
+  const DuplicateGroups({this.groups = const [], this.complete = false});
+
+  factory DuplicateGroups.fromPlatformData(Map<dynamic, dynamic> data) {
+    final List<dynamic> groups = data['groups'] as List<dynamic>? ?? const [];
+    return DuplicateGroups(
+      groups: groups
+          .map((group) => (group as List<dynamic>)
+              .cast<Map<dynamic, dynamic>>()
+              .map((media) => Media.fromJson(Map<String, dynamic>.from(media)))
+              .toList())
+          .toList(),
+      complete: data['complete'] as bool? ?? false,
+    );
+  }
+
+  @override
+  String toString() =>
+      'DuplicateGroups(groups: ${groups.length}, complete: $complete)';
+}
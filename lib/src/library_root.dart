@@ -0,0 +1,34 @@
+/// A folder the media library is built from, with optional globs choosing
+/// what below it is indexed (Linux only).
+///
+/// Globs use shell syntax and match case-insensitively. A glob without a
+/// slash matches the last component of a path, such as `Screenshots` or
+/// `*.jpg`; one with a slash matches the whole path relative to [path], with
+/// `*` also crossing slashes, so `2019/*` covers everything below 2019.
+class LibraryRoot {
+  /// Absolute path of the folder
+  final String path;
+
+  /// When not empty, only files matching one of these globs are indexed
+  final List<String> include;
+
+  /// Folders and files matching any of these globs are skipped; excluded
+  /// folders are not walked at all
+  final List<String> exclude;
+
+  const LibraryRoot(
+    this.path, {
+    this.include = const [],
+    this.exclude = const [],
+  });
+
+  Map<String, dynamic> toMap() => {
+        'path': path,
+        'include': include,
+        'exclude': exclude,
+      };
+
+  @override
+  String toString() =>
+      'LibraryRoot(path: $path, include: $include, exclude: $exclude)';
+}
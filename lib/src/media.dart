@@ -2,6 +2,9 @@ import 'package:flutter/foundation.dart';
 import 'package:meta/meta.dart';
 import 'package:photo_gallery_pro/src/media_type.dart';
 
+DateTime? _dateFromSeconds(Object? value) =>
+    value is int ? DateTime.fromMillisecondsSinceEpoch(value * 1000) : null;
+
 /// Base class for media items (images and videos) in the gallery.
 ///
 /// This abstract class provides common properties shared between different
@@ -32,6 +35,26 @@ abstract class Media {
   /// Type of media (image or video)
   final MediaType type;
 
+  /// When the media was captured, from its EXIF data (Linux only)
+  final DateTime? dateTaken;
+
+  /// EXIF orientation (1-8) of the stored pixels (Linux only)
+  final int? orientation;
+
+  /// Model of the camera that captured the media (Linux only)
+  final String? cameraModel;
+
+  /// Latitude where the media was captured, in degrees (Linux only)
+  final double? latitude;
+
+  /// Longitude where the media was captured, in degrees (Linux only)
+  final double? longitude;
+
+  /// BlurHash of the media to show while its thumbnail loads, once the
+  /// platform has computed it (Linux only). `BlurHash.decode` turns it
+  /// into pixels.
+  final String? placeholder;
+
   /// Creates a new [Media] instance.
   const Media({
     required this.id,
@@ -42,6 +65,12 @@ abstract class Media {
     required this.width,
     required this.height,
     required this.type,
+    this.dateTaken,
+    this.orientation,
+    this.cameraModel,
+    this.latitude,
+    this.longitude,
+    this.placeholder,
   });
 
   /// Creates a [Media] instance from a JSON map.
@@ -57,6 +86,9 @@ abstract class Media {
   /// - width: int (pixels)
   /// - height: int (pixels)
   /// - type: String ('image' or 'video')
+  ///
+  /// and optionally dateTaken (Unix timestamp in seconds), orientation,
+  /// cameraModel, latitude, longitude and placeholder.
   factory Media.fromJson(Map<String, dynamic> json) {
     final type = json['type'] == 'image' ? MediaType.image : MediaType.video;
 
@@ -80,6 +112,12 @@ class ImageMedia extends Media {
     required super.size,
     required super.width,
     required super.height,
+    super.dateTaken,
+    super.orientation,
+    super.cameraModel,
+    super.latitude,
+    super.longitude,
+    super.placeholder,
   }) : super(type: MediaType.image);
 
   /// Creates an [ImageMedia] instance from a JSON map.
@@ -96,6 +134,12 @@ class ImageMedia extends Media {
       size: json['size'] as int? ?? 0,
       width: json['width'] as int? ?? 0,
       height: json['height'] as int? ?? 0,
+      dateTaken: _dateFromSeconds(json['dateTaken']),
+      orientation: json['orientation'] as int?,
+      cameraModel: json['cameraModel'] as String?,
+      latitude: (json['latitude'] as num?)?.toDouble(),
+      longitude: (json['longitude'] as num?)?.toDouble(),
+      placeholder: json['placeholder'] as String?,
     );
   }
 
@@ -121,6 +165,12 @@ class VideoMedia extends Media {
     required super.width,
     required super.height,
     required this.duration,
+    super.dateTaken,
+    super.orientation,
+    super.cameraModel,
+    super.latitude,
+    super.longitude,
+    super.placeholder,
   }) : super(type: MediaType.video);
 
   /// Creates a [VideoMedia] instance from a JSON map.
@@ -139,6 +189,12 @@ class VideoMedia extends Media {
       width: json['width'] as int? ?? 0,
       height: json['height'] as int? ?? 0,
       duration: Duration(milliseconds: json['duration'] as int? ?? 0),
+      dateTaken: _dateFromSeconds(json['dateTaken']),
+      orientation: json['orientation'] as int?,
+      cameraModel: json['cameraModel'] as String?,
+      latitude: (json['latitude'] as num?)?.toDouble(),
+      longitude: (json['longitude'] as num?)?.toDouble(),
+      placeholder: json['placeholder'] as String?,
     );
   }
 
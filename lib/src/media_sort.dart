@@ -0,0 +1,14 @@
+/// Keys [PhotoGalleryPro.getMediaInAlbum] can sort by.
+enum MediaSortBy {
+  /// File name
+  name,
+
+  /// [Media.dateAdded]
+  dateAdded,
+
+  /// [Media.dateTaken], or [Media.dateAdded] when it is unknown (Linux only)
+  dateTaken,
+
+  /// File size
+  size,
+}
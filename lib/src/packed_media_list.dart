@@ -0,0 +1,201 @@
+import 'dart:collection';
+import 'dart:convert';
+import 'dart:typed_data';
+
+import 'media.dart';
+import 'media_type.dart';
+
+/// A page of media received in the packed encoding (Linux only).
+///
+/// The platform sends the whole page as one buffer of columns instead of a
+/// map per item, and a [Media] is only built when its index is first read.
+/// The column accessors such as [sizeAt] and [pathAt] read the buffer
+/// directly, so sorting or filtering a large album does not need to build
+/// any [Media] at all.
+class PackedMediaList extends ListBase<Media> {
+  static const int _magic = 0x4c4d4750;
+  static const int _version = 2;
+  static const int _headerSize = 32;
+  static const int _bytesPerItem = 96;
+
+  final ByteData _data;
+  final Uint8List _bytes;
+  final int _length;
+  final int _strings;
+  final List<Media?> _media;
+
+  // Start of each column
+  final int _sizes;
+  final int _datesAdded;
+  final int _datesTaken;
+  final int _widths;
+  final int _heights;
+  final int _durations;
+  final int _latitudes;
+  final int _longitudes;
+  final int _pathOffsets;
+  final int _pathLengths;
+  final int _nameOffsets;
+  final int _cameraOffsets;
+  final int _cameraLengths;
+  final int _placeholderOffsets;
+  final int _placeholderLengths;
+  final int _infos;
+
+  // Six int64 and two float64 columns come first, then eight uint32 ones
+  PackedMediaList._(this._bytes, this._data, this._length, this._strings)
+      : _media = List<Media?>.filled(_length, null),
+        _sizes = _headerSize,
+        _datesAdded = _headerSize + _length * 8,
+        _datesTaken = _headerSize + _length * 16,
+        _widths = _headerSize + _length * 24,
+        _heights = _headerSize + _length * 32,
+        _durations = _headerSize + _length * 40,
+        _latitudes = _headerSize + _length * 48,
+        _longitudes = _headerSize + _length * 56,
+        _pathOffsets = _headerSize + _length * 64,
+        _pathLengths = _headerSize + _length * 68,
+        _nameOffsets = _headerSize + _length * 72,
+        _cameraOffsets = _headerSize + _length * 76,
+        _cameraLengths = _headerSize + _length * 80,
+        _placeholderOffsets = _headerSize + _length * 84,
+        _placeholderLengths = _headerSize + _length * 88,
+        _infos = _headerSize + _length * 92;
+
+  /// Wraps a buffer produced by the platform's packed encoding.
+  factory PackedMediaList.fromBytes(Uint8List bytes) {
+    final data = ByteData.sublistView(bytes);
+    if (bytes.length < _headerSize ||
+        data.getUint32(0, Endian.little) != _magic ||
+        data.getUint32(4, Endian.little) != _version) {
+      throw const FormatException('Not a packed media list');
+    }
+    final length = data.getUint32(8, Endian.little);
+    final strings = data.getUint32(12, Endian.little);
+    if (strings != _headerSize + length * _bytesPerItem ||
+        strings + data.getUint32(16, Endian.little) > bytes.length) {
+      throw const FormatException('Truncated packed media list');
+    }
+    return PackedMediaList._(bytes, data, length, strings);
+  }
+
+  @override
+  int get length => _length;
+
+  @override
+  set length(int newLength) =>
+      throw UnsupportedError('Cannot change the length of a media list');
+
+  @override
+  Media operator [](int index) => _media[index] ??= _decode(index);
+
+  @override
+  void operator []=(int index, Media value) =>
+      throw UnsupportedError('Cannot modify a media list');
+
+  int _int64(int column, int index) =>
+      _data.getInt64(column + index * 8, Endian.little);
+
+  int _uint32(int column, int index) =>
+      _data.getUint32(column + index * 4, Endian.little);
+
+  String _string(int offset, int length) => utf8.decode(
+        Uint8List.sublistView(
+          _bytes,
+          _strings + offset,
+          _strings + offset + length,
+        ),
+      );
+
+  /// File size in bytes of the item at [index]
+  int sizeAt(int index) => _int64(_sizes, index);
+
+  /// Modification time of the item at [index]
+  DateTime dateAddedAt(int index) =>
+      DateTime.fromMillisecondsSinceEpoch(_int64(_datesAdded, index) * 1000);
+
+  /// Capture time of the item at [index], when known
+  DateTime? dateTakenAt(int index) {
+    final seconds = _int64(_datesTaken, index);
+    return seconds != 0
+        ? DateTime.fromMillisecondsSinceEpoch(seconds * 1000)
+        : null;
+  }
+
+  /// Type of the item at [index]
+  MediaType typeAt(int index) =>
+      _uint32(_infos, index) & 0xff == 1 ? MediaType.image : MediaType.video;
+
+  /// Full path of the item at [index]
+  String pathAt(int index) =>
+      _string(_uint32(_pathOffsets, index), _uint32(_pathLengths, index));
+
+  /// BlurHash placeholder of the item at [index], when computed
+  String? placeholderAt(int index) {
+    final length = _uint32(_placeholderLengths, index);
+    return length > 0
+        ? _string(_uint32(_placeholderOffsets, index), length)
+        : null;
+  }
+
+  /// File name of the item at [index]
+  String nameAt(int index) {
+    final pathEnd =
+        _uint32(_pathOffsets, index) + _uint32(_pathLengths, index);
+    final nameOffset = _uint32(_nameOffsets, index);
+    return _string(nameOffset, pathEnd - nameOffset);
+  }
+
+  Media _decode(int index) {
+    final path = pathAt(index);
+    final name = nameAt(index);
+    final dateAdded = dateAddedAt(index);
+    final size = sizeAt(index);
+    final width = _int64(_widths, index);
+    final height = _int64(_heights, index);
+    final dateTaken = dateTakenAt(index);
+    final info = _uint32(_infos, index);
+    final orientation = info >> 8 & 0xff;
+    final cameraLength = _uint32(_cameraLengths, index);
+    final cameraModel = cameraLength > 0
+        ? _string(_uint32(_cameraOffsets, index), cameraLength)
+        : null;
+    final latitude = _data.getFloat64(_latitudes + index * 8, Endian.little);
+    final longitude = _data.getFloat64(_longitudes + index * 8, Endian.little);
+    final placeholder = placeholderAt(index);
+
+    if (info & 0xff == 1) {
+      return ImageMedia(
+        id: path,
+        name: name,
+        path: path,
+        dateAdded: dateAdded,
+        size: size,
+        width: width,
+        height: height,
+        dateTaken: dateTaken,
+        orientation: orientation != 0 ? orientation : null,
+        cameraModel: cameraModel,
+        latitude: latitude.isNaN ? null : latitude,
+        longitude: longitude.isNaN ? null : longitude,
+        placeholder: placeholder,
+      );
+    }
+    return VideoMedia(
+      id: path,
+      name: name,
+      path: path,
+      dateAdded: dateAdded,
+      size: size,
+      width: width,
+      height: height,
+      duration: Duration(milliseconds: _int64(_durations, index)),
+      dateTaken: dateTaken,
+      orientation: orientation != 0 ? orientation : null,
+      cameraModel: cameraModel,
+      latitude: latitude.isNaN ? null : latitude,
+      longitude: longitude.isNaN ? null : longitude,
+      placeholder: placeholder,
+    );
+  }
+}
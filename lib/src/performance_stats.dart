@@ -0,0 +1,168 @@
+import 'package:meta/meta.dart';
+
+/// Latency percentiles of a method or stage, in microseconds.
+///
+/// Percentiles are rounded up to within 1/16 of the true value.
+@immutable
+class LatencySummary {
+  /// Calls or stages timed
+  final int count;
+  final double meanUs;
+  final int p50Us;
+  final int p90Us;
+  final int p99Us;
+  final int maxUs;
+
+  const LatencySummary({
+    this.count = 0,
+    this.meanUs = 0,
+    this.p50Us = 0,
+    this.p90Us = 0,
+    this.p99Us = 0,
+    this.maxUs = 0,
+  });
+
+  factory LatencySummary.fromJson(Map<String, dynamic> json) {
+    return LatencySummary(
+      count: json['count'] as int? ?? 0,
+      meanUs: (json['meanUs'] as num?)?.toDouble() ?? 0,
+      p50Us: json['p50Us'] as int? ?? 0,
+      p90Us: json['p90Us'] as int? ?? 0,
+      p99Us: json['p99Us'] as int? ?? 0,
+      maxUs: json['maxUs'] as int? ?? 0,
+    );
+  }
+
+  @override
+  String toString() =>
+      'LatencySummary(count: $count, meanUs: ${meanUs.toStringAsFixed(1)}, '
+      'p50Us: $p50Us, p90Us: $p90Us, p99Us: $p99Us, maxUs: $maxUs)';
+}
+
+/// Counters of one method channel method.
+@immutable
+class MethodPerformance {
+  final int calls;
+
+  /// Calls that returned an error
+  final int errors;
+
+  /// From the handler starting to it returning its response
+  final LatencySummary latency;
+
+  /// From the call arriving to its handler starting
+  final LatencySummary queueWait;
+
+  const MethodPerformance({
+    this.calls = 0,
+    this.errors = 0,
+    this.latency = const LatencySummary(),
+    this.queueWait = const LatencySummary(),
+  });
+
+  factory MethodPerformance.fromJson(Map<String, dynamic> json) {
+    return MethodPerformance(
+      calls: json['calls'] as int? ?? 0,
+      errors: json['errors'] as int? ?? 0,
+      latency: _summaryFromJson(json['latency']),
+      queueWait: _summaryFromJson(json['queueWait']),
+    );
+  }
+
+  @override
+  String toString() =>
+      'MethodPerformance(calls: $calls, errors: $errors, latency: $latency, '
+      'queueWait: $queueWait)';
+}
+
+/// Depth of one of the plugin's work queues.
+@immutable
+class QueueDepth {
+  /// Calls waiting when last sampled
+  final int depth;
+
+  /// Most calls waiting at once
+  final int peakDepth;
+
+  const QueueDepth({this.depth = 0, this.peakDepth = 0});
+
+  factory QueueDepth.fromJson(Map<String, dynamic> json) {
+    return QueueDepth(
+      depth: json['depth'] as int? ?? 0,
+      peakDepth: json['peakDepth'] as int? ?? 0,
+    );
+  }
+
+  @override
+  String toString() => 'QueueDepth(depth: $depth, peakDepth: $peakDepth)';
+}
+
+/// Where the plugin spends its time, from
+/// [PhotoGalleryPro.getPerformanceStats].
+///
+/// Counts run from plugin start or the last reset.
+@immutable
+class PerformanceStats {
+  /// Whether counting is on; see [PhotoGalleryPro.setPerformanceStatsEnabled]
+  final bool enabled;
+
+  /// Methods called at least once, by name
+  final Map<String, MethodPerformance> methods;
+
+  /// Time spent decoding, scaling, encoding and on the filesystem, keyed
+  /// `decode`, `scale`, `encode` and `filesystem`
+  final Map<String, LatencySummary> stages;
+
+  /// Work queues by name
+  final Map<String, QueueDepth> queues;
+
+  /// Fraction of thumbnail lookups served from memory or disk
+  final double thumbnailHitRate;
+
+  /// Fraction of prefetched thumbnails that were used
+  final double prefetchHitRate;
+
+  const PerformanceStats({
+    this.enabled = false,
+    this.methods = const {},
+    this.stages = const {},
+    this.queues = const {},
+    this.thumbnailHitRate = 0,
+    this.prefetchHitRate = 0,
+  });
+
+  factory PerformanceStats.fromJson(Map<String, dynamic> json) {
+    final Map<String, dynamic> hitRates = json['cacheHitRates'] is Map
+        ? Map<String, dynamic>.from(json['cacheHitRates'])
+        : const {};
+    return PerformanceStats(
+      enabled: json['enabled'] as bool? ?? false,
+      methods: _mapFromJson(json['methods'], MethodPerformance.fromJson),
+      stages: _mapFromJson(json['stages'], LatencySummary.fromJson),
+      queues: _mapFromJson(json['queues'], QueueDepth.fromJson),
+      thumbnailHitRate: (hitRates['thumbnail'] as num?)?.toDouble() ?? 0,
+      prefetchHitRate: (hitRates['prefetch'] as num?)?.toDouble() ?? 0,
+    );
+  }
+
+  @override
+  String toString() =>
+      'PerformanceStats(enabled: $enabled, methods: $methods, '
+      'stages: $stages, queues: $queues, '
+      'thumbnailHitRate: $thumbnailHitRate, prefetchHitRate: $prefetchHitRate)';
+}
+
+LatencySummary _summaryFromJson(dynamic json) => json is Map
+    ? LatencySummary.fromJson(Map<String, dynamic>.from(json))
+    : const LatencySummary();
+
+Map<String, T> _mapFromJson<T>(
+  dynamic json,
+  T Function(Map<String, dynamic>) fromJson,
+) {
+  if (json is! Map) return const {};
+  return json.map((key, value) => MapEntry(
+        key as String,
+        fromJson(Map<String, dynamic>.from(value as Map)),
+      ));
+}
@@ -0,0 +1,46 @@
+import 'package:meta/meta.dart';
+
+/// Counters of thumbnails prefetched for [PhotoGalleryPro.setViewport].
+@immutable
+class PrefetchStats {
+  /// Thumbnails generated ahead of the grid
+  final int prefetched;
+
+  /// Prefetched thumbnails the grid then asked for
+  final int hits;
+
+  /// Requests for items that were still waiting to be prefetched
+  final int late;
+
+  /// Items that were cached already and needed no work
+  final int alreadyCached;
+
+  /// Items dropped because the viewport moved on first
+  final int cancelled;
+
+  const PrefetchStats({
+    this.prefetched = 0,
+    this.hits = 0,
+    this.late = 0,
+    this.alreadyCached = 0,
+    this.cancelled = 0,
+  });
+
+  factory PrefetchStats.fromJson(Map<String, dynamic> json) {
+    return PrefetchStats(
+      prefetched: json['prefetched'] as int? ?? 0,
+      hits: json['hits'] as int? ?? 0,
+      late: json['late'] as int? ?? 0,
+      alreadyCached: json['alreadyCached'] as int? ?? 0,
+      cancelled: json['cancelled'] as int? ?? 0,
+    );
+  }
+
+  /// Fraction of prefetched thumbnails that were used
+  double get hitRate => prefetched == 0 ? 0 : hits / prefetched;
+
+  @override
+  String toString() =>
+      'PrefetchStats(prefetched: $prefetched, hits: $hits, late: $late, '
+      'alreadyCached: $alreadyCached, cancelled: $cancelled)';
+}
@@ -1,14 +1,30 @@
 import 'dart:typed_data';
 
+import 'thumbnail_format.dart';
+
 class Thumbnail {
   final Uint8List data;
   final int width;
   final int height;
 
+  /// Encoding of [data]
+  final ThumbnailFormat format;
+
+  /// Bytes per row of a [ThumbnailFormat.raw] thumbnail, which may include
+  /// padding. Null for encoded formats.
+  final int? rowstride;
+
+  /// Bytes per pixel of a [ThumbnailFormat.raw] thumbnail (3 for RGB, 4 for
+  /// RGBA). Null for encoded formats.
+  final int? channels;
+
   Thumbnail({
     required this.data,
     this.width = 512,  // Default size for backward compatibility
     this.height = 512,
+    this.format = ThumbnailFormat.png,
+    this.rowstride,
+    this.channels,
   });
 
   factory Thumbnail.fromPlatformData(dynamic rawData) {
@@ -29,6 +45,12 @@ class Thumbnail {
         data: data,
         width: map['width'] as int? ?? 512,
         height: map['height'] as int? ?? 512,
+        format: ThumbnailFormat.values.firstWhere(
+          (format) => format.name == map['format'],
+          orElse: () => ThumbnailFormat.png,
+        ),
+        rowstride: map['rowstride'] as int?,
+        channels: map['channels'] as int?,
       );
     }
 
@@ -42,8 +64,10 @@ class Thumbnail {
           runtimeType == other.runtimeType &&
           data == other.data &&
           width == other.width &&
-          height == other.height;
+          height == other.height &&
+          format == other.format;
 
   @override
-  int get hashCode => data.hashCode ^ width.hashCode ^ height.hashCode;
+  int get hashCode =>
+      data.hashCode ^ width.hashCode ^ height.hashCode ^ format.hashCode;
 }
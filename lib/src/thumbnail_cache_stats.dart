@@ -0,0 +1,58 @@
+import 'package:meta/meta.dart';
+
+import 'prefetch_stats.dart';
+
+/// Counters reported by the native thumbnail cache.
+@immutable
+class ThumbnailCacheStats {
+  /// Lookups answered from the in-memory cache
+  final int memoryHits;
+
+  /// Lookups answered from the on-disk thumbnail store
+  final int diskHits;
+
+  /// Lookups that had to generate a new thumbnail
+  final int misses;
+
+  /// Pixel bytes currently held in memory
+  final int memoryBytes;
+
+  /// Number of thumbnails currently held in memory
+  final int memoryEntries;
+
+  /// Counters of [PhotoGalleryPro.setViewport] prefetching
+  final PrefetchStats prefetch;
+
+  const ThumbnailCacheStats({
+    required this.memoryHits,
+    required this.diskHits,
+    required this.misses,
+    required this.memoryBytes,
+    required this.memoryEntries,
+    this.prefetch = const PrefetchStats(),
+  });
+
+  factory ThumbnailCacheStats.fromJson(Map<String, dynamic> json) {
+    return ThumbnailCacheStats(
+      memoryHits: json['memoryHits'] as int? ?? 0,
+      diskHits: json['diskHits'] as int? ?? 0,
+      misses: json['misses'] as int? ?? 0,
+      memoryBytes: json['memoryBytes'] as int? ?? 0,
+      memoryEntries: json['memoryEntries'] as int? ?? 0,
+      prefetch: json['prefetch'] is Map
+          ? PrefetchStats.fromJson(Map<String, dynamic>.from(json['prefetch']))
+          : const PrefetchStats(),
+    );
+  }
+
+  /// Fraction of lookups served from either cache tier
+  double get hitRate {
+    final total = memoryHits + diskHits + misses;
+    return total == 0 ? 0 : (memoryHits + diskHits) / total;
+  }
+
+  @override
+  String toString() =>
+      'ThumbnailCacheStats(memoryHits: $memoryHits, diskHits: $diskHits, '
+      'misses: $misses, memoryBytes: $memoryBytes)';
+}
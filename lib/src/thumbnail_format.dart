@@ -0,0 +1,19 @@
+/// Encoding of the bytes returned for a thumbnail.
+///
+/// Only [png] is supported on every platform; the other formats are Linux
+/// only for now.
+enum ThumbnailFormat {
+  /// Lossless PNG (the default)
+  png,
+
+  /// Unencoded pixels, described by [Thumbnail.rowstride] and
+  /// [Thumbnail.channels]. Cheapest to produce, but the largest payload.
+  raw,
+
+  /// Lossy JPEG, see the `quality` argument
+  jpeg,
+
+  /// Lossy WebP, see the `quality` argument. Needs a WebP pixbuf loader on
+  /// Linux.
+  webp,
+}
@@ -0,0 +1,53 @@
+import 'package:meta/meta.dart';
+
+import 'thumbnail.dart';
+
+/// Result for one media item of a [PhotoGalleryPro.getThumbnails] request.
+@immutable
+class ThumbnailResult {
+  /// ID of the media item the thumbnail belongs to
+  final String mediaId;
+
+  /// The thumbnail, or null if generation failed or this is a placeholder
+  final Thumbnail? thumbnail;
+
+  /// BlurHash to show until the thumbnail arrives, for requests made with
+  /// placeholders; see `BlurHash.decode`. A placeholder result has neither
+  /// a thumbnail nor an error.
+  final String? placeholder;
+
+  /// Error message if generation failed
+  final String? error;
+
+  /// Error code if generation failed, such as `IMAGE_TOO_LARGE` for images
+  /// over the limits set with [PhotoGalleryPro.setDecodeLimits]
+  final String? errorCode;
+
+  const ThumbnailResult({
+    required this.mediaId,
+    this.thumbnail,
+    this.error,
+    this.errorCode,
+    this.placeholder,
+  });
+
+  factory ThumbnailResult.fromPlatformData(Map<String, dynamic> map) {
+    final error = map['error']?.toString();
+    final placeholder = map['placeholder']?.toString();
+    if (placeholder != null) {
+      return ThumbnailResult(
+        mediaId: map['mediaId']?.toString() ?? '',
+        placeholder: placeholder,
+      );
+    }
+    return ThumbnailResult(
+      mediaId: map['mediaId']?.toString() ?? '',
+      thumbnail: error == null ? Thumbnail.fromPlatformData(map) : null,
+      error: error,
+      errorCode: map['errorCode']?.toString(),
+    );
+  }
+
+  @override
+  String toString() => 'ThumbnailResult(mediaId: $mediaId, error: $error)';
+}
@@ -0,0 +1,39 @@
+import 'package:meta/meta.dart';
+
+/// A thumbnail shown through a native texture rather than returned as bytes.
+///
+/// Display it with a `Texture(textureId: textureId)` widget and hand it back
+/// with [PhotoGalleryPro.releaseThumbnailTexture] once it scrolls out of
+/// view, so the texture can be reused for another thumbnail.
+@immutable
+class ThumbnailTexture {
+  /// ID of the registered texture
+  final int textureId;
+
+  /// Width of the thumbnail in pixels
+  final int width;
+
+  /// Height of the thumbnail in pixels
+  final int height;
+
+  const ThumbnailTexture({
+    required this.textureId,
+    required this.width,
+    required this.height,
+  });
+
+  factory ThumbnailTexture.fromJson(Map<String, dynamic> json) {
+    return ThumbnailTexture(
+      textureId: json['textureId'] as int,
+      width: json['width'] as int? ?? 0,
+      height: json['height'] as int? ?? 0,
+    );
+  }
+
+  /// Width divided by height, for sizing the `Texture` widget
+  double get aspectRatio => height == 0 ? 1 : width / height;
+
+  @override
+  String toString() =>
+      'ThumbnailTexture(textureId: $textureId, width: $width, height: $height)';
+}
@@ -0,0 +1,60 @@
+import 'package:meta/meta.dart';
+
+/// Spans [PhotoGalleryPro.getTimeline] can group media by.
+enum TimelineGranularity {
+  /// Local calendar days
+  day,
+
+  /// Local calendar months
+  month,
+
+  /// Local calendar years
+  year,
+}
+
+/// The media taken within one day, month or year.
+///
+/// Media are dated by [Media.dateTaken], or [Media.dateAdded] when it is
+/// unknown.
+@immutable
+class TimelineBucket {
+  /// Local midnight starting the span
+  final DateTime start;
+
+  /// Start of the next span; the bucket holds media dated before it
+  final DateTime end;
+
+  /// Number of media in the span
+  final int count;
+
+  /// ID of the newest media item in the span
+  final String coverId;
+
+  const TimelineBucket({
+    required this.start,
+    required this.end,
+    required this.count,
+    required this.coverId,
+  });
+
+  /// Decodes the parallel lists sent by the platform side.
+  static List<TimelineBucket> listFromPlatformData(Map<dynamic, dynamic> data) {
+    final List<int> starts = (data['starts'] as List<dynamic>).cast<int>();
+    final List<int> ends = (data['ends'] as List<dynamic>).cast<int>();
+    final List<int> counts = (data['counts'] as List<dynamic>).cast<int>();
+    final List<dynamic> covers = data['covers'] as List<dynamic>;
+    return List<TimelineBucket>.generate(
+      starts.length,
+      (i) => TimelineBucket(
+        start: DateTime.fromMillisecondsSinceEpoch(starts[i] * 1000),
+        end: DateTime.fromMillisecondsSinceEpoch(ends[i] * 1000),
+        count: counts[i],
+        coverId: covers[i] as String,
+      ),
+    );
+  }
+
+  @override
+  String toString() =>
+      'TimelineBucket(start: $start, count: $count, coverId: $coverId)';
+}
@@ -0,0 +1,193 @@
+#include "loopback_messenger.h"
+
+#include <gio/gio.h>
+
+G_DECLARE_FINAL_TYPE(LoopbackResponseHandle,
+                     loopback_response_handle,
+                     LOOPBACK,
+                     RESPONSE_HANDLE,
+                     FlBinaryMessengerResponseHandle)
+
+struct _LoopbackResponseHandle {
+  FlBinaryMessengerResponseHandle parent_instance;
+
+  // Completes the sender's call. NULL once a response has been sent.
+  GTask* task;
+};
+
+G_DEFINE_TYPE(LoopbackResponseHandle,
+              loopback_response_handle,
+              fl_binary_messenger_response_handle_get_type())
+
+static void loopback_response_handle_dispose(GObject* object) {
+  LoopbackResponseHandle* self = LOOPBACK_RESPONSE_HANDLE(object);
+  // A handler that drops a message without answering still completes the
+  // call, so callers waiting on it do not hang.
+  if (self->task != nullptr) {
+    g_task_return_new_error(self->task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "No response sent");
+    g_clear_object(&self->task);
+  }
+  G_OBJECT_CLASS(loopback_response_handle_parent_class)->dispose(object);
+}
+
+static void loopback_response_handle_class_init(
+    LoopbackResponseHandleClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = loopback_response_handle_dispose;
+}
+
+static void loopback_response_handle_init(LoopbackResponseHandle* self) {}
+
+typedef struct {
+  FlBinaryMessengerMessageHandler handler;
+  gpointer user_data;
+  GDestroyNotify destroy_notify;
+} ChannelHandler;
+
+static void channel_handler_free(gpointer data) {
+  ChannelHandler* handler = static_cast<ChannelHandler*>(data);
+  if (handler->destroy_notify != nullptr) {
+    handler->destroy_notify(handler->user_data);
+  }
+  g_free(handler);
+}
+
+G_DECLARE_FINAL_TYPE(LoopbackMessenger,
+                     loopback_messenger,
+                     LOOPBACK,
+                     MESSENGER,
+                     GObject)
+
+struct _LoopbackMessenger {
+  GObject parent_instance;
+
+  // Channel name to ChannelHandler.
+  GHashTable* handlers;
+
+  // The other end; weak.
+  LoopbackMessenger* peer;
+};
+
+static void loopback_messenger_iface_init(FlBinaryMessengerInterface* iface);
+
+G_DEFINE_TYPE_WITH_CODE(
+    LoopbackMessenger,
+    loopback_messenger,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE(fl_binary_messenger_get_type(),
+                          loopback_messenger_iface_init))
+
+static void loopback_messenger_set_message_handler_on_channel(
+    FlBinaryMessenger* messenger,
+    const gchar* channel,
+    FlBinaryMessengerMessageHandler handler,
+    gpointer user_data,
+    GDestroyNotify destroy_notify) {
+  LoopbackMessenger* self = LOOPBACK_MESSENGER(messenger);
+  if (handler == nullptr) {
+    g_hash_table_remove(self->handlers, channel);
+    return;
+  }
+  ChannelHandler* entry = g_new0(ChannelHandler, 1);
+  entry->handler = handler;
+  entry->user_data = user_data;
+  entry->destroy_notify = destroy_notify;
+  g_hash_table_insert(self->handlers, g_strdup(channel), entry);
+}
+
+static gboolean loopback_messenger_send_response(
+    FlBinaryMessenger* messenger,
+    FlBinaryMessengerResponseHandle* response_handle,
+    GBytes* response,
+    GError** error) {
+  LoopbackResponseHandle* handle = LOOPBACK_RESPONSE_HANDLE(response_handle);
+  if (handle->task == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Response already sent");
+    return FALSE;
+  }
+  g_task_return_pointer(handle->task,
+                        response != nullptr ? g_bytes_ref(response)
+                                            : g_bytes_new(nullptr, 0),
+                        reinterpret_cast<GDestroyNotify>(g_bytes_unref));
+  g_clear_object(&handle->task);
+  return TRUE;
+}
+
+static void loopback_messenger_send_on_channel(FlBinaryMessenger* messenger,
+                                               const gchar* channel,
+                                               GBytes* message,
+                                               GCancellable* cancellable,
+                                               GAsyncReadyCallback callback,
+                                               gpointer user_data) {
+  LoopbackMessenger* self = LOOPBACK_MESSENGER(messenger);
+  GTask* task = g_task_new(self, cancellable, callback, user_data);
+  ChannelHandler* entry =
+      self->peer != nullptr
+          ? static_cast<ChannelHandler*>(
+                g_hash_table_lookup(self->peer->handlers, channel))
+          : nullptr;
+  if (entry == nullptr) {
+    g_task_return_pointer(task, g_bytes_new(nullptr, 0),
+                          reinterpret_cast<GDestroyNotify>(g_bytes_unref));
+    g_object_unref(task);
+    return;
+  }
+
+  LoopbackResponseHandle* handle = LOOPBACK_RESPONSE_HANDLE(
+      g_object_new(loopback_response_handle_get_type(), nullptr));
+  handle->task = task;
+  entry->handler(FL_BINARY_MESSENGER(self->peer), channel, message,
+                 FL_BINARY_MESSENGER_RESPONSE_HANDLE(handle),
+                 entry->user_data);
+  g_object_unref(handle);
+}
+
+static GBytes* loopback_messenger_send_on_channel_finish(
+    FlBinaryMessenger* messenger,
+    GAsyncResult* result,
+    GError** error) {
+  return static_cast<GBytes*>(g_task_propagate_pointer(G_TASK(result), error));
+}
+
+// Channel resizing and overflow warnings only matter to the engine's
+// buffered channels, so they are left unimplemented.
+static void loopback_messenger_iface_init(FlBinaryMessengerInterface* iface) {
+  iface->set_message_handler_on_channel =
+      loopback_messenger_set_message_handler_on_channel;
+  iface->send_response = loopback_messenger_send_response;
+  iface->send_on_channel = loopback_messenger_send_on_channel;
+  iface->send_on_channel_finish = loopback_messenger_send_on_channel_finish;
+}
+
+static void loopback_messenger_dispose(GObject* object) {
+  LoopbackMessenger* self = LOOPBACK_MESSENGER(object);
+  if (self->peer != nullptr) {
+    self->peer->peer = nullptr;
+    self->peer = nullptr;
+  }
+  // Releases the channels, and with them whatever they keep alive.
+  g_clear_pointer(&self->handlers, g_hash_table_unref);
+  G_OBJECT_CLASS(loopback_messenger_parent_class)->dispose(object);
+}
+
+static void loopback_messenger_class_init(LoopbackMessengerClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = loopback_messenger_dispose;
+}
+
+static void loopback_messenger_init(LoopbackMessenger* self) {
+  self->handlers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         channel_handler_free);
+}
+
+void loopback_messenger_new_pair(FlBinaryMessenger** plugin,
+                                 FlBinaryMessenger** app) {
+  LoopbackMessenger* a = LOOPBACK_MESSENGER(
+      g_object_new(loopback_messenger_get_type(), nullptr));
+  LoopbackMessenger* b = LOOPBACK_MESSENGER(
+      g_object_new(loopback_messenger_get_type(), nullptr));
+  a->peer = b;
+  b->peer = a;
+  *plugin = FL_BINARY_MESSENGER(a);
+  *app = FL_BINARY_MESSENGER(b);
+}
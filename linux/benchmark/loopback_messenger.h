@@ -0,0 +1,22 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_LOOPBACK_MESSENGER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_LOOPBACK_MESSENGER_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+G_BEGIN_DECLS
+
+// Two in-process binary messengers standing in for the engine. A message
+// sent on one end is handed to the handler registered for that channel on
+// the other, and the reply comes back the same way, so a method channel on
+// |app| calls a plugin whose channels were created on |plugin| through the
+// real codecs, FlMethodCall and response path.
+//
+// Both ends only keep weak pointers to each other; free them together.
+// Messages without a handler on the other end get an empty reply, as the
+// engine gives them.
+void loopback_messenger_new_pair(FlBinaryMessenger** plugin,
+                                 FlBinaryMessenger** app);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_LOOPBACK_MESSENGER_H_
@@ -0,0 +1,1120 @@
+#include <fcntl.h>
+#include <flutter_linux/flutter_linux.h>
+#include <ftw.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "image_resampler.h"
+#include "loopback_messenger.h"
+#include "media_encoder.h"
+#include "media_index.h"
+#include "media_probe.h"
+#include "media_stat.h"
+#include "performance_stats.h"
+#include "photo_gallery_pro_plugin_private.h"
+#include "thumbnail_generator.h"
+
+// Micro-benchmarks for the plugin's hot paths.
+//
+// Once you have built the plugin's example app, run the benchmark from the
+// command line, e.g. for an x64 release build:
+// $ build/linux/x64/release/plugins/photo_gallery_pro/photo_gallery_pro_benchmark
+//
+// Pass a benchmark name to run a single benchmark. The synthetic corpus is
+// written to a temporary directory and removed afterwards; the plugin's
+// caches are kept there too.
+//
+// method_calls is a load test rather than a micro-benchmark: it drives the
+// plugin's handlers through real method calls against a synthetic library,
+// e.g.
+// $ photo_gallery_pro_benchmark --albums 20 --images 100 --formats jpeg,png
+//     --resolutions 1920x1080,6000x4000 -c 16 method_calls
+//
+// index_scan times a cold index build with each way of fetching file
+// metadata. Point --root at a directory on a network mount to see what
+// batching saves there, e.g.
+// $ photo_gallery_pro_benchmark --root /mnt/nas/scratch -n 20000 index_scan
+//
+// performance_stats measures what leaving the latency counters on costs:
+// per timed section on one and on several threads, and on warm getThumbnail
+// calls, each with counting on and off.
+
+typedef struct {
+  gint files;
+  gint width;
+  gint height;
+  gint iterations;
+
+  // Shape of the synthetic library for method_calls
+  gint albums;
+  gint images;
+  const gchar* formats;
+  const gchar* resolutions;
+  // Method calls kept in flight at once
+  gint concurrency;
+
+  // Where index_scan writes its library; the corpus directory if NULL
+  const gchar* root;
+} BenchmarkOptions;
+
+typedef void (*BenchmarkFunc)(const BenchmarkOptions* options);
+
+static gchar* corpus_dir = nullptr;
+
+// Heap allocations made by the process so far. glibc's allocator is wrapped
+// below so benchmarks can report allocations as well as time; elsewhere the
+// count stays at zero.
+static gint allocation_count = 0;
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+extern "C" void* malloc(size_t size) {
+  g_atomic_int_inc(&allocation_count);
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  g_atomic_int_inc(&allocation_count);
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+  g_atomic_int_inc(&allocation_count);
+  return __libc_realloc(pointer, size);
+}
+#endif
+
+static gdouble elapsed_ms(gint64 start) {
+  return (g_get_monotonic_time() - start) / 1000.0;
+}
+
+// Fills |pixbuf| with a noisy gradient so encoders cannot compress it to
+// nothing and decoders do realistic amounts of work.
+static void fill_pattern(GdkPixbuf* pixbuf) {
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  gint channels = gdk_pixbuf_get_n_channels(pixbuf);
+  guchar* pixels = gdk_pixbuf_get_pixels(pixbuf);
+  g_autoptr(GRand) rand = g_rand_new_with_seed(42);
+  for (gint y = 0; y < height; y++) {
+    guchar* row = pixels + (gsize)y * rowstride;
+    for (gint x = 0; x < width; x++) {
+      guint8 noise = g_rand_int(rand) & 0x1f;
+      row[x * channels + 0] = (guint8)(x * 255 / width) ^ noise;
+      row[x * channels + 1] = (guint8)(y * 255 / height) ^ noise;
+      row[x * channels + 2] = (guint8)((x + y) & 0xff);
+    }
+  }
+}
+
+// Encodes one image per format and writes |count| copies of it into the
+// corpus directory. Returns the file paths.
+static GPtrArray* create_corpus(const gchar* format,
+                                const gchar* extension,
+                                gint count,
+                                gint width,
+                                gint height) {
+  g_autoptr(GdkPixbuf) pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+  fill_pattern(pixbuf);
+
+  g_autofree gchar* buffer = nullptr;
+  gsize buffer_size = 0;
+  g_autoptr(GError) error = nullptr;
+  if (!gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &buffer_size, format,
+                                 &error, nullptr)) {
+    g_printerr("Failed to encode %s: %s\n", format, error->message);
+    return g_ptr_array_new_with_free_func(g_free);
+  }
+
+  GPtrArray* paths = g_ptr_array_new_with_free_func(g_free);
+  for (gint i = 0; i < count; i++) {
+    g_autofree gchar* name = g_strdup_printf("%s_%05d.%s", format, i, extension);
+    gchar* path = g_build_filename(corpus_dir, name, nullptr);
+    g_file_set_contents(path, buffer, buffer_size, nullptr);
+    g_ptr_array_add(paths, path);
+  }
+  return paths;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag,
+                        struct FTW* ftw) {
+  return remove(path);
+}
+
+static void remove_tree(const gchar* path) {
+  nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static void remove_corpus(GPtrArray* paths) {
+  for (guint i = 0; i < paths->len; i++) {
+    g_unlink(static_cast<const gchar*>(g_ptr_array_index(paths, i)));
+  }
+  g_ptr_array_unref(paths);
+}
+
+// Compares reading image dimensions by decoding the whole file (the old
+// getMediaInAlbum behaviour) with header-only probing.
+static void benchmark_dimension_probe(const BenchmarkOptions* options) {
+  static const gchar* kFormats[][2] = {{"jpeg", "jpg"}, {"png", "png"}};
+
+  for (gsize f = 0; f < G_N_ELEMENTS(kFormats); f++) {
+    GPtrArray* paths = create_corpus(kFormats[f][0], kFormats[f][1],
+                                     options->files, options->width,
+                                     options->height);
+    if (paths->len == 0) {
+      g_ptr_array_unref(paths);
+      continue;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    for (guint i = 0; i < paths->len; i++) {
+      GdkPixbuf* pixbuf = gdk_pixbuf_new_from_file(
+          static_cast<const gchar*>(g_ptr_array_index(paths, i)), nullptr);
+      g_clear_object(&pixbuf);
+    }
+    gdouble decode_ms = elapsed_ms(start);
+
+    start = g_get_monotonic_time();
+    for (guint i = 0; i < paths->len; i++) {
+      gint width, height;
+      media_probe_image_size(
+          static_cast<const gchar*>(g_ptr_array_index(paths, i)), &width,
+          &height);
+    }
+    gdouble probe_ms = elapsed_ms(start);
+
+    gdouble per_thousand = 1000.0 / paths->len;
+    g_print("dimension_probe %-4s %dx%d: full decode %9.2f ms/1000 files, "
+            "header probe %7.2f ms/1000 files (%.0fx)\n",
+            kFormats[f][0], options->width, options->height,
+            decode_ms * per_thousand, probe_ms * per_thousand,
+            probe_ms > 0 ? decode_ms / probe_ms : 0.0);
+    remove_corpus(paths);
+  }
+}
+
+typedef GdkPixbuf* (*ThumbnailFunc)(const gchar* path, gint size);
+
+static GdkPixbuf* load_nothing(const gchar* path, gint size) {
+  return nullptr;
+}
+
+// The thumbnail path before scale-on-load: decode at full resolution, then
+// scale down.
+static GdkPixbuf* decode_then_scale(const gchar* path, gint size) {
+  g_autoptr(GdkPixbuf) pixbuf = gdk_pixbuf_new_from_file(path, nullptr);
+  if (pixbuf == nullptr) return nullptr;
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  double scale = MIN((double)size / width, (double)size / height);
+  return gdk_pixbuf_scale_simple(pixbuf, MAX((int)(width * scale), 1),
+                                 MAX((int)(height * scale), 1),
+                                 GDK_INTERP_BILINEAR);
+}
+
+static GdkPixbuf* scale_on_load(const gchar* path, gint size) {
+  return generate_thumbnail(path, size, size, nullptr, nullptr);
+}
+
+// Runs |func| |iterations| times in a child process so that each variant's
+// peak RSS is measured in isolation. Returns FALSE if the child failed.
+static gboolean run_isolated(ThumbnailFunc func,
+                             const gchar* path,
+                             gint size,
+                             gint iterations,
+                             gdouble* mean_ms,
+                             glong* max_rss_kb) {
+  int fds[2];
+  if (pipe(fds) != 0) return FALSE;
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return FALSE;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    gint64 start = g_get_monotonic_time();
+    for (gint i = 0; i < iterations; i++) {
+      GdkPixbuf* thumbnail = func(path, size);
+      g_clear_object(&thumbnail);
+    }
+    gdouble ms = elapsed_ms(start) / MAX(iterations, 1);
+    gboolean ok = write(fds[1], &ms, sizeof(ms)) == sizeof(ms);
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fds[1]);
+  gboolean ok = read(fds[0], mean_ms, sizeof(*mean_ms)) == sizeof(*mean_ms);
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage = {};
+  if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    return FALSE;
+  }
+  *max_rss_kb = usage.ru_maxrss;
+  return ok;
+}
+
+// Compares thumbnail latency and peak memory of decode-then-scale with
+// scale-on-load for large JPEG and PNG sources.
+static void benchmark_thumbnail_decode(const BenchmarkOptions* options) {
+  static const gchar* kFormats[][2] = {{"jpeg", "jpg"}, {"png", "png"}};
+  static const gint kSources[][2] = {{4000, 3000}, {6000, 4000}, {8000, 6000}};
+  static const gint kTargetSize = 512;
+
+  for (gsize s = 0; s < G_N_ELEMENTS(kSources); s++) {
+    for (gsize f = 0; f < G_N_ELEMENTS(kFormats); f++) {
+      GPtrArray* paths = create_corpus(kFormats[f][0], kFormats[f][1], 1,
+                                       kSources[s][0], kSources[s][1]);
+      if (paths->len == 0) {
+        g_ptr_array_unref(paths);
+        continue;
+      }
+      const gchar* path = static_cast<const gchar*>(g_ptr_array_index(paths, 0));
+
+      static const struct {
+        const gchar* name;
+        ThumbnailFunc func;
+      } kVariants[] = {
+          {"baseline", load_nothing},
+          {"decode+scale", decode_then_scale},
+          {"scale-on-load", scale_on_load},
+      };
+      for (gsize v = 0; v < G_N_ELEMENTS(kVariants); v++) {
+        gdouble mean_ms = 0;
+        glong max_rss_kb = 0;
+        if (!run_isolated(kVariants[v].func, path, kTargetSize,
+                          options->iterations, &mean_ms, &max_rss_kb)) {
+          g_printerr("thumbnail_decode %s: %s failed\n", kFormats[f][0],
+                     kVariants[v].name);
+          continue;
+        }
+        g_print("thumbnail_decode %-4s %dx%d -> %d: %-13s %8.2f ms, "
+                "peak RSS %7.1f MB\n",
+                kFormats[f][0], kSources[s][0], kSources[s][1], kTargetSize,
+                kVariants[v].name, mean_ms, max_rss_kb / 1024.0);
+      }
+      remove_corpus(paths);
+    }
+  }
+}
+
+// Compares gdk_pixbuf_scale_simple()'s bilinear filter with the area
+// resampler, on every kernel this CPU supports, for already decoded images.
+static void benchmark_resample(const BenchmarkOptions* options) {
+  static const gint kSources[][2] = {{4000, 3000}, {6000, 4000}};
+  static const gint kTargetSizes[] = {256, 512};
+  static const ImageResamplerKernel kKernels[] = {
+      IMAGE_RESAMPLER_KERNEL_SCALAR, IMAGE_RESAMPLER_KERNEL_SSE41,
+      IMAGE_RESAMPLER_KERNEL_AVX2, IMAGE_RESAMPLER_KERNEL_NEON};
+
+  for (gsize s = 0; s < G_N_ELEMENTS(kSources); s++) {
+    for (gint has_alpha = FALSE; has_alpha <= TRUE; has_alpha++) {
+      g_autoptr(GdkPixbuf) source = gdk_pixbuf_new(
+          GDK_COLORSPACE_RGB, has_alpha, 8, kSources[s][0], kSources[s][1]);
+      gdk_pixbuf_fill(source, 0xffffffff);
+      fill_pattern(source);
+      for (gsize t = 0; t < G_N_ELEMENTS(kTargetSizes); t++) {
+        gint width = kTargetSizes[t];
+        gint height = kTargetSizes[t] * kSources[s][1] / kSources[s][0];
+
+        gint64 start = g_get_monotonic_time();
+        for (gint i = 0; i < options->iterations; i++) {
+          GdkPixbuf* scaled = gdk_pixbuf_scale_simple(source, width, height,
+                                                      GDK_INTERP_BILINEAR);
+          g_clear_object(&scaled);
+        }
+        gdouble bilinear_ms = elapsed_ms(start) / MAX(options->iterations, 1);
+        g_print("resample %s %dx%d -> %dx%d: %-8s %8.2f ms\n",
+                has_alpha ? "rgba" : "rgb ", kSources[s][0], kSources[s][1],
+                width, height, "bilinear", bilinear_ms);
+
+        for (gsize k = 0; k < G_N_ELEMENTS(kKernels); k++) {
+          if (!image_resampler_kernel_is_supported(kKernels[k])) continue;
+          start = g_get_monotonic_time();
+          for (gint i = 0; i < options->iterations; i++) {
+            GdkPixbuf* scaled =
+                image_resample_with_kernel(source, width, height, kKernels[k]);
+            g_clear_object(&scaled);
+          }
+          gdouble area_ms = elapsed_ms(start) / MAX(options->iterations, 1);
+          g_print("resample %s %dx%d -> %dx%d: %-8s %8.2f ms (%.1fx)\n",
+                  has_alpha ? "rgba" : "rgb ", kSources[s][0], kSources[s][1],
+                  width, height, image_resampler_kernel_name(kKernels[k]),
+                  area_ms, area_ms > 0 ? bilinear_ms / area_ms : 0.0);
+        }
+      }
+    }
+  }
+}
+
+// Compares returning an indexed album as one map per item with the packed
+// encoding: building the value, encoding it for the channel and decoding it
+// again. The engine's codec decodes the way the Dart side's does, so it
+// stands in for the receiving end.
+static void benchmark_media_list(const BenchmarkOptions* options) {
+  static const gint kAlbumSizes[] = {1000, 20000};
+  static const struct {
+    const gchar* name;
+    MediaEncoding encoding;
+  } kEncodings[] = {
+      {"maps", MEDIA_ENCODING_MAPS},
+      {"packed", MEDIA_ENCODING_PACKED},
+  };
+  g_autoptr(FlStandardMessageCodec) codec = fl_standard_message_codec_new();
+
+  for (gsize a = 0; a < G_N_ELEMENTS(kAlbumSizes); a++) {
+    // The index only looks at names and headers, so empty files will do.
+    g_autofree gchar* root = g_strdup_printf("%s/list%d", corpus_dir,
+                                             kAlbumSizes[a]);
+    g_autofree gchar* album_dir = g_build_filename(root, "Album", nullptr);
+    g_mkdir_with_parents(album_dir, 0755);
+    g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+    for (gint i = 0; i < kAlbumSizes[a]; i++) {
+      g_autofree gchar* name = g_strdup_printf("IMG_%05d.jpg", i);
+      gchar* path = g_build_filename(album_dir, name, nullptr);
+      g_file_set_contents(path, "", 0, nullptr);
+      g_ptr_array_add(paths, path);
+    }
+    g_autofree gchar* cache_file = g_strdup_printf("%s.bin", root);
+
+    // The index is stopped before measuring so its threads add no
+    // allocations of their own; the snapshot outlives it.
+    MediaIndex* index = media_index_new(root, cache_file, nullptr, nullptr);
+    g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index);
+    media_index_free(index);
+    const MediaAlbumRecord* album =
+        media_index_snapshot_find_album(snapshot, "Album");
+    guint n_records = 0;
+    const guint32* order = media_index_snapshot_get_order(
+        snapshot, album, MEDIA_KIND_ANY, MEDIA_SORT_NAME, &n_records);
+
+    for (gsize e = 0; e < G_N_ELEMENTS(kEncodings); e++) {
+      gdouble build_ms = 0, encode_ms = 0, decode_ms = 0;
+      gint allocations = 0;
+      gsize message_size = 0;
+      for (gint i = 0; i < options->iterations; i++) {
+        gint allocations_before = g_atomic_int_get(&allocation_count);
+        gint64 start = g_get_monotonic_time();
+        FlValue* value;
+        if (kEncodings[e].encoding == MEDIA_ENCODING_PACKED) {
+          value = media_encoder_encode_packed(snapshot, order, n_records);
+        } else {
+          value = fl_value_new_list();
+          for (guint r = 0; r < n_records; r++) {
+            fl_value_append_take(value, media_encoder_encode_record(
+                                            snapshot,
+                                            &snapshot->records[order[r]]));
+          }
+        }
+        build_ms += elapsed_ms(start);
+
+        start = g_get_monotonic_time();
+        GBytes* message = fl_message_codec_encode_message(
+            FL_MESSAGE_CODEC(codec), value, nullptr);
+        encode_ms += elapsed_ms(start);
+        fl_value_unref(value);
+
+        start = g_get_monotonic_time();
+        FlValue* decoded = fl_message_codec_decode_message(
+            FL_MESSAGE_CODEC(codec), message, nullptr);
+        decode_ms += elapsed_ms(start);
+        allocations += g_atomic_int_get(&allocation_count) - allocations_before;
+        message_size = g_bytes_get_size(message);
+        fl_value_unref(decoded);
+        g_bytes_unref(message);
+      }
+
+      gint iterations = MAX(options->iterations, 1);
+      g_print("media_list %5u items: %-6s build %7.2f ms, encode %7.2f ms, "
+              "decode %7.2f ms, %8d allocations, %8.1f KB\n",
+              n_records, kEncodings[e].name, build_ms / iterations,
+              encode_ms / iterations, decode_ms / iterations,
+              allocations / iterations, message_size / 1024.0);
+    }
+
+    g_unlink(cache_file);
+    remove_corpus(g_steal_pointer(&paths));
+    g_rmdir(album_dir);
+    g_rmdir(root);
+  }
+}
+
+// Writes a reproducible library of |options->albums| albums with
+// |options->images| images each under |root|, cycling through every
+// combination of the requested formats and resolutions. Each combination is
+// encoded once; the page cache is per file, so the copies cost as much I/O
+// as distinct images would. Returns the image paths, or NULL on failure.
+static GPtrArray* create_library(const gchar* root,
+                                 const BenchmarkOptions* options) {
+  g_auto(GStrv) formats = g_strsplit(options->formats, ",", -1);
+  g_auto(GStrv) resolutions = g_strsplit(options->resolutions, ",", -1);
+  g_autoptr(GPtrArray) variants = g_ptr_array_new_with_free_func(
+      reinterpret_cast<GDestroyNotify>(g_bytes_unref));
+  g_autoptr(GPtrArray) extensions = g_ptr_array_new();
+  for (gchar** format = formats; *format != nullptr; format++) {
+    for (gchar** resolution = resolutions; *resolution != nullptr;
+         resolution++) {
+      gint width = 0, height = 0;
+      if (sscanf(*resolution, "%dx%d", &width, &height) != 2 || width <= 0 ||
+          height <= 0) {
+        g_printerr("Invalid resolution: %s\n", *resolution);
+        return nullptr;
+      }
+      g_autoptr(GdkPixbuf) pixbuf =
+          gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+      fill_pattern(pixbuf);
+      gchar* buffer = nullptr;
+      gsize buffer_size = 0;
+      g_autoptr(GError) error = nullptr;
+      if (!gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &buffer_size, *format,
+                                     &error, nullptr)) {
+        g_printerr("Failed to encode %s: %s\n", *format, error->message);
+        return nullptr;
+      }
+      g_ptr_array_add(variants, g_bytes_new_take(buffer, buffer_size));
+      g_ptr_array_add(extensions,
+                      g_strcmp0(*format, "jpeg") == 0 ? (gpointer) "jpg"
+                                                      : *format);
+    }
+  }
+  if (variants->len == 0) return nullptr;
+
+  GPtrArray* paths = g_ptr_array_new_with_free_func(g_free);
+  for (gint a = 0; a < options->albums; a++) {
+    g_autofree gchar* album_name = g_strdup_printf("Album_%03d", a);
+    g_autofree gchar* album_dir = g_build_filename(root, album_name, nullptr);
+    g_mkdir_with_parents(album_dir, 0755);
+    for (gint i = 0; i < options->images; i++) {
+      guint v = (guint)(a * options->images + i) % variants->len;
+      GBytes* variant = static_cast<GBytes*>(variants->pdata[v]);
+      g_autofree gchar* name = g_strdup_printf(
+          "IMG_%05d.%s", i, static_cast<const gchar*>(extensions->pdata[v]));
+      gchar* path = g_build_filename(album_dir, name, nullptr);
+      gsize size = 0;
+      const gchar* data =
+          static_cast<const gchar*>(g_bytes_get_data(variant, &size));
+      g_file_set_contents(path, data, size, nullptr);
+      g_ptr_array_add(paths, path);
+    }
+  }
+  return paths;
+}
+
+// Drops |paths| from the page cache so the next reads go to the disk.
+// Dirty pages cannot be dropped, so each file is flushed first.
+static void evict_files(GPtrArray* paths) {
+  for (guint i = 0; i < paths->len; i++) {
+    int fd = open(static_cast<const gchar*>(paths->pdata[i]), O_RDONLY);
+    if (fd < 0) continue;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+typedef struct {
+  FlMethodResponse* response;
+  GError* error;
+  gboolean done;
+} SyncCall;
+
+static void sync_call_cb(GObject* object, GAsyncResult* result,
+                         gpointer user_data) {
+  SyncCall* call = static_cast<SyncCall*>(user_data);
+  call->response = fl_method_channel_invoke_method_finish(
+      FL_METHOD_CHANNEL(object), result, &call->error);
+  call->done = TRUE;
+}
+
+// Calls |method| and runs the main context until it is answered. Returns
+// the result, or NULL after printing the error.
+static FlValue* invoke_sync(FlMethodChannel* channel,
+                            const gchar* method,
+                            FlValue* args) {
+  SyncCall call = {};
+  fl_method_channel_invoke_method(channel, method, args, nullptr, sync_call_cb,
+                                  &call);
+  while (!call.done) g_main_context_iteration(nullptr, TRUE);
+
+  FlValue* result = nullptr;
+  if (call.response != nullptr) {
+    result = fl_method_response_get_result(call.response, &call.error);
+  }
+  if (result == nullptr) {
+    g_printerr("%s failed: %s\n", method,
+               call.error != nullptr ? call.error->message : "no response");
+  } else {
+    result = fl_value_ref(result);
+  }
+  g_clear_error(&call.error);
+  g_clear_object(&call.response);
+  return result;
+}
+
+// Lists the library through the plugin once its background stages are
+// done, so they neither compete for the CPU nor warm the page cache while
+// calls are measured. Fills |album_ids| and |media_ids|; returns FALSE if
+// the library did not settle in time.
+static gboolean wait_for_library(FlMethodChannel* channel,
+                                 gint n_albums,
+                                 gint n_images,
+                                 GPtrArray* album_ids,
+                                 GPtrArray* media_ids) {
+  static const gint64 kTimeoutUs = 300 * G_USEC_PER_SEC;
+  gint64 deadline = g_get_monotonic_time() + kTimeoutUs;
+  while (g_get_monotonic_time() < deadline) {
+    g_ptr_array_set_size(album_ids, 0);
+    g_ptr_array_set_size(media_ids, 0);
+    g_autoptr(FlValue) args = fl_value_new_map();
+    fl_value_set_string_take(args, "mediaType", fl_value_new_string("image"));
+    g_autoptr(FlValue) albums = invoke_sync(channel, "getAlbums", args);
+    if (albums == nullptr) return FALSE;
+
+    gint with_placeholder = 0;
+    for (size_t a = 0; a < fl_value_get_length(albums); a++) {
+      FlValue* id =
+          fl_value_lookup_string(fl_value_get_list_value(albums, a), "id");
+      g_ptr_array_add(album_ids, g_strdup(fl_value_get_string(id)));
+      g_autoptr(FlValue) media_args = fl_value_new_map();
+      fl_value_set_string(media_args, "albumId", id);
+      fl_value_set_string_take(media_args, "mediaType",
+                               fl_value_new_string("image"));
+      g_autoptr(FlValue) media =
+          invoke_sync(channel, "getMediaInAlbum", media_args);
+      if (media == nullptr) return FALSE;
+      for (size_t i = 0; i < fl_value_get_length(media); i++) {
+        FlValue* item = fl_value_get_list_value(media, i);
+        g_ptr_array_add(media_ids, g_strdup(fl_value_get_string(
+                                       fl_value_lookup_string(item, "id"))));
+        if (fl_value_lookup_string(item, "placeholder") != nullptr) {
+          with_placeholder++;
+        }
+      }
+    }
+    if ((gint)album_ids->len == n_albums &&
+        with_placeholder == n_albums * n_images) {
+      return TRUE;
+    }
+    g_usleep(100 * 1000);
+  }
+  g_printerr("method_calls: library not indexed after %" G_GINT64_FORMAT
+             " s\n", kTimeoutUs / G_USEC_PER_SEC);
+  return FALSE;
+}
+
+// Builds the arguments of each call of one pass.
+typedef void (*CallArgsFunc)(GPtrArray* album_ids,
+                             GPtrArray* media_ids,
+                             GPtrArray* calls);
+
+// One getAlbums per album, as if the album picker were opened that often.
+static void get_albums_args(GPtrArray* album_ids,
+                            GPtrArray* media_ids,
+                            GPtrArray* calls) {
+  for (guint i = 0; i < album_ids->len; i++) {
+    FlValue* args = fl_value_new_map();
+    fl_value_set_string_take(args, "mediaType", fl_value_new_string("image"));
+    g_ptr_array_add(calls, args);
+  }
+}
+
+static void get_media_in_album_args(GPtrArray* album_ids,
+                                    GPtrArray* media_ids,
+                                    GPtrArray* calls) {
+  for (guint i = 0; i < album_ids->len; i++) {
+    FlValue* args = fl_value_new_map();
+    fl_value_set_string_take(
+        args, "albumId",
+        fl_value_new_string(static_cast<const gchar*>(album_ids->pdata[i])));
+    fl_value_set_string_take(args, "mediaType", fl_value_new_string("image"));
+    g_ptr_array_add(calls, args);
+  }
+}
+
+static void get_thumbnail_args(GPtrArray* album_ids,
+                               GPtrArray* media_ids,
+                               GPtrArray* calls) {
+  for (guint i = 0; i < media_ids->len; i++) {
+    FlValue* args = fl_value_new_map();
+    fl_value_set_string_take(
+        args, "mediaId",
+        fl_value_new_string(static_cast<const gchar*>(media_ids->pdata[i])));
+    fl_value_set_string_take(args, "width", fl_value_new_int(256));
+    fl_value_set_string_take(args, "height", fl_value_new_int(256));
+    g_ptr_array_add(calls, args);
+  }
+}
+
+static void get_album_thumbnail_args(GPtrArray* album_ids,
+                                     GPtrArray* media_ids,
+                                     GPtrArray* calls) {
+  get_media_in_album_args(album_ids, media_ids, calls);
+}
+
+typedef struct {
+  FlMethodChannel* channel;
+  const gchar* method;
+  GPtrArray* calls;
+  gint concurrency;
+
+  guint next;
+  gint in_flight;
+  gint errors;
+  // Milliseconds from sending each call to receiving its response
+  GArray* latencies;
+} LoadRun;
+
+typedef struct {
+  LoadRun* run;
+  gint64 start;
+} LoadCall;
+
+static void load_run_fill(LoadRun* run);
+
+static void load_call_cb(GObject* object, GAsyncResult* result,
+                         gpointer user_data) {
+  LoadCall* call = static_cast<LoadCall*>(user_data);
+  LoadRun* run = call->run;
+  gdouble ms = elapsed_ms(call->start);
+  g_array_append_val(run->latencies, ms);
+  g_free(call);
+
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(FlMethodResponse) response = fl_method_channel_invoke_method_finish(
+      FL_METHOD_CHANNEL(object), result, &error);
+  if (response == nullptr || !FL_IS_METHOD_SUCCESS_RESPONSE(response)) {
+    run->errors++;
+  }
+  run->in_flight--;
+  load_run_fill(run);
+}
+
+// Sends calls until |concurrency| are in flight or the pass is complete.
+static void load_run_fill(LoadRun* run) {
+  while (run->in_flight < run->concurrency && run->next < run->calls->len) {
+    LoadCall* call = g_new(LoadCall, 1);
+    call->run = run;
+    call->start = g_get_monotonic_time();
+    run->in_flight++;
+    fl_method_channel_invoke_method(
+        run->channel, run->method,
+        static_cast<FlValue*>(run->calls->pdata[run->next++]), nullptr,
+        load_call_cb, call);
+  }
+}
+
+// Runs every call of one pass and returns its wall time in milliseconds.
+static gdouble load_run_pass(LoadRun* run) {
+  run->next = 0;
+  gint64 start = g_get_monotonic_time();
+  load_run_fill(run);
+  while (run->in_flight > 0) g_main_context_iteration(nullptr, TRUE);
+  return elapsed_ms(start);
+}
+
+static gint compare_doubles(gconstpointer a, gconstpointer b) {
+  gdouble x = *static_cast<const gdouble*>(a);
+  gdouble y = *static_cast<const gdouble*>(b);
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted |values|.
+static gdouble percentile(GArray* values, gdouble p) {
+  if (values->len == 0) return 0;
+  guint rank = (guint)ceil(p * values->len);
+  return g_array_index(values, gdouble, CLAMP(rank, 1u, values->len) - 1);
+}
+
+typedef struct {
+  gint calls;
+  gint errors;
+  gdouble p50_ms;
+  gdouble p99_ms;
+  gdouble calls_per_second;
+} LoadResult;
+
+// Starts a plugin on a loopback messenger, points it at |library| and
+// measures |options->iterations| passes of |method|. Cold passes clear the
+// thumbnail cache and evict |paths| from the page cache first; warm runs
+// get one unmeasured pass to fill the caches.
+static gboolean run_method_calls(const gchar* library,
+                                 GPtrArray* paths,
+                                 const BenchmarkOptions* options,
+                                 const gchar* method,
+                                 CallArgsFunc make_args,
+                                 gboolean cold,
+                                 LoadResult* result) {
+  FlBinaryMessenger* plugin_messenger = nullptr;
+  FlBinaryMessenger* app_messenger = nullptr;
+  loopback_messenger_new_pair(&plugin_messenger, &app_messenger);
+  photo_gallery_pro_plugin_register_with_messenger(plugin_messenger, nullptr);
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+  FlMethodChannel* channel = fl_method_channel_new(
+      app_messenger, "photo_gallery_pro", FL_METHOD_CODEC(codec));
+
+  g_autoptr(FlValue) root = fl_value_new_map();
+  fl_value_set_string_take(root, "path", fl_value_new_string(library));
+  g_autoptr(FlValue) roots = fl_value_new_list();
+  fl_value_append(roots, root);
+  g_autoptr(FlValue) roots_args = fl_value_new_map();
+  fl_value_set_string(roots_args, "roots", roots);
+  g_autoptr(FlValue) set_roots =
+      invoke_sync(channel, "setLibraryRoots", roots_args);
+
+  g_autoptr(GPtrArray) album_ids = g_ptr_array_new_with_free_func(g_free);
+  g_autoptr(GPtrArray) media_ids = g_ptr_array_new_with_free_func(g_free);
+  gboolean ok = set_roots != nullptr &&
+                wait_for_library(channel, options->albums, options->images,
+                                 album_ids, media_ids);
+  if (ok) {
+    g_autoptr(GPtrArray) calls = g_ptr_array_new_with_free_func(
+        reinterpret_cast<GDestroyNotify>(fl_value_unref));
+    make_args(album_ids, media_ids, calls);
+    g_autoptr(GArray) latencies = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    LoadRun run = {channel, method, calls, MAX(options->concurrency, 1),
+                   0, 0, 0, latencies};
+    if (!cold) {
+      load_run_pass(&run);
+      g_array_set_size(latencies, 0);
+      run.errors = 0;
+    }
+
+    g_autoptr(FlValue) clear_args = fl_value_new_map();
+    fl_value_set_string_take(clear_args, "includeDisk", fl_value_new_bool(TRUE));
+    gdouble wall_ms = 0;
+    for (gint i = 0; i < options->iterations; i++) {
+      if (cold) {
+        g_autoptr(FlValue) cleared =
+            invoke_sync(channel, "clearThumbnailCache", clear_args);
+        evict_files(paths);
+      }
+      wall_ms += load_run_pass(&run);
+    }
+
+    g_array_sort(latencies, compare_doubles);
+    result->calls = latencies->len;
+    result->errors = run.errors;
+    result->p50_ms = percentile(latencies, 0.50);
+    result->p99_ms = percentile(latencies, 0.99);
+    result->calls_per_second =
+        wall_ms > 0 ? latencies->len * 1000.0 / wall_ms : 0.0;
+  }
+
+  // Releasing the plugin's end drops its channels and with them the plugin.
+  g_object_unref(channel);
+  g_object_unref(app_messenger);
+  g_object_unref(plugin_messenger);
+  return ok;
+}
+
+// Runs run_method_calls() in a child process so each run starts with a
+// fresh plugin and its peak RSS is measured in isolation.
+static gboolean run_method_calls_isolated(const gchar* library,
+                                          GPtrArray* paths,
+                                          const BenchmarkOptions* options,
+                                          const gchar* method,
+                                          CallArgsFunc make_args,
+                                          gboolean cold,
+                                          LoadResult* result,
+                                          glong* max_rss_kb) {
+  int fds[2];
+  if (pipe(fds) != 0) return FALSE;
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return FALSE;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    LoadResult child_result = {};
+    gboolean ok = run_method_calls(library, paths, options, method, make_args,
+                                   cold, &child_result) &&
+                  write(fds[1], &child_result, sizeof(child_result)) ==
+                      sizeof(child_result);
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fds[1]);
+  gboolean ok = read(fds[0], result, sizeof(*result)) == sizeof(*result);
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage = {};
+  if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    return FALSE;
+  }
+  *max_rss_kb = usage.ru_maxrss;
+  return ok;
+}
+
+// Load-tests the handlers the Dart side depends on, through real method
+// calls on a synthetic library, cold and warm.
+static void benchmark_method_calls(const BenchmarkOptions* options) {
+  static const struct {
+    const gchar* method;
+    CallArgsFunc make_args;
+  } kMethods[] = {
+      {"getAlbums", get_albums_args},
+      {"getMediaInAlbum", get_media_in_album_args},
+      {"getThumbnail", get_thumbnail_args},
+      {"getAlbumThumbnail", get_album_thumbnail_args},
+  };
+
+  g_autofree gchar* library = g_build_filename(corpus_dir, "library", nullptr);
+  g_autoptr(GPtrArray) paths = create_library(library, options);
+  if (paths == nullptr) {
+    remove_tree(library);
+    return;
+  }
+
+  for (gsize m = 0; m < G_N_ELEMENTS(kMethods); m++) {
+    for (gint cold = TRUE; cold >= FALSE; cold--) {
+      LoadResult result = {};
+      glong max_rss_kb = 0;
+      if (!run_method_calls_isolated(library, paths, options,
+                                     kMethods[m].method, kMethods[m].make_args,
+                                     cold, &result, &max_rss_kb)) {
+        g_printerr("method_calls %s: run failed\n", kMethods[m].method);
+        continue;
+      }
+      g_print("method_calls %-17s %s: %6d calls, p50 %8.2f ms, p99 %8.2f ms, "
+              "%9.1f calls/s, peak RSS %7.1f MB, %d errors\n",
+              kMethods[m].method, cold ? "cold" : "warm", result.calls,
+              result.p50_ms, result.p99_ms, result.calls_per_second,
+              max_rss_kb / 1024.0, result.errors);
+    }
+  }
+
+  remove_tree(library);
+}
+
+// Times |iterations| timed sections on one thread, in nanoseconds each.
+static gpointer time_performance_spans(gpointer data) {
+  gint iterations = GPOINTER_TO_INT(data);
+  gint64 start = g_get_monotonic_time();
+  for (gint i = 0; i < iterations; i++) {
+    performance_stats_end_stage(PERFORMANCE_STAGE_SCALE,
+                                performance_stats_begin());
+  }
+  gdouble* ns = g_new(gdouble, 1);
+  *ns = elapsed_ms(start) * 1e6 / MAX(iterations, 1);
+  return ns;
+}
+
+// Compares the plugin with its latency counters on and off: the cost of a
+// single timed section, alone and with every core recording at once, and
+// what it adds up to on warm getThumbnail calls.
+static void benchmark_performance_stats(const BenchmarkOptions* options) {
+  static const gint kSpansPerThread = 1000000;
+  gint n_threads[] = {1, MAX((gint)g_get_num_processors(), 2)};
+
+  for (gsize t = 0; t < G_N_ELEMENTS(n_threads); t++) {
+    for (gint enabled = TRUE; enabled >= FALSE; enabled--) {
+      performance_stats_set_enabled(enabled);
+      performance_stats_reset();
+      g_autoptr(GPtrArray) threads = g_ptr_array_new();
+      for (gint i = 0; i < n_threads[t]; i++) {
+        g_ptr_array_add(threads,
+                        g_thread_new("performance-stats",
+                                     time_performance_spans,
+                                     GINT_TO_POINTER(kSpansPerThread)));
+      }
+      gdouble ns = 0;
+      for (guint i = 0; i < threads->len; i++) {
+        g_autofree gdouble* thread_ns = static_cast<gdouble*>(
+            g_thread_join(static_cast<GThread*>(threads->pdata[i])));
+        ns += *thread_ns / threads->len;
+      }
+      g_print("performance_stats %2d thread(s), %-8s: %7.1f ns per span\n",
+              n_threads[t], enabled ? "enabled" : "disabled", ns);
+    }
+  }
+
+  g_autofree gchar* library = g_build_filename(corpus_dir, "library", nullptr);
+  g_autoptr(GPtrArray) paths = create_library(library, options);
+  if (paths != nullptr) {
+    for (gint enabled = TRUE; enabled >= FALSE; enabled--) {
+      // The child process running the calls inherits the setting.
+      performance_stats_set_enabled(enabled);
+      LoadResult result = {};
+      glong max_rss_kb = 0;
+      if (!run_method_calls_isolated(library, paths, options, "getThumbnail",
+                                     get_thumbnail_args, FALSE, &result,
+                                     &max_rss_kb)) {
+        g_printerr("performance_stats getThumbnail: run failed\n");
+        continue;
+      }
+      g_print("performance_stats getThumbnail warm, %-8s: p50 %8.2f ms, "
+              "p99 %8.2f ms, %9.1f calls/s\n",
+              enabled ? "enabled" : "disabled", result.p50_ms, result.p99_ms,
+              result.calls_per_second);
+    }
+  }
+  remove_tree(library);
+
+  performance_stats_set_enabled(TRUE);
+  performance_stats_reset();
+}
+
+// Times a build of the index over |options->files| images, once per
+// metadata backend. File contents are dropped from the page cache before
+// each run, but inodes stay cached, so on a local disk the runs mostly
+// measure system call overhead. On a network mount, mount with noac (or a
+// short actimeo) so every run pays the round trips the first one does.
+static void benchmark_index_scan(const BenchmarkOptions* options) {
+  // A PNG signature and header is all the index reads of an image.
+  static const guint8 kPngHeader[] = {
+      0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00,
+      0x0d, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x07, 0x80, 0x00, 0x00,
+      0x04, 0x38, 0x08, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  };
+  static const gint kImagesPerAlbum = 500;
+  static const struct {
+    const gchar* name;
+    MediaStatBackend backend;
+  } kBackends[] = {
+      {"sync", MEDIA_STAT_BACKEND_SYNC},
+      {"threads", MEDIA_STAT_BACKEND_THREADS},
+      {"io_uring", MEDIA_STAT_BACKEND_IO_URING},
+  };
+
+  const gchar* parent = options->root != nullptr ? options->root : corpus_dir;
+  g_autofree gchar* root = g_build_filename(parent, "index_scan", nullptr);
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+  for (gint i = 0; i < options->files; i++) {
+    g_autofree gchar* album_name =
+        g_strdup_printf("Album_%03d", i / kImagesPerAlbum);
+    g_autofree gchar* album_dir = g_build_filename(root, album_name, nullptr);
+    if (i % kImagesPerAlbum == 0) g_mkdir_with_parents(album_dir, 0755);
+    g_autofree gchar* name = g_strdup_printf("IMG_%05d.png", i);
+    gchar* path = g_build_filename(album_dir, name, nullptr);
+    g_file_set_contents(path, reinterpret_cast<const gchar*>(kPngHeader),
+                        sizeof(kPngHeader), nullptr);
+    g_ptr_array_add(paths, path);
+  }
+  g_autofree gchar* cache_file =
+      g_build_filename(corpus_dir, "index_scan.bin", nullptr);
+
+  MediaStatBackend default_backend = media_stat_get_backend();
+  for (gsize b = 0; b < G_N_ELEMENTS(kBackends); b++) {
+    if (!media_stat_set_backend(kBackends[b].backend)) {
+      g_print("index_scan %-8s: unavailable\n", kBackends[b].name);
+      continue;
+    }
+    evict_files(paths);
+    gint64 start = g_get_monotonic_time();
+    MediaIndex* index = media_index_new(root, cache_file, nullptr, nullptr);
+    g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index);
+    gdouble ms = elapsed_ms(start);
+    media_index_free(index);
+    g_unlink(cache_file);
+    g_print("index_scan %-8s: %6u files in %8.2f ms, %9.1f files/s\n",
+            kBackends[b].name, snapshot->n_records, ms,
+            snapshot->n_records * 1000.0 / MAX(ms, 0.001));
+  }
+  media_stat_set_backend(default_backend);
+
+  remove_tree(root);
+}
+
+static const struct {
+  const gchar* name;
+  BenchmarkFunc func;
+} kBenchmarks[] = {
+    {"index_scan", benchmark_index_scan},
+    {"dimension_probe", benchmark_dimension_probe},
+    {"media_list", benchmark_media_list},
+    {"method_calls", benchmark_method_calls},
+    {"performance_stats", benchmark_performance_stats},
+    {"resample", benchmark_resample},
+    {"thumbnail_decode", benchmark_thumbnail_decode},
+};
+
+int main(int argc, char** argv) {
+  BenchmarkOptions options = {1000, 1920,    1080,    5, 8,
+                              32,   nullptr, nullptr, 8, nullptr};
+  g_autofree gchar* formats = nullptr;
+  g_autofree gchar* resolutions = nullptr;
+  g_autofree gchar* root = nullptr;
+  const gchar* only = nullptr;
+  GOptionEntry entries[] = {
+      {"files", 'n', 0, G_OPTION_ARG_INT, &options.files,
+       "Number of files per corpus", "N"},
+      {"width", 0, 0, G_OPTION_ARG_INT, &options.width,
+       "Width of generated images", "PX"},
+      {"height", 0, 0, G_OPTION_ARG_INT, &options.height,
+       "Height of generated images", "PX"},
+      {"iterations", 'i', 0, G_OPTION_ARG_INT, &options.iterations,
+       "Repetitions per measurement", "N"},
+      {"albums", 0, 0, G_OPTION_ARG_INT, &options.albums,
+       "Albums in the synthetic library", "N"},
+      {"images", 0, 0, G_OPTION_ARG_INT, &options.images,
+       "Images per album in the synthetic library", "N"},
+      {"formats", 0, 0, G_OPTION_ARG_STRING, &formats,
+       "Image formats of the synthetic library (default jpeg,png)", "LIST"},
+      {"resolutions", 0, 0, G_OPTION_ARG_STRING, &resolutions,
+       "Image sizes of the synthetic library (default 1920x1080,4000x3000)",
+       "WxH,..."},
+      {"concurrency", 'c', 0, G_OPTION_ARG_INT, &options.concurrency,
+       "Method calls in flight at once", "N"},
+      {"root", 0, 0, G_OPTION_ARG_FILENAME, &root,
+       "Where index_scan writes its library, e.g. on a network mount", "DIR"},
+      {nullptr}};
+
+  g_autoptr(GOptionContext) context = g_option_context_new("[BENCHMARK]");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  g_autoptr(GError) error = nullptr;
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+  if (argc > 1) only = argv[1];
+  options.formats = formats != nullptr ? formats : "jpeg,png";
+  options.resolutions =
+      resolutions != nullptr ? resolutions : "1920x1080,4000x3000";
+  options.root = root;
+
+  corpus_dir = g_dir_make_tmp("photo_gallery_pro_benchmark-XXXXXX", &error);
+  if (corpus_dir == nullptr) {
+    g_printerr("Failed to create corpus directory: %s\n", error->message);
+    return 1;
+  }
+  // Keeps the plugin's saved indexes and thumbnails out of the user's cache,
+  // and stops it from indexing the user's Pictures directory on startup.
+  // Must happen before GLib first reads either directory.
+  g_autofree gchar* cache_home = g_build_filename(corpus_dir, "cache", nullptr);
+  g_autofree gchar* config_home =
+      g_build_filename(corpus_dir, "config", nullptr);
+  g_setenv("XDG_CACHE_HOME", cache_home, TRUE);
+  g_setenv("XDG_CONFIG_HOME", config_home, TRUE);
+
+  for (gsize i = 0; i < G_N_ELEMENTS(kBenchmarks); i++) {
+    if (only == nullptr || g_strcmp0(only, kBenchmarks[i].name) == 0) {
+      kBenchmarks[i].func(&options);
+    }
+  }
+
+  remove_tree(corpus_dir);
+  g_free(corpus_dir);
+  return 0;
+}
@@ -0,0 +1,342 @@
+#include "image_resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLER_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON 1
+#endif
+
+#include "performance_stats.h"
+
+// Vertical weights are fixed point, in 1/256 of a source row. Byte values
+// times the weights of all rows summed into one target row must fit the
+// 32-bit accumulators, which bounds the vertical reduction ratio.
+#define ROW_WEIGHT_ONE 256
+#define MAX_ROWS_PER_TARGET_ROW (G_MAXUINT32 / (255 * ROW_WEIGHT_ONE) - 1)
+
+// Adds |row|[i] * |weight| to |sums|[i] for the |n| bytes of a row. The
+// weight is at most ROW_WEIGHT_ONE, so each product fits in 16 bits.
+typedef void (*AccumulateFunc)(guint32* sums,
+                               const guint8* row,
+                               gsize n,
+                               guint32 weight);
+
+static void accumulate_scalar(guint32* sums,
+                              const guint8* row,
+                              gsize n,
+                              guint32 weight) {
+  for (gsize i = 0; i < n; i++) sums[i] += row[i] * weight;
+}
+
+#if RESAMPLER_X86
+__attribute__((target("sse4.1"))) static void accumulate_sse41(
+    guint32* sums,
+    const guint8* row,
+    gsize n,
+    guint32 weight) {
+  const __m128i weights = _mm_set1_epi16(static_cast<gint16>(weight));
+  gsize i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + i));
+    __m128i products = _mm_mullo_epi16(_mm_cvtepu8_epi16(bytes), weights);
+    __m128i* out = reinterpret_cast<__m128i*>(sums + i);
+    _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out),
+                                        _mm_cvtepu16_epi32(products)));
+    _mm_storeu_si128(
+        out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1),
+                               _mm_cvtepu16_epi32(_mm_srli_si128(products, 8))));
+  }
+  accumulate_scalar(sums + i, row + i, n - i, weight);
+}
+
+__attribute__((target("avx2"))) static void accumulate_avx2(guint32* sums,
+                                                            const guint8* row,
+                                                            gsize n,
+                                                            guint32 weight) {
+  const __m256i weights = _mm256_set1_epi16(static_cast<gint16>(weight));
+  gsize i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+    __m256i products =
+        _mm256_mullo_epi16(_mm256_cvtepu8_epi16(bytes), weights);
+    __m256i* out = reinterpret_cast<__m256i*>(sums + i);
+    _mm256_storeu_si256(
+        out, _mm256_add_epi32(
+                 _mm256_loadu_si256(out),
+                 _mm256_cvtepu16_epi32(_mm256_castsi256_si128(products))));
+    _mm256_storeu_si256(
+        out + 1, _mm256_add_epi32(_mm256_loadu_si256(out + 1),
+                                  _mm256_cvtepu16_epi32(
+                                      _mm256_extracti128_si256(products, 1))));
+  }
+  accumulate_scalar(sums + i, row + i, n - i, weight);
+}
+#endif
+
+#if RESAMPLER_NEON
+static void accumulate_neon(guint32* sums,
+                            const guint8* row,
+                            gsize n,
+                            guint32 weight) {
+  const uint16x8_t weights = vdupq_n_u16(static_cast<guint16>(weight));
+  gsize i = 0;
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t bytes = vld1q_u8(row + i);
+    uint16x8_t low = vmulq_u16(vmovl_u8(vget_low_u8(bytes)), weights);
+    uint16x8_t high = vmulq_u16(vmovl_u8(vget_high_u8(bytes)), weights);
+    guint32* out = sums + i;
+    vst1q_u32(out, vaddw_u16(vld1q_u32(out), vget_low_u16(low)));
+    vst1q_u32(out + 4, vaddw_u16(vld1q_u32(out + 4), vget_high_u16(low)));
+    vst1q_u32(out + 8, vaddw_u16(vld1q_u32(out + 8), vget_low_u16(high)));
+    vst1q_u32(out + 12, vaddw_u16(vld1q_u32(out + 12), vget_high_u16(high)));
+  }
+  accumulate_scalar(sums + i, row + i, n - i, weight);
+}
+#endif
+
+gboolean image_resampler_kernel_is_supported(ImageResamplerKernel kernel) {
+  switch (kernel) {
+    case IMAGE_RESAMPLER_KERNEL_SCALAR:
+      return TRUE;
+#if RESAMPLER_X86
+    case IMAGE_RESAMPLER_KERNEL_SSE41:
+      return __builtin_cpu_supports("sse4.1");
+    case IMAGE_RESAMPLER_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+#if RESAMPLER_NEON
+    case IMAGE_RESAMPLER_KERNEL_NEON:
+      return TRUE;
+#endif
+    default:
+      return FALSE;
+  }
+}
+
+ImageResamplerKernel image_resampler_get_best_kernel(void) {
+  static const ImageResamplerKernel kPreferred[] = {
+      IMAGE_RESAMPLER_KERNEL_AVX2,
+      IMAGE_RESAMPLER_KERNEL_NEON,
+      IMAGE_RESAMPLER_KERNEL_SSE41,
+  };
+  for (gsize i = 0; i < G_N_ELEMENTS(kPreferred); i++) {
+    if (image_resampler_kernel_is_supported(kPreferred[i])) {
+      return kPreferred[i];
+    }
+  }
+  return IMAGE_RESAMPLER_KERNEL_SCALAR;
+}
+
+const gchar* image_resampler_kernel_name(ImageResamplerKernel kernel) {
+  switch (kernel) {
+    case IMAGE_RESAMPLER_KERNEL_SSE41:
+      return "sse4.1";
+    case IMAGE_RESAMPLER_KERNEL_AVX2:
+      return "avx2";
+    case IMAGE_RESAMPLER_KERNEL_NEON:
+      return "neon";
+    default:
+      return "scalar";
+  }
+}
+
+static AccumulateFunc kernel_function(ImageResamplerKernel kernel) {
+  switch (kernel) {
+#if RESAMPLER_X86
+    case IMAGE_RESAMPLER_KERNEL_SSE41:
+      return accumulate_sse41;
+    case IMAGE_RESAMPLER_KERNEL_AVX2:
+      return accumulate_avx2;
+#endif
+#if RESAMPLER_NEON
+    case IMAGE_RESAMPLER_KERNEL_NEON:
+      return accumulate_neon;
+#endif
+    default:
+      return accumulate_scalar;
+  }
+}
+
+// The source pixels covered by one target pixel along one axis. Their
+// coverage, from just above 0 to 1, is |count| entries from |offset| in the
+// weight array.
+typedef struct {
+  gint first;
+  gint count;
+  guint offset;
+} Span;
+
+// Fills |spans| for scaling |source| pixels down to |target| and |weights|
+// with the coverage of each source pixel. |weights| needs room for
+// |source| + |target| entries, as each target pixel shares at most one
+// source pixel with the next.
+static void compute_spans(gint source,
+                          gint target,
+                          Span* spans,
+                          gdouble* weights) {
+  gdouble scale = (gdouble)source / target;
+  guint offset = 0;
+  for (gint i = 0; i < target; i++) {
+    gdouble start = i * scale;
+    gdouble end = MIN((i + 1) * scale, (gdouble)source);
+    gint first = (gint)start;
+    gint last = MIN((gint)ceil(end), source) - 1;
+    spans[i].first = first;
+    spans[i].count = last - first + 1;
+    spans[i].offset = offset;
+    for (gint j = first; j <= last; j++) {
+      weights[offset++] = MIN(end, j + 1.0) - MAX(start, (gdouble)j);
+    }
+  }
+}
+
+// Copies an RGBA row with its colour channels multiplied by alpha.
+static void premultiply_row(const guint8* row, guint8* out, gint width) {
+  for (gint x = 0; x < width; x++) {
+    guint alpha = row[x * 4 + 3];
+    for (gint c = 0; c < 3; c++) {
+      out[x * 4 + c] = (row[x * 4 + c] * alpha + 127) / 255;
+    }
+    out[x * 4 + 3] = alpha;
+  }
+}
+
+static guint8 round_to_byte(gdouble value) {
+  return value >= 254.5 ? 255 : static_cast<guint8>(value + 0.5);
+}
+
+static GdkPixbuf* resample_area(GdkPixbuf* source,
+                                gint width,
+                                gint height,
+                                AccumulateFunc accumulate) {
+  gint source_width = gdk_pixbuf_get_width(source);
+  gint source_height = gdk_pixbuf_get_height(source);
+  gint source_stride = gdk_pixbuf_get_rowstride(source);
+  gint channels = gdk_pixbuf_get_n_channels(source);
+  gboolean has_alpha = gdk_pixbuf_get_has_alpha(source);
+  const guint8* source_pixels = gdk_pixbuf_read_pixels(source);
+  gsize row_bytes = (gsize)source_width * channels;
+
+  Span* rows = g_new(Span, height);
+  gdouble* row_coverage = g_new(gdouble, source_height + height);
+  compute_spans(source_height, height, rows, row_coverage);
+  Span* columns = g_new(Span, width);
+  gdouble* column_coverage = g_new(gdouble, source_width + width);
+  compute_spans(source_width, width, columns, column_coverage);
+
+  guint32* sums = g_new(guint32, row_bytes);
+  guint8* premultiplied = has_alpha ? g_new(guint8, row_bytes) : nullptr;
+
+  GdkPixbuf* target =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+  guint8* target_pixels = gdk_pixbuf_get_pixels(target);
+  gint target_stride = gdk_pixbuf_get_rowstride(target);
+
+  for (gint y = 0; y < height; y++) {
+    // Box the covered source rows into |sums|.
+    memset(sums, 0, row_bytes * sizeof(guint32));
+    guint32 row_total = 0;
+    const Span* row_span = &rows[y];
+    for (gint k = 0; k < row_span->count; k++) {
+      guint32 weight = (guint32)lround(row_coverage[row_span->offset + k] *
+                                       ROW_WEIGHT_ONE);
+      if (weight == 0) continue;
+      const guint8* row =
+          source_pixels + (gsize)(row_span->first + k) * source_stride;
+      if (has_alpha) {
+        premultiply_row(row, premultiplied, source_width);
+        row = premultiplied;
+      }
+      accumulate(sums, row, row_bytes, weight);
+      row_total += weight;
+    }
+
+    // Then reduce the accumulated row horizontally.
+    guint8* out = target_pixels + (gsize)y * target_stride;
+    for (gint x = 0; x < width; x++) {
+      const Span* column_span = &columns[x];
+      gdouble totals[4] = {0, 0, 0, 0};
+      gdouble coverage = 0;
+      for (gint k = 0; k < column_span->count; k++) {
+        gdouble weight = column_coverage[column_span->offset + k];
+        const guint32* pixel = sums + (gsize)(column_span->first + k) * channels;
+        for (gint c = 0; c < channels; c++) totals[c] += pixel[c] * weight;
+        coverage += weight;
+      }
+
+      guint8* pixel = out + (gsize)x * channels;
+      gdouble scale = 1.0 / (coverage * row_total);
+      if (!has_alpha) {
+        for (gint c = 0; c < 3; c++) pixel[c] = round_to_byte(totals[c] * scale);
+      } else {
+        // Averaged premultiplied colour over averaged alpha is the
+        // alpha-weighted mean colour.
+        for (gint c = 0; c < 3; c++) {
+          pixel[c] = totals[3] > 0 ? round_to_byte(totals[c] * 255 / totals[3])
+                                   : 0;
+        }
+        pixel[3] = round_to_byte(totals[3] * scale);
+      }
+    }
+  }
+
+  g_free(premultiplied);
+  g_free(sums);
+  g_free(column_coverage);
+  g_free(columns);
+  g_free(row_coverage);
+  g_free(rows);
+  return target;
+}
+
+GdkPixbuf* image_resample_with_kernel(GdkPixbuf* source,
+                                      gint width,
+                                      gint height,
+                                      ImageResamplerKernel kernel) {
+  g_return_val_if_fail(image_resampler_kernel_is_supported(kernel), nullptr);
+  gint source_width = gdk_pixbuf_get_width(source);
+  gint source_height = gdk_pixbuf_get_height(source);
+  width = MAX(width, 1);
+  height = MAX(height, 1);
+  if (width == source_width && height == source_height) {
+    return gdk_pixbuf_copy(source);
+  }
+
+  gint channels = gdk_pixbuf_get_n_channels(source);
+  gboolean area = width <= source_width && height <= source_height &&
+                  gdk_pixbuf_get_bits_per_sample(source) == 8 &&
+                  channels == (gdk_pixbuf_get_has_alpha(source) ? 4 : 3) &&
+                  (guint)(source_height / height) < MAX_ROWS_PER_TARGET_ROW;
+  if (!area) {
+    return gdk_pixbuf_scale_simple(source, width, height, GDK_INTERP_BILINEAR);
+  }
+  return resample_area(source, width, height, kernel_function(kernel));
+}
+
+GdkPixbuf* image_resample(GdkPixbuf* source, gint width, gint height) {
+  return image_resample_with_kernel(source, width, height,
+                                    image_resampler_get_best_kernel());
+}
+
+GdkPixbuf* image_resample_to_fit(GdkPixbuf* source, gint width, gint height) {
+  gint source_width = gdk_pixbuf_get_width(source);
+  gint source_height = gdk_pixbuf_get_height(source);
+  if (source_width <= width && source_height <= height) {
+    return GDK_PIXBUF(g_object_ref(source));
+  }
+
+  gint64 start = performance_stats_begin();
+  gdouble scale = MIN((gdouble)width / source_width,
+                      (gdouble)height / source_height);
+  GdkPixbuf* scaled =
+      image_resample(source, MAX((gint)(source_width * scale), 1),
+                     MAX((gint)(source_height * scale), 1));
+  performance_stats_end_stage(PERFORMANCE_STAGE_SCALE, start);
+  return scaled;
+}
@@ -0,0 +1,54 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_IMAGE_RESAMPLER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_IMAGE_RESAMPLER_H_
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Area-averaging downscaler for thumbnails.
+//
+// Each target pixel is the average of the source pixels it covers, with
+// fractional weights for the pixels on its edges, so large reductions do not
+// alias the way gdk_pixbuf_scale_simple()'s bilinear filter does. The filter
+// is separable: source rows are summed into an accumulator row, which boxes
+// the image down vertically in one pass over the pixels, and the accumulator
+// is then reduced horizontally. The row sums touch every source byte and run
+// on the widest SIMD kernel the CPU supports, picked at runtime.
+//
+// Alpha is premultiplied while averaging so transparent pixels do not bleed
+// their colour into the result.
+
+typedef enum {
+  IMAGE_RESAMPLER_KERNEL_SCALAR,
+  IMAGE_RESAMPLER_KERNEL_SSE41,
+  IMAGE_RESAMPLER_KERNEL_AVX2,
+  IMAGE_RESAMPLER_KERNEL_NEON,
+} ImageResamplerKernel;
+
+// Returns the fastest kernel this CPU supports.
+ImageResamplerKernel image_resampler_get_best_kernel(void);
+
+// Returns TRUE if this CPU can run |kernel|.
+gboolean image_resampler_kernel_is_supported(ImageResamplerKernel kernel);
+
+const gchar* image_resampler_kernel_name(ImageResamplerKernel kernel);
+
+// Returns |source| scaled to exactly |width|x|height|. 8-bit RGB and RGBA
+// pixbufs of any rowstride are downscaled with the area filter; upscaling
+// falls back to gdk_pixbuf_scale_simple().
+GdkPixbuf* image_resample(GdkPixbuf* source, gint width, gint height);
+
+// As image_resample(), with a given kernel, which must be supported. Meant
+// for tests and benchmarks.
+GdkPixbuf* image_resample_with_kernel(GdkPixbuf* source,
+                                      gint width,
+                                      gint height,
+                                      ImageResamplerKernel kernel);
+
+// Returns |source| scaled down to fit in |width|x|height| while keeping its
+// aspect ratio, or a new reference to it if it already fits.
+GdkPixbuf* image_resample_to_fit(GdkPixbuf* source, gint width, gint height);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_IMAGE_RESAMPLER_H_
@@ -0,0 +1,214 @@
+#include "media_encoder.h"
+
+#include <math.h>
+#include <string.h>
+
+// Column counts of the packed layout, see media_encoder.h.
+#define PACKED_INT64_COLUMNS 6
+#define PACKED_FLOAT64_COLUMNS 2
+#define PACKED_UINT32_COLUMNS 8
+
+gboolean media_encoding_parse(FlValue* args, MediaEncoding* encoding) {
+  *encoding = MEDIA_ENCODING_MAPS;
+  FlValue* value = fl_value_lookup_string(args, "encoding");
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+    return TRUE;
+  }
+  const gchar* name = fl_value_get_string(value);
+  if (g_strcmp0(name, "packed") == 0) {
+    *encoding = MEDIA_ENCODING_PACKED;
+    return TRUE;
+  }
+  return g_strcmp0(name, "maps") == 0;
+}
+
+void media_encoder_set_capture_metadata(FlValue* media_info,
+                                        gint64 date_taken,
+                                        guint orientation,
+                                        const gchar* camera_model,
+                                        const gdouble* location) {
+  if (date_taken != 0) {
+    fl_value_set_string_take(media_info, "dateTaken",
+                             fl_value_new_int(date_taken));
+  }
+  if (orientation != 0) {
+    fl_value_set_string_take(media_info, "orientation",
+                             fl_value_new_int(orientation));
+  }
+  if (camera_model != nullptr && camera_model[0] != '\0') {
+    fl_value_set_string_take(media_info, "cameraModel",
+                             fl_value_new_string(camera_model));
+  }
+  if (location != nullptr) {
+    fl_value_set_string_take(media_info, "latitude",
+                             fl_value_new_float(location[0]));
+    fl_value_set_string_take(media_info, "longitude",
+                             fl_value_new_float(location[1]));
+  }
+}
+
+FlValue* media_encoder_encode_record(const MediaIndexSnapshot* snapshot,
+                                     const MediaRecord* record) {
+  const gchar* path = media_index_snapshot_string(snapshot, record->path);
+  FlValue* media_info = fl_value_new_map();
+  fl_value_set_string_take(media_info, "id", fl_value_new_string(path));
+  fl_value_set_string_take(
+      media_info, "name",
+      fl_value_new_string(media_index_snapshot_string(snapshot, record->name)));
+  fl_value_set_string_take(media_info, "path", fl_value_new_string(path));
+  fl_value_set_string_take(media_info, "dateAdded",
+                           fl_value_new_int(record->mtime));
+  fl_value_set_string_take(media_info, "size", fl_value_new_int(record->size));
+  fl_value_set_string_take(
+      media_info, "type",
+      fl_value_new_string(record->kind == MEDIA_KIND_IMAGE ? "image" : "video"));
+  // Video dimensions come with the metadata stage, after the listing.
+  if (record->kind == MEDIA_KIND_IMAGE ||
+      (record->flags & MEDIA_RECORD_HAS_METADATA)) {
+    fl_value_set_string_take(media_info, "width",
+                             fl_value_new_int(record->width));
+    fl_value_set_string_take(media_info, "height",
+                             fl_value_new_int(record->height));
+  }
+  if (record->kind == MEDIA_KIND_VIDEO && record->duration_ms > 0) {
+    fl_value_set_string_take(media_info, "duration",
+                             fl_value_new_int(record->duration_ms));
+  }
+  const gchar* placeholder =
+      media_index_snapshot_string(snapshot, record->placeholder);
+  if (placeholder[0] != '\0') {
+    fl_value_set_string_take(media_info, "placeholder",
+                             fl_value_new_string(placeholder));
+  }
+  gdouble location[] = {record->latitude, record->longitude};
+  media_encoder_set_capture_metadata(
+      media_info, record->date_taken, record->orientation,
+      media_index_snapshot_string(snapshot, record->camera_model),
+      (record->flags & MEDIA_RECORD_HAS_LOCATION) ? location : nullptr);
+  return media_info;
+}
+
+static void put_uint32(guint8* column, gsize i, guint32 value) {
+  value = GUINT32_TO_LE(value);
+  memcpy(column + i * sizeof(value), &value, sizeof(value));
+}
+
+static void put_int64(guint8* column, gsize i, gint64 value) {
+  value = GINT64_TO_LE(value);
+  memcpy(column + i * sizeof(value), &value, sizeof(value));
+}
+
+static void put_float64(guint8* column, gsize i, gdouble value) {
+  guint64 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put_int64(column, i, (gint64)bits);
+}
+
+FlValue* media_encoder_encode_packed(const MediaIndexSnapshot* snapshot,
+                                     const guint32* positions,
+                                     guint n_positions) {
+  gsize n = n_positions;
+
+  // Camera models repeat across a library and are stored once in the
+  // snapshot pool, so they are stored once here too, keyed by pool offset.
+  // The values are table offsets plus one once written.
+  g_autoptr(GHashTable) camera_models =
+      g_hash_table_new(g_direct_hash, g_direct_equal);
+  gsize strings_size = 0;
+  for (gsize i = 0; i < n; i++) {
+    const MediaRecord* record = &snapshot->records[positions[i]];
+    strings_size +=
+        strlen(media_index_snapshot_string(snapshot, record->path)) +
+        strlen(media_index_snapshot_string(snapshot, record->placeholder));
+    const gchar* camera_model =
+        media_index_snapshot_string(snapshot, record->camera_model);
+    gpointer key = GUINT_TO_POINTER(record->camera_model);
+    if (camera_model[0] != '\0' &&
+        !g_hash_table_contains(camera_models, key)) {
+      g_hash_table_insert(camera_models, key, nullptr);
+      strings_size += strlen(camera_model);
+    }
+  }
+
+  gsize header_size = MEDIA_PACKED_HEADER_FIELDS * sizeof(guint32);
+  gsize strings_offset =
+      header_size + n * (PACKED_INT64_COLUMNS * sizeof(gint64) +
+                         PACKED_FLOAT64_COLUMNS * sizeof(gdouble) +
+                         PACKED_UINT32_COLUMNS * sizeof(guint32));
+  gsize size = strings_offset + strings_size;
+  guint8* data = static_cast<guint8*>(g_malloc0(size));
+  put_uint32(data, 0, MEDIA_PACKED_MAGIC);
+  put_uint32(data, 1, MEDIA_PACKED_VERSION);
+  put_uint32(data, 2, n);
+  put_uint32(data, 3, strings_offset);
+  put_uint32(data, 4, strings_size);
+
+  guint8* sizes = data + header_size;
+  guint8* dates_added = sizes + n * sizeof(gint64);
+  guint8* dates_taken = dates_added + n * sizeof(gint64);
+  guint8* widths = dates_taken + n * sizeof(gint64);
+  guint8* heights = widths + n * sizeof(gint64);
+  guint8* durations = heights + n * sizeof(gint64);
+  guint8* latitudes = durations + n * sizeof(gint64);
+  guint8* longitudes = latitudes + n * sizeof(gdouble);
+  guint8* path_offsets = longitudes + n * sizeof(gdouble);
+  guint8* path_lengths = path_offsets + n * sizeof(guint32);
+  guint8* name_offsets = path_lengths + n * sizeof(guint32);
+  guint8* camera_offsets = name_offsets + n * sizeof(guint32);
+  guint8* camera_lengths = camera_offsets + n * sizeof(guint32);
+  guint8* placeholder_offsets = camera_lengths + n * sizeof(guint32);
+  guint8* placeholder_lengths = placeholder_offsets + n * sizeof(guint32);
+  guint8* infos = placeholder_lengths + n * sizeof(guint32);
+  gchar* strings = reinterpret_cast<gchar*>(data + strings_offset);
+
+  gsize cursor = 0;
+  for (gsize i = 0; i < n; i++) {
+    const MediaRecord* record = &snapshot->records[positions[i]];
+    put_int64(sizes, i, record->size);
+    put_int64(dates_added, i, record->mtime);
+    put_int64(dates_taken, i, record->date_taken);
+    put_int64(widths, i, record->width);
+    put_int64(heights, i, record->height);
+    put_int64(durations, i, record->duration_ms);
+    gboolean has_location = record->flags & MEDIA_RECORD_HAS_LOCATION;
+    put_float64(latitudes, i, has_location ? record->latitude : NAN);
+    put_float64(longitudes, i, has_location ? record->longitude : NAN);
+    put_uint32(infos, i, record->kind | (guint32)record->orientation << 8);
+
+    const gchar* path = media_index_snapshot_string(snapshot, record->path);
+    gsize path_length = strlen(path);
+    memcpy(strings + cursor, path, path_length);
+    put_uint32(path_offsets, i, cursor);
+    put_uint32(path_lengths, i, path_length);
+    put_uint32(name_offsets, i, cursor + (record->name - record->path));
+    cursor += path_length;
+
+    const gchar* placeholder =
+        media_index_snapshot_string(snapshot, record->placeholder);
+    gsize placeholder_length = strlen(placeholder);
+    memcpy(strings + cursor, placeholder, placeholder_length);
+    put_uint32(placeholder_offsets, i, cursor);
+    put_uint32(placeholder_lengths, i, placeholder_length);
+    cursor += placeholder_length;
+
+    const gchar* camera_model =
+        media_index_snapshot_string(snapshot, record->camera_model);
+    if (camera_model[0] == '\0') continue;
+    gpointer key = GUINT_TO_POINTER(record->camera_model);
+    guint camera_offset =
+        GPOINTER_TO_UINT(g_hash_table_lookup(camera_models, key));
+    gsize camera_length = strlen(camera_model);
+    if (camera_offset == 0) {
+      memcpy(strings + cursor, camera_model, camera_length);
+      camera_offset = cursor + 1;
+      g_hash_table_insert(camera_models, key, GUINT_TO_POINTER(camera_offset));
+      cursor += camera_length;
+    }
+    put_uint32(camera_offsets, i, camera_offset - 1);
+    put_uint32(camera_lengths, i, camera_length);
+  }
+
+  FlValue* value = fl_value_new_uint8_list(data, size);
+  g_free(data);
+  return value;
+}
@@ -0,0 +1,66 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_ENCODER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_ENCODER_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include "media_index.h"
+
+G_BEGIN_DECLS
+
+// Turns indexed media records into what is sent over the method channel.
+//
+// The default encoding is one map per item, which costs a dozen small
+// allocations per item on each side of the channel. The packed encoding
+// sends a whole page as one Uint8List laid out as struct-of-arrays, which
+// the Dart side reads lazily:
+//
+//   header        MEDIA_PACKED_HEADER_FIELDS little-endian uint32 values:
+//                 magic, version, count, string table offset and size,
+//                 then reserved zeroes
+//   int64[count]  size, dateAdded, dateTaken (seconds, 0 when unknown),
+//                 width, height (0 when unknown), duration (ms)
+//   float64[count] latitude, longitude (NaN when unknown)
+//   uint32[count] path offset, path length, name offset (the name is the
+//                 tail of the path), camera model offset and length (0
+//                 when unknown), placeholder offset and length (0 when
+//                 there is none yet), info (MediaKind | orientation << 8)
+//   string table  UTF-8 without terminators
+//
+// Values are little-endian and every column is naturally aligned relative
+// to the start of the payload. String offsets are relative to the string
+// table.
+
+#define MEDIA_PACKED_MAGIC 0x4c4d4750  // "PGML"
+#define MEDIA_PACKED_VERSION 2
+#define MEDIA_PACKED_HEADER_FIELDS 8
+
+typedef enum {
+  MEDIA_ENCODING_MAPS,
+  MEDIA_ENCODING_PACKED,
+} MediaEncoding;
+
+// Reads the optional "encoding" argument, "maps" or "packed", from the
+// |args| map. Returns FALSE for an unknown encoding.
+gboolean media_encoding_parse(FlValue* args, MediaEncoding* encoding);
+
+// Adds the capture metadata fields to a media map; unknown values are left
+// out. |location| is {latitude, longitude}, or NULL.
+void media_encoder_set_capture_metadata(FlValue* media_info,
+                                        gint64 date_taken,
+                                        guint orientation,
+                                        const gchar* camera_model,
+                                        const gdouble* location);
+
+// Returns the map sent to Dart for one indexed media item.
+FlValue* media_encoder_encode_record(const MediaIndexSnapshot* snapshot,
+                                     const MediaRecord* record);
+
+// Returns the packed encoding of the records of |snapshot| at |positions|,
+// in that order.
+FlValue* media_encoder_encode_packed(const MediaIndexSnapshot* snapshot,
+                                     const guint32* positions,
+                                     guint n_positions);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_ENCODER_H_
@@ -0,0 +1,597 @@
+#include "media_exif.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Bytes read up front; a camera JPEG's APP1 segment starts within them.
+#define HEAD_SIZE 4096
+
+// Limits that keep corrupt files from being walked forever.
+#define MAX_JPEG_SEGMENTS 16
+#define MAX_IFD_ENTRIES 512
+#define MAX_SUB_IFDS 4
+#define MAX_PREVIEW_LENGTH (16 * 1024 * 1024)
+
+#define TAG_COMPRESSION 0x0103
+#define TAG_MAKE 0x010f
+#define TAG_MODEL 0x0110
+#define TAG_STRIP_OFFSETS 0x0111
+#define TAG_ORIENTATION 0x0112
+#define TAG_STRIP_BYTE_COUNTS 0x0117
+#define TAG_DATE_TIME 0x0132
+#define TAG_SUB_IFDS 0x014a
+#define TAG_JPEG_OFFSET 0x0201
+#define TAG_JPEG_LENGTH 0x0202
+#define TAG_EXIF_IFD 0x8769
+#define TAG_GPS_IFD 0x8825
+#define TAG_DATE_TIME_ORIGINAL 0x9003
+#define TAG_DATE_TIME_DIGITIZED 0x9004
+#define TAG_OFFSET_TIME_ORIGINAL 0x9011
+
+#define TAG_GPS_LATITUDE_REF 0x0001
+#define TAG_GPS_LATITUDE 0x0002
+#define TAG_GPS_LONGITUDE_REF 0x0003
+#define TAG_GPS_LONGITUDE 0x0004
+
+#define TYPE_ASCII 2
+#define TYPE_SHORT 3
+#define TYPE_RATIONAL 5
+
+// TIFF compression values whose strips hold a baseline JPEG.
+#define COMPRESSION_OLD_JPEG 6
+#define COMPRESSION_JPEG 7
+
+// "YYYY:MM:DD HH:MM:SS" plus the terminator.
+#define DATE_SIZE 20
+
+#define XMP_SIGNATURE "http://ns.adobe.com/xap/1.0/"
+
+typedef struct {
+  int fd;
+  guint64 base;        // File offset of the TIFF header.
+  const guint8* data;  // The whole TIFF block when it is held in memory.
+  gsize length;
+  gboolean big_endian;
+} TiffReader;
+
+typedef enum {
+  DATE_ORIGINAL,
+  DATE_DIGITIZED,
+  DATE_MODIFIED,
+  N_DATES,
+} DateKind;
+
+// Values collected while parsing, before they are combined into MediaExif.
+typedef struct {
+  MediaExif* exif;
+  gchar dates[N_DATES][DATE_SIZE];
+  gchar offset_time[8];  // "+HH:MM"
+  gchar make[MEDIA_EXIF_CAMERA_MODEL_SIZE];
+  gchar latitude_ref[2];
+  gchar longitude_ref[2];
+  gdouble latitude[3];
+  gdouble longitude[3];
+  gboolean has_latitude;
+  gboolean has_longitude;
+} ExifParse;
+
+static gboolean read_full(int fd, guint64 offset, guint8* buffer, gsize length) {
+  gsize done = 0;
+  while (done < length) {
+    ssize_t n = pread(fd, buffer + done, length - done, offset + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return FALSE;
+    done += n;
+  }
+  return TRUE;
+}
+
+static gboolean tiff_read(const TiffReader* reader,
+                          guint32 offset,
+                          guint8* buffer,
+                          gsize length) {
+  if (reader->data != nullptr) {
+    if ((guint64)offset + length > reader->length) return FALSE;
+    memcpy(buffer, reader->data + offset, length);
+    return TRUE;
+  }
+  return read_full(reader->fd, reader->base + offset, buffer, length);
+}
+
+static guint16 tiff_u16(const TiffReader* reader, const guint8* p) {
+  return reader->big_endian ? (guint16)((p[0] << 8) | p[1])
+                            : (guint16)(p[0] | (p[1] << 8));
+}
+
+static guint32 tiff_u32(const TiffReader* reader, const guint8* p) {
+  return reader->big_endian
+             ? ((guint32)p[0] << 24) | ((guint32)p[1] << 16) |
+                   ((guint32)p[2] << 8) | (guint32)p[3]
+             : ((guint32)p[3] << 24) | ((guint32)p[2] << 16) |
+                   ((guint32)p[1] << 8) | (guint32)p[0];
+}
+
+// Returns the first value of a SHORT or LONG entry.
+static guint32 tiff_entry_value(const TiffReader* reader, const guint8* entry) {
+  return tiff_u16(reader, entry + 2) == TYPE_SHORT
+             ? tiff_u16(reader, entry + 8)
+             : tiff_u32(reader, entry + 8);
+}
+
+static guint32 tiff_entry_count(const TiffReader* reader, const guint8* entry) {
+  return tiff_u32(reader, entry + 4);
+}
+
+// Copies an ASCII entry into |buffer|, truncating it to fit, and strips
+// trailing padding. Returns FALSE if the entry is not ASCII or unreadable.
+static gboolean tiff_entry_string(const TiffReader* reader,
+                                  const guint8* entry,
+                                  gchar* buffer,
+                                  gsize size) {
+  if (tiff_u16(reader, entry + 2) != TYPE_ASCII) return FALSE;
+  guint32 count = tiff_entry_count(reader, entry);
+  gsize length = MIN((gsize)count, size - 1);
+  guint8* target = reinterpret_cast<guint8*>(buffer);
+  // Values of up to four bytes are stored in the entry itself.
+  if (count <= 4) {
+    memcpy(target, entry + 8, length);
+  } else if (!tiff_read(reader, tiff_u32(reader, entry + 8), target, length)) {
+    return FALSE;
+  }
+  buffer[length] = '\0';
+  g_strchomp(buffer);
+  return TRUE;
+}
+
+// Reads the three RATIONAL values of a GPS coordinate entry.
+static gboolean tiff_entry_coordinate(const TiffReader* reader,
+                                      const guint8* entry,
+                                      gdouble values[3]) {
+  if (tiff_u16(reader, entry + 2) != TYPE_RATIONAL ||
+      tiff_entry_count(reader, entry) != 3) {
+    return FALSE;
+  }
+  guint8 data[24];
+  if (!tiff_read(reader, tiff_u32(reader, entry + 8), data, sizeof(data))) {
+    return FALSE;
+  }
+  for (int i = 0; i < 3; i++) {
+    guint32 numerator = tiff_u32(reader, data + i * 8);
+    guint32 denominator = tiff_u32(reader, data + i * 8 + 4);
+    if (denominator == 0) return FALSE;
+    values[i] = (gdouble)numerator / denominator;
+  }
+  return TRUE;
+}
+
+// Reads the entries of the IFD at |offset| and the next-IFD offset behind
+// them. Returns NULL if the IFD is missing or damaged.
+static guint8* tiff_read_ifd(const TiffReader* reader,
+                             guint32 offset,
+                             guint16* count) {
+  guint8 count_bytes[2];
+  if (offset == 0 || !tiff_read(reader, offset, count_bytes, 2)) return nullptr;
+  *count = tiff_u16(reader, count_bytes);
+  if (*count == 0 || *count > MAX_IFD_ENTRIES) return nullptr;
+
+  gsize size = *count * 12 + 4;
+  guint8* entries = static_cast<guint8*>(g_malloc(size));
+  if (!tiff_read(reader, offset + 2, entries, size)) {
+    g_free(entries);
+    return nullptr;
+  }
+  return entries;
+}
+
+static void exif_add_preview(MediaExif* exif,
+                             const TiffReader* reader,
+                             guint32 offset,
+                             guint32 length) {
+  if (offset == 0 || length == 0 || length > MAX_PREVIEW_LENGTH ||
+      exif->n_previews == MEDIA_EXIF_MAX_PREVIEWS) {
+    return;
+  }
+  if (reader->data != nullptr && (guint64)offset + length > reader->length) {
+    return;
+  }
+
+  // Keep the list ordered by size, smallest first.
+  guint i = exif->n_previews++;
+  while (i > 0 && exif->previews[i - 1].length > length) {
+    exif->previews[i] = exif->previews[i - 1];
+    i--;
+  }
+  exif->previews[i].offset = reader->base + offset;
+  exif->previews[i].length = length;
+}
+
+// Reads the capture dates from the EXIF sub-IFD.
+static void exif_parse_exif_ifd(const TiffReader* reader,
+                                guint32 offset,
+                                ExifParse* parse) {
+  guint16 count = 0;
+  g_autofree guint8* entries = tiff_read_ifd(reader, offset, &count);
+  if (entries == nullptr) return;
+
+  for (guint i = 0; i < count; i++) {
+    const guint8* entry = entries + i * 12;
+    switch (tiff_u16(reader, entry)) {
+      case TAG_DATE_TIME_ORIGINAL:
+        tiff_entry_string(reader, entry, parse->dates[DATE_ORIGINAL],
+                          DATE_SIZE);
+        break;
+      case TAG_DATE_TIME_DIGITIZED:
+        tiff_entry_string(reader, entry, parse->dates[DATE_DIGITIZED],
+                          DATE_SIZE);
+        break;
+      case TAG_OFFSET_TIME_ORIGINAL:
+        tiff_entry_string(reader, entry, parse->offset_time,
+                          sizeof(parse->offset_time));
+        break;
+    }
+  }
+}
+
+static void exif_parse_gps_ifd(const TiffReader* reader,
+                               guint32 offset,
+                               ExifParse* parse) {
+  guint16 count = 0;
+  g_autofree guint8* entries = tiff_read_ifd(reader, offset, &count);
+  if (entries == nullptr) return;
+
+  for (guint i = 0; i < count; i++) {
+    const guint8* entry = entries + i * 12;
+    switch (tiff_u16(reader, entry)) {
+      case TAG_GPS_LATITUDE_REF:
+        tiff_entry_string(reader, entry, parse->latitude_ref,
+                          sizeof(parse->latitude_ref));
+        break;
+      case TAG_GPS_LATITUDE:
+        parse->has_latitude =
+            tiff_entry_coordinate(reader, entry, parse->latitude);
+        break;
+      case TAG_GPS_LONGITUDE_REF:
+        tiff_entry_string(reader, entry, parse->longitude_ref,
+                          sizeof(parse->longitude_ref));
+        break;
+      case TAG_GPS_LONGITUDE:
+        parse->has_longitude =
+            tiff_entry_coordinate(reader, entry, parse->longitude);
+        break;
+    }
+  }
+}
+
+static guint32 exif_parse_ifd(const TiffReader* reader,
+                              guint32 offset,
+                              gboolean is_main,
+                              ExifParse* parse);
+
+static void exif_parse_sub_ifds(const TiffReader* reader,
+                                const guint8* entry,
+                                ExifParse* parse) {
+  guint32 count = MIN(tiff_entry_count(reader, entry), MAX_SUB_IFDS);
+  guint8 offsets[MAX_SUB_IFDS * 4];
+  if (count <= 1) {
+    memcpy(offsets, entry + 8, 4);
+  } else if (!tiff_read(reader, tiff_u32(reader, entry + 8), offsets,
+                        count * 4)) {
+    return;
+  }
+  for (guint32 i = 0; i < count; i++) {
+    exif_parse_ifd(reader, tiff_u32(reader, offsets + i * 4), FALSE, parse);
+  }
+}
+
+// Parses the IFD at |offset| and returns the offset of the next IFD in its
+// chain, or 0. Only the main IFD, IFD0, describes the image itself; the
+// others hold previews.
+static guint32 exif_parse_ifd(const TiffReader* reader,
+                              guint32 offset,
+                              gboolean is_main,
+                              ExifParse* parse) {
+  guint16 count = 0;
+  g_autofree guint8* entries = tiff_read_ifd(reader, offset, &count);
+  if (entries == nullptr) return 0;
+
+  MediaExif* exif = parse->exif;
+  guint32 jpeg_offset = 0;
+  guint32 jpeg_length = 0;
+  guint32 compression = 0;
+  guint32 strip_offset = 0;
+  guint32 strip_length = 0;
+  for (guint i = 0; i < count; i++) {
+    const guint8* entry = entries + i * 12;
+    guint16 tag = tiff_u16(reader, entry);
+    if (!is_main && tag != TAG_JPEG_OFFSET && tag != TAG_JPEG_LENGTH &&
+        tag != TAG_COMPRESSION && tag != TAG_STRIP_OFFSETS &&
+        tag != TAG_STRIP_BYTE_COUNTS) {
+      continue;
+    }
+    switch (tag) {
+      case TAG_ORIENTATION: {
+        guint32 orientation = tiff_entry_value(reader, entry);
+        if (orientation >= 1 && orientation <= 8) {
+          exif->orientation = orientation;
+        }
+        break;
+      }
+      case TAG_MAKE:
+        tiff_entry_string(reader, entry, parse->make, sizeof(parse->make));
+        break;
+      case TAG_MODEL:
+        tiff_entry_string(reader, entry, exif->camera_model,
+                          sizeof(exif->camera_model));
+        break;
+      case TAG_DATE_TIME:
+        tiff_entry_string(reader, entry, parse->dates[DATE_MODIFIED],
+                          DATE_SIZE);
+        break;
+      case TAG_EXIF_IFD:
+        exif_parse_exif_ifd(reader, tiff_entry_value(reader, entry), parse);
+        break;
+      case TAG_GPS_IFD:
+        exif_parse_gps_ifd(reader, tiff_entry_value(reader, entry), parse);
+        break;
+      case TAG_JPEG_OFFSET:
+        jpeg_offset = tiff_entry_value(reader, entry);
+        break;
+      case TAG_JPEG_LENGTH:
+        jpeg_length = tiff_entry_value(reader, entry);
+        break;
+      case TAG_COMPRESSION:
+        compression = tiff_entry_value(reader, entry);
+        break;
+      // A preview stored as a single JPEG strip, as in CR2 and DNG files.
+      case TAG_STRIP_OFFSETS:
+        if (tiff_entry_count(reader, entry) == 1) {
+          strip_offset = tiff_entry_value(reader, entry);
+        }
+        break;
+      case TAG_STRIP_BYTE_COUNTS:
+        if (tiff_entry_count(reader, entry) == 1) {
+          strip_length = tiff_entry_value(reader, entry);
+        }
+        break;
+      case TAG_SUB_IFDS:
+        exif_parse_sub_ifds(reader, entry, parse);
+        break;
+    }
+  }
+
+  exif_add_preview(exif, reader, jpeg_offset, jpeg_length);
+  if (compression == COMPRESSION_OLD_JPEG || compression == COMPRESSION_JPEG) {
+    exif_add_preview(exif, reader, strip_offset, strip_length);
+  }
+  return tiff_u32(reader, entries + count * 12);
+}
+
+// Parses the TIFF structure behind |reader|: IFD0 with its sub-IFDs, then
+// IFD1, which holds the EXIF thumbnail.
+static gboolean exif_parse_tiff(TiffReader* reader, ExifParse* parse) {
+  guint8 header[8];
+  if (!tiff_read(reader, 0, header, sizeof(header))) return FALSE;
+  if (memcmp(header, "II*\0", 4) == 0) {
+    reader->big_endian = FALSE;
+  } else if (memcmp(header, "MM\0*", 4) == 0) {
+    reader->big_endian = TRUE;
+  } else {
+    return FALSE;
+  }
+
+  guint32 ifd1 = exif_parse_ifd(reader, tiff_u32(reader, header + 4), TRUE,
+                                parse);
+  exif_parse_ifd(reader, ifd1, FALSE, parse);
+  return TRUE;
+}
+
+// Copies the value of the XMP property |name| into |buffer|, whether it is
+// written as an attribute or as an element.
+static gboolean xmp_find_property(const gchar* xmp,
+                                  gsize length,
+                                  const gchar* name,
+                                  gchar* buffer,
+                                  gsize size) {
+  const gchar* end = xmp + length;
+  gsize name_length = strlen(name);
+  for (const gchar* p = g_strstr_len(xmp, length, name); p != nullptr;
+       p = g_strstr_len(p + 1, end - p - 1, name)) {
+    const gchar* value = p + name_length;
+    gchar terminator;
+    if (value + 2 <= end && value[0] == '=' &&
+        (value[1] == '"' || value[1] == '\'')) {
+      terminator = value[1];
+      value += 2;
+    } else if (value < end && value[0] == '>') {
+      terminator = '<';
+      value++;
+    } else {
+      continue;
+    }
+    const gchar* value_end = value;
+    while (value_end < end && *value_end != terminator) value_end++;
+    if (value_end == end) return FALSE;
+    gsize value_length = MIN((gsize)(value_end - value), size - 1);
+    memcpy(buffer, value, value_length);
+    buffer[value_length] = '\0';
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// Finds the APP1 EXIF and XMP segments among the segments before the image
+// data and parses them in memory.
+static gboolean exif_read_jpeg(int fd,
+                               const guint8* head,
+                               gsize head_length,
+                               ExifParse* parse,
+                               gchar* xmp_date,
+                               gsize xmp_date_size) {
+  gboolean found = FALSE;
+  gboolean has_exif = FALSE;
+  guint64 offset = 2;
+  for (int i = 0; i < MAX_JPEG_SEGMENTS; i++) {
+    guint8 marker[4];
+    if (offset + sizeof(marker) <= head_length) {
+      memcpy(marker, head + offset, sizeof(marker));
+    } else if (!read_full(fd, offset, marker, sizeof(marker))) {
+      break;
+    }
+    // EXIF and XMP data always precede the frame and scan headers.
+    if (marker[0] != 0xff || marker[1] == 0xda ||
+        (marker[1] >= 0xc0 && marker[1] <= 0xcf)) {
+      break;
+    }
+
+    guint16 length = (guint16)((marker[2] << 8) | marker[3]);
+    if (length < 2) break;
+    if (marker[1] == 0xe1 && length > 16) {
+      gsize segment_length = length - 2;
+      g_autofree guint8* segment =
+          static_cast<guint8*>(g_malloc(segment_length));
+      if (!read_full(fd, offset + 4, segment, segment_length)) break;
+      const gchar* text = reinterpret_cast<const gchar*>(segment);
+      if (memcmp(segment, "Exif\0\0", 6) == 0 && !has_exif) {
+        TiffReader reader = {fd, offset + 10, segment + 6, segment_length - 6,
+                             FALSE};
+        has_exif = exif_parse_tiff(&reader, parse);
+        found |= has_exif;
+      } else if (segment_length > sizeof(XMP_SIGNATURE) &&
+                 memcmp(segment, XMP_SIGNATURE, sizeof(XMP_SIGNATURE)) == 0) {
+        const gchar* xmp = text + sizeof(XMP_SIGNATURE);
+        gsize xmp_length = segment_length - sizeof(XMP_SIGNATURE);
+        found |= xmp_find_property(xmp, xmp_length, "exif:DateTimeOriginal",
+                                   xmp_date, xmp_date_size) ||
+                 xmp_find_property(xmp, xmp_length, "photoshop:DateCreated",
+                                   xmp_date, xmp_date_size) ||
+                 xmp_find_property(xmp, xmp_length, "xmp:CreateDate",
+                                   xmp_date, xmp_date_size);
+      }
+    }
+    offset += 2 + length;
+  }
+  return found;
+}
+
+// Parses a "+HH:MM" offset into seconds east of UTC.
+static gboolean parse_utc_offset(const gchar* text, gint32* seconds) {
+  int hours, minutes;
+  if ((text[0] != '+' && text[0] != '-') ||
+      sscanf(text + 1, "%2d:%2d", &hours, &minutes) != 2) {
+    return FALSE;
+  }
+  *seconds = (hours * 3600 + minutes * 60) * (text[0] == '-' ? -1 : 1);
+  return TRUE;
+}
+
+// Converts an EXIF "YYYY:MM:DD HH:MM:SS" date to seconds since the epoch.
+static gint64 parse_exif_date(const gchar* date, const gchar* offset_time) {
+  int year, month, day, hour, minute, second;
+  if (sscanf(date, "%4d:%2d:%2d %2d:%2d:%2d", &year, &month, &day, &hour,
+             &minute, &second) != 6 ||
+      year < 1800) {
+    return 0;
+  }
+  gint32 offset = 0;
+  GTimeZone* zone = parse_utc_offset(offset_time, &offset)
+                        ? g_time_zone_new_offset(offset)
+                        : g_time_zone_new_local();
+  GDateTime* time =
+      g_date_time_new(zone, year, month, day, hour, minute, second);
+  g_time_zone_unref(zone);
+  if (time == nullptr) return 0;
+  gint64 result = g_date_time_to_unix(time);
+  g_date_time_unref(time);
+  return result;
+}
+
+// Converts an XMP ISO 8601 date, with or without an offset, to seconds since
+// the epoch.
+static gint64 parse_xmp_date(const gchar* date) {
+  GTimeZone* zone = g_time_zone_new_local();
+  GDateTime* time = g_date_time_new_from_iso8601(date, zone);
+  g_time_zone_unref(zone);
+  if (time == nullptr) return 0;
+  gint64 result = g_date_time_to_unix(time);
+  g_date_time_unref(time);
+  return result;
+}
+
+static gdouble coordinate_degrees(const gdouble values[3]) {
+  return values[0] + values[1] / 60 + values[2] / 3600;
+}
+
+// Fills the fields of |parse->exif| that combine several tags.
+static void exif_finish(ExifParse* parse, const gchar* xmp_date) {
+  MediaExif* exif = parse->exif;
+  for (int i = 0; i < N_DATES && exif->date_taken == 0; i++) {
+    if (parse->dates[i][0] == '\0') continue;
+    // The offset tag only describes DateTimeOriginal.
+    exif->date_taken = parse_exif_date(
+        parse->dates[i], i == DATE_ORIGINAL ? parse->offset_time : "");
+  }
+  if (exif->date_taken == 0 && xmp_date[0] != '\0') {
+    exif->date_taken = parse_xmp_date(xmp_date);
+  }
+
+  // Most vendors repeat the make in the model ("Canon EOS R5"), some do not
+  // ("NIKON CORPORATION" and "NIKON Z 6").
+  if (exif->camera_model[0] == '\0') {
+    g_strlcpy(exif->camera_model, parse->make, sizeof(exif->camera_model));
+  }
+
+  if (parse->has_latitude && parse->has_longitude) {
+    exif->has_location = TRUE;
+    exif->latitude = coordinate_degrees(parse->latitude);
+    exif->longitude = coordinate_degrees(parse->longitude);
+    if (parse->latitude_ref[0] == 'S') exif->latitude = -exif->latitude;
+    if (parse->longitude_ref[0] == 'W') exif->longitude = -exif->longitude;
+  }
+}
+
+gboolean media_exif_read(const gchar* path, MediaExif* exif) {
+  g_return_val_if_fail(path != nullptr, FALSE);
+  memset(exif, 0, sizeof(*exif));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return FALSE;
+
+  guint8 head[HEAD_SIZE];
+  ssize_t n;
+  do {
+    n = read(fd, head, sizeof(head));
+  } while (n < 0 && errno == EINTR);
+
+  ExifParse parse = {};
+  parse.exif = exif;
+  gchar xmp_date[40] = "";
+  gboolean found = FALSE;
+  if (n >= 4 && head[0] == 0xff && head[1] == 0xd8) {
+    found = exif_read_jpeg(fd, head, n, &parse, xmp_date, sizeof(xmp_date));
+  } else if (n >= 8) {
+    // TIFF-based RAW formats are one big TIFF structure read in place.
+    TiffReader reader = {fd, 0, nullptr, 0, FALSE};
+    found = exif_parse_tiff(&reader, &parse);
+  }
+  close(fd);
+  if (found) exif_finish(&parse, xmp_date);
+  return found;
+}
+
+GBytes* media_exif_load_preview(const gchar* path,
+                                const MediaExifPreview* preview) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+
+  guint8* data = static_cast<guint8*>(g_malloc(preview->length));
+  gboolean complete = read_full(fd, preview->offset, data, preview->length);
+  close(fd);
+  if (!complete) {
+    g_free(data);
+    return nullptr;
+  }
+  return g_bytes_new_take(data, preview->length);
+}
@@ -0,0 +1,47 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_EXIF_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_EXIF_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Minimal EXIF reader for JPEG files (APP1 segment) and TIFF-based RAW
+// formats such as DNG, CR2, NEF and ARW. Only the IFD entries are read; for
+// a camera JPEG that is the first few KB of the file. The XMP packet of a
+// JPEG is consulted for the capture date when the EXIF data has none.
+
+#define MEDIA_EXIF_MAX_PREVIEWS 4
+#define MEDIA_EXIF_CAMERA_MODEL_SIZE 64
+
+// An embedded JPEG preview, e.g. the 160x120 EXIF thumbnail or the larger
+// previews RAW files carry.
+typedef struct {
+  guint64 offset;  // From the start of the file.
+  guint32 length;
+} MediaExifPreview;
+
+typedef struct {
+  guint16 orientation;  // EXIF orientation 1-8, or 0 when absent.
+  // DateTimeOriginal, falling back to DateTimeDigitized and DateTime, in
+  // seconds since the epoch, or 0 when absent. Taken as local time unless
+  // the file records its UTC offset.
+  gint64 date_taken;
+  gchar camera_model[MEDIA_EXIF_CAMERA_MODEL_SIZE];  // Empty when absent.
+  gboolean has_location;
+  gdouble latitude;  // Degrees, negative south of the equator.
+  gdouble longitude;  // Degrees, negative west of Greenwich.
+  MediaExifPreview previews[MEDIA_EXIF_MAX_PREVIEWS];  // Smallest first.
+  guint n_previews;
+} MediaExif;
+
+// Reads the EXIF data of the file at |path| into |exif|. Returns FALSE if
+// the file has none.
+gboolean media_exif_read(const gchar* path, MediaExif* exif);
+
+// Returns the bytes of |preview| in the file at |path|, or NULL.
+GBytes* media_exif_load_preview(const gchar* path,
+                                const MediaExifPreview* preview);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_EXIF_H_
@@ -0,0 +1,64 @@
+#include "media_filter.h"
+
+#include <fnmatch.h>
+#include <string.h>
+
+struct _MediaFilter {
+  gchar** include;  // NULL when every file is included.
+  gchar** exclude;  // NULL when nothing is excluded.
+};
+
+static gboolean patterns_are_empty(const gchar* const* patterns) {
+  return patterns == nullptr || patterns[0] == nullptr;
+}
+
+// Returns TRUE if any of |patterns| matches |relative_path|.
+static gboolean patterns_match(gchar** patterns, const gchar* relative_path) {
+  const gchar* slash = strrchr(relative_path, '/');
+  const gchar* name = slash != nullptr ? slash + 1 : relative_path;
+  for (gchar** pattern = patterns; *pattern != nullptr; pattern++) {
+    const gchar* subject =
+        strchr(*pattern, '/') != nullptr ? relative_path : name;
+    if (fnmatch(*pattern, subject, FNM_CASEFOLD) == 0) return TRUE;
+  }
+  return FALSE;
+}
+
+MediaFilter* media_filter_new(const gchar* const* include,
+                              const gchar* const* exclude) {
+  if (patterns_are_empty(include) && patterns_are_empty(exclude)) {
+    return nullptr;
+  }
+  MediaFilter* self = g_new0(MediaFilter, 1);
+  if (!patterns_are_empty(include)) {
+    self->include = g_strdupv(const_cast<gchar**>(include));
+  }
+  if (!patterns_are_empty(exclude)) {
+    self->exclude = g_strdupv(const_cast<gchar**>(exclude));
+  }
+  return self;
+}
+
+gboolean media_filter_visit_directory(const MediaFilter* self,
+                                      const gchar* relative_path) {
+  if (self == nullptr || self->exclude == nullptr) return TRUE;
+  return !patterns_match(self->exclude, relative_path);
+}
+
+gboolean media_filter_match_file(const MediaFilter* self,
+                                 const gchar* relative_path) {
+  if (self == nullptr) return TRUE;
+  if (self->exclude != nullptr &&
+      patterns_match(self->exclude, relative_path)) {
+    return FALSE;
+  }
+  return self->include == nullptr ||
+         patterns_match(self->include, relative_path);
+}
+
+void media_filter_free(MediaFilter* self) {
+  if (self == nullptr) return;
+  g_strfreev(self->include);
+  g_strfreev(self->exclude);
+  g_free(self);
+}
@@ -0,0 +1,40 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_FILTER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_FILTER_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Include and exclude globs for one library root.
+//
+// Patterns use fnmatch(3) syntax and match case-insensitively, so "*.jpg"
+// also takes "IMG_0001.JPG". A pattern without a slash is matched against
+// the last component of a path, like "Screenshots" or ".thumbnails"; one
+// with a slash is matched against the whole path relative to the root, in
+// which "*" also crosses slashes, so "2019/*" covers everything below 2019.
+//
+// An excluded directory is not walked at all. Include patterns only apply
+// to files: when there are any, a file has to match one of them.
+typedef struct _MediaFilter MediaFilter;
+
+// Returns a filter for the NULL-terminated pattern lists, either of which may
+// be NULL, or NULL if both are empty; every function below accepts a NULL
+// filter and lets everything through.
+MediaFilter* media_filter_new(const gchar* const* include,
+                              const gchar* const* exclude);
+
+// Returns TRUE if the directory at |relative_path| below the root, and so
+// possibly what it holds, should be walked.
+gboolean media_filter_visit_directory(const MediaFilter* self,
+                                      const gchar* relative_path);
+
+// Returns TRUE if the file at |relative_path| below the root should be
+// indexed.
+gboolean media_filter_match_file(const MediaFilter* self,
+                                 const gchar* relative_path);
+
+void media_filter_free(MediaFilter* self);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_FILTER_H_
@@ -0,0 +1,178 @@
+#include "media_hash.h"
+
+#include <algorithm>
+
+// The hash compares horizontally adjacent cells, so one more column than
+// bits per row.
+#define HASH_COLUMNS 9
+#define HASH_ROWS 8
+
+// Marks the end of a child or sibling list.
+#define NO_NODE G_MAXUINT
+
+guint64 media_hash_compute(GdkPixbuf* pixbuf) {
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  gint channels = gdk_pixbuf_get_n_channels(pixbuf);
+  const guint8* pixels = gdk_pixbuf_read_pixels(pixbuf);
+
+  // Mean luma of each cell, in 1/256ths. Images narrower or shorter than
+  // the grid repeat their pixels across cells.
+  guint32 cells[HASH_ROWS][HASH_COLUMNS];
+  for (gint row = 0; row < HASH_ROWS; row++) {
+    gint y0 = row * height / HASH_ROWS;
+    gint y1 = MAX((row + 1) * height / HASH_ROWS, y0 + 1);
+    for (gint column = 0; column < HASH_COLUMNS; column++) {
+      gint x0 = column * width / HASH_COLUMNS;
+      gint x1 = MAX((column + 1) * width / HASH_COLUMNS, x0 + 1);
+      guint64 sum = 0;
+      for (gint y = y0; y < y1; y++) {
+        const guint8* pixel = pixels + (gsize)y * rowstride + x0 * channels;
+        for (gint x = x0; x < x1; x++, pixel += channels) {
+          // BT.601 luma in 8.8 fixed point.
+          sum += 77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2];
+        }
+      }
+      cells[row][column] = sum / ((guint64)(y1 - y0) * (x1 - x0));
+    }
+  }
+
+  guint64 hash = 0;
+  for (gint row = 0; row < HASH_ROWS; row++) {
+    for (gint column = 0; column < HASH_COLUMNS - 1; column++) {
+      hash <<= 1;
+      hash |= cells[row][column] > cells[row][column + 1];
+    }
+  }
+  return hash;
+}
+
+// A BK-tree node. Children hang off a sibling list, keyed by their distance
+// to the parent; at most 64 distances are possible, so the lists stay
+// short while the nodes stay small.
+typedef struct {
+  guint64 hash;
+  guint first_child;
+  guint next_sibling;
+  guint distance;
+} TreeNode;
+
+static void tree_insert(GArray* nodes, guint64 hash) {
+  TreeNode node = {hash, NO_NODE, NO_NODE, 0};
+  if (nodes->len == 0) {
+    g_array_append_val(nodes, node);
+    return;
+  }
+  guint current = 0;
+  while (TRUE) {
+    node.distance =
+        media_hash_distance(g_array_index(nodes, TreeNode, current).hash, hash);
+    guint child = g_array_index(nodes, TreeNode, current).first_child;
+    while (child != NO_NODE &&
+           g_array_index(nodes, TreeNode, child).distance != node.distance) {
+      child = g_array_index(nodes, TreeNode, child).next_sibling;
+    }
+    if (child == NO_NODE) break;
+    current = child;
+  }
+  // Prepended; the order of siblings does not matter.
+  TreeNode* parent = &g_array_index(nodes, TreeNode, current);
+  node.next_sibling = parent->first_child;
+  parent->first_child = nodes->len;
+  g_array_append_val(nodes, node);
+}
+
+static guint find_root(guint* parents, guint i) {
+  while (parents[i] != i) {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+
+static void join(guint* parents, guint a, guint b) {
+  a = find_root(parents, a);
+  b = find_root(parents, b);
+  if (a != b) parents[MAX(a, b)] = MIN(a, b);
+}
+
+// Joins every node within |max_distance| of node |query| with it. By the
+// triangle inequality, only children whose distance to their parent is
+// within |max_distance| of the parent's distance to the query can hold a
+// match, which prunes most of the tree for small distances.
+static void tree_join_matches(const TreeNode* nodes,
+                              guint query,
+                              guint max_distance,
+                              GArray* stack,
+                              guint* parents) {
+  guint64 hash = nodes[query].hash;
+  g_array_set_size(stack, 0);
+  guint root = 0;
+  g_array_append_val(stack, root);
+  while (stack->len > 0) {
+    guint current = g_array_index(stack, guint, stack->len - 1);
+    g_array_set_size(stack, stack->len - 1);
+    guint distance = media_hash_distance(nodes[current].hash, hash);
+    // Each pair is found from both ends, so only one end joins it.
+    if (distance <= max_distance && current > query) {
+      join(parents, query, current);
+    }
+    for (guint child = nodes[current].first_child; child != NO_NODE;
+         child = nodes[child].next_sibling) {
+      guint edge = nodes[child].distance;
+      if (edge + max_distance >= distance && edge <= distance + max_distance) {
+        g_array_append_val(stack, child);
+      }
+    }
+  }
+}
+
+GPtrArray* media_hash_group(const guint64* hashes,
+                            guint n_hashes,
+                            guint max_distance) {
+  GPtrArray* groups = g_ptr_array_new_with_free_func(
+      reinterpret_cast<GDestroyNotify>(g_array_unref));
+  if (n_hashes < 2) return groups;
+
+  // Exact duplicates, the bulk of the matches in a real library, share one
+  // node, so the tree only holds distinct hashes.
+  g_autofree guint* order = g_new(guint, n_hashes);
+  for (guint i = 0; i < n_hashes; i++) order[i] = i;
+  std::sort(order, order + n_hashes, [hashes](guint a, guint b) {
+    return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : a < b;
+  });
+  g_autofree guint* node_of = g_new(guint, n_hashes);
+  g_autoptr(GArray) nodes = g_array_new(FALSE, FALSE, sizeof(TreeNode));
+  for (guint i = 0; i < n_hashes; i++) {
+    guint64 hash = hashes[order[i]];
+    if (i == 0 || hash != hashes[order[i - 1]]) tree_insert(nodes, hash);
+    node_of[order[i]] = nodes->len - 1;
+  }
+
+  g_autofree guint* parents = g_new(guint, nodes->len);
+  for (guint n = 0; n < nodes->len; n++) parents[n] = n;
+  g_autoptr(GArray) stack = g_array_new(FALSE, FALSE, sizeof(guint));
+  for (guint n = 0; n < nodes->len && max_distance > 0; n++) {
+    tree_join_matches(reinterpret_cast<const TreeNode*>(nodes->data), n,
+                      max_distance, stack, parents);
+  }
+
+  // Clusters of one distinct hash still count when several files share it.
+  g_autofree guint* sizes = g_new0(guint, nodes->len);
+  for (guint i = 0; i < n_hashes; i++) {
+    sizes[find_root(parents, node_of[i])]++;
+  }
+  g_autofree GArray** clusters = g_new0(GArray*, nodes->len);
+  for (guint i = 0; i < n_hashes; i++) {
+    guint root = find_root(parents, node_of[i]);
+    if (sizes[root] < 2) continue;
+    if (clusters[root] == nullptr) {
+      clusters[root] = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+                                         sizes[root]);
+      g_ptr_array_add(groups, clusters[root]);
+    }
+    g_array_append_val(clusters[root], i);
+  }
+  return groups;
+}
@@ -0,0 +1,42 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_HASH_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_HASH_H_
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Perceptual hashes for finding duplicate and near-duplicate images.
+//
+// The hash is a 64-bit difference hash (dHash): the image is reduced to 9x8
+// grayscale and each bit says whether a cell is brighter than its right
+// neighbour. Copies that were resaved, rescaled or lightly edited, and
+// shots of a burst, land within a few bits of each other, so similarity is
+// the Hamming distance between two hashes.
+
+// Distance at or below which two images count as near duplicates unless
+// the caller asks otherwise.
+#define MEDIA_HASH_DEFAULT_MAX_DISTANCE 6
+
+// Returns the difference hash of |pixbuf|, an 8-bit RGB or RGBA image of
+// any size. Alpha is ignored.
+guint64 media_hash_compute(GdkPixbuf* pixbuf);
+
+// Returns the number of bits in which |a| and |b| differ.
+static inline guint media_hash_distance(guint64 a, guint64 b) {
+  return __builtin_popcountll(a ^ b);
+}
+
+// Groups |hashes| into clusters whose members are each within
+// |max_distance| of another member. Identical hashes are merged first, and
+// the remaining distinct hashes are matched through a BK-tree, so a lookup
+// only visits the branches that can hold a match instead of every hash.
+// Returns a GPtrArray of GArrays of guint indices into |hashes|, one per
+// cluster of at least two, each in ascending order and ordered by their
+// first index.
+GPtrArray* media_hash_group(const guint64* hashes,
+                            guint n_hashes,
+                            guint max_distance);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_HASH_H_
@@ -0,0 +1,1348 @@
+#include "media_index.h"
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "media_exif.h"
+#include "media_hash.h"
+#include "media_placeholder.h"
+#include "media_probe.h"
+#include "media_stat.h"
+#include "media_video.h"
+
+// Bump MEDIA_INDEX_VERSION whenever the header or record layout changes;
+// saved indexes with another version are discarded and rebuilt.
+#define MEDIA_INDEX_MAGIC "PGPMIDX"
+#define MEDIA_INDEX_VERSION 7
+#define MEDIA_INDEX_BYTE_ORDER 0x01020304
+
+// Changes are published once the library has been quiet for
+// PUBLISH_DELAY_MS, or after PUBLISH_MAX_DELAY_MS while changes keep coming.
+#define PUBLISH_DELAY_MS 250
+#define PUBLISH_MAX_DELAY_MS 2000
+
+// Files handed to a metadata or placeholder worker at a time.
+#define METADATA_BATCH_SIZE 64
+
+// Placeholders are computed PLACEHOLDER_ROUND_SIZE files at a time, so
+// changes and requests are handled in between. Publishing rebuilds the
+// snapshot, so rounds are published every PLACEHOLDER_PUBLISH_INTERVAL_MS,
+// which still gives the first albums theirs long before a large library is
+// done. Saving writes the whole index, so they are only saved every
+// PLACEHOLDER_SAVE_INTERVAL_MS. Both happen once the stage is done.
+#define PLACEHOLDER_ROUND_SIZE 512
+#define PLACEHOLDER_PUBLISH_INTERVAL_MS 1000
+#define PLACEHOLDER_SAVE_INTERVAL_MS (30 * 1000)
+
+#define DIR_WATCH_MASK                                               \
+  (IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | \
+   IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR)
+
+typedef struct {
+  char magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 n_albums;
+  guint32 n_records;
+  guint32 strings_size;
+  guint32 root;  // Offset of the library root in the string pool.
+} IndexHeader;
+
+// Keeps both tables 8-byte aligned behind the header.
+G_STATIC_ASSERT(sizeof(IndexHeader) == 32);
+G_STATIC_ASSERT(sizeof(MediaAlbumRecord) % 8 == 0);
+G_STATIC_ASSERT(sizeof(MediaRecord) % 8 == 0);
+
+typedef struct {
+  MediaIndexSnapshot view;  // Must be first.
+  gint ref_count;
+  // IndexHeader, album table, record table and string pool, back to back.
+  gchar* data;
+  gsize size;
+
+  // Sorted album views, built on demand.
+  GMutex orders_mutex;
+  GHashTable* orders;  // gint64* order key -> RecordOrder*
+} Snapshot;
+
+typedef struct {
+  guint n_records;
+  guint32 records[];
+} RecordOrder;
+
+// What the index thread knows about one file.
+typedef struct {
+  guint32 kind;
+  gint64 size;
+  gint64 mtime;
+  gint32 width;
+  gint32 height;
+  gint64 date_taken;
+  gdouble latitude;
+  gdouble longitude;
+  const gchar* camera_model;  // Interned; NULL when unknown.
+  guint16 orientation;
+  guint16 flags;  // MediaRecordFlags.
+  gint64 duration_ms;
+  gchar placeholder[MEDIA_PLACEHOLDER_MAX_LENGTH + 1];
+  guint64 hash;
+} MediaItem;
+
+// What the index thread knows about one directory.
+typedef struct {
+  int watch;        // -1 when it could not be watched.
+  gint depth;       // Levels below the root.
+  gboolean hidden;  // Holds a .nomedia marker.
+} DirState;
+
+struct _MediaIndex {
+  gchar* root;
+  gchar* cache_file;
+  MediaFilter* filter;
+
+  GMutex mutex;
+  GCond cond;
+  Snapshot* snapshot;  // NULL until the first one is published.
+  // Requests for the index thread, which is woken through |wake_fd|.
+  MediaScanOptions requested_options;
+  gboolean rescan_requested;
+  gboolean stop_requested;
+
+  GThread* thread;
+  int wake_fd;
+  // Stat and head reads of this root when io_uring is not used.
+  MediaStatPool* stat_pool;
+
+  // Owned by the index thread. While a scan runs, its workers share the
+  // tables below under |scan_mutex|.
+  GMutex scan_mutex;
+  MediaScanOptions options;
+  int inotify_fd;
+  gboolean watch_limit_reported;
+  gint64 last_publish;  // Monotonic time of the last publish of |items|.
+  gboolean unpublished;  // Placeholders were computed since then.
+  gint64 last_save;      // Monotonic time of the last save.
+  gboolean unsaved;      // The published snapshot has not been saved.
+  GHashTable* items;    // gchar* path -> MediaItem*
+  // Set of gchar* paths that may still lack a placeholder, so the stage
+  // does not have to walk |items|. Paths that are gone are dropped lazily.
+  GHashTable* unplaced;
+  GHashTable* dirs;     // gchar* directory path -> DirState*
+  GHashTable* watches;  // GINT_TO_POINTER(watch) -> gchar* directory path
+};
+
+// Wraps a validated data block.
+static Snapshot* snapshot_new_take(gchar* data, gsize size) {
+  const IndexHeader* header = reinterpret_cast<const IndexHeader*>(data);
+  Snapshot* snapshot = g_new0(Snapshot, 1);
+  snapshot->ref_count = 1;
+  snapshot->data = data;
+  snapshot->size = size;
+
+  gchar* cursor = data + sizeof(IndexHeader);
+  snapshot->view.albums = reinterpret_cast<const MediaAlbumRecord*>(cursor);
+  snapshot->view.n_albums = header->n_albums;
+  cursor += header->n_albums * sizeof(MediaAlbumRecord);
+  snapshot->view.records = reinterpret_cast<const MediaRecord*>(cursor);
+  snapshot->view.n_records = header->n_records;
+  cursor += header->n_records * sizeof(MediaRecord);
+  snapshot->view.strings = cursor;
+  snapshot->view.root = cursor + header->root;
+  g_mutex_init(&snapshot->orders_mutex);
+  return snapshot;
+}
+
+static gboolean snapshot_data_is_valid(const gchar* data,
+                                       gsize size,
+                                       const gchar* root) {
+  if (size < sizeof(IndexHeader)) return FALSE;
+  const IndexHeader* header = reinterpret_cast<const IndexHeader*>(data);
+  if (memcmp(header->magic, MEDIA_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != MEDIA_INDEX_VERSION ||
+      header->byte_order != MEDIA_INDEX_BYTE_ORDER) {
+    return FALSE;
+  }
+
+  guint64 expected = sizeof(IndexHeader) +
+                     (guint64)header->n_albums * sizeof(MediaAlbumRecord) +
+                     (guint64)header->n_records * sizeof(MediaRecord) +
+                     header->strings_size;
+  if (expected != size || header->strings_size == 0) return FALSE;
+
+  const gchar* strings = data + size - header->strings_size;
+  guint32 strings_size = header->strings_size;
+  if (strings[strings_size - 1] != '\0' || header->root >= strings_size ||
+      g_strcmp0(strings + header->root, root) != 0) {
+    return FALSE;
+  }
+
+  const MediaAlbumRecord* albums =
+      reinterpret_cast<const MediaAlbumRecord*>(data + sizeof(IndexHeader));
+  for (guint32 i = 0; i < header->n_albums; i++) {
+    if (albums[i].path >= strings_size || albums[i].name >= strings_size ||
+        (guint64)albums[i].first + albums[i].count > header->n_records ||
+        (albums[i].image_cover >= header->n_records &&
+         albums[i].image_cover != MEDIA_INDEX_NO_RECORD) ||
+        (albums[i].video_cover >= header->n_records &&
+         albums[i].video_cover != MEDIA_INDEX_NO_RECORD)) {
+      return FALSE;
+    }
+  }
+  const MediaRecord* records =
+      reinterpret_cast<const MediaRecord*>(albums + header->n_albums);
+  for (guint32 i = 0; i < header->n_records; i++) {
+    if (records[i].path >= strings_size || records[i].name >= strings_size ||
+        records[i].camera_model >= strings_size ||
+        records[i].placeholder >= strings_size ||
+        records[i].album >= header->n_albums) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+MediaIndexSnapshot* media_index_snapshot_ref(MediaIndexSnapshot* snapshot) {
+  g_atomic_int_inc(&reinterpret_cast<Snapshot*>(snapshot)->ref_count);
+  return snapshot;
+}
+
+void media_index_snapshot_unref(MediaIndexSnapshot* snapshot) {
+  Snapshot* self = reinterpret_cast<Snapshot*>(snapshot);
+  if (g_atomic_int_dec_and_test(&self->ref_count)) {
+    g_clear_pointer(&self->orders, g_hash_table_unref);
+    g_mutex_clear(&self->orders_mutex);
+    g_free(self->data);
+    g_free(self);
+  }
+}
+
+const MediaAlbumRecord* media_index_snapshot_find_album(
+    const MediaIndexSnapshot* snapshot,
+    const gchar* album_id) {
+  if (album_id == nullptr) return nullptr;
+  gboolean by_path = g_path_is_absolute(album_id);
+  for (guint i = 0; i < snapshot->n_albums; i++) {
+    const MediaAlbumRecord* album = &snapshot->albums[i];
+    guint32 key = by_path ? album->path : album->name;
+    if (strcmp(media_index_snapshot_string(snapshot, key), album_id) == 0) {
+      return album;
+    }
+  }
+
+  // Names were the album IDs before hashed ones, so both are accepted.
+  gchar* end = nullptr;
+  guint64 id = g_ascii_strtoull(album_id, &end, 16);
+  if (by_path || end - album_id != 16 || *end != '\0') return nullptr;
+  for (guint i = 0; i < snapshot->n_albums; i++) {
+    if (snapshot->albums[i].id == id) return &snapshot->albums[i];
+  }
+  return nullptr;
+}
+
+static bool album_path_less(const MediaAlbumRecord& album,
+                            const std::pair<const MediaIndexSnapshot*,
+                                            const gchar*>& key) {
+  return strcmp(media_index_snapshot_string(key.first, album.path),
+                key.second) < 0;
+}
+
+static bool record_name_less(const MediaRecord& record,
+                             const std::pair<const MediaIndexSnapshot*,
+                                             const gchar*>& key) {
+  return strcmp(media_index_snapshot_string(key.first, record.name),
+                key.second) < 0;
+}
+
+const MediaRecord* media_index_snapshot_find_record(
+    const MediaIndexSnapshot* snapshot,
+    const gchar* path) {
+  const gchar* slash = path != nullptr ? strrchr(path, '/') : nullptr;
+  if (slash == nullptr) return nullptr;
+  g_autofree gchar* dir = g_strndup(path, slash - path);
+
+  // Albums are sorted by path and their records by name.
+  const MediaAlbumRecord* albums_end = snapshot->albums + snapshot->n_albums;
+  const MediaAlbumRecord* album = std::lower_bound(
+      snapshot->albums, albums_end, std::make_pair(snapshot, (const gchar*)dir),
+      album_path_less);
+  if (album == albums_end ||
+      strcmp(media_index_snapshot_string(snapshot, album->path), dir) != 0) {
+    return nullptr;
+  }
+  const MediaRecord* first = snapshot->records + album->first;
+  const MediaRecord* last = first + album->count;
+  const MediaRecord* record = std::lower_bound(
+      first, last, std::make_pair(snapshot, slash + 1), record_name_less);
+  if (record == last ||
+      strcmp(media_index_snapshot_string(snapshot, record->name), slash + 1) !=
+          0) {
+    return nullptr;
+  }
+  return record;
+}
+
+typedef struct {
+  gint64 key;
+  guint32 record;
+} SortEntry;
+
+// Records are stored in name order, so comparing positions breaks ties by
+// name.
+static bool sort_entry_less(const SortEntry& a, const SortEntry& b) {
+  return a.key != b.key ? a.key < b.key : a.record < b.record;
+}
+
+// Sorts the records [first, first + count).
+static RecordOrder* record_order_new(const MediaIndexSnapshot* snapshot,
+                                     guint32 first,
+                                     guint32 count,
+                                     guint32 kinds,
+                                     MediaSortKey sort) {
+  RecordOrder* order = static_cast<RecordOrder*>(
+      g_malloc(sizeof(RecordOrder) + count * sizeof(guint32)));
+  SortEntry* entries = sort == MEDIA_SORT_NAME
+                           ? nullptr
+                           : g_new(SortEntry, count);
+  guint n = 0;
+  for (guint32 i = first; i < first + count; i++) {
+    const MediaRecord* record = &snapshot->records[i];
+    if ((record->kind & kinds) == 0) continue;
+    if (entries == nullptr) {
+      order->records[n++] = i;
+    } else {
+      gint64 key = record->mtime;
+      if (sort == MEDIA_SORT_SIZE) {
+        key = record->size;
+      } else if (sort == MEDIA_SORT_DATE_TAKEN && record->date_taken != 0) {
+        key = record->date_taken;
+      }
+      entries[n++] = {key, i};
+    }
+  }
+  if (entries != nullptr) {
+    std::sort(entries, entries + n, sort_entry_less);
+    for (guint i = 0; i < n; i++) order->records[i] = entries[i].record;
+    g_free(entries);
+  }
+  order->n_records = n;
+  return order;
+}
+
+const guint32* media_index_snapshot_get_order(MediaIndexSnapshot* snapshot,
+                                              const MediaAlbumRecord* album,
+                                              guint32 kinds,
+                                              MediaSortKey sort,
+                                              guint* n_records) {
+  Snapshot* self = reinterpret_cast<Snapshot*>(snapshot);
+  // The whole snapshot is keyed as the album past the last one.
+  gint64 album_index =
+      album != nullptr ? album - snapshot->albums : snapshot->n_albums;
+  gint64 key = (album_index << 16) | ((kinds & 0xff) << 8) | sort;
+
+  g_mutex_lock(&self->orders_mutex);
+  if (self->orders == nullptr) {
+    self->orders = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                         g_free);
+  }
+  RecordOrder* order =
+      static_cast<RecordOrder*>(g_hash_table_lookup(self->orders, &key));
+  if (order == nullptr) {
+    order = album != nullptr
+                ? record_order_new(snapshot, album->first, album->count, kinds,
+                                   sort)
+                : record_order_new(snapshot, 0, snapshot->n_records, kinds,
+                                   sort);
+    gint64* stored_key = g_new(gint64, 1);
+    *stored_key = key;
+    g_hash_table_insert(self->orders, stored_key, order);
+  }
+  g_mutex_unlock(&self->orders_mutex);
+
+  *n_records = order->n_records;
+  return order->records;
+}
+
+gboolean media_index_snapshot_save(const MediaIndexSnapshot* snapshot,
+                                   const gchar* path,
+                                   GError** error) {
+  const Snapshot* self = reinterpret_cast<const Snapshot*>(snapshot);
+  g_autofree gchar* dir = g_path_get_dirname(path);
+  if (g_mkdir_with_parents(dir, 0700) != 0) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to create %s: %s", dir, g_strerror(saved_errno));
+    return FALSE;
+  }
+  return g_file_set_contents(path, self->data, self->size, error);
+}
+
+MediaIndexSnapshot* media_index_snapshot_load(const gchar* path,
+                                              const gchar* root,
+                                              GError** error) {
+  gchar* data = nullptr;
+  gsize size = 0;
+  if (!g_file_get_contents(path, &data, &size, error)) {
+    return nullptr;
+  }
+  if (!snapshot_data_is_valid(data, size, root)) {
+    g_free(data);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not a usable media index", path);
+    return nullptr;
+  }
+  return &snapshot_new_take(data, size)->view;
+}
+
+// Classifies a file by name alone, so listing never reads file contents.
+static guint32 media_kind_for_name(const gchar* name) {
+  g_autofree gchar* content_type = g_content_type_guess(name, nullptr, 0,
+                                                        nullptr);
+  if (g_content_type_is_a(content_type, "image/*")) return MEDIA_KIND_IMAGE;
+  if (g_content_type_is_a(content_type, "video/*")) return MEDIA_KIND_VIDEO;
+  return 0;
+}
+
+typedef struct {
+  const gchar* path;
+  const gchar* name;
+  guint32 album;
+  const MediaItem* item;
+} BuildEntry;
+
+static gint build_entry_compare(gconstpointer a, gconstpointer b) {
+  const BuildEntry* entry_a = static_cast<const BuildEntry*>(a);
+  const BuildEntry* entry_b = static_cast<const BuildEntry*>(b);
+  if (entry_a->album != entry_b->album) {
+    return entry_a->album < entry_b->album ? -1 : 1;
+  }
+  return strcmp(entry_a->name, entry_b->name);
+}
+
+static gint path_compare(gconstpointer a, gconstpointer b) {
+  return strcmp(*static_cast<const gchar* const*>(a),
+                *static_cast<const gchar* const*>(b));
+}
+
+// Derives an album's ID from its absolute path.
+static guint64 album_id_for_path(const gchar* path) {
+  g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  g_checksum_update(checksum, reinterpret_cast<const guchar*>(path), -1);
+  guint8 digest[32];
+  gsize digest_length = sizeof(digest);
+  g_checksum_get_digest(checksum, digest, &digest_length);
+  guint64 id = 0;
+  for (gint i = 0; i < 8; i++) id = id << 8 | digest[i];
+  return id;
+}
+
+// Appends |string| to the pool at |cursor| and returns its offset.
+static guint32 pool_append(gchar* strings, gsize* cursor, const gchar* string) {
+  gsize length = strlen(string) + 1;
+  guint32 offset = *cursor;
+  memcpy(strings + offset, string, length);
+  *cursor += length;
+  return offset;
+}
+
+// Lays out the index thread's current state as a snapshot: albums sorted by
+// path, records grouped by album and sorted by name. Every directory below
+// the root that is not hidden is an album.
+static Snapshot* index_build_snapshot(MediaIndex* self) {
+  g_autoptr(GPtrArray) album_paths =
+      g_ptr_array_sized_new(g_hash_table_size(self->dirs));
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, self->dirs);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    const DirState* dir = static_cast<const DirState*>(value);
+    if (dir->depth > 0 && !dir->hidden) g_ptr_array_add(album_paths, key);
+  }
+  g_ptr_array_sort(album_paths, path_compare);
+
+  g_autoptr(GHashTable) album_numbers = g_hash_table_new(g_str_hash,
+                                                         g_str_equal);
+  gsize root_length = strlen(self->root);
+  // The root, then the empty string unknown camera models and missing
+  // placeholders point to.
+  gsize strings_size = root_length + 2;
+  for (guint i = 0; i < album_paths->len; i++) {
+    const gchar* path = static_cast<const gchar*>(album_paths->pdata[i]);
+    g_hash_table_insert(album_numbers, (gpointer)path, GUINT_TO_POINTER(i + 1));
+    strings_size += strlen(path) + 1;
+  }
+
+  // Camera models are interned, and stored once per snapshot. Maps each to
+  // its pool offset once it has been appended.
+  g_autoptr(GHashTable) camera_models = g_hash_table_new(g_direct_hash,
+                                                         g_direct_equal);
+  g_autoptr(GArray) entries = g_array_sized_new(
+      FALSE, FALSE, sizeof(BuildEntry), g_hash_table_size(self->items));
+  g_hash_table_iter_init(&iter, self->items);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    const gchar* path = static_cast<const gchar*>(key);
+    const gchar* slash = strrchr(path, '/');
+    if (slash == nullptr) continue;
+    g_autofree gchar* dir = g_strndup(path, slash - path);
+    guint album = GPOINTER_TO_UINT(g_hash_table_lookup(album_numbers, dir));
+    if (album == 0) continue;
+
+    BuildEntry entry = {path, slash + 1, album - 1,
+                        static_cast<const MediaItem*>(value)};
+    g_array_append_val(entries, entry);
+    strings_size += strlen(path) + 1;
+    if (entry.item->placeholder[0] != '\0') {
+      strings_size += strlen(entry.item->placeholder) + 1;
+    }
+    const gchar* camera_model = entry.item->camera_model;
+    if (camera_model != nullptr &&
+        !g_hash_table_contains(camera_models, camera_model)) {
+      g_hash_table_insert(camera_models, (gpointer)camera_model, nullptr);
+      strings_size += strlen(camera_model) + 1;
+    }
+  }
+  g_array_sort(entries, build_entry_compare);
+
+  gsize size = sizeof(IndexHeader) +
+               album_paths->len * sizeof(MediaAlbumRecord) +
+               entries->len * sizeof(MediaRecord) + strings_size;
+  gchar* data = static_cast<gchar*>(g_malloc0(size));
+  IndexHeader* header = reinterpret_cast<IndexHeader*>(data);
+  memcpy(header->magic, MEDIA_INDEX_MAGIC, sizeof(header->magic));
+  header->version = MEDIA_INDEX_VERSION;
+  header->byte_order = MEDIA_INDEX_BYTE_ORDER;
+  header->n_albums = album_paths->len;
+  header->n_records = entries->len;
+  header->strings_size = strings_size;
+
+  MediaAlbumRecord* albums =
+      reinterpret_cast<MediaAlbumRecord*>(data + sizeof(IndexHeader));
+  MediaRecord* records =
+      reinterpret_cast<MediaRecord*>(albums + album_paths->len);
+  gchar* strings = reinterpret_cast<gchar*>(records + entries->len);
+  gsize cursor = 0;
+  header->root = pool_append(strings, &cursor, self->root);
+  guint32 empty_string = pool_append(strings, &cursor, "");
+
+  for (guint i = 0; i < album_paths->len; i++) {
+    const gchar* path = static_cast<const gchar*>(album_paths->pdata[i]);
+    albums[i].path = pool_append(strings, &cursor, path);
+    // The name is the part below the root.
+    albums[i].name = albums[i].path + root_length + 1;
+    albums[i].id = album_id_for_path(path);
+    albums[i].image_cover = MEDIA_INDEX_NO_RECORD;
+    albums[i].video_cover = MEDIA_INDEX_NO_RECORD;
+  }
+
+  // One pass over the records yields each album's counts, covers and
+  // newest mtime.
+  for (guint i = 0; i < entries->len; i++) {
+    const BuildEntry* entry = &g_array_index(entries, BuildEntry, i);
+    MediaAlbumRecord* album = &albums[entry->album];
+    if (album->count == 0) album->first = i;
+    album->count++;
+    if (entry->item->kind == MEDIA_KIND_IMAGE && album->image_count++ == 0) {
+      album->image_cover = i;
+    }
+    if (entry->item->kind == MEDIA_KIND_VIDEO && album->video_count++ == 0) {
+      album->video_cover = i;
+    }
+    album->newest_mtime = MAX(album->newest_mtime, entry->item->mtime);
+
+    MediaRecord* record = &records[i];
+    record->path = pool_append(strings, &cursor, entry->path);
+    record->name = record->path + (entry->name - entry->path);
+    record->album = entry->album;
+    record->kind = entry->item->kind;
+    record->size = entry->item->size;
+    record->mtime = entry->item->mtime;
+    record->width = entry->item->width;
+    record->height = entry->item->height;
+    record->date_taken = entry->item->date_taken;
+    record->latitude = entry->item->latitude;
+    record->longitude = entry->item->longitude;
+    record->orientation = entry->item->orientation;
+    record->flags = entry->item->flags;
+    record->duration_ms = entry->item->duration_ms;
+    record->hash = entry->item->hash;
+    record->placeholder =
+        entry->item->placeholder[0] != '\0'
+            ? pool_append(strings, &cursor, entry->item->placeholder)
+            : empty_string;
+    record->camera_model = empty_string;
+    const gchar* camera_model = entry->item->camera_model;
+    if (camera_model != nullptr) {
+      // Offset 0 is the root, so it doubles as "not appended yet".
+      record->camera_model = GPOINTER_TO_UINT(
+          g_hash_table_lookup(camera_models, camera_model));
+      if (record->camera_model == 0) {
+        record->camera_model = pool_append(strings, &cursor, camera_model);
+        g_hash_table_insert(camera_models, (gpointer)camera_model,
+                            GUINT_TO_POINTER(record->camera_model));
+      }
+    }
+  }
+
+  return snapshot_new_take(data, size);
+}
+
+static void index_publish(MediaIndex* self, Snapshot* snapshot) {
+  g_mutex_lock(&self->mutex);
+  Snapshot* old = self->snapshot;
+  self->snapshot = snapshot;
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->mutex);
+  if (old != nullptr) media_index_snapshot_unref(&old->view);
+}
+
+// Saves the published snapshot for the next start. Only called from the
+// index thread, which is the only one replacing it.
+static void index_save(MediaIndex* self) {
+  self->last_save = g_get_monotonic_time();
+  self->unsaved = FALSE;
+  g_autoptr(GError) error = nullptr;
+  if (!media_index_snapshot_save(&self->snapshot->view, self->cache_file,
+                                 &error)) {
+    g_debug("Failed to save media index: %s", error->message);
+  }
+}
+
+// Publishes the current state of |items|.
+static void index_publish_items(MediaIndex* self) {
+  index_publish(self, index_build_snapshot(self));
+  self->last_publish = g_get_monotonic_time();
+  self->unpublished = FALSE;
+}
+
+// Publishes the current state and saves it for the next start.
+static void index_commit(MediaIndex* self) {
+  index_publish_items(self);
+  index_save(self);
+}
+
+// Publishes and saves the placeholders computed since the last time, if
+// there are any.
+static void index_flush_placeholders(MediaIndex* self) {
+  if (self->unpublished) {
+    index_publish_items(self);
+    self->unsaved = TRUE;
+  }
+  if (self->unsaved) index_save(self);
+}
+
+// Directory reads are latency bound on network mounts, so walk with a few
+// threads even on small machines.
+static gint get_scan_thread_count() {
+  return CLAMP((gint)g_get_num_processors(), 2, 8);
+}
+
+// Adds or refreshes the |n_names| files |names| in |dir_path|. What
+// |previous| knows about a file is reused when its size and mtime are
+// unchanged. Stats and opens relative to |dir_fd|, or by full path when it
+// is -1, a batch at a time so network mounts see the requests together.
+// Files directly in the root belong to no album and are not indexed, nor
+// are files the filter leaves out. Safe to call from scan workers.
+static void index_update_files(MediaIndex* self,
+                               int dir_fd,
+                               const gchar* dir_path,
+                               const gchar* const* names,
+                               guint n_names,
+                               GHashTable* previous) {
+  if (strcmp(dir_path, self->root) == 0) return;
+
+  // Full paths, for the table and for stats without a directory.
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+  g_autoptr(GArray) files = g_array_new(FALSE, FALSE, sizeof(MediaStatFile));
+  for (guint i = 0; i < n_names; i++) {
+    if (media_kind_for_name(names[i]) == 0) continue;
+    gchar* path = g_build_filename(dir_path, names[i], nullptr);
+    if (!media_filter_match_file(self->filter,
+                                 path + strlen(self->root) + 1)) {
+      g_free(path);
+      continue;
+    }
+    MediaStatFile file = {};
+    file.name = dir_fd >= 0 ? names[i] : path;
+    g_ptr_array_add(paths, path);
+    g_array_append_val(files, file);
+  }
+  if (files->len == 0) return;
+  int at_fd = dir_fd >= 0 ? dir_fd : AT_FDCWD;
+  media_stat_files(self->stat_pool, at_fd,
+                   &g_array_index(files, MediaStatFile, 0), files->len);
+
+  g_autofree MediaItem** items = g_new0(MediaItem*, files->len);
+  g_autofree MediaStatHead* heads = g_new(MediaStatHead, files->len);
+  g_autofree guint* head_items = g_new(guint, files->len);
+  guint n_heads = 0;
+  if (previous != nullptr) g_mutex_lock(&self->scan_mutex);
+  for (guint i = 0; i < files->len; i++) {
+    const MediaStatFile* file = &g_array_index(files, MediaStatFile, i);
+    if (file->error != 0 || !file->regular) continue;
+    const gchar* path = static_cast<const gchar*>(paths->pdata[i]);
+    MediaItem* item = g_new0(MediaItem, 1);
+    item->kind = media_kind_for_name(path);
+    item->size = file->size;
+    item->mtime = file->mtime;
+    const MediaItem* known =
+        previous != nullptr
+            ? static_cast<const MediaItem*>(g_hash_table_lookup(previous, path))
+            : nullptr;
+    if (known != nullptr && known->kind == item->kind &&
+        known->size == item->size && known->mtime == item->mtime) {
+      *item = *known;
+    } else if (item->kind == MEDIA_KIND_IMAGE) {
+      // Capture metadata is read later by index_extract_metadata(), as are
+      // the dimensions of videos, which need a demuxer.
+      heads[n_heads].name = file->name;
+      head_items[n_heads++] = i;
+    }
+    items[i] = item;
+  }
+  if (previous != nullptr) g_mutex_unlock(&self->scan_mutex);
+
+  media_stat_read_heads(self->stat_pool, at_fd, heads, n_heads);
+  for (guint h = 0; h < n_heads; h++) {
+    if (heads[h].fd < 0) continue;
+    MediaItem* item = items[head_items[h]];
+    media_probe_image_size_from_head(
+        static_cast<const gchar*>(paths->pdata[head_items[h]]), heads[h].fd,
+        heads[h].head, heads[h].head_length, &item->width, &item->height);
+  }
+  media_stat_close_heads(self->stat_pool, heads, n_heads);
+
+  g_mutex_lock(&self->scan_mutex);
+  for (guint i = 0; i < files->len; i++) {
+    gchar* path = static_cast<gchar*>(paths->pdata[i]);
+    if (items[i] == nullptr) {
+      g_hash_table_remove(self->items, path);
+    } else {
+      if (!(items[i]->flags & MEDIA_RECORD_HAS_PLACEHOLDER)) {
+        g_hash_table_add(self->unplaced, g_strdup(path));
+      }
+      g_hash_table_replace(self->items, path, items[i]);
+      paths->pdata[i] = nullptr;
+    }
+  }
+  g_mutex_unlock(&self->scan_mutex);
+}
+
+static gboolean index_stop_requested(MediaIndex* self) {
+  g_mutex_lock(&self->mutex);
+  gboolean stop = self->stop_requested;
+  g_mutex_unlock(&self->mutex);
+  return stop;
+}
+
+typedef struct {
+  MediaIndex* self;
+  guint n_items;
+  const gchar* paths[METADATA_BATCH_SIZE];
+  MediaItem* items[METADATA_BATCH_SIZE];
+} MetadataBatch;
+
+// Runs on a metadata worker. Each item belongs to exactly one batch and the
+// index thread leaves the table alone until all batches are done, so no
+// locking is needed.
+static void index_read_metadata(gpointer data, gpointer user_data) {
+  MetadataBatch* batch = static_cast<MetadataBatch*>(data);
+  if (index_stop_requested(batch->self)) {
+    g_free(batch);
+    return;
+  }
+  for (guint i = 0; i < batch->n_items; i++) {
+    MediaItem* item = batch->items[i];
+    MediaExif exif;
+    MediaVideoInfo video;
+    if (item->kind == MEDIA_KIND_VIDEO) {
+      if (media_video_probe(batch->paths[i], &video, nullptr)) {
+        item->duration_ms = video.duration_ms;
+        item->width = video.width;
+        item->height = video.height;
+      }
+    } else if (media_exif_read(batch->paths[i], &exif)) {
+      item->date_taken = exif.date_taken;
+      item->orientation = exif.orientation;
+      item->camera_model = exif.camera_model[0] != '\0'
+                               ? g_intern_string(exif.camera_model)
+                               : nullptr;
+      if (exif.has_location) {
+        item->latitude = exif.latitude;
+        item->longitude = exif.longitude;
+        item->flags |= MEDIA_RECORD_HAS_LOCATION;
+      }
+    }
+    item->flags |= MEDIA_RECORD_HAS_METADATA;
+  }
+  g_free(batch);
+}
+
+// Runs on a placeholder worker, like index_read_metadata(). A decode takes
+// far longer than reading EXIF data, so a stop is checked for every file.
+// The perceptual hash of an image comes from the same small decode.
+static void index_compute_placeholders(gpointer data, gpointer user_data) {
+  MetadataBatch* batch = static_cast<MetadataBatch*>(data);
+  for (guint i = 0; i < batch->n_items; i++) {
+    if (index_stop_requested(batch->self)) break;
+    MediaItem* item = batch->items[i];
+    g_autoptr(GdkPixbuf) source =
+        media_placeholder_load_source(batch->paths[i]);
+    item->placeholder[0] = '\0';
+    if (source != nullptr) {
+      media_placeholder_encode(source, item->placeholder);
+      if (item->kind == MEDIA_KIND_IMAGE) {
+        item->hash = media_hash_compute(source);
+        item->flags |= MEDIA_RECORD_HAS_HASH;
+      }
+    }
+    item->flags |= MEDIA_RECORD_HAS_PLACEHOLDER;
+  }
+  g_free(batch);
+}
+
+// Hands the files that do not have |flag| yet to |func| in batches on a
+// thread pool of |n_threads|, at most |limit| files, and waits for them.
+// Only the files in |candidates| are looked at if it is not NULL; those
+// handed out, done or gone are removed from it. Returns FALSE if there was
+// nothing to do.
+static gboolean index_run_stage(MediaIndex* self,
+                                guint16 flag,
+                                GFunc func,
+                                gint n_threads,
+                                guint limit,
+                                GHashTable* candidates) {
+  GThreadPool* pool = nullptr;
+  MetadataBatch* batch = nullptr;
+  guint n_items = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter,
+                         candidates != nullptr ? candidates : self->items);
+  while (n_items < limit && g_hash_table_iter_next(&iter, &key, &value)) {
+    if (candidates != nullptr) {
+      gboolean known =
+          g_hash_table_lookup_extended(self->items, key, &key, &value);
+      g_hash_table_iter_remove(&iter);
+      if (!known) continue;
+    }
+    MediaItem* item = static_cast<MediaItem*>(value);
+    if (item->flags & flag) continue;
+    if (pool == nullptr) {
+      pool = g_thread_pool_new(func, nullptr, n_threads, FALSE, nullptr);
+    }
+    if (batch == nullptr) {
+      batch = g_new0(MetadataBatch, 1);
+      batch->self = self;
+    }
+    batch->paths[batch->n_items] = static_cast<const gchar*>(key);
+    batch->items[batch->n_items] = item;
+    n_items++;
+    if (++batch->n_items == METADATA_BATCH_SIZE) {
+      g_thread_pool_push(pool, batch, nullptr);
+      batch = nullptr;
+    }
+  }
+  if (pool == nullptr) return FALSE;
+  if (batch != nullptr) g_thread_pool_push(pool, batch, nullptr);
+  g_thread_pool_free(pool, FALSE, TRUE);
+  return TRUE;
+}
+
+// Reads the capture metadata or video information of every file that does
+// not have it yet. Returns FALSE if there was nothing to read.
+static gboolean index_extract_metadata(MediaIndex* self) {
+  return index_run_stage(self, MEDIA_RECORD_HAS_METADATA, index_read_metadata,
+                         get_scan_thread_count(), G_MAXUINT, nullptr);
+}
+
+// Publishes the capture metadata read for the files listed since the last
+// call, if there were any.
+static void index_commit_metadata(MediaIndex* self) {
+  if (index_extract_metadata(self)) index_commit(self);
+}
+
+// Decoding is CPU bound and competes with the thumbnails on screen, so
+// placeholders get at most half the cores.
+static gint get_placeholder_thread_count() {
+  return CLAMP((gint)g_get_num_processors() / 2, 1, 4);
+}
+
+// Computes the placeholders of up to PLACEHOLDER_ROUND_SIZE files that do
+// not have one yet, publishing and saving them when their interval is up.
+// Returns FALSE if every file has one.
+static gboolean index_commit_placeholders(MediaIndex* self) {
+  if (!index_run_stage(self, MEDIA_RECORD_HAS_PLACEHOLDER,
+                       index_compute_placeholders,
+                       get_placeholder_thread_count(), PLACEHOLDER_ROUND_SIZE,
+                       self->unplaced)) {
+    index_flush_placeholders(self);
+    return FALSE;
+  }
+  self->unpublished = TRUE;
+  gint64 now = g_get_monotonic_time();
+  if (now - self->last_publish >= PLACEHOLDER_PUBLISH_INTERVAL_MS * 1000) {
+    index_publish_items(self);
+    self->unsaved = TRUE;
+  }
+  if (now - self->last_save >= PLACEHOLDER_SAVE_INTERVAL_MS * 1000) {
+    index_flush_placeholders(self);
+  }
+  return TRUE;
+}
+
+// Called with |scan_mutex| held.
+static void index_watch_dir(MediaIndex* self,
+                            const gchar* path,
+                            gint depth,
+                            gboolean hidden) {
+  DirState* dir = g_new(DirState, 1);
+  dir->watch = -1;
+  dir->depth = depth;
+  dir->hidden = hidden;
+  if (self->inotify_fd >= 0) {
+    dir->watch = inotify_add_watch(self->inotify_fd, path, DIR_WATCH_MASK);
+    if (dir->watch < 0 && errno == ENOSPC && !self->watch_limit_reported) {
+      g_warning("inotify watch limit reached; changes below %s are only "
+                "picked up by the next rescan", path);
+      self->watch_limit_reported = TRUE;
+    }
+  }
+  g_hash_table_replace(self->dirs, g_strdup(path), dir);
+  if (dir->watch >= 0) {
+    g_hash_table_replace(self->watches, GINT_TO_POINTER(dir->watch),
+                         g_strdup(path));
+  }
+}
+
+typedef struct {
+  MediaIndex* self;
+  GHashTable* previous;
+} ScanContext;
+
+// Excluded directories are neither watched nor walked, so they cost nothing
+// however large they are. New ones show up in their parent's events, which
+// come back here through index_scan_tree().
+static gboolean index_scan_directory(const gchar* path,
+                                     gint depth,
+                                     gboolean hidden,
+                                     gpointer user_data) {
+  MediaIndex* self = static_cast<ScanContext*>(user_data)->self;
+  if (depth > 0 && !media_filter_visit_directory(
+                       self->filter, path + strlen(self->root) + 1)) {
+    return FALSE;
+  }
+  g_mutex_lock(&self->scan_mutex);
+  index_watch_dir(self, path, depth, hidden);
+  g_mutex_unlock(&self->scan_mutex);
+  return TRUE;
+}
+
+static void index_scan_files(const gchar* dir_path,
+                             int dir_fd,
+                             const gchar* const* names,
+                             guint n_names,
+                             gpointer user_data) {
+  ScanContext* context = static_cast<ScanContext*>(user_data);
+  index_update_files(context->self, dir_fd, dir_path, names, n_names,
+                     context->previous);
+}
+
+// Lets media_index_free() interrupt a walk of a large or slow tree.
+static gboolean index_scan_stopped(gpointer user_data) {
+  return index_stop_requested(static_cast<ScanContext*>(user_data)->self);
+}
+
+// Walks the tree at |path|, |depth| levels below the root, adding every
+// directory and media file found. Stops early once the index is stopped,
+// leaving the tree partly listed.
+static void index_scan_tree(MediaIndex* self,
+                            const gchar* path,
+                            gint depth,
+                            GHashTable* previous) {
+  static const MediaScanCallbacks callbacks = {
+      index_scan_directory, index_scan_files, index_scan_stopped};
+  ScanContext context = {self, previous};
+  media_scan(path, depth, &self->options, &callbacks, get_scan_thread_count(),
+             &context);
+}
+
+// Returns TRUE if |path| lies anywhere below |dir|.
+static gboolean path_is_below(const gchar* path, const gchar* dir) {
+  gsize length = strlen(dir);
+  return strncmp(path, dir, length) == 0 && path[length] == '/';
+}
+
+// Forgets the directory |path|, everything below it and their watches. The
+// files' items are moved to |removed| if it is not NULL.
+static void index_remove_tree(MediaIndex* self,
+                              const gchar* path,
+                              GHashTable* removed) {
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, self->dirs);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    const gchar* dir_path = static_cast<const gchar*>(key);
+    if (strcmp(dir_path, path) != 0 && !path_is_below(dir_path, path)) {
+      continue;
+    }
+    int watch = static_cast<DirState*>(value)->watch;
+    if (watch >= 0) {
+      inotify_rm_watch(self->inotify_fd, watch);
+      g_hash_table_remove(self->watches, GINT_TO_POINTER(watch));
+    }
+    g_hash_table_iter_remove(&iter);
+  }
+
+  g_hash_table_iter_init(&iter, self->items);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if (!path_is_below(static_cast<const gchar*>(key), path)) continue;
+    if (removed != nullptr) {
+      g_hash_table_iter_steal(&iter);
+      g_hash_table_replace(removed, key, value);
+    } else {
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+}
+
+// Rescans the whole library, reusing what is already known about files whose
+// size and mtime have not changed.
+static void index_reconcile(MediaIndex* self) {
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init(&iter, self->watches);
+  while (g_hash_table_iter_next(&iter, &key, nullptr)) {
+    inotify_rm_watch(self->inotify_fd, GPOINTER_TO_INT(key));
+  }
+  g_hash_table_remove_all(self->watches);
+  g_hash_table_remove_all(self->dirs);
+
+  GHashTable* previous = self->items;
+  self->items = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  index_scan_tree(self, self->root, 0, previous);
+  g_hash_table_unref(previous);
+}
+
+static void index_handle_event(MediaIndex* self,
+                               const struct inotify_event* event) {
+  if (event->mask & IN_Q_OVERFLOW) {
+    index_reconcile(self);
+    return;
+  }
+
+  const gchar* watched = static_cast<const gchar*>(
+      g_hash_table_lookup(self->watches, GINT_TO_POINTER(event->wd)));
+  if (watched == nullptr) return;
+  g_autofree gchar* dir_path = g_strdup(watched);
+  const DirState* dir =
+      static_cast<const DirState*>(g_hash_table_lookup(self->dirs, dir_path));
+  if (dir == nullptr) return;
+  gint depth = dir->depth;
+
+  if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+    index_remove_tree(self, dir_path, nullptr);
+    return;
+  }
+  if (event->len == 0) return;
+
+  // The marker hides or reveals the directory and everything below it. The
+  // rescan reuses what is known about files still shown, as a reconcile does.
+  if (strcmp(event->name, MEDIA_SCAN_NO_MEDIA_MARKER) == 0) {
+    GHashTable* previous =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    index_remove_tree(self, dir_path, previous);
+    index_scan_tree(self, dir_path, depth, previous);
+    g_hash_table_unref(previous);
+    return;
+  }
+  if (dir->hidden) return;
+
+  g_autofree gchar* path = g_build_filename(dir_path, event->name, nullptr);
+  if (event->mask & IN_ISDIR) {
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+      if (media_scan_should_visit(&self->options, event->name, depth + 1)) {
+        index_scan_tree(self, path, depth + 1, nullptr);
+      }
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+      index_remove_tree(self, path, nullptr);
+    }
+    return;
+  }
+
+  if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+    g_hash_table_remove(self->items, path);
+  } else {
+    const gchar* name = event->name;
+    index_update_files(self, -1, dir_path, &name, 1, self->items);
+  }
+}
+
+// Wakes the index thread to look at its requests.
+static void index_wake(MediaIndex* self) {
+  guint64 wake = 1;
+  if (write(self->wake_fd, &wake, sizeof(wake)) != sizeof(wake)) {
+    g_warning("Failed to wake the media index thread");
+  }
+}
+
+// Applies inotify events and requested rescans until the index is stopped,
+// publishing batches of changes, and computes placeholders while idle.
+static void index_follow_changes(MediaIndex* self) {
+  gchar buffer[16 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  gboolean dirty = FALSE;
+  gint64 first_change = 0;
+  gboolean placeholders_pending = TRUE;
+
+  while (TRUE) {
+    int timeout = -1;
+    if (dirty) {
+      gint64 waited = (g_get_monotonic_time() - first_change) / 1000;
+      timeout = CLAMP(PUBLISH_MAX_DELAY_MS - waited, 0, PUBLISH_DELAY_MS);
+    } else if (placeholders_pending) {
+      timeout = 0;
+    }
+
+    struct pollfd fds[2] = {{self->wake_fd, POLLIN, 0},
+                            {self->inotify_fd, POLLIN, 0}};
+    int ready = poll(fds, self->inotify_fd >= 0 ? 2 : 1, timeout);
+    if (ready < 0 && errno == EINTR) continue;
+    if (ready < 0) break;
+    if (fds[0].revents != 0) {
+      guint64 count;
+      if (read(self->wake_fd, &count, sizeof(count)) < 0) continue;
+      g_mutex_lock(&self->mutex);
+      gboolean stop = self->stop_requested;
+      gboolean rescan = self->rescan_requested;
+      self->options = self->requested_options;
+      self->rescan_requested = FALSE;
+      g_mutex_unlock(&self->mutex);
+      if (stop) {
+        // Keeps the placeholders computed since the last save.
+        index_flush_placeholders(self);
+        break;
+      }
+      if (rescan) {
+        index_reconcile(self);
+        // |items| only holds part of the library now, so nothing computed
+        // since the last publish can be kept.
+        if (index_stop_requested(self)) {
+          if (self->unsaved) index_save(self);
+          break;
+        }
+        index_commit(self);
+        index_commit_metadata(self);
+        dirty = FALSE;
+        placeholders_pending = TRUE;
+      }
+      continue;
+    }
+    if (ready == 0 && dirty) {
+      // Changes trickle in a few files at a time, so their metadata is read
+      // before publishing rather than in a second snapshot.
+      index_extract_metadata(self);
+      index_commit(self);
+      dirty = FALSE;
+      placeholders_pending = TRUE;
+      continue;
+    }
+    if (ready == 0) {
+      // Placeholders are computed a round at a time while nothing else is
+      // going on, so changes and requests are still handled in between.
+      placeholders_pending = index_commit_placeholders(self);
+      continue;
+    }
+
+    ssize_t length = read(self->inotify_fd, buffer, sizeof(buffer));
+    if (length <= 0) continue;
+    for (gchar* cursor = buffer; cursor < buffer + length;) {
+      const struct inotify_event* event =
+          reinterpret_cast<const struct inotify_event*>(cursor);
+      index_handle_event(self, event);
+      cursor += sizeof(struct inotify_event) + event->len;
+    }
+    if (!dirty) {
+      dirty = TRUE;
+      first_change = g_get_monotonic_time();
+    }
+  }
+}
+
+static gpointer index_thread_run(gpointer data) {
+  MediaIndex* self = static_cast<MediaIndex*>(data);
+
+  // Serve the saved index right away; the reconcile below then brings it up
+  // to date with whatever changed while the app was not running.
+  MediaIndexSnapshot* saved =
+      media_index_snapshot_load(self->cache_file, self->root, nullptr);
+  if (saved != nullptr) {
+    for (guint i = 0; i < saved->n_records; i++) {
+      const MediaRecord* record = &saved->records[i];
+      MediaItem* item = g_new0(MediaItem, 1);
+      item->kind = record->kind;
+      item->size = record->size;
+      item->mtime = record->mtime;
+      item->width = record->width;
+      item->height = record->height;
+      item->date_taken = record->date_taken;
+      item->latitude = record->latitude;
+      item->longitude = record->longitude;
+      item->orientation = record->orientation;
+      item->flags = record->flags;
+      item->duration_ms = record->duration_ms;
+      item->hash = record->hash;
+      g_strlcpy(item->placeholder,
+                media_index_snapshot_string(saved, record->placeholder),
+                sizeof(item->placeholder));
+      const gchar* camera_model =
+          media_index_snapshot_string(saved, record->camera_model);
+      if (camera_model[0] != '\0') {
+        item->camera_model = g_intern_string(camera_model);
+      }
+      g_hash_table_replace(
+          self->items,
+          g_strdup(media_index_snapshot_string(saved, record->path)), item);
+    }
+    index_publish(self, reinterpret_cast<Snapshot*>(saved));
+  }
+
+  // Listing first, so albums show up before the metadata of a large new
+  // library has been read.
+  index_reconcile(self);
+  // An interrupted listing is incomplete; keep the saved index instead.
+  if (index_stop_requested(self)) return nullptr;
+  index_commit(self);
+  index_commit_metadata(self);
+  index_follow_changes(self);
+  return nullptr;
+}
+
+MediaIndex* media_index_new(const gchar* root,
+                            const gchar* cache_file,
+                            const MediaScanOptions* options,
+                            MediaFilter* filter) {
+  MediaIndex* self = g_new0(MediaIndex, 1);
+  self->root = g_strdup(root);
+  self->cache_file = g_strdup(cache_file);
+  self->filter = filter;
+  g_mutex_init(&self->mutex);
+  g_cond_init(&self->cond);
+  g_mutex_init(&self->scan_mutex);
+  if (options != nullptr) {
+    self->options = *options;
+  } else {
+    self->options.max_depth = MEDIA_SCAN_DEFAULT_MAX_DEPTH;
+    self->options.skip_hidden = TRUE;
+  }
+  self->requested_options = self->options;
+  self->stat_pool = media_stat_pool_new();
+  self->wake_fd = eventfd(0, EFD_CLOEXEC);
+  self->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  self->items = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->unplaced =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, nullptr);
+  self->dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->watches = g_hash_table_new_full(g_direct_hash, g_direct_equal, nullptr,
+                                        g_free);
+  self->thread = g_thread_new("media-index", index_thread_run, self);
+  return self;
+}
+
+void media_index_set_scan_options(MediaIndex* self,
+                                  const MediaScanOptions* options) {
+  g_mutex_lock(&self->mutex);
+  self->requested_options = *options;
+  self->rescan_requested = TRUE;
+  g_mutex_unlock(&self->mutex);
+  index_wake(self);
+}
+
+MediaIndexSnapshot* media_index_get_snapshot(MediaIndex* self) {
+  g_mutex_lock(&self->mutex);
+  while (self->snapshot == nullptr) {
+    g_cond_wait(&self->cond, &self->mutex);
+  }
+  MediaIndexSnapshot* snapshot = media_index_snapshot_ref(&self->snapshot->view);
+  g_mutex_unlock(&self->mutex);
+  return snapshot;
+}
+
+MediaIndexSnapshot* media_index_try_get_snapshot(MediaIndex* self,
+                                                 gint64 end_time) {
+  g_mutex_lock(&self->mutex);
+  while (self->snapshot == nullptr) {
+    if (!g_cond_wait_until(&self->cond, &self->mutex, end_time)) break;
+  }
+  MediaIndexSnapshot* snapshot =
+      self->snapshot != nullptr
+          ? media_index_snapshot_ref(&self->snapshot->view)
+          : nullptr;
+  g_mutex_unlock(&self->mutex);
+  return snapshot;
+}
+
+// Lets waiters in media_index_wait_for_update() see the cancellation.
+static void index_wake_waiters(GCancellable* cancellable, gpointer data) {
+  MediaIndex* self = static_cast<MediaIndex*>(data);
+  g_mutex_lock(&self->mutex);
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->mutex);
+}
+
+gboolean media_index_wait_for_update(MediaIndex* self,
+                                     const MediaIndexSnapshot* snapshot,
+                                     gint64 end_time,
+                                     GCancellable* cancellable) {
+  gulong handler = 0;
+  if (cancellable != nullptr) {
+    handler = g_cancellable_connect(cancellable, G_CALLBACK(index_wake_waiters),
+                                    self, nullptr);
+  }
+  g_mutex_lock(&self->mutex);
+  while ((self->snapshot == nullptr || &self->snapshot->view == snapshot) &&
+         !g_cancellable_is_cancelled(cancellable)) {
+    if (!g_cond_wait_until(&self->cond, &self->mutex, end_time)) break;
+  }
+  gboolean updated =
+      self->snapshot != nullptr && &self->snapshot->view != snapshot;
+  g_mutex_unlock(&self->mutex);
+  // Outside the lock, as it waits for a callback running elsewhere.
+  g_cancellable_disconnect(cancellable, handler);
+  return updated;
+}
+
+void media_index_free(MediaIndex* self) {
+  g_mutex_lock(&self->mutex);
+  self->stop_requested = TRUE;
+  g_mutex_unlock(&self->mutex);
+  index_wake(self);
+  g_thread_join(self->thread);
+
+  if (self->inotify_fd >= 0) close(self->inotify_fd);
+  close(self->wake_fd);
+  media_stat_pool_free(self->stat_pool);
+  g_hash_table_unref(self->items);
+  g_hash_table_unref(self->unplaced);
+  g_hash_table_unref(self->dirs);
+  g_hash_table_unref(self->watches);
+  if (self->snapshot != nullptr) {
+    media_index_snapshot_unref(&self->snapshot->view);
+  }
+  g_mutex_clear(&self->scan_mutex);
+  g_cond_clear(&self->cond);
+  g_mutex_clear(&self->mutex);
+  media_filter_free(self->filter);
+  g_free(self->cache_file);
+  g_free(self->root);
+  g_free(self);
+}
@@ -0,0 +1,204 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_INDEX_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_INDEX_H_
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "media_filter.h"
+#include "media_scanner.h"
+
+G_BEGIN_DECLS
+
+// In-memory index of the media under a library root, persisted between runs
+// and kept current with inotify.
+//
+// The index is published as immutable snapshots. A snapshot is one
+// contiguous block holding an album table, a media record table and a string
+// pool, which is also exactly what is written to disk, so loading it at
+// startup is a single read. Queries work on a snapshot reference and never
+// touch the filesystem; a background thread owns all scanning, watching and
+// saving, and swaps in a new snapshot after each batch of changes.
+typedef struct _MediaIndex MediaIndex;
+
+typedef enum {
+  MEDIA_KIND_IMAGE = 1 << 0,
+  MEDIA_KIND_VIDEO = 1 << 1,
+} MediaKind;
+
+#define MEDIA_KIND_ANY (MEDIA_KIND_IMAGE | MEDIA_KIND_VIDEO)
+
+// One media file. String fields are offsets into the snapshot string pool.
+typedef struct {
+  guint32 path;   // Absolute path.
+  guint32 name;   // File name; the tail of |path|.
+  guint32 album;  // Index in the snapshot album table.
+  guint32 kind;   // A single MediaKind.
+  gint64 size;
+  gint64 mtime;   // Seconds since the epoch.
+  gint32 width;   // 0 when unknown.
+  gint32 height;
+  // Capture metadata from the file's EXIF data, or the duration and
+  // dimensions of a video, filled in by a background stage after the file
+  // is listed; see MEDIA_RECORD_HAS_METADATA.
+  gint64 date_taken;      // Seconds since the epoch, or 0 when unknown.
+  gdouble latitude;       // Valid with MEDIA_RECORD_HAS_LOCATION.
+  gdouble longitude;
+  guint32 camera_model;   // Pool offset; the empty string when unknown.
+  guint16 orientation;    // EXIF orientation 1-8, or 0 when unknown.
+  guint16 flags;          // MediaRecordFlags.
+  gint64 duration_ms;     // Videos only; 0 when unknown.
+  // Pool offset of the BlurHash placeholder, filled in by a later
+  // background stage; the empty string until then, or when the file could
+  // not be decoded. See MEDIA_RECORD_HAS_PLACEHOLDER.
+  guint32 placeholder;
+  guint32 reserved;
+  // Perceptual hash of an image, computed with the placeholder; valid with
+  // MEDIA_RECORD_HAS_HASH. See media_hash.h.
+  guint64 hash;
+} MediaRecord;
+
+typedef enum {
+  // The capture metadata fields have been read for this size and mtime.
+  MEDIA_RECORD_HAS_METADATA = 1 << 0,
+  MEDIA_RECORD_HAS_LOCATION = 1 << 1,
+  // The placeholder has been computed for this size and mtime.
+  MEDIA_RECORD_HAS_PLACEHOLDER = 1 << 2,
+  // |hash| has been computed for this size and mtime. Only images that
+  // could be decoded have one.
+  MEDIA_RECORD_HAS_HASH = 1 << 3,
+} MediaRecordFlags;
+
+// Marks an album without a cover of some kind.
+#define MEDIA_INDEX_NO_RECORD G_MAXUINT32
+
+// One directory below the library root, at any depth. Its records are the
+// contiguous range [first, first + count) of the record table, sorted by
+// name.
+typedef struct {
+  guint32 path;  // Absolute path.
+  guint32 name;  // Path relative to the library root, e.g. "2024/Trip".
+  guint32 first;
+  guint32 count;
+  guint32 image_count;
+  guint32 video_count;
+  gint64 newest_mtime;  // Newest media mtime, or 0 for an empty album.
+  // First image and first video in name order, as positions in the record
+  // table, or MEDIA_INDEX_NO_RECORD.
+  guint32 image_cover;
+  guint32 video_cover;
+  // The album ID: the leading 64 bits of the SHA-256 of |path|, so it stays
+  // the same across runs and rescans, and is unique across library roots.
+  // Printed with MEDIA_INDEX_ALBUM_ID_FORMAT.
+  guint64 id;
+} MediaAlbumRecord;
+
+#define MEDIA_INDEX_ALBUM_ID_FORMAT "%016" G_GINT64_MODIFIER "x"
+
+typedef enum {
+  MEDIA_SORT_NAME,
+  MEDIA_SORT_DATE_ADDED,  // By mtime.
+  MEDIA_SORT_SIZE,
+  MEDIA_SORT_DATE_TAKEN,  // By date_taken, or mtime when it is unknown.
+} MediaSortKey;
+
+// Read-only view of one published snapshot.
+typedef struct {
+  const MediaAlbumRecord* albums;
+  guint n_albums;
+  const MediaRecord* records;
+  guint n_records;
+  const gchar* strings;
+  const gchar* root;
+} MediaIndexSnapshot;
+
+// Returns the pool string at |offset|.
+static inline const gchar* media_index_snapshot_string(
+    const MediaIndexSnapshot* snapshot,
+    guint32 offset) {
+  return snapshot->strings + offset;
+}
+
+// Creates an index of |root| and starts its background thread, which loads
+// the snapshot saved in |cache_file| (if any, and if it was built for the
+// same root and format version), reconciles it with the filesystem and then
+// follows changes. Each batch of new or changed files is published as soon
+// as it is listed; their capture metadata, or video duration and
+// dimensions, is read on a thread pool afterwards and published with the next
+// snapshot. Placeholders and the perceptual hashes of images need a
+// decode, so they come last and are published a few hundred files at a
+// time. The tree is walked with |options|, or with the defaults when it is
+// NULL, and only what |filter| lets through is indexed. The index takes
+// ownership of |filter|, which may be NULL.
+MediaIndex* media_index_new(const gchar* root,
+                            const gchar* cache_file,
+                            const MediaScanOptions* options,
+                            MediaFilter* filter);
+
+// Changes the walk options and rescans the library in the background. The
+// current snapshot stays available until the rescan has been published.
+void media_index_set_scan_options(MediaIndex* self,
+                                  const MediaScanOptions* options);
+
+// Returns a reference to the current snapshot. Blocks until the first one is
+// available, i.e. until the saved index is loaded or, without one, until the
+// first scan has finished.
+MediaIndexSnapshot* media_index_get_snapshot(MediaIndex* self);
+
+// Like media_index_get_snapshot(), but waits for the first snapshot only
+// until the monotonic time |end_time| and returns NULL if there is none by
+// then.
+MediaIndexSnapshot* media_index_try_get_snapshot(MediaIndex* self,
+                                                 gint64 end_time);
+
+// Waits until a snapshot other than |snapshot| is published, until the
+// monotonic time |end_time| or until |cancellable| is cancelled, whichever
+// comes first. Returns TRUE if a newer snapshot was published.
+gboolean media_index_wait_for_update(MediaIndex* self,
+                                     const MediaIndexSnapshot* snapshot,
+                                     gint64 end_time,
+                                     GCancellable* cancellable);
+
+MediaIndexSnapshot* media_index_snapshot_ref(MediaIndexSnapshot* snapshot);
+void media_index_snapshot_unref(MediaIndexSnapshot* snapshot);
+
+// Returns the album whose ID, name or absolute path is |album_id|, or NULL.
+const MediaAlbumRecord* media_index_snapshot_find_album(
+    const MediaIndexSnapshot* snapshot,
+    const gchar* album_id);
+
+// Returns the record of the file at the absolute |path|, or NULL.
+const MediaRecord* media_index_snapshot_find_record(
+    const MediaIndexSnapshot* snapshot,
+    const gchar* path);
+
+// Returns the positions in |snapshot->records| of the media of |album|, or
+// of the whole snapshot when |album| is NULL, whose kind is in |kinds|, in
+// ascending |sort| order with ties in album and name order. Each order is
+// computed on first use and cached in the snapshot, so paging through an
+// album sorts it once. The result lives as long as |snapshot|.
+const guint32* media_index_snapshot_get_order(MediaIndexSnapshot* snapshot,
+                                              const MediaAlbumRecord* album,
+                                              guint32 kinds,
+                                              MediaSortKey sort,
+                                              guint* n_records);
+
+// Writes |snapshot| to |path| atomically.
+gboolean media_index_snapshot_save(const MediaIndexSnapshot* snapshot,
+                                   const gchar* path,
+                                   GError** error);
+
+// Reads a snapshot written by media_index_snapshot_save(). Fails if the file
+// is damaged, has another format version or was built for another |root|.
+MediaIndexSnapshot* media_index_snapshot_load(const gchar* path,
+                                              const gchar* root,
+                                              GError** error);
+
+// Stops the background thread and releases the index. Snapshots still
+// referenced elsewhere stay valid.
+void media_index_free(MediaIndex* self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(MediaIndexSnapshot, media_index_snapshot_unref)
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_INDEX_H_
@@ -0,0 +1,302 @@
+#include "media_library.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+// How long after a root is added queries wait for its first snapshot before
+// leaving it out.
+#define LIBRARY_FIRST_SCAN_WAIT_MS 1000
+
+// One root and its index, shared by the library and any query still using
+// it, so replacing the roots never stops an index under a running query.
+typedef struct {
+  gint ref_count;
+  gchar* path;
+  gchar* key;  // Hash of the path and filter; names the cache file.
+  MediaIndex* index;
+  gint64 created;  // Monotonic time the root was added.
+} LibraryRoot;
+
+struct _MediaLibrary {
+  gchar* cache_dir;
+
+  GMutex mutex;
+  GPtrArray* roots;  // LibraryRoot*, in the order they were given.
+  MediaScanOptions options;
+};
+
+static LibraryRoot* library_root_ref(LibraryRoot* root) {
+  g_atomic_int_inc(&root->ref_count);
+  return root;
+}
+
+static void library_root_unref(gpointer data) {
+  LibraryRoot* root = static_cast<LibraryRoot*>(data);
+  if (!g_atomic_int_dec_and_test(&root->ref_count)) return;
+  media_index_free(root->index);
+  g_free(root->key);
+  g_free(root->path);
+  g_free(root);
+}
+
+// Returns TRUE if |path| is |dir| or lies anywhere below it.
+static gboolean path_contains(const gchar* dir, const gchar* path) {
+  gsize length = strlen(dir);
+  if (strncmp(path, dir, length) != 0) return FALSE;
+  return path[length] == '\0' || path[length] == '/' ||
+         dir[length - 1] == '/';
+}
+
+static void checksum_update_patterns(GChecksum* checksum,
+                                     const gchar* kind,
+                                     const gchar* const* patterns) {
+  for (gint i = 0; patterns != nullptr && patterns[i] != nullptr; i++) {
+    g_checksum_update(checksum, reinterpret_cast<const guchar*>(kind), 1);
+    g_checksum_update(checksum, reinterpret_cast<const guchar*>(patterns[i]),
+                      strlen(patterns[i]) + 1);
+  }
+}
+
+// Identifies a root by everything that decides what its index holds.
+static gchar* library_root_key(const gchar* path, const MediaLibraryRoot* root) {
+  g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  g_checksum_update(checksum, reinterpret_cast<const guchar*>(path),
+                    strlen(path) + 1);
+  checksum_update_patterns(checksum, "+", root->include);
+  checksum_update_patterns(checksum, "-", root->exclude);
+  return g_strndup(g_checksum_get_string(checksum), 16);
+}
+
+// Returns the root of |roots| whose key is |key|, or NULL.
+static LibraryRoot* library_find_root(GPtrArray* roots, const gchar* key) {
+  for (guint i = 0; i < roots->len; i++) {
+    LibraryRoot* root = static_cast<LibraryRoot*>(roots->pdata[i]);
+    if (strcmp(root->key, key) == 0) return root;
+  }
+  return nullptr;
+}
+
+// Returns the snapshot of |root|, or NULL if it is still on its first scan
+// and was added over LIBRARY_FIRST_SCAN_WAIT_MS ago.
+static MediaIndexSnapshot* library_root_try_get_snapshot(LibraryRoot* root) {
+  return media_index_try_get_snapshot(
+      root->index, root->created + LIBRARY_FIRST_SCAN_WAIT_MS * 1000);
+}
+
+// Returns a new reference to every current root.
+static GPtrArray* library_get_roots(MediaLibrary* self) {
+  g_mutex_lock(&self->mutex);
+  GPtrArray* roots =
+      g_ptr_array_new_full(self->roots->len, library_root_unref);
+  for (guint i = 0; i < self->roots->len; i++) {
+    g_ptr_array_add(roots, library_root_ref(static_cast<LibraryRoot*>(
+                               self->roots->pdata[i])));
+  }
+  g_mutex_unlock(&self->mutex);
+  return roots;
+}
+
+MediaLibrary* media_library_new(const gchar* cache_dir) {
+  MediaLibrary* self = g_new0(MediaLibrary, 1);
+  self->cache_dir = g_strdup(cache_dir);
+  g_mutex_init(&self->mutex);
+  self->roots = g_ptr_array_new_with_free_func(library_root_unref);
+  self->options.max_depth = MEDIA_SCAN_DEFAULT_MAX_DEPTH;
+  self->options.skip_hidden = TRUE;
+  return self;
+}
+
+gboolean media_library_set_roots(MediaLibrary* self,
+                                 const MediaLibraryRoot* roots,
+                                 guint n_roots,
+                                 GError** error) {
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+  for (guint i = 0; i < n_roots; i++) {
+    if (roots[i].path == nullptr || !g_path_is_absolute(roots[i].path)) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                  "Library root %s is not an absolute path",
+                  roots[i].path != nullptr ? roots[i].path : "(null)");
+      return FALSE;
+    }
+    gchar* path = g_canonicalize_filename(roots[i].path, nullptr);
+    for (guint j = 0; j < paths->len; j++) {
+      const gchar* other = static_cast<const gchar*>(paths->pdata[j]);
+      if (path_contains(other, path) || path_contains(path, other)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Library roots %s and %s overlap", other, path);
+        g_free(path);
+        return FALSE;
+      }
+    }
+    g_ptr_array_add(paths, path);
+  }
+
+  g_mutex_lock(&self->mutex);
+  GPtrArray* replaced = self->roots;
+  self->roots = g_ptr_array_new_full(n_roots, library_root_unref);
+  for (guint i = 0; i < n_roots; i++) {
+    const gchar* path = static_cast<const gchar*>(paths->pdata[i]);
+    g_autofree gchar* key = library_root_key(path, &roots[i]);
+    LibraryRoot* root = library_find_root(replaced, key);
+    if (root != nullptr) {
+      g_ptr_array_add(self->roots, library_root_ref(root));
+      continue;
+    }
+
+    g_autofree gchar* cache_name = g_strdup_printf("index-%s.bin", key);
+    g_autofree gchar* cache_file =
+        g_build_filename(self->cache_dir, cache_name, nullptr);
+    root = g_new0(LibraryRoot, 1);
+    root->ref_count = 1;
+    root->path = g_strdup(path);
+    root->key = g_steal_pointer(&key);
+    root->created = g_get_monotonic_time();
+    root->index = media_index_new(
+        path, cache_file, &self->options,
+        media_filter_new(roots[i].include, roots[i].exclude));
+    g_ptr_array_add(self->roots, root);
+  }
+  g_mutex_unlock(&self->mutex);
+
+  // Stopping an index joins its thread, so do it outside the lock.
+  g_ptr_array_unref(replaced);
+  return TRUE;
+}
+
+void media_library_set_scan_options(MediaLibrary* self,
+                                    const MediaScanOptions* options) {
+  g_mutex_lock(&self->mutex);
+  self->options = *options;
+  for (guint i = 0; i < self->roots->len; i++) {
+    LibraryRoot* root = static_cast<LibraryRoot*>(self->roots->pdata[i]);
+    media_index_set_scan_options(root->index, options);
+  }
+  g_mutex_unlock(&self->mutex);
+}
+
+GPtrArray* media_library_get_snapshots(MediaLibrary* self, guint* n_pending) {
+  g_autoptr(GPtrArray) roots = library_get_roots(self);
+  GPtrArray* snapshots = g_ptr_array_new_full(
+      roots->len, reinterpret_cast<GDestroyNotify>(media_index_snapshot_unref));
+  for (guint i = 0; i < roots->len; i++) {
+    LibraryRoot* root = static_cast<LibraryRoot*>(roots->pdata[i]);
+    MediaIndexSnapshot* snapshot = library_root_try_get_snapshot(root);
+    if (snapshot != nullptr) g_ptr_array_add(snapshots, snapshot);
+  }
+  // With nothing to show yet, waiting is better than an empty library.
+  if (snapshots->len == 0) {
+    for (guint i = 0; i < roots->len; i++) {
+      LibraryRoot* root = static_cast<LibraryRoot*>(roots->pdata[i]);
+      g_ptr_array_add(snapshots, media_index_get_snapshot(root->index));
+    }
+  }
+  if (n_pending != nullptr) *n_pending = roots->len - snapshots->len;
+  return snapshots;
+}
+
+gboolean media_library_wait_for_update(MediaLibrary* self,
+                                       const MediaIndexSnapshot* snapshot,
+                                       gint64 end_time,
+                                       GCancellable* cancellable) {
+  LibraryRoot* root = nullptr;
+  g_autoptr(GPtrArray) roots = library_get_roots(self);
+  for (guint i = 0; i < roots->len && root == nullptr; i++) {
+    LibraryRoot* candidate = static_cast<LibraryRoot*>(roots->pdata[i]);
+    if (snapshot != nullptr) {
+      if (strcmp(candidate->path, snapshot->root) == 0) root = candidate;
+      continue;
+    }
+    MediaIndexSnapshot* first =
+        media_index_try_get_snapshot(candidate->index, 0);
+    if (first == nullptr) {
+      root = candidate;
+    } else {
+      media_index_snapshot_unref(first);
+    }
+  }
+  if (root == nullptr) return TRUE;
+
+  return media_index_wait_for_update(root->index, snapshot, end_time,
+                                     cancellable);
+}
+
+MediaIndexSnapshot* media_library_find_album(MediaLibrary* self,
+                                             const gchar* album_id,
+                                             const MediaAlbumRecord** album) {
+  if (album_id == nullptr) return nullptr;
+  gboolean by_path = g_path_is_absolute(album_id);
+  g_autoptr(GPtrArray) roots = library_get_roots(self);
+  g_autoptr(GPtrArray) pending = g_ptr_array_new();
+  for (guint i = 0; i < roots->len; i++) {
+    LibraryRoot* root = static_cast<LibraryRoot*>(roots->pdata[i]);
+    // A path can only be in the root it lies below, so the other roots'
+    // first scans are not waited for.
+    if (by_path && !path_contains(root->path, album_id)) continue;
+    MediaIndexSnapshot* snapshot = library_root_try_get_snapshot(root);
+    if (snapshot == nullptr) {
+      g_ptr_array_add(pending, root);
+      continue;
+    }
+    *album = media_index_snapshot_find_album(snapshot, album_id);
+    if (*album != nullptr) return snapshot;
+    media_index_snapshot_unref(snapshot);
+  }
+
+  // The album can only be in a root still on its first scan.
+  for (guint i = 0; i < pending->len; i++) {
+    LibraryRoot* root = static_cast<LibraryRoot*>(pending->pdata[i]);
+    MediaIndexSnapshot* snapshot = media_index_get_snapshot(root->index);
+    *album = media_index_snapshot_find_album(snapshot, album_id);
+    if (*album != nullptr) return snapshot;
+    media_index_snapshot_unref(snapshot);
+  }
+  return nullptr;
+}
+
+// Looks |path| up in the root it lies below, waiting for that root's first
+// snapshot only if |wait| is TRUE.
+static MediaIndexSnapshot* library_find_record(MediaLibrary* self,
+                                               const gchar* path,
+                                               gboolean wait,
+                                               const MediaRecord** record) {
+  if (path == nullptr || !g_path_is_absolute(path)) return nullptr;
+  g_autoptr(GPtrArray) roots = library_get_roots(self);
+  for (guint i = 0; i < roots->len; i++) {
+    LibraryRoot* root = static_cast<LibraryRoot*>(roots->pdata[i]);
+    if (!path_contains(root->path, path)) continue;
+    MediaIndexSnapshot* snapshot =
+        wait ? media_index_get_snapshot(root->index)
+             : media_index_try_get_snapshot(root->index, 0);
+    if (snapshot == nullptr) return nullptr;
+    *record = media_index_snapshot_find_record(snapshot, path);
+    if (*record != nullptr) return snapshot;
+    media_index_snapshot_unref(snapshot);
+    // Roots do not overlap.
+    break;
+  }
+  return nullptr;
+}
+
+MediaIndexSnapshot* media_library_find_record(MediaLibrary* self,
+                                              const gchar* path,
+                                              const MediaRecord** record) {
+  return library_find_record(self, path, TRUE, record);
+}
+
+MediaIndexSnapshot* media_library_peek_record(MediaLibrary* self,
+                                              const gchar* path,
+                                              const MediaRecord** record) {
+  return library_find_record(self, path, FALSE, record);
+}
+
+gchar* media_library_get_default_cache_dir(void) {
+  return g_build_filename(g_get_user_cache_dir(), "photo_gallery_pro",
+                          nullptr);
+}
+
+void media_library_free(MediaLibrary* self) {
+  g_ptr_array_unref(self->roots);
+  g_mutex_clear(&self->mutex);
+  g_free(self->cache_dir);
+  g_free(self);
+}
@@ -0,0 +1,89 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_LIBRARY_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_LIBRARY_H_
+
+#include <glib.h>
+
+#include "media_index.h"
+
+G_BEGIN_DECLS
+
+// The set of library roots the albums come from, each with its own filter.
+//
+// Every root gets its own MediaIndex, so roots are walked, watched and
+// probed concurrently, each on its own threads, and a slow network mount
+// does not hold up the local disk. Each index saves to its own cache file,
+// named after the root and its filter. Album IDs are hashes of absolute
+// paths and roots may not overlap, so IDs are unique across roots.
+typedef struct _MediaLibrary MediaLibrary;
+
+typedef struct {
+  const gchar* path;             // Absolute path of the root directory.
+  const gchar* const* include;   // NULL-terminated globs, or NULL.
+  const gchar* const* exclude;   // NULL-terminated globs, or NULL.
+} MediaLibraryRoot;
+
+// Creates a library without roots that saves its indexes in |cache_dir|.
+MediaLibrary* media_library_new(const gchar* cache_dir);
+
+// Replaces the roots, in order. A root whose path and filter are unchanged
+// keeps its index, snapshot and watches; indexes of roots that went away are
+// stopped. Roots need not exist yet; one that does not simply has no
+// albums. Fails without changing anything if a path is not absolute or two
+// roots overlap.
+gboolean media_library_set_roots(MediaLibrary* self,
+                                 const MediaLibraryRoot* roots,
+                                 guint n_roots,
+                                 GError** error);
+
+// Changes the walk options of every root, present and future; each index
+// rescans in the background.
+void media_library_set_scan_options(MediaLibrary* self,
+                                    const MediaScanOptions* options);
+
+// Returns the current snapshot of every root, in root order, as an array
+// that unrefs them when freed. A root still on its first scan is waited for
+// for up to a second after it was added and then left out, so one slow root
+// does not hold up the others; the number left out is stored in |n_pending|
+// if not NULL. Only when no root has a snapshot yet are they all waited for.
+GPtrArray* media_library_get_snapshots(MediaLibrary* self, guint* n_pending);
+
+// Waits until the root |snapshot| came from publishes a newer one, like
+// media_index_wait_for_update(). Returns TRUE straight away if that root has
+// been removed since. With |snapshot| NULL, waits for a root that is still
+// on its first scan to publish, and returns TRUE straight away if there is
+// none.
+gboolean media_library_wait_for_update(MediaLibrary* self,
+                                       const MediaIndexSnapshot* snapshot,
+                                       gint64 end_time,
+                                       GCancellable* cancellable);
+
+// Returns the snapshot holding the album |album_id| of any root and sets
+// |album| to it, or returns NULL. See media_index_snapshot_find_album().
+// Roots still on their first scan, as for media_library_get_snapshots(), are
+// only waited for if no other root has the album.
+MediaIndexSnapshot* media_library_find_album(MediaLibrary* self,
+                                             const gchar* album_id,
+                                             const MediaAlbumRecord** album);
+
+// Returns the snapshot holding the file at the absolute |path| and sets
+// |record| to it, or returns NULL. Only the root |path| lies below is
+// consulted.
+MediaIndexSnapshot* media_library_find_record(MediaLibrary* self,
+                                              const gchar* path,
+                                              const MediaRecord** record);
+
+// Like media_library_find_record(), but never blocks: returns NULL if the
+// root |path| lies below has no snapshot yet. For the main thread.
+MediaIndexSnapshot* media_library_peek_record(MediaLibrary* self,
+                                              const gchar* path,
+                                              const MediaRecord** record);
+
+// Returns the default directory for saved indexes under $XDG_CACHE_HOME.
+gchar* media_library_get_default_cache_dir(void);
+
+// Stops every index and releases the library.
+void media_library_free(MediaLibrary* self);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_LIBRARY_H_
@@ -0,0 +1,137 @@
+#include "media_placeholder.h"
+
+#include <math.h>
+
+#include "thumbnail_generator.h"
+
+static const char kBase83[] =
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+    "#$%*+,-.:;=?@[]^_{|}~";
+
+// Appends |value| as |length| base 83 digits, most significant first.
+static gchar* append_base83(gchar* out, guint value, gint length) {
+  for (gint i = length - 1; i >= 0; i--) {
+    out[i] = kBase83[value % 83];
+    value /= 83;
+  }
+  return out + length;
+}
+
+static gdouble srgb_to_linear(guint8 value) {
+  gdouble v = value / 255.0;
+  return v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+}
+
+static guint linear_to_srgb(gdouble value) {
+  gdouble v = CLAMP(value, 0.0, 1.0);
+  gdouble srgb = v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1 / 2.4) - 0.055;
+  return (guint)(srgb * 255 + 0.5);
+}
+
+// sign(value) * |value|^exponent
+static gdouble sign_pow(gdouble value, gdouble exponent) {
+  return copysign(pow(fabs(value), exponent), value);
+}
+
+void media_placeholder_encode(GdkPixbuf* pixbuf, gchar* hash) {
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gint channels = gdk_pixbuf_get_n_channels(pixbuf);
+  gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  const guint8* pixels = gdk_pixbuf_read_pixels(pixbuf);
+  gint components_x = width >= height ? MEDIA_PLACEHOLDER_COMPONENTS
+                                      : MEDIA_PLACEHOLDER_COMPONENTS - 1;
+  gint components_y = width >= height ? MEDIA_PLACEHOLDER_COMPONENTS - 1
+                                      : MEDIA_PLACEHOLDER_COMPONENTS;
+
+  // Linearised pixels, and the cosine tables of both axes.
+  g_autofree gdouble* linear = g_new(gdouble, (gsize)width * height * 3);
+  for (gint y = 0; y < height; y++) {
+    const guint8* row = pixels + (gsize)y * rowstride;
+    for (gint x = 0; x < width; x++) {
+      for (gint c = 0; c < 3; c++) {
+        linear[((gsize)y * width + x) * 3 + c] =
+            srgb_to_linear(row[x * channels + c]);
+      }
+    }
+  }
+  g_autofree gdouble* cos_x = g_new(gdouble, (gsize)components_x * width);
+  for (gint i = 0; i < components_x; i++) {
+    for (gint x = 0; x < width; x++) {
+      cos_x[i * width + x] = cos(G_PI * i * x / width);
+    }
+  }
+  g_autofree gdouble* cos_y = g_new(gdouble, (gsize)components_y * height);
+  for (gint j = 0; j < components_y; j++) {
+    for (gint y = 0; y < height; y++) {
+      cos_y[j * height + y] = cos(G_PI * j * y / height);
+    }
+  }
+
+  gdouble factors[MEDIA_PLACEHOLDER_COMPONENTS * MEDIA_PLACEHOLDER_COMPONENTS]
+                 [3];
+  gint n_factors = 0;
+  for (gint j = 0; j < components_y; j++) {
+    for (gint i = 0; i < components_x; i++) {
+      gdouble sum[3] = {0, 0, 0};
+      for (gint y = 0; y < height; y++) {
+        for (gint x = 0; x < width; x++) {
+          gdouble basis = cos_x[i * width + x] * cos_y[j * height + y];
+          const gdouble* pixel = &linear[((gsize)y * width + x) * 3];
+          for (gint c = 0; c < 3; c++) sum[c] += basis * pixel[c];
+        }
+      }
+      gdouble scale = (i == 0 && j == 0 ? 1.0 : 2.0) / ((gdouble)width * height);
+      for (gint c = 0; c < 3; c++) factors[n_factors][c] = sum[c] * scale;
+      n_factors++;
+    }
+  }
+
+  gchar* out = hash;
+  out = append_base83(out, (components_x - 1) + (components_y - 1) * 9, 1);
+
+  // The AC components are quantised relative to the largest of them.
+  gdouble maximum = 0;
+  for (gint f = 1; f < n_factors; f++) {
+    for (gint c = 0; c < 3; c++) maximum = MAX(maximum, fabs(factors[f][c]));
+  }
+  guint quantised_maximum = (guint)CLAMP(floor(maximum * 166 - 0.5), 0, 82);
+  gdouble maximum_value = (quantised_maximum + 1) / 166.0;
+  out = append_base83(out, quantised_maximum, 1);
+
+  out = append_base83(out,
+                      linear_to_srgb(factors[0][0]) << 16 |
+                          linear_to_srgb(factors[0][1]) << 8 |
+                          linear_to_srgb(factors[0][2]),
+                      4);
+  for (gint f = 1; f < n_factors; f++) {
+    guint quantised[3];
+    for (gint c = 0; c < 3; c++) {
+      quantised[c] = (guint)CLAMP(
+          floor(sign_pow(factors[f][c] / maximum_value, 0.5) * 9 + 9.5), 0,
+          18);
+    }
+    out = append_base83(
+        out, quantised[0] * 19 * 19 + quantised[1] * 19 + quantised[2], 2);
+  }
+  *out = '\0';
+}
+
+GdkPixbuf* media_placeholder_load_source(const gchar* path) {
+  GdkPixbuf* pixbuf = generate_thumbnail_from_preview(
+      path, MEDIA_PLACEHOLDER_SOURCE_SIZE, MEDIA_PLACEHOLDER_SOURCE_SIZE,
+      nullptr);
+  if (pixbuf == nullptr) {
+    pixbuf = generate_thumbnail(path, MEDIA_PLACEHOLDER_SOURCE_SIZE,
+                                MEDIA_PLACEHOLDER_SOURCE_SIZE, nullptr,
+                                nullptr);
+  }
+  return pixbuf;
+}
+
+gboolean media_placeholder_compute(const gchar* path, gchar* hash) {
+  g_autoptr(GdkPixbuf) pixbuf = media_placeholder_load_source(path);
+  if (pixbuf == nullptr) return FALSE;
+  media_placeholder_encode(pixbuf, hash);
+  return TRUE;
+}
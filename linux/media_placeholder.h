@@ -0,0 +1,41 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_PLACEHOLDER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_PLACEHOLDER_H_
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// BlurHash placeholders, shown while a grid cell's thumbnail is decoded.
+//
+// A BlurHash is a short ASCII string holding the average colour and a few
+// low-frequency cosine components of the image, which a client turns back
+// into a blurred preview of any size without touching the file. See
+// https://blurha.sh for the format.
+
+// Components along the longer side; the shorter side gets one less, so a
+// hash is at most 4 + 2 * 4 * 3 characters.
+#define MEDIA_PLACEHOLDER_COMPONENTS 4
+#define MEDIA_PLACEHOLDER_MAX_LENGTH 28
+
+// Side of the box images are reduced to before hashing. Only the lowest
+// frequencies are kept, so more pixels would not change the hash.
+#define MEDIA_PLACEHOLDER_SOURCE_SIZE 32
+
+// Writes the BlurHash of |pixbuf|, an 8-bit RGB or RGBA image, to |hash|,
+// which holds at least MEDIA_PLACEHOLDER_MAX_LENGTH + 1 bytes. Alpha is
+// ignored.
+void media_placeholder_encode(GdkPixbuf* pixbuf, gchar* hash);
+
+// Decodes the image or video frame at |path| to fit
+// MEDIA_PLACEHOLDER_SOURCE_SIZE, from the embedded EXIF preview when there
+// is one. Returns NULL if the file could not be decoded.
+GdkPixbuf* media_placeholder_load_source(const gchar* path);
+
+// Writes the BlurHash of the file at |path|, loaded with
+// media_placeholder_load_source(), to |hash|. Returns FALSE if the file could
+// not be decoded.
+gboolean media_placeholder_compute(const gchar* path, gchar* hash);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_PLACEHOLDER_H_
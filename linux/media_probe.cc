@@ -0,0 +1,237 @@
+#include "media_probe.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+// JPEG files normally have a handful of segments before the frame header;
+// anything beyond this is treated as corrupt rather than walked forever.
+#define MAX_JPEG_SEGMENTS 64
+
+typedef struct {
+  int fd;
+  const guint8* head;
+  gsize head_length;
+} ProbeReader;
+
+static guint16 read_be16(const guint8* p) {
+  return (guint16)((p[0] << 8) | p[1]);
+}
+
+static guint32 read_be32(const guint8* p) {
+  return ((guint32)p[0] << 24) | ((guint32)p[1] << 16) |
+         ((guint32)p[2] << 8) | (guint32)p[3];
+}
+
+static guint16 read_le16(const guint8* p) {
+  return (guint16)(p[0] | (p[1] << 8));
+}
+
+static guint32 read_le24(const guint8* p) {
+  return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16);
+}
+
+static guint32 read_le32(const guint8* p) {
+  return read_le24(p) | ((guint32)p[3] << 24);
+}
+
+// Reads |length| bytes at |offset|, serving them from the cached head when
+// possible so most probes cost a single read() call.
+static gboolean probe_reader_read(ProbeReader* reader,
+                                  goffset offset,
+                                  guint8* buffer,
+                                  gsize length) {
+  if (offset >= 0 && (gsize)offset + length <= reader->head_length) {
+    memcpy(buffer, reader->head + offset, length);
+    return TRUE;
+  }
+
+  gsize done = 0;
+  while (done < length) {
+    ssize_t n = pread(reader->fd, buffer + done, length - done, offset + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return FALSE;
+    done += n;
+  }
+  return TRUE;
+}
+
+static gboolean probe_png(const guint8* head, gsize length,
+                          gint* width, gint* height) {
+  static const guint8 kSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  if (length < 24 || memcmp(head, kSignature, sizeof(kSignature)) != 0 ||
+      memcmp(head + 12, "IHDR", 4) != 0) {
+    return FALSE;
+  }
+  *width = (gint)read_be32(head + 16);
+  *height = (gint)read_be32(head + 20);
+  return TRUE;
+}
+
+static gboolean probe_gif(const guint8* head, gsize length,
+                          gint* width, gint* height) {
+  if (length < 10 || (memcmp(head, "GIF87a", 6) != 0 &&
+                      memcmp(head, "GIF89a", 6) != 0)) {
+    return FALSE;
+  }
+  *width = read_le16(head + 6);
+  *height = read_le16(head + 8);
+  return TRUE;
+}
+
+static gboolean probe_bmp(const guint8* head, gsize length,
+                          gint* width, gint* height) {
+  if (length < 26 || head[0] != 'B' || head[1] != 'M') {
+    return FALSE;
+  }
+  guint32 dib_size = read_le32(head + 14);
+  if (dib_size == 12) {
+    // OS/2 BITMAPCOREHEADER with 16-bit dimensions.
+    *width = read_le16(head + 18);
+    *height = read_le16(head + 20);
+  } else {
+    // Negative heights mark top-down bitmaps.
+    *width = ABS((gint32)read_le32(head + 18));
+    *height = ABS((gint32)read_le32(head + 22));
+  }
+  return TRUE;
+}
+
+static gboolean probe_webp(const guint8* head, gsize length,
+                           gint* width, gint* height) {
+  if (length < 30 || memcmp(head, "RIFF", 4) != 0 ||
+      memcmp(head + 8, "WEBP", 4) != 0) {
+    return FALSE;
+  }
+
+  const guint8* chunk = head + 12;
+  const guint8* data = head + 20;
+  if (memcmp(chunk, "VP8 ", 4) == 0) {
+    // Lossy: 3-byte frame tag, 3-byte start code, then 14-bit dimensions.
+    if (data[3] != 0x9d || data[4] != 0x01 || data[5] != 0x2a) return FALSE;
+    *width = read_le16(data + 6) & 0x3fff;
+    *height = read_le16(data + 8) & 0x3fff;
+    return TRUE;
+  }
+  if (memcmp(chunk, "VP8L", 4) == 0) {
+    // Lossless: signature byte, then width-1 and height-1 in 14 bits each.
+    if (data[0] != 0x2f) return FALSE;
+    guint32 bits = read_le32(data + 1);
+    *width = (gint)(bits & 0x3fff) + 1;
+    *height = (gint)((bits >> 14) & 0x3fff) + 1;
+    return TRUE;
+  }
+  if (memcmp(chunk, "VP8X", 4) == 0) {
+    // Extended: flags and reserved bytes, then 24-bit canvas size minus one.
+    *width = (gint)read_le24(data + 4) + 1;
+    *height = (gint)read_le24(data + 7) + 1;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static gboolean is_jpeg_sof_marker(guint8 marker) {
+  // SOF0..SOF15, excluding DHT (C4), JPG (C8) and DAC (CC).
+  return marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 &&
+         marker != 0xc8 && marker != 0xcc;
+}
+
+// Walks the JPEG marker segments up to the first frame header. Only the
+// two-byte length of each segment is read; segment bodies are skipped.
+static gboolean probe_jpeg(ProbeReader* reader, gint* width, gint* height) {
+  if (reader->head_length < 4 || reader->head[0] != 0xff ||
+      reader->head[1] != 0xd8) {
+    return FALSE;
+  }
+
+  goffset offset = 2;
+  for (int i = 0; i < MAX_JPEG_SEGMENTS; i++) {
+    guint8 marker[4];
+    if (!probe_reader_read(reader, offset, marker, 2)) return FALSE;
+    if (marker[0] != 0xff) return FALSE;
+    if (marker[1] == 0xff) {
+      // Fill byte before the actual marker.
+      offset++;
+      continue;
+    }
+    if (marker[1] == 0x01 || (marker[1] >= 0xd0 && marker[1] <= 0xd8)) {
+      // Standalone markers carry no length.
+      offset += 2;
+      continue;
+    }
+    if (marker[1] == 0xd9 || marker[1] == 0xda) {
+      // End of image or start of scan without a frame header.
+      return FALSE;
+    }
+
+    if (!probe_reader_read(reader, offset + 2, marker + 2, 2)) return FALSE;
+    guint16 segment_length = read_be16(marker + 2);
+    if (segment_length < 2) return FALSE;
+
+    if (is_jpeg_sof_marker(marker[1])) {
+      // Precision byte, then height and width.
+      guint8 frame[5];
+      if (!probe_reader_read(reader, offset + 4, frame, sizeof(frame))) {
+        return FALSE;
+      }
+      *height = read_be16(frame + 1);
+      *width = read_be16(frame + 3);
+      return TRUE;
+    }
+    offset += 2 + segment_length;
+  }
+  return FALSE;
+}
+
+gboolean media_probe_image_size(const gchar* path, gint* width, gint* height) {
+  g_return_val_if_fail(path != nullptr, FALSE);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return FALSE;
+  }
+
+  guint8 head[MEDIA_PROBE_HEAD_SIZE];
+  ssize_t n;
+  do {
+    n = read(fd, head, sizeof(head));
+  } while (n < 0 && errno == EINTR);
+  gboolean found = media_probe_image_size_from_head(path, fd, head,
+                                                    n > 0 ? n : 0, width,
+                                                    height);
+  close(fd);
+  return found;
+}
+
+gboolean media_probe_image_size_from_head(const gchar* path,
+                                          int fd,
+                                          const guint8* head,
+                                          gsize head_length,
+                                          gint* width,
+                                          gint* height) {
+  g_return_val_if_fail(path != nullptr, FALSE);
+
+  ProbeReader reader = {fd, head, head_length};
+  gint w = 0;
+  gint h = 0;
+  gboolean found =
+      probe_jpeg(&reader, &w, &h) ||
+      probe_png(reader.head, reader.head_length, &w, &h) ||
+      probe_webp(reader.head, reader.head_length, &w, &h) ||
+      probe_gif(reader.head, reader.head_length, &w, &h) ||
+      probe_bmp(reader.head, reader.head_length, &w, &h);
+
+  if (!found && reader.head_length > 0) {
+    // Let the installed pixbuf loaders handle anything else (TIFF, ICO, ...).
+    found = gdk_pixbuf_get_file_info(path, &w, &h) != nullptr;
+  }
+
+  if (!found || w <= 0 || h <= 0) {
+    return FALSE;
+  }
+  if (width != nullptr) *width = w;
+  if (height != nullptr) *height = h;
+  return TRUE;
+}
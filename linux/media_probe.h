@@ -0,0 +1,33 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_PROBE_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_PROBE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Upper bound on the bytes read from the start of a file when probing. JPEG
+// files may need a few extra small reads to skip past large APPn segments.
+#define MEDIA_PROBE_HEAD_SIZE 4096
+
+// Reads the pixel dimensions of the image at |path| from its header without
+// decoding any pixel data. JPEG, PNG, GIF, BMP and WebP are parsed directly;
+// other formats fall back to gdk_pixbuf_get_file_info(), which stops reading
+// as soon as the loader reports the image size.
+//
+// Returns FALSE if the file could not be read or is not a recognised image.
+gboolean media_probe_image_size(const gchar* path, gint* width, gint* height);
+
+// Like media_probe_image_size(), for a file that is already open as |fd|
+// and whose first |head_length| bytes, up to MEDIA_PROBE_HEAD_SIZE, have
+// been read into |head|. Further reads, which only JPEG files with large
+// metadata segments need, go through |fd|. Does not close |fd|.
+gboolean media_probe_image_size_from_head(const gchar* path,
+                                          int fd,
+                                          const guint8* head,
+                                          gsize head_length,
+                                          gint* width,
+                                          gint* height);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_PROBE_H_
@@ -0,0 +1,194 @@
+#include "media_scanner.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+  const MediaScanOptions* options;
+  const MediaScanCallbacks* callbacks;
+  gpointer user_data;
+  GThreadPool* pool;
+
+  GMutex mutex;
+  GCond done;
+  guint pending;         // Queued or running directory jobs.
+  GHashTable* visited;   // ScanDirId* of the directories seen.
+} Scan;
+
+// Identifies a directory across bind mounts and symlinks.
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} ScanDirId;
+
+typedef struct {
+  gchar* path;
+  gint depth;
+} ScanJob;
+
+gboolean media_scan_should_visit(const MediaScanOptions* options,
+                                 const gchar* name,
+                                 gint depth) {
+  if (options->skip_hidden && name[0] == '.') return FALSE;
+  return options->max_depth < 0 || depth <= options->max_depth;
+}
+
+static void scan_push(Scan* scan, gchar* path, gint depth) {
+  ScanJob* job = g_new(ScanJob, 1);
+  job->path = path;
+  job->depth = depth;
+  g_mutex_lock(&scan->mutex);
+  scan->pending++;
+  g_mutex_unlock(&scan->mutex);
+  g_thread_pool_push(scan->pool, job, nullptr);
+}
+
+static guint scan_dir_id_hash(gconstpointer key) {
+  const ScanDirId* id = static_cast<const ScanDirId*>(key);
+  guint64 dev = id->dev;
+  guint64 ino = id->ino;
+  return (guint)(ino ^ (ino >> 32)) * 31 + (guint)(dev ^ (dev >> 32));
+}
+
+static gboolean scan_dir_id_equal(gconstpointer a, gconstpointer b) {
+  const ScanDirId* id_a = static_cast<const ScanDirId*>(a);
+  const ScanDirId* id_b = static_cast<const ScanDirId*>(b);
+  return id_a->dev == id_b->dev && id_a->ino == id_b->ino;
+}
+
+// Returns TRUE the first time the directory open as |fd| is seen, so
+// symlinked directories and bind mounts cannot make the walk loop.
+static gboolean scan_mark_visited(Scan* scan, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) return FALSE;
+  ScanDirId id = {st.st_dev, st.st_ino};
+  g_mutex_lock(&scan->mutex);
+  gboolean first = !g_hash_table_contains(scan->visited, &id);
+  if (first) {
+    ScanDirId* stored_id = g_new(ScanDirId, 1);
+    *stored_id = id;
+    g_hash_table_add(scan->visited, stored_id);
+  }
+  g_mutex_unlock(&scan->mutex);
+  return first;
+}
+
+static gboolean scan_stopped(Scan* scan) {
+  return scan->callbacks->stopped != nullptr &&
+         scan->callbacks->stopped(scan->user_data);
+}
+
+// Resolves DT_UNKNOWN, which some network filesystems report for every
+// entry, and symlinks, which are followed.
+static guchar scan_resolve_type(int dir_fd, const struct dirent* entry) {
+  if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) {
+    return entry->d_type;
+  }
+  struct stat st;
+  if (fstatat(dir_fd, entry->d_name, &st, 0) != 0) return DT_UNKNOWN;
+  return S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+}
+
+// Hands the file names gathered so far to the callback, and clears them.
+static void scan_flush_files(Scan* scan,
+                             const gchar* path,
+                             int dir_fd,
+                             GPtrArray* names) {
+  if (names->len == 0) return;
+  scan->callbacks->files(path, dir_fd,
+                         reinterpret_cast<const gchar* const*>(names->pdata),
+                         names->len, scan->user_data);
+  g_ptr_array_set_size(names, 0);
+}
+
+static void scan_directory(Scan* scan, const gchar* path, gint depth) {
+  int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) return;
+  if (!scan_mark_visited(scan, dir_fd)) {
+    close(dir_fd);
+    return;
+  }
+
+  // The directory is reported, and so watched by the index, before its
+  // listing is read, so files created meanwhile are not missed.
+  gboolean hidden =
+      faccessat(dir_fd, MEDIA_SCAN_NO_MEDIA_MARKER, F_OK, 0) == 0;
+  gboolean descend =
+      scan->callbacks->directory(path, depth, hidden, scan->user_data);
+  DIR* dir = hidden || !descend ? nullptr : fdopendir(dir_fd);
+  if (dir == nullptr) {
+    close(dir_fd);
+    return;
+  }
+
+  g_autoptr(GPtrArray) names = g_ptr_array_new_with_free_func(g_free);
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    guchar type = scan_resolve_type(dir_fd, entry);
+    if (type == DT_DIR) {
+      if (media_scan_should_visit(scan->options, entry->d_name, depth + 1)) {
+        scan_push(scan, g_build_filename(path, entry->d_name, nullptr),
+                  depth + 1);
+      }
+    } else if (type != DT_UNKNOWN) {
+      g_ptr_array_add(names, g_strdup(entry->d_name));
+      if (names->len == MEDIA_SCAN_FILE_BATCH) {
+        scan_flush_files(scan, path, dir_fd, names);
+        if (scan_stopped(scan)) break;
+      }
+    }
+  }
+  scan_flush_files(scan, path, dir_fd, names);
+  closedir(dir);
+}
+
+static void scan_job_run(gpointer data, gpointer user_data) {
+  ScanJob* job = static_cast<ScanJob*>(data);
+  Scan* scan = static_cast<Scan*>(user_data);
+  // Subdirectories are queued before this job counts as done, so |pending|
+  // only reaches zero once the whole tree has been walked. Once stopped, the
+  // queued jobs only count themselves done.
+  if (!scan_stopped(scan)) scan_directory(scan, job->path, job->depth);
+  g_free(job->path);
+  g_free(job);
+
+  g_mutex_lock(&scan->mutex);
+  if (--scan->pending == 0) g_cond_signal(&scan->done);
+  g_mutex_unlock(&scan->mutex);
+}
+
+void media_scan(const gchar* path,
+                gint depth,
+                const MediaScanOptions* options,
+                const MediaScanCallbacks* callbacks,
+                gint max_threads,
+                gpointer user_data) {
+  Scan scan = {};
+  scan.options = options;
+  scan.callbacks = callbacks;
+  scan.user_data = user_data;
+  g_mutex_init(&scan.mutex);
+  g_cond_init(&scan.done);
+  scan.visited = g_hash_table_new_full(scan_dir_id_hash, scan_dir_id_equal,
+                                       g_free, nullptr);
+  scan.pool = g_thread_pool_new(scan_job_run, &scan, MAX(max_threads, 1),
+                                FALSE, nullptr);
+
+  scan_push(&scan, g_strdup(path), depth);
+  g_mutex_lock(&scan.mutex);
+  while (scan.pending > 0) {
+    g_cond_wait(&scan.done, &scan.mutex);
+  }
+  g_mutex_unlock(&scan.mutex);
+
+  g_thread_pool_free(scan.pool, FALSE, TRUE);
+  g_hash_table_unref(scan.visited);
+  g_cond_clear(&scan.done);
+  g_mutex_clear(&scan.mutex);
+}
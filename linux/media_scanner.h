@@ -0,0 +1,74 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_SCANNER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_SCANNER_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Parallel recursive directory walker for the media library.
+//
+// Each directory is read exactly once, relative to its own descriptor, and
+// entries are classified from d_type so plain files and directories need no
+// extra stat. Subdirectories are queued as separate jobs, so wide trees such
+// as one folder per day are read on several threads at once, which matters
+// most on network mounts where every readdir is a round trip.
+
+typedef struct {
+  // Directory levels below the library root to visit; negative for no limit.
+  gint max_depth;
+  // Skip directories whose name starts with a dot.
+  gboolean skip_hidden;
+} MediaScanOptions;
+
+// Deep enough for year/month/event layouts while bounding runaway trees.
+#define MEDIA_SCAN_DEFAULT_MAX_DEPTH 16
+
+// Name of the file that hides a directory and everything below it.
+#define MEDIA_SCAN_NO_MEDIA_MARKER ".nomedia"
+
+typedef struct {
+  // Called once per visited directory, before its listing is read, with its
+  // depth below the library root. |hidden| is TRUE for a directory holding
+  // a .nomedia marker; its contents are not visited. Returning FALSE skips
+  // the contents of any other directory as well.
+  gboolean (*directory)(const gchar* path,
+                        gint depth,
+                        gboolean hidden,
+                        gpointer user_data);
+  // Called with the entries of a visited directory that are not
+  // directories, up to MEDIA_SCAN_FILE_BATCH at a time, so their metadata
+  // can be fetched together. |dir_fd| is the directory's descriptor, open
+  // for the call's duration.
+  void (*files)(const gchar* dir_path,
+                int dir_fd,
+                const gchar* const* names,
+                guint n_names,
+                gpointer user_data);
+  // Polled before each directory and between batches of files; returning
+  // TRUE abandons the walk. May be NULL.
+  gboolean (*stopped)(gpointer user_data);
+} MediaScanCallbacks;
+
+// Largest number of names passed to one files() call.
+#define MEDIA_SCAN_FILE_BATCH 256
+
+// Returns TRUE if a directory called |name| at |depth| below the library
+// root should be visited.
+gboolean media_scan_should_visit(const MediaScanOptions* options,
+                                 const gchar* name,
+                                 gint depth);
+
+// Walks the tree at |path|, which lies |depth| levels below the library
+// root, on up to |max_threads| threads and returns once every directory has
+// been visited, or soon after stopped() returns TRUE. Callbacks run
+// concurrently on the worker threads.
+void media_scan(const gchar* path,
+                gint depth,
+                const MediaScanOptions* options,
+                const MediaScanCallbacks* callbacks,
+                gint max_threads,
+                gpointer user_data);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_SCANNER_H_
@@ -0,0 +1,547 @@
+#include "media_stat.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "performance_stats.h"
+
+// The io_uring rings of the calling thread, mapped from the kernel. Only
+// the fields this file uses are kept.
+typedef struct {
+  int fd;
+  guint entries;
+  void* sq_ring;
+  gsize sq_ring_size;
+  void* cq_ring;  // The same mapping as |sq_ring| on newer kernels.
+  gsize cq_ring_size;
+  struct io_uring_sqe* sqes;
+  gsize sqes_size;
+  guint* sq_tail;
+  guint sq_mask;
+  guint* cq_head;
+  guint* cq_tail;
+  guint cq_mask;
+  struct io_uring_cqe* cqes;
+} Ring;
+
+// Fills in the io_uring request for operation |index| of a batch.
+typedef void (*PrepareFunc)(struct io_uring_sqe* sqe,
+                            gpointer data,
+                            guint index);
+
+// Takes the result of operation |index|: a count, a descriptor or -errno.
+typedef void (*CompleteFunc)(gpointer data, guint index, gint result);
+
+// Performs operation |index| with plain system calls.
+typedef void (*RunFunc)(gpointer data, guint index);
+
+struct _MediaStatPool {
+  GThreadPool* threads;  // Created on first use.
+};
+
+// Unset, or a MediaStatBackend forced by media_stat_set_backend().
+static gint forced_backend = -1;
+
+static void ring_free(gpointer data) {
+  Ring* ring = static_cast<Ring*>(data);
+  if (ring == nullptr) return;
+  if (ring->sqes != nullptr) munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != nullptr && ring->cq_ring != ring->sq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != nullptr) munmap(ring->sq_ring, ring->sq_ring_size);
+  close(ring->fd);
+  g_free(ring);
+}
+
+// Returns TRUE if the kernel supports every operation used here, which came
+// with io_uring itself in 5.6 but may be filtered by a sandbox.
+static gboolean ring_supports_operations(int fd) {
+  gsize size = sizeof(struct io_uring_probe) +
+               IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+  g_autofree struct io_uring_probe* probe =
+      static_cast<struct io_uring_probe*>(g_malloc0(size));
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+              IORING_OP_LAST) < 0) {
+    return FALSE;
+  }
+  static const guint8 kOperations[] = {IORING_OP_STATX, IORING_OP_OPENAT,
+                                       IORING_OP_READ, IORING_OP_CLOSE};
+  for (guint8 op : kOperations) {
+    if (op > probe->last_op ||
+        !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static Ring* ring_new() {
+  struct io_uring_params params = {};
+  int fd = syscall(__NR_io_uring_setup, MEDIA_STAT_QUEUE_DEPTH, &params);
+  if (fd < 0) return nullptr;
+
+  Ring* ring = g_new0(Ring, 1);
+  ring->fd = fd;
+  ring->entries = params.sq_entries;
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(guint);
+  ring->cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  gboolean single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    ring->sq_ring_size = ring->cq_ring_size =
+        MAX(ring->sq_ring_size, ring->cq_ring_size);
+  }
+  void* sq_ring = mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED || !ring_supports_operations(fd)) {
+    if (sq_ring != MAP_FAILED) ring->sq_ring = sq_ring;
+    ring_free(ring);
+    return nullptr;
+  }
+  ring->sq_ring = sq_ring;
+  // Stats, opens and reads that would block are handed to kernel workers,
+  // of which there are only four per CPU by default, too few to keep a
+  // slow mount busy on a small machine. Kernels before 5.15 keep the
+  // default.
+  guint max_workers[2] = {MEDIA_STAT_QUEUE_DEPTH, 0};
+  syscall(__NR_io_uring_register, fd, IORING_REGISTER_IOWQ_MAX_WORKERS,
+          max_workers, 2);
+  void* cq_ring = single_mmap ? sq_ring
+                              : mmap(nullptr, ring->cq_ring_size,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, fd,
+                                     IORING_OFF_CQ_RING);
+  if (cq_ring == MAP_FAILED) {
+    ring_free(ring);
+    return nullptr;
+  }
+  ring->cq_ring = cq_ring;
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    ring_free(ring);
+    return nullptr;
+  }
+  ring->sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+  gchar* sq = static_cast<gchar*>(sq_ring);
+  gchar* cq = static_cast<gchar*>(cq_ring);
+  ring->sq_tail = reinterpret_cast<guint*>(sq + params.sq_off.tail);
+  ring->sq_mask = *reinterpret_cast<guint*>(sq + params.sq_off.ring_mask);
+  ring->cq_head = reinterpret_cast<guint*>(cq + params.cq_off.head);
+  ring->cq_tail = reinterpret_cast<guint*>(cq + params.cq_off.tail);
+  ring->cq_mask = *reinterpret_cast<guint*>(cq + params.cq_off.ring_mask);
+  ring->cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  // Submission slots are used in order, so the indirection array is fixed.
+  guint* sq_array = reinterpret_cast<guint*>(sq + params.sq_off.array);
+  for (guint i = 0; i < params.sq_entries; i++) sq_array[i] = i;
+  return ring;
+}
+
+// Hands every completion posted so far to |complete| and returns how many
+// there were.
+static guint ring_reap(Ring* ring, CompleteFunc complete, gpointer data) {
+  guint head = *ring->cq_head;
+  guint cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  guint reaped = cq_tail - head;
+  for (; head != cq_tail; head++) {
+    const struct io_uring_cqe* cqe = &ring->cqes[head & ring->cq_mask];
+    complete(data, cqe->user_data, cqe->res);
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  return reaped;
+}
+
+// Runs |n| operations on |ring|, keeping as many in flight as it has
+// submission slots, and returns once all of them have completed. If the
+// ring fails, the requests the kernel has taken are waited for, the rest
+// are made with |run| instead and later batches use the thread pool.
+static void ring_run(Ring* ring,
+                     guint n,
+                     PrepareFunc prepare,
+                     CompleteFunc complete,
+                     RunFunc run,
+                     gpointer data) {
+  gint64 start = performance_stats_begin();
+  guint next = 0;
+  guint in_flight = 0;
+  guint unsubmitted = 0;
+  guint completed = 0;
+  while (completed < n) {
+    // Only this thread writes the tail, so it needs no atomic load.
+    guint tail = *ring->sq_tail;
+    while (next < n && in_flight < ring->entries) {
+      struct io_uring_sqe* sqe = &ring->sqes[tail & ring->sq_mask];
+      memset(sqe, 0, sizeof(*sqe));
+      prepare(sqe, data, next);
+      sqe->user_data = next;
+      tail++;
+      next++;
+      in_flight++;
+      unsubmitted++;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    // Submits the new requests and waits for at least one completion.
+    long submitted = syscall(__NR_io_uring_enter, ring->fd, unsubmitted, 1,
+                             IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (submitted >= 0) {
+      unsubmitted -= submitted;
+    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      g_warning("io_uring_enter failed, using plain system calls: %s",
+                g_strerror(errno));
+      media_stat_set_backend(MEDIA_STAT_BACKEND_THREADS);
+      // The kernel has not looked at the unsubmitted requests, so they can
+      // be withdrawn. The others still point into the caller's buffers and
+      // must complete before this returns.
+      __atomic_store_n(ring->sq_tail, tail - unsubmitted, __ATOMIC_RELEASE);
+      in_flight -= unsubmitted;
+      while (in_flight > 0) {
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+                    IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+            errno != EINTR) {
+          // Workers post their completions without the call.
+          g_usleep(1000);
+        }
+        in_flight -= ring_reap(ring, complete, data);
+      }
+      for (guint i = next - unsubmitted; i < n; i++) run(data, i);
+      break;
+    }
+
+    guint reaped = ring_reap(ring, complete, data);
+    in_flight -= reaped;
+    completed += reaped;
+  }
+  performance_stats_end_stage(PERFORMANCE_STAGE_FILESYSTEM, start);
+}
+
+static MediaStatBackend get_default_backend() {
+  static gsize backend = 0;
+  if (g_once_init_enter(&backend)) {
+    Ring* ring = ring_new();
+    gboolean available = ring != nullptr;
+    ring_free(ring);
+    g_once_init_leave(&backend, (available ? MEDIA_STAT_BACKEND_IO_URING
+                                           : MEDIA_STAT_BACKEND_THREADS) +
+                                    1);
+  }
+  return static_cast<MediaStatBackend>(backend - 1);
+}
+
+MediaStatBackend media_stat_get_backend() {
+  gint forced = g_atomic_int_get(&forced_backend);
+  return forced >= 0 ? static_cast<MediaStatBackend>(forced)
+                     : get_default_backend();
+}
+
+gboolean media_stat_set_backend(MediaStatBackend backend) {
+  if (backend == MEDIA_STAT_BACKEND_IO_URING &&
+      get_default_backend() != MEDIA_STAT_BACKEND_IO_URING) {
+    return FALSE;
+  }
+  g_atomic_int_set(&forced_backend, backend);
+  return TRUE;
+}
+
+// Returns the calling thread's ring, creating it on first use, or NULL if
+// one cannot be created, e.g. because older kernels count its memory
+// against RLIMIT_MEMLOCK.
+static Ring* get_thread_ring() {
+  static GPrivate thread_ring = G_PRIVATE_INIT(ring_free);
+  Ring* ring = static_cast<Ring*>(g_private_get(&thread_ring));
+  if (ring == nullptr) {
+    ring = ring_new();
+    g_private_set(&thread_ring, ring);
+  }
+  return ring;
+}
+
+// One batch on the fallback pool. Each job takes operations off the batch
+// until none are left, so a batch never has more jobs than threads.
+typedef struct {
+  RunFunc run;
+  gpointer data;
+  guint n;
+  gint next;
+
+  GMutex mutex;
+  GCond done;
+  guint running_jobs;
+} PoolBatch;
+
+static void pool_job_run(gpointer job_data, gpointer user_data) {
+  PoolBatch* batch = static_cast<PoolBatch*>(job_data);
+  guint index;
+  while ((index = g_atomic_int_add(&batch->next, 1)) < batch->n) {
+    batch->run(batch->data, index);
+  }
+  g_mutex_lock(&batch->mutex);
+  if (--batch->running_jobs == 0) g_cond_signal(&batch->done);
+  g_mutex_unlock(&batch->mutex);
+}
+
+MediaStatPool* media_stat_pool_new() {
+  return g_new0(MediaStatPool, 1);
+}
+
+void media_stat_pool_free(MediaStatPool* self) {
+  if (self->threads != nullptr) g_thread_pool_free(self->threads, FALSE, TRUE);
+  g_free(self);
+}
+
+static GThreadPool* pool_get_threads(MediaStatPool* self) {
+  if (g_once_init_enter(&self->threads)) {
+    g_once_init_leave(&self->threads,
+                      g_thread_pool_new(pool_job_run, nullptr,
+                                        MEDIA_STAT_THREADS, FALSE, nullptr));
+  }
+  return self->threads;
+}
+
+static void pool_run(MediaStatPool* pool,
+                     guint n,
+                     RunFunc run,
+                     gpointer data) {
+  PoolBatch batch = {};
+  batch.run = run;
+  batch.data = data;
+  batch.n = n;
+  g_mutex_init(&batch.mutex);
+  g_cond_init(&batch.done);
+  batch.running_jobs = MIN(n, MEDIA_STAT_THREADS);
+  guint jobs = batch.running_jobs;
+  for (guint i = 0; i < jobs; i++) {
+    g_thread_pool_push(pool_get_threads(pool), &batch, nullptr);
+  }
+  g_mutex_lock(&batch.mutex);
+  while (batch.running_jobs > 0) g_cond_wait(&batch.done, &batch.mutex);
+  g_mutex_unlock(&batch.mutex);
+  g_cond_clear(&batch.done);
+  g_mutex_clear(&batch.mutex);
+}
+
+// Returns the ring to use on the calling thread, or NULL to make plain
+// system calls instead.
+static Ring* get_ring() {
+  return media_stat_get_backend() == MEDIA_STAT_BACKEND_IO_URING
+             ? get_thread_ring()
+             : nullptr;
+}
+
+// Runs |n| operations with plain system calls, on |pool| unless the
+// synchronous backend was asked for.
+static void run_calls(MediaStatPool* pool,
+                      guint n,
+                      RunFunc run,
+                      gpointer data) {
+  gint64 start = performance_stats_begin();
+  if (media_stat_get_backend() != MEDIA_STAT_BACKEND_SYNC && n > 1) {
+    pool_run(pool, n, run, data);
+  } else {
+    for (guint i = 0; i < n; i++) run(data, i);
+  }
+  performance_stats_end_stage(PERFORMANCE_STAGE_FILESYSTEM, start);
+}
+
+typedef struct {
+  int dir_fd;
+  MediaStatFile* files;
+  struct statx* buffers;  // One per file, for io_uring.
+} StatBatch;
+
+static void stat_prepare(struct io_uring_sqe* sqe, gpointer data,
+                         guint index) {
+  StatBatch* batch = static_cast<StatBatch*>(data);
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = batch->dir_fd;
+  sqe->addr = reinterpret_cast<guintptr>(batch->files[index].name);
+  sqe->len = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+  sqe->off = reinterpret_cast<guintptr>(&batch->buffers[index]);
+}
+
+static void stat_complete(gpointer data, guint index, gint result) {
+  StatBatch* batch = static_cast<StatBatch*>(data);
+  MediaStatFile* file = &batch->files[index];
+  const struct statx* st = &batch->buffers[index];
+  file->error = result < 0 ? -result : 0;
+  file->regular = result == 0 && S_ISREG(st->stx_mode);
+  file->size = result == 0 ? st->stx_size : 0;
+  file->mtime = result == 0 ? st->stx_mtime.tv_sec : 0;
+}
+
+static void stat_run(gpointer data, guint index) {
+  StatBatch* batch = static_cast<StatBatch*>(data);
+  MediaStatFile* file = &batch->files[index];
+  struct stat st;
+  gboolean ok = fstatat(batch->dir_fd, file->name, &st, 0) == 0;
+  file->error = ok ? 0 : errno;
+  file->regular = ok && S_ISREG(st.st_mode);
+  file->size = ok ? st.st_size : 0;
+  file->mtime = ok ? st.st_mtime : 0;
+}
+
+void media_stat_files(MediaStatPool* pool,
+                      int dir_fd,
+                      MediaStatFile* files,
+                      guint n_files) {
+  if (n_files == 0) return;
+  Ring* ring = get_ring();
+  if (ring == nullptr) {
+    StatBatch batch = {dir_fd, files, nullptr};
+    run_calls(pool, n_files, stat_run, &batch);
+    return;
+  }
+  g_autofree struct statx* buffers = g_new(struct statx, n_files);
+  StatBatch batch = {dir_fd, files, buffers};
+  ring_run(ring, n_files, stat_prepare, stat_complete, stat_run, &batch);
+}
+
+typedef struct {
+  int dir_fd;
+  MediaStatHead* heads;
+  // For the read and close passes: positions in |heads| of the open files.
+  guint* opened;
+} HeadBatch;
+
+// Fills |batch->opened| with the heads whose file is open and returns how
+// many there are. The array is the caller's to free.
+static guint collect_opened(HeadBatch* batch, guint n_heads) {
+  batch->opened = g_new(guint, n_heads);
+  guint n_opened = 0;
+  for (guint i = 0; i < n_heads; i++) {
+    if (batch->heads[i].fd >= 0) batch->opened[n_opened++] = i;
+  }
+  return n_opened;
+}
+
+static void open_prepare(struct io_uring_sqe* sqe, gpointer data,
+                         guint index) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = batch->dir_fd;
+  sqe->addr = reinterpret_cast<guintptr>(batch->heads[index].name);
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+}
+
+static void open_complete(gpointer data, guint index, gint result) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  batch->heads[index].fd = result >= 0 ? result : -1;
+}
+
+static void read_prepare(struct io_uring_sqe* sqe, gpointer data,
+                         guint index) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  MediaStatHead* head = &batch->heads[batch->opened[index]];
+  sqe->opcode = IORING_OP_READ;
+  // The file was only just opened, so its first page is rarely cached, and
+  // the kernel's non-blocking first try can still stall this thread, e.g.
+  // on FUSE revalidating attributes. Going straight to a kernel worker
+  // keeps the submissions flowing.
+  sqe->flags = IOSQE_ASYNC;
+  sqe->fd = head->fd;
+  sqe->addr = reinterpret_cast<guintptr>(head->head);
+  sqe->len = sizeof(head->head);
+  sqe->off = 0;
+}
+
+static void read_complete(gpointer data, guint index, gint result) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  batch->heads[batch->opened[index]].head_length = MAX(result, 0);
+}
+
+static void open_run(gpointer data, guint index) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  MediaStatHead* head = &batch->heads[index];
+  head->fd = openat(batch->dir_fd, head->name, O_RDONLY | O_CLOEXEC);
+}
+
+static void read_run(gpointer data, guint index) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  MediaStatHead* head = &batch->heads[batch->opened[index]];
+  ssize_t n;
+  do {
+    n = pread(head->fd, head->head, sizeof(head->head), 0);
+  } while (n < 0 && errno == EINTR);
+  head->head_length = MAX(n, 0);
+}
+
+static void read_head_run(gpointer data, guint index) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  MediaStatHead* head = &batch->heads[index];
+  head->head_length = 0;
+  head->fd = openat(batch->dir_fd, head->name, O_RDONLY | O_CLOEXEC);
+  if (head->fd < 0) return;
+  ssize_t n;
+  do {
+    n = read(head->fd, head->head, sizeof(head->head));
+  } while (n < 0 && errno == EINTR);
+  head->head_length = MAX(n, 0);
+}
+
+void media_stat_read_heads(MediaStatPool* pool,
+                           int dir_fd,
+                           MediaStatHead* heads,
+                           guint n_heads) {
+  if (n_heads == 0) return;
+  HeadBatch batch = {dir_fd, heads, nullptr};
+  Ring* ring = get_ring();
+  if (ring == nullptr) {
+    run_calls(pool, n_heads, read_head_run, &batch);
+    return;
+  }
+
+  // A read needs the descriptor its open returns, so the opens go first
+  // as one batch and the reads follow as another.
+  for (guint i = 0; i < n_heads; i++) heads[i].head_length = 0;
+  ring_run(ring, n_heads, open_prepare, open_complete, open_run, &batch);
+  guint n_opened = collect_opened(&batch, n_heads);
+  if (n_opened > 0) {
+    ring_run(ring, n_opened, read_prepare, read_complete, read_run, &batch);
+  }
+  g_free(batch.opened);
+}
+
+static void close_prepare(struct io_uring_sqe* sqe, gpointer data,
+                          guint index) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = batch->heads[batch->opened[index]].fd;
+}
+
+static void close_complete(gpointer data, guint index, gint result) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  batch->heads[batch->opened[index]].fd = -1;
+}
+
+static void close_run(gpointer data, guint index) {
+  HeadBatch* batch = static_cast<HeadBatch*>(data);
+  MediaStatHead* head = &batch->heads[batch->opened[index]];
+  close(head->fd);
+  head->fd = -1;
+}
+
+void media_stat_close_heads(MediaStatPool* pool,
+                            MediaStatHead* heads,
+                            guint n_heads) {
+  HeadBatch batch = {-1, heads, nullptr};
+  guint n_opened = collect_opened(&batch, n_heads);
+  if (n_opened > 0) {
+    Ring* ring = get_ring();
+    if (ring != nullptr) {
+      ring_run(ring, n_opened, close_prepare, close_complete, close_run,
+               &batch);
+    } else {
+      run_calls(pool, n_opened, close_run, &batch);
+    }
+  }
+  g_free(batch.opened);
+}
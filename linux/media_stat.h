@@ -0,0 +1,90 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_STAT_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_STAT_H_
+
+#include <glib.h>
+
+#include "media_probe.h"
+
+G_BEGIN_DECLS
+
+// Batched file metadata reads for directory scans.
+//
+// On a network mount every stat, open and read is a round trip, so looking
+// at a directory one file at a time keeps a scan thread waiting out the
+// latency of each file in turn. These calls take a batch of files in one
+// directory and keep up to MEDIA_STAT_QUEUE_DEPTH requests in flight at
+// once: through io_uring where the kernel offers it, which also saves a
+// system call per request, and otherwise on a MediaStatPool of threads, one
+// per library root so a slow mount only holds up its own scan.
+
+#define MEDIA_STAT_QUEUE_DEPTH 64
+
+// Threads of each fallback pool.
+#define MEDIA_STAT_THREADS 16
+
+typedef struct _MediaStatPool MediaStatPool;
+
+typedef enum {
+  MEDIA_STAT_BACKEND_IO_URING,
+  MEDIA_STAT_BACKEND_THREADS,
+  // One file at a time on the calling thread, as before batching.
+  MEDIA_STAT_BACKEND_SYNC,
+} MediaStatBackend;
+
+typedef struct {
+  const gchar* name;  // Relative to the directory descriptor.
+  // Filled in by media_stat_files(). Symlinks are followed.
+  gint error;  // 0, or the errno of the failed stat.
+  gboolean regular;
+  gint64 size;
+  gint64 mtime;  // Seconds since the epoch.
+} MediaStatFile;
+
+typedef struct {
+  const gchar* name;  // Relative to the directory descriptor.
+  // Filled in by media_stat_read_heads(): the file, open for reading, or -1
+  // if it could not be opened; and its first bytes.
+  int fd;
+  gsize head_length;
+  guint8 head[MEDIA_PROBE_HEAD_SIZE];
+} MediaStatHead;
+
+// Creates a pool for the batches of one library root. Its threads are only
+// started when a batch runs on the thread pool backend.
+MediaStatPool* media_stat_pool_new(void);
+
+// Waits for the pool's threads to finish and frees it.
+void media_stat_pool_free(MediaStatPool* self);
+
+// The calls below run on |pool| when io_uring is not in use.
+
+// Stats the |n_files| |files| relative to |dir_fd|, which may be AT_FDCWD.
+void media_stat_files(MediaStatPool* pool,
+                      int dir_fd,
+                      MediaStatFile* files,
+                      guint n_files);
+
+// Opens the |n_heads| |heads| relative to |dir_fd| and reads the start of
+// each, for media_probe_image_size_from_head().
+void media_stat_read_heads(MediaStatPool* pool,
+                           int dir_fd,
+                           MediaStatHead* heads,
+                           guint n_heads);
+
+// Closes the files media_stat_read_heads() left open. Closing can be a
+// round trip of its own, e.g. on SMB or FUSE mounts.
+void media_stat_close_heads(MediaStatPool* pool,
+                            MediaStatHead* heads,
+                            guint n_heads);
+
+// Returns the backend in use: io_uring unless the kernel lacks it or a
+// sandbox forbids it, in which case the thread pool.
+MediaStatBackend media_stat_get_backend(void);
+
+// Switches backends, for tests and benchmarks. Returns FALSE and leaves the
+// backend unchanged if io_uring is asked for but unavailable.
+gboolean media_stat_set_backend(MediaStatBackend backend);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_STAT_H_
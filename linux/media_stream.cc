@@ -0,0 +1,200 @@
+#include "media_stream.h"
+
+struct _MediaStreamer {
+  GObject* owner;  // Not owned; each running stream holds its own reference.
+  FlEventChannel* channel;
+  MediaStreamFunc func;
+  GMainContext* context;
+  GThreadPool* pool;
+
+  GMutex mutex;
+  GHashTable* streams;  // gchar* token -> GCancellable*
+};
+
+struct _MediaStreamSink {
+  MediaStreamer* streamer;
+  GObject* owner;
+  GCancellable* cancellable;
+  gchar* token;
+  gpointer request;
+  GDestroyNotify request_free;
+  guint chunk_size;
+
+  FlValue* chunk;  // Entries not sent yet; NULL when empty.
+  gint64 chunk_started;
+  guint count;
+};
+
+// One event on its way to the main context.
+typedef struct {
+  MediaStreamer* streamer;
+  GObject* owner;
+  FlValue* event;
+  // Set on the final event. The sink holds an owner reference that may be
+  // the last one, so it is released on the main context too.
+  MediaStreamSink* sink;
+} StreamEvent;
+
+static void stream_sink_free(MediaStreamSink* sink) {
+  g_clear_pointer(&sink->chunk, fl_value_unref);
+  if (sink->request_free != nullptr) sink->request_free(sink->request);
+  g_object_unref(sink->cancellable);
+  g_object_unref(sink->owner);
+  g_free(sink->token);
+  g_free(sink);
+}
+
+static void stream_event_free(gpointer data) {
+  StreamEvent* event = static_cast<StreamEvent*>(data);
+  fl_value_unref(event->event);
+  g_clear_pointer(&event->sink, stream_sink_free);
+  g_object_unref(event->owner);
+  g_free(event);
+}
+
+// Runs on the streamer's main context.
+static gboolean stream_event_deliver(gpointer data) {
+  StreamEvent* event = static_cast<StreamEvent*>(data);
+  fl_event_channel_send(event->streamer->channel, event->event, nullptr,
+                        nullptr);
+  return G_SOURCE_REMOVE;
+}
+
+// Takes ownership of |event|, and of |sink| when |last| is TRUE.
+static void stream_post(MediaStreamSink* sink, FlValue* event, gboolean last) {
+  StreamEvent* delivery = g_new(StreamEvent, 1);
+  delivery->streamer = sink->streamer;
+  delivery->owner = G_OBJECT(g_object_ref(sink->owner));
+  delivery->event = event;
+  delivery->sink = last ? sink : nullptr;
+  g_main_context_invoke_full(sink->streamer->context, G_PRIORITY_DEFAULT,
+                             stream_event_deliver, delivery,
+                             stream_event_free);
+}
+
+static FlValue* stream_event_new(MediaStreamSink* sink) {
+  FlValue* event = fl_value_new_map();
+  fl_value_set_string_take(event, "token", fl_value_new_string(sink->token));
+  return event;
+}
+
+static void stream_flush(MediaStreamSink* sink) {
+  if (sink->chunk == nullptr) return;
+  FlValue* chunk = sink->chunk;
+  sink->chunk = nullptr;
+  if (g_cancellable_is_cancelled(sink->cancellable)) {
+    fl_value_unref(chunk);
+    return;
+  }
+  FlValue* event = stream_event_new(sink);
+  fl_value_set_string_take(event, "media", chunk);
+  stream_post(sink, event, FALSE);
+}
+
+void media_stream_sink_add(MediaStreamSink* sink, FlValue* entry) {
+  if (sink->chunk == nullptr) {
+    sink->chunk = fl_value_new_list();
+    sink->chunk_started = g_get_monotonic_time();
+  }
+  fl_value_append_take(sink->chunk, entry);
+  sink->count++;
+
+  gint64 waited = (g_get_monotonic_time() - sink->chunk_started) / 1000;
+  if (fl_value_get_length(sink->chunk) >= sink->chunk_size ||
+      waited >= MEDIA_STREAM_FLUSH_INTERVAL_MS) {
+    stream_flush(sink);
+  }
+}
+
+GCancellable* media_stream_sink_get_cancellable(MediaStreamSink* sink) {
+  return sink->cancellable;
+}
+
+// Runs on a worker thread.
+static void stream_run(gpointer data, gpointer user_data) {
+  MediaStreamSink* sink = static_cast<MediaStreamSink*>(data);
+  MediaStreamer* self = sink->streamer;
+
+  if (!g_cancellable_is_cancelled(sink->cancellable)) {
+    self->func(sink->request, sink, sink->owner);
+  }
+  stream_flush(sink);
+
+  g_mutex_lock(&self->mutex);
+  // The token may already name a newer stream if this one was cancelled.
+  if (g_hash_table_lookup(self->streams, sink->token) == sink->cancellable) {
+    g_hash_table_remove(self->streams, sink->token);
+  }
+  g_mutex_unlock(&self->mutex);
+
+  FlValue* done = stream_event_new(sink);
+  fl_value_set_string_take(done, "done", fl_value_new_bool(true));
+  fl_value_set_string_take(done, "count", fl_value_new_int(sink->count));
+  stream_post(sink, done, TRUE);
+}
+
+MediaStreamer* media_streamer_new(GObject* owner,
+                                  FlEventChannel* channel,
+                                  MediaStreamFunc func,
+                                  gint max_threads) {
+  MediaStreamer* self = g_new0(MediaStreamer, 1);
+  self->owner = owner;
+  self->channel = channel;
+  self->func = func;
+  self->context = g_main_context_ref_thread_default();
+  g_mutex_init(&self->mutex);
+  self->streams = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        g_object_unref);
+  self->pool = g_thread_pool_new(stream_run, self, MAX(max_threads, 1), FALSE,
+                                 nullptr);
+  return self;
+}
+
+gboolean media_streamer_start(MediaStreamer* self,
+                              const gchar* token,
+                              gpointer request,
+                              GDestroyNotify request_free,
+                              guint chunk_size) {
+  g_mutex_lock(&self->mutex);
+  if (g_hash_table_contains(self->streams, token)) {
+    g_mutex_unlock(&self->mutex);
+    if (request_free != nullptr) request_free(request);
+    return FALSE;
+  }
+
+  MediaStreamSink* sink = g_new0(MediaStreamSink, 1);
+  sink->streamer = self;
+  sink->owner = G_OBJECT(g_object_ref(self->owner));
+  sink->cancellable = g_cancellable_new();
+  sink->token = g_strdup(token);
+  sink->request = request;
+  sink->request_free = request_free;
+  sink->chunk_size = MAX(chunk_size, 1);
+  g_hash_table_insert(self->streams, g_strdup(token),
+                      g_object_ref(sink->cancellable));
+  g_mutex_unlock(&self->mutex);
+
+  g_thread_pool_push(self->pool, sink, nullptr);
+  return TRUE;
+}
+
+gboolean media_streamer_cancel(MediaStreamer* self, const gchar* token) {
+  g_mutex_lock(&self->mutex);
+  GCancellable* cancellable =
+      G_CANCELLABLE(g_hash_table_lookup(self->streams, token));
+  if (cancellable != nullptr) {
+    g_cancellable_cancel(cancellable);
+    // Forget the token right away so it can be reused.
+    g_hash_table_remove(self->streams, token);
+  }
+  g_mutex_unlock(&self->mutex);
+  return cancellable != nullptr;
+}
+
+void media_streamer_free(MediaStreamer* self) {
+  g_thread_pool_free(self->pool, FALSE, TRUE);
+  g_hash_table_unref(self->streams);
+  g_mutex_clear(&self->mutex);
+  g_main_context_unref(self->context);
+  g_free(self);
+}
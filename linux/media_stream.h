@@ -0,0 +1,59 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_STREAM_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_STREAM_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+// Cancellable streams of media entries, delivered in chunks.
+//
+// Each stream is started under a caller-chosen token and produced on a
+// worker thread. Entries are buffered and sent over an event channel as
+// {token, media: [...]} once a chunk is full, or once the first entry of a
+// chunk has waited MEDIA_STREAM_FLUSH_INTERVAL_MS, so the first entries show
+// up quickly even when producing each one is slow. A final {token, done:
+// true, count} event follows the last chunk. Cancelling a token stops its
+// producer and drops entries not sent yet.
+typedef struct _MediaStreamer MediaStreamer;
+typedef struct _MediaStreamSink MediaStreamSink;
+
+#define MEDIA_STREAM_DEFAULT_CHUNK_SIZE 256
+#define MEDIA_STREAM_FLUSH_INTERVAL_MS 50
+
+// Produces the entries of one stream with media_stream_sink_add(). Runs on a
+// worker thread and should return early once the sink is cancelled.
+// |user_data| is the streamer owner.
+typedef void (*MediaStreamFunc)(gpointer request,
+                                MediaStreamSink* sink,
+                                gpointer user_data);
+
+// Creates a streamer running at most |max_threads| streams at once. Events
+// are sent on |channel| from the thread-default main context. |owner| is
+// passed to |func| and kept alive while streams run; it must also keep
+// |channel| alive.
+MediaStreamer* media_streamer_new(GObject* owner,
+                                  FlEventChannel* channel,
+                                  MediaStreamFunc func,
+                                  gint max_threads);
+
+// Starts a stream under |token| producing |request|, which is released with
+// |request_free| when the stream ends. Returns FALSE, releasing |request|,
+// if a stream with that token is already running.
+gboolean media_streamer_start(MediaStreamer* self,
+                              const gchar* token,
+                              gpointer request,
+                              GDestroyNotify request_free,
+                              guint chunk_size);
+
+// Stops the stream of |token|. Returns FALSE if no such stream is running.
+gboolean media_streamer_cancel(MediaStreamer* self, const gchar* token);
+
+// Waits for running streams to finish and releases the streamer.
+void media_streamer_free(MediaStreamer* self);
+
+// Appends |entry| to the stream, taking ownership, and sends the pending
+// chunk if it is due.
+void media_stream_sink_add(MediaStreamSink* sink, FlValue* entry);
+
+// Returns the stream's cancellable, for passing to blocking I/O.
+GCancellable* media_stream_sink_get_cancellable(MediaStreamSink* sink);
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_STREAM_H_
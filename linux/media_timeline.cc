@@ -0,0 +1,200 @@
+#include "media_timeline.h"
+
+#include <algorithm>
+
+#include <time.h>
+
+// Sets [start, end) to the local day, month or year holding |date|.
+static void get_bucket_bounds(gint64 date,
+                              MediaTimelineGranularity granularity,
+                              gint64* start,
+                              gint64* end) {
+  time_t time = date;
+  struct tm first;
+  localtime_r(&time, &first);
+  first.tm_sec = 0;
+  first.tm_min = 0;
+  first.tm_hour = 0;
+  if (granularity != MEDIA_TIMELINE_DAY) first.tm_mday = 1;
+  if (granularity == MEDIA_TIMELINE_YEAR) first.tm_mon = 0;
+  // Let mktime() work out whether daylight saving time applies.
+  first.tm_isdst = -1;
+  struct tm next = first;
+  switch (granularity) {
+    case MEDIA_TIMELINE_DAY:
+      next.tm_mday++;
+      break;
+    case MEDIA_TIMELINE_MONTH:
+      next.tm_mon++;
+      break;
+    case MEDIA_TIMELINE_YEAR:
+      next.tm_year++;
+      break;
+  }
+  *start = mktime(&first);
+  *end = mktime(&next);
+}
+
+static const guint32* get_date_order(GPtrArray* snapshots,
+                                     guint index,
+                                     guint32 kinds,
+                                     guint* n_records) {
+  return media_index_snapshot_get_order(
+      static_cast<MediaIndexSnapshot*>(snapshots->pdata[index]), nullptr,
+      kinds, MEDIA_SORT_DATE_TAKEN, n_records);
+}
+
+static gint64 get_record_date(GPtrArray* snapshots,
+                              guint index,
+                              guint32 record) {
+  const MediaIndexSnapshot* snapshot =
+      static_cast<const MediaIndexSnapshot*>(snapshots->pdata[index]);
+  return media_timeline_record_date(&snapshot->records[record]);
+}
+
+// Returns the buckets of one snapshot, newest first.
+static GArray* build_snapshot_buckets(GPtrArray* snapshots,
+                                      guint index,
+                                      guint32 kinds,
+                                      MediaTimelineGranularity granularity) {
+  const MediaIndexSnapshot* snapshot =
+      static_cast<const MediaIndexSnapshot*>(snapshots->pdata[index]);
+  guint n_records = 0;
+  const guint32* order = get_date_order(snapshots, index, kinds, &n_records);
+
+  GArray* buckets = g_array_new(FALSE, FALSE, sizeof(MediaTimelineBucket));
+  MediaTimelineBucket* bucket = nullptr;
+  for (guint i = n_records; i-- > 0;) {
+    gint64 date = media_timeline_record_date(&snapshot->records[order[i]]);
+    if (bucket == nullptr || date < bucket->start) {
+      // The first record seen of a bucket is its newest.
+      MediaTimelineBucket next = {0, 0, 0, index, order[i]};
+      get_bucket_bounds(date, granularity, &next.start, &next.end);
+      g_array_append_val(buckets, next);
+      bucket = &g_array_index(buckets, MediaTimelineBucket, buckets->len - 1);
+    }
+    bucket->count++;
+  }
+  return buckets;
+}
+
+GArray* media_timeline_build(GPtrArray* snapshots,
+                             guint32 kinds,
+                             MediaTimelineGranularity granularity) {
+  if (snapshots->len == 1) {
+    return build_snapshot_buckets(snapshots, 0, kinds, granularity);
+  }
+
+  g_autoptr(GPtrArray) lists = g_ptr_array_new_with_free_func(
+      reinterpret_cast<GDestroyNotify>(g_array_unref));
+  for (guint s = 0; s < snapshots->len; s++) {
+    g_ptr_array_add(lists,
+                    build_snapshot_buckets(snapshots, s, kinds, granularity));
+  }
+
+  // Every list is ordered newest first, so merge them, adding up buckets
+  // that several roots have.
+  GArray* buckets = g_array_new(FALSE, FALSE, sizeof(MediaTimelineBucket));
+  g_autofree guint* cursors = g_new0(guint, lists->len);
+  while (TRUE) {
+    MediaTimelineBucket* newest = nullptr;
+    for (guint l = 0; l < lists->len; l++) {
+      GArray* list = static_cast<GArray*>(lists->pdata[l]);
+      if (cursors[l] == list->len) continue;
+      MediaTimelineBucket* head =
+          &g_array_index(list, MediaTimelineBucket, cursors[l]);
+      if (newest == nullptr || head->start > newest->start) newest = head;
+    }
+    if (newest == nullptr) break;
+
+    MediaTimelineBucket merged = *newest;
+    merged.count = 0;
+    gint64 cover_date =
+        get_record_date(snapshots, merged.cover_snapshot, merged.cover);
+    for (guint l = 0; l < lists->len; l++) {
+      GArray* list = static_cast<GArray*>(lists->pdata[l]);
+      if (cursors[l] == list->len) continue;
+      const MediaTimelineBucket* head =
+          &g_array_index(list, MediaTimelineBucket, cursors[l]);
+      if (head->start != merged.start) continue;
+      merged.count += head->count;
+      gint64 date = get_record_date(snapshots, head->cover_snapshot,
+                                    head->cover);
+      if (date > cover_date) {
+        merged.cover_snapshot = head->cover_snapshot;
+        merged.cover = head->cover;
+        cover_date = date;
+      }
+      cursors[l]++;
+    }
+    g_array_append_val(buckets, merged);
+  }
+  return buckets;
+}
+
+// Walks the records of one snapshot within the range, newest first.
+typedef struct {
+  const MediaIndexSnapshot* snapshot;
+  const guint32* order;
+  guint first;  // Position in |order| of the oldest record in range.
+  guint next;   // One past the position of the next record to take.
+} RangeCursor;
+
+GArray* media_timeline_get_range(GPtrArray* snapshots,
+                                 guint32 kinds,
+                                 gint64 start,
+                                 gint64 end,
+                                 guint offset,
+                                 gint64 limit) {
+  GArray* entries = g_array_new(FALSE, FALSE, sizeof(MediaTimelineEntry));
+  g_autofree RangeCursor* cursors = g_new0(RangeCursor, snapshots->len);
+  for (guint s = 0; s < snapshots->len; s++) {
+    RangeCursor* cursor = &cursors[s];
+    cursor->snapshot =
+        static_cast<const MediaIndexSnapshot*>(snapshots->pdata[s]);
+    guint n_records = 0;
+    cursor->order = get_date_order(snapshots, s, kinds, &n_records);
+    auto date_before = [cursor](guint32 record, gint64 date) {
+      return media_timeline_record_date(&cursor->snapshot->records[record]) <
+             date;
+    };
+    const guint32* order_end = cursor->order + n_records;
+    cursor->first =
+        std::lower_bound(cursor->order, order_end, start, date_before) -
+        cursor->order;
+    cursor->next =
+        std::lower_bound(cursor->order, order_end, MAX(end, start),
+                         date_before) -
+        cursor->order;
+  }
+
+  // Merges the roots, taking the newest head each time; ties go to the
+  // earlier root.
+  guint skipped = 0;
+  while (limit != 0) {
+    RangeCursor* newest = nullptr;
+    gint64 newest_date = 0;
+    for (guint s = 0; s < snapshots->len; s++) {
+      RangeCursor* cursor = &cursors[s];
+      if (cursor->next == cursor->first) continue;
+      gint64 date = media_timeline_record_date(
+          &cursor->snapshot->records[cursor->order[cursor->next - 1]]);
+      if (newest == nullptr || date > newest_date) {
+        newest = cursor;
+        newest_date = date;
+      }
+    }
+    if (newest == nullptr) break;
+
+    newest->next--;
+    if (skipped < offset) {
+      skipped++;
+      continue;
+    }
+    MediaTimelineEntry entry = {(guint32)(newest - cursors),
+                                newest->order[newest->next]};
+    g_array_append_val(entries, entry);
+    if (limit > 0) limit--;
+  }
+  return entries;
+}
@@ -0,0 +1,69 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_TIMELINE_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_TIMELINE_H_
+
+#include <glib.h>
+
+#include "media_index.h"
+
+G_BEGIN_DECLS
+
+// Groups the media of every library root by date, for timeline views.
+//
+// Media are dated by their capture time, or their mtime when it is unknown,
+// which is the MEDIA_SORT_DATE_TAKEN key. Each snapshot caches its records
+// in that order, so a timeline is one walk over presorted records per root:
+// the calendar is only consulted when a record falls outside the current
+// bucket, and the roots' bucket lists are merged at the end. Buckets follow
+// the local time zone.
+//
+// |snapshots| is an array of MediaIndexSnapshot*, as returned by
+// media_library_get_snapshots().
+
+typedef enum {
+  MEDIA_TIMELINE_DAY,
+  MEDIA_TIMELINE_MONTH,
+  MEDIA_TIMELINE_YEAR,
+} MediaTimelineGranularity;
+
+typedef struct {
+  // Local midnight starting the day, month or year, and the one starting
+  // the next, in seconds since the epoch.
+  gint64 start;
+  gint64 end;
+  guint32 count;
+  // The newest item: its snapshot in |snapshots| and its position in that
+  // snapshot's record table.
+  guint32 cover_snapshot;
+  guint32 cover;
+} MediaTimelineBucket;
+
+typedef struct {
+  guint32 snapshot;  // Index in |snapshots|.
+  guint32 record;    // Position in that snapshot's record table.
+} MediaTimelineEntry;
+
+// Returns the time |record| is placed at, in seconds since the epoch.
+static inline gint64 media_timeline_record_date(const MediaRecord* record) {
+  return record->date_taken != 0 ? record->date_taken : record->mtime;
+}
+
+// Returns the non-empty buckets of the media whose kind is in |kinds|, as a
+// GArray of MediaTimelineBucket, newest first.
+GArray* media_timeline_build(GPtrArray* snapshots,
+                             guint32 kinds,
+                             MediaTimelineGranularity granularity);
+
+// Returns the media whose kind is in |kinds| and whose date lies in
+// [start, end), newest first, as a GArray of MediaTimelineEntry. The first
+// |offset| are skipped and at most |limit| are returned, or all of them
+// when |limit| is negative.
+GArray* media_timeline_get_range(GPtrArray* snapshots,
+                                 guint32 kinds,
+                                 gint64 start,
+                                 gint64 end,
+                                 guint offset,
+                                 gint64 limit);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_TIMELINE_H_
@@ -0,0 +1,313 @@
+#include "media_video.h"
+
+#include <gio/gio.h>
+#include <gst/app/gstappsink.h>
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+#include <gst/video/video.h>
+#include <string.h>
+
+// How long a pipeline may take to preroll, seek or hand over a frame, and
+// how long the discoverer may take per file.
+#define VIDEO_TIMEOUT (5 * GST_SECOND)
+
+// Idle pipelines and discoverers kept for reuse. More are created when
+// several threads need one at the same time; the extra ones are dropped
+// when they are returned.
+#define MAX_IDLE_PIPELINES 4
+#define MAX_IDLE_DISCOVERERS 4
+
+typedef struct {
+  GstElement* pipeline;
+  GstElement* decodebin;
+  GstElement* convert;
+  GstElement* capsfilter;
+  GstElement* sink;
+} FramePipeline;
+
+static GMutex pool_mutex;
+static GQueue idle_pipelines = G_QUEUE_INIT;
+static GQueue idle_discoverers = G_QUEUE_INIT;
+
+// gst_init() is thread-safe and does nothing after the first call.
+static void video_init() {
+  gst_init(nullptr, nullptr);
+}
+
+gboolean media_video_is_video_file(const gchar* path) {
+  g_autofree gchar* content_type = g_content_type_guess(path, nullptr, 0,
+                                                        nullptr);
+  return g_content_type_is_a(content_type, "video/*");
+}
+
+// Links each decoded video stream to the converter; other streams are not
+// exposed at all (see frame_pipeline_new()).
+static void frame_pipeline_pad_added(GstElement* decodebin,
+                                     GstPad* pad,
+                                     gpointer user_data) {
+  FramePipeline* frame = static_cast<FramePipeline*>(user_data);
+  g_autoptr(GstPad) sink_pad = gst_element_get_static_pad(frame->convert,
+                                                          "sink");
+  if (!gst_pad_is_linked(sink_pad)) gst_pad_link(pad, sink_pad);
+}
+
+static void frame_pipeline_free(FramePipeline* frame) {
+  gst_element_set_state(frame->pipeline, GST_STATE_NULL);
+  gst_object_unref(frame->pipeline);
+  g_free(frame);
+}
+
+static FramePipeline* frame_pipeline_new(GError** error) {
+  GstElement* decodebin = gst_element_factory_make("uridecodebin", nullptr);
+  GstElement* convert = gst_element_factory_make("videoconvert", nullptr);
+  GstElement* scale = gst_element_factory_make("videoscale", nullptr);
+  GstElement* capsfilter = gst_element_factory_make("capsfilter", nullptr);
+  GstElement* sink = gst_element_factory_make("appsink", nullptr);
+  if (decodebin == nullptr || convert == nullptr || scale == nullptr ||
+      capsfilter == nullptr || sink == nullptr) {
+    GstElement* elements[] = {decodebin, convert, scale, capsfilter, sink};
+    for (GstElement* element : elements) {
+      if (element != nullptr) gst_object_unref(element);
+    }
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "GStreamer base plugins are not installed");
+    return nullptr;
+  }
+
+  FramePipeline* frame = g_new0(FramePipeline, 1);
+  frame->pipeline = gst_pipeline_new("video-frame");
+  frame->decodebin = decodebin;
+  frame->convert = convert;
+  frame->capsfilter = capsfilter;
+  frame->sink = sink;
+
+  // Stop at raw video and leave audio streams undecoded.
+  g_autoptr(GstCaps) raw_caps = gst_caps_from_string("video/x-raw");
+  g_object_set(decodebin, "caps", raw_caps, "expose-all-streams", FALSE,
+               nullptr);
+  // Only the prerolled frame is wanted, so never wait on the clock.
+  g_object_set(sink, "sync", FALSE, "max-buffers", 1, "drop", TRUE,
+               "enable-last-sample", FALSE, nullptr);
+
+  gst_bin_add_many(GST_BIN(frame->pipeline), decodebin, convert, scale,
+                   capsfilter, sink, nullptr);
+  gst_element_link_many(convert, scale, capsfilter, sink, nullptr);
+  g_signal_connect(decodebin, "pad-added",
+                   G_CALLBACK(frame_pipeline_pad_added), frame);
+  return frame;
+}
+
+static FramePipeline* frame_pipeline_take(GError** error) {
+  g_mutex_lock(&pool_mutex);
+  FramePipeline* frame =
+      static_cast<FramePipeline*>(g_queue_pop_head(&idle_pipelines));
+  g_mutex_unlock(&pool_mutex);
+  return frame != nullptr ? frame : frame_pipeline_new(error);
+}
+
+// Returns |frame| to the pool, or frees it if it failed or the pool is full.
+static void frame_pipeline_release(FramePipeline* frame, gboolean reusable) {
+  // READY drops the source and decoders but keeps the elements and bus.
+  if (reusable &&
+      gst_element_set_state(frame->pipeline, GST_STATE_READY) !=
+          GST_STATE_CHANGE_FAILURE) {
+    g_mutex_lock(&pool_mutex);
+    gboolean pooled = idle_pipelines.length < MAX_IDLE_PIPELINES;
+    if (pooled) g_queue_push_head(&idle_pipelines, frame);
+    g_mutex_unlock(&pool_mutex);
+    if (pooled) return;
+  }
+  frame_pipeline_free(frame);
+}
+
+// Waits for a pending state change. On failure, sets |error| from the error
+// the pipeline posted, if any.
+static gboolean frame_pipeline_wait(FramePipeline* frame,
+                                    GstStateChangeReturn change,
+                                    GError** error) {
+  if (change == GST_STATE_CHANGE_ASYNC) {
+    change = gst_element_get_state(frame->pipeline, nullptr, nullptr,
+                                   VIDEO_TIMEOUT);
+  }
+  if (change == GST_STATE_CHANGE_SUCCESS ||
+      change == GST_STATE_CHANGE_NO_PREROLL) {
+    return TRUE;
+  }
+
+  g_autoptr(GstBus) bus = gst_element_get_bus(frame->pipeline);
+  g_autoptr(GstMessage) message =
+      gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+  if (message != nullptr) {
+    gst_message_parse_error(message, error, nullptr);
+  } else if (change == GST_STATE_CHANGE_ASYNC) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                "Timed out decoding the video");
+  } else {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Failed to decode the video");
+  }
+  return FALSE;
+}
+
+// Copies the RGB frame in |sample| into a new pixbuf.
+static GdkPixbuf* pixbuf_from_sample(GstSample* sample, GError** error) {
+  GstVideoInfo info;
+  GstVideoFrame video_frame;
+  if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+      !gst_video_frame_map(&video_frame, &info, gst_sample_get_buffer(sample),
+                           GST_MAP_READ)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Failed to read the video frame");
+    return nullptr;
+  }
+
+  gint width = GST_VIDEO_FRAME_WIDTH(&video_frame);
+  gint height = GST_VIDEO_FRAME_HEIGHT(&video_frame);
+  GdkPixbuf* pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width,
+                                     height);
+  const guint8* source =
+      static_cast<const guint8*>(GST_VIDEO_FRAME_PLANE_DATA(&video_frame, 0));
+  gint source_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&video_frame, 0);
+  guint8* target = gdk_pixbuf_get_pixels(pixbuf);
+  gint target_stride = gdk_pixbuf_get_rowstride(pixbuf);
+  for (gint y = 0; y < height; y++) {
+    memcpy(target + (gsize)y * target_stride,
+           source + (gsize)y * source_stride, (gsize)width * 3);
+  }
+  gst_video_frame_unmap(&video_frame);
+  return pixbuf;
+}
+
+// Picks the frame position for a clip of |duration| (GST_CLOCK_TIME_NONE
+// when unknown).
+static GstClockTime choose_position(gint64 position_ms,
+                                    GstClockTime duration) {
+  GstClockTime position = position_ms >= 0
+                              ? (GstClockTime)position_ms * GST_MSECOND
+                              : MEDIA_VIDEO_DEFAULT_POSITION_MS * GST_MSECOND;
+  if (GST_CLOCK_TIME_IS_VALID(duration) &&
+      (position_ms < 0 ? position * 2 > duration : position >= duration)) {
+    position = duration / 2;
+  }
+  return position;
+}
+
+GdkPixbuf* media_video_extract_frame(const gchar* path,
+                                     gint width,
+                                     gint height,
+                                     gint64 position_ms,
+                                     GError** error) {
+  video_init();
+  g_autofree gchar* uri = g_filename_to_uri(path, nullptr, error);
+  if (uri == nullptr) return nullptr;
+  FramePipeline* frame = frame_pipeline_take(error);
+  if (frame == nullptr) return nullptr;
+
+  // Drop whatever the previous use left on the bus.
+  g_autoptr(GstBus) bus = gst_element_get_bus(frame->pipeline);
+  gst_bus_set_flushing(bus, TRUE);
+  gst_bus_set_flushing(bus, FALSE);
+
+  // videoscale fixes both dimensions within these ranges while keeping the
+  // display aspect ratio, so the frame fits the box.
+  g_autoptr(GstCaps) caps = gst_caps_new_simple(
+      "video/x-raw", "format", G_TYPE_STRING, "RGB", "pixel-aspect-ratio",
+      GST_TYPE_FRACTION, 1, 1, "width", GST_TYPE_INT_RANGE, 1, MAX(width, 1),
+      "height", GST_TYPE_INT_RANGE, 1, MAX(height, 1), nullptr);
+  g_object_set(frame->capsfilter, "caps", caps, nullptr);
+  g_object_set(frame->decodebin, "uri", uri, nullptr);
+
+  if (!frame_pipeline_wait(
+          frame, gst_element_set_state(frame->pipeline, GST_STATE_PAUSED),
+          error)) {
+    frame_pipeline_release(frame, FALSE);
+    return nullptr;
+  }
+
+  gint64 duration = -1;
+  if (!gst_element_query_duration(frame->pipeline, GST_FORMAT_TIME,
+                                  &duration)) {
+    duration = -1;
+  }
+  GstClockTime position = choose_position(
+      position_ms, duration >= 0 ? (GstClockTime)duration : GST_CLOCK_TIME_NONE);
+  if (position > 0) {
+    // Decoding from the keyframe before the position is much cheaper than
+    // an accurate seek, and any frame near it will do.
+    GstSeekFlags flags = static_cast<GstSeekFlags>(
+        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+        GST_SEEK_FLAG_SNAP_BEFORE);
+    if (gst_element_seek_simple(frame->pipeline, GST_FORMAT_TIME, flags,
+                                position) &&
+        !frame_pipeline_wait(frame, GST_STATE_CHANGE_ASYNC, error)) {
+      frame_pipeline_release(frame, FALSE);
+      return nullptr;
+    }
+  }
+
+  GstSample* sample = gst_app_sink_try_pull_preroll(GST_APP_SINK(frame->sink),
+                                                    VIDEO_TIMEOUT);
+  GdkPixbuf* pixbuf = nullptr;
+  if (sample != nullptr) {
+    pixbuf = pixbuf_from_sample(sample, error);
+    gst_sample_unref(sample);
+  } else {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "%s has no decodable video stream", path);
+  }
+  frame_pipeline_release(frame, pixbuf != nullptr);
+  return pixbuf;
+}
+
+static GstDiscoverer* discoverer_take(GError** error) {
+  g_mutex_lock(&pool_mutex);
+  GstDiscoverer* discoverer =
+      static_cast<GstDiscoverer*>(g_queue_pop_head(&idle_discoverers));
+  g_mutex_unlock(&pool_mutex);
+  return discoverer != nullptr ? discoverer
+                               : gst_discoverer_new(VIDEO_TIMEOUT, error);
+}
+
+static void discoverer_release(GstDiscoverer* discoverer) {
+  g_mutex_lock(&pool_mutex);
+  gboolean pooled = idle_discoverers.length < MAX_IDLE_DISCOVERERS;
+  if (pooled) g_queue_push_head(&idle_discoverers, discoverer);
+  g_mutex_unlock(&pool_mutex);
+  if (!pooled) g_object_unref(discoverer);
+}
+
+gboolean media_video_probe(const gchar* path,
+                           MediaVideoInfo* info,
+                           GError** error) {
+  memset(info, 0, sizeof(*info));
+  video_init();
+  g_autofree gchar* uri = g_filename_to_uri(path, nullptr, error);
+  if (uri == nullptr) return FALSE;
+  GstDiscoverer* discoverer = discoverer_take(error);
+  if (discoverer == nullptr) return FALSE;
+
+  // The synchronous discoverer is reusable but not reentrant, so each one
+  // serves one caller at a time.
+  g_autoptr(GstDiscovererInfo) result =
+      gst_discoverer_discover_uri(discoverer, uri, error);
+  discoverer_release(discoverer);
+  if (result == nullptr) return FALSE;
+
+  GList* streams = gst_discoverer_info_get_video_streams(result);
+  if (streams == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "%s has no video stream", path);
+    return FALSE;
+  }
+  GstDiscovererVideoInfo* video =
+      static_cast<GstDiscovererVideoInfo*>(streams->data);
+  info->width = gst_discoverer_video_info_get_width(video);
+  info->height = gst_discoverer_video_info_get_height(video);
+  gst_discoverer_stream_info_list_free(streams);
+
+  GstClockTime duration = gst_discoverer_info_get_duration(result);
+  if (GST_CLOCK_TIME_IS_VALID(duration)) {
+    info->duration_ms = duration / GST_MSECOND;
+  }
+  return TRUE;
+}
@@ -0,0 +1,47 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_VIDEO_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_VIDEO_H_
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Video frames and stream information through GStreamer.
+//
+// Frames come from a "uridecodebin ! videoconvert ! videoscale ! appsink"
+// pipeline that prerolls, seeks to the nearest keyframe before the requested
+// position and scales the frame to the target box while converting it.
+// Pipelines and discoverers are kept in process-wide pools and reused, so a
+// grid of videos does not build a pipeline per cell. All functions are
+// thread-safe and initialise GStreamer on first use.
+
+// Position of the frame used when none is requested. Clips shorter than
+// twice this use their middle frame instead.
+#define MEDIA_VIDEO_DEFAULT_POSITION_MS 1000
+
+typedef struct {
+  gint64 duration_ms;  // 0 when unknown, e.g. for live streams.
+  gint width;
+  gint height;
+} MediaVideoInfo;
+
+// Reads the duration and dimensions of the first video stream of the file
+// at |path|.
+gboolean media_video_probe(const gchar* path,
+                           MediaVideoInfo* info,
+                           GError** error);
+
+// Returns the keyframe at or before |position_ms| (or the default position
+// when it is negative) of the video at |path|, scaled to fit in
+// |width|x|height| while keeping its aspect ratio.
+GdkPixbuf* media_video_extract_frame(const gchar* path,
+                                     gint width,
+                                     gint height,
+                                     gint64 position_ms,
+                                     GError** error);
+
+// Returns TRUE if the file name |path| looks like a video.
+gboolean media_video_is_video_file(const gchar* path);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_MEDIA_VIDEO_H_
@@ -0,0 +1,187 @@
+#include "method_dispatcher.h"
+
+#include "performance_stats.h"
+
+typedef struct {
+  gchar* name;
+  GThreadPool* pool;
+  PerformanceQueue* queue_stats;
+} DispatchLane;
+
+typedef struct {
+  MethodDispatcherHandler handler;
+  DispatchLane* lane;  // NULL for methods handled inline.
+  PerformanceMethod* stats;
+} DispatchMethod;
+
+struct _MethodDispatcher {
+  GObject* owner;  // Not owned; each queued job holds its own reference.
+  GMainContext* context;
+  GHashTable* lanes;    // gchar* name -> DispatchLane*
+  GHashTable* methods;  // gchar* name -> DispatchMethod*
+};
+
+typedef struct {
+  MethodDispatcherHandler handler;
+  FlMethodCall* method_call;
+  GObject* owner;
+  GMainContext* context;
+  FlMethodResponse* response;
+  PerformanceMethod* stats;
+  gint64 queued;  // 0 when performance stats are off.
+} DispatchJob;
+
+static void dispatch_lane_free(gpointer data) {
+  DispatchLane* lane = static_cast<DispatchLane*>(data);
+  // Let queued jobs run so every pending call still gets a response.
+  g_thread_pool_free(lane->pool, FALSE, TRUE);
+  g_free(lane->name);
+  g_free(lane);
+}
+
+static void dispatch_job_free(gpointer data) {
+  DispatchJob* job = static_cast<DispatchJob*>(data);
+  g_clear_object(&job->response);
+  g_object_unref(job->method_call);
+  g_object_unref(job->owner);
+  g_main_context_unref(job->context);
+  g_free(job);
+}
+
+// Runs on the dispatcher's main context.
+static gboolean dispatch_job_deliver(gpointer data) {
+  DispatchJob* job = static_cast<DispatchJob*>(data);
+  g_autoptr(GError) error = nullptr;
+  if (!fl_method_call_respond(job->method_call, job->response, &error)) {
+    g_warning("Failed to send response to %s: %s",
+              fl_method_call_get_name(job->method_call), error->message);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+// Runs on a lane worker thread.
+static void dispatch_job_run(gpointer data, gpointer user_data) {
+  DispatchJob* job = static_cast<DispatchJob*>(data);
+  DispatchLane* lane = static_cast<DispatchLane*>(user_data);
+  if (job->queued != 0) {
+    performance_stats_sample_queue(lane->queue_stats,
+                                   g_thread_pool_unprocessed(lane->pool));
+  }
+  gint64 start = performance_stats_begin();
+  job->response = job->handler(job->method_call, job->owner);
+  performance_stats_end_method(job->stats, job->queued, start,
+                               FL_IS_METHOD_ERROR_RESPONSE(job->response));
+  // The job, and with it the last reference to the owner, is released on the
+  // main context so the plugin is never disposed from inside its own pool.
+  g_main_context_invoke_full(job->context, G_PRIORITY_DEFAULT,
+                             dispatch_job_deliver, job, dispatch_job_free);
+}
+
+MethodDispatcher* method_dispatcher_new(GObject* owner) {
+  MethodDispatcher* self = g_new0(MethodDispatcher, 1);
+  self->owner = owner;
+  self->context = g_main_context_ref_thread_default();
+  self->lanes = g_hash_table_new_full(g_str_hash, g_str_equal, nullptr,
+                                      dispatch_lane_free);
+  self->methods = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        g_free);
+  return self;
+}
+
+void method_dispatcher_add_lane(MethodDispatcher* self,
+                                const gchar* lane,
+                                gint max_threads) {
+  g_autoptr(GError) error = nullptr;
+  DispatchLane* dispatch_lane = g_new0(DispatchLane, 1);
+  dispatch_lane->name = g_strdup(lane);
+  // Non-exclusive pools share idle threads process-wide; |max_threads| only
+  // bounds how many of them work on this lane at once.
+  dispatch_lane->pool = g_thread_pool_new(dispatch_job_run, dispatch_lane,
+                                          MAX(max_threads, 1), FALSE, &error);
+  if (dispatch_lane->pool == nullptr) {
+    g_warning("Failed to create %s worker pool: %s", lane, error->message);
+    g_free(dispatch_lane->name);
+    g_free(dispatch_lane);
+    return;
+  }
+  dispatch_lane->queue_stats = performance_stats_register_queue(lane);
+  g_hash_table_replace(self->lanes, dispatch_lane->name, dispatch_lane);
+}
+
+void method_dispatcher_add_method(MethodDispatcher* self,
+                                  const gchar* method,
+                                  MethodDispatcherHandler handler,
+                                  const gchar* lane) {
+  DispatchMethod* dispatch_method = g_new0(DispatchMethod, 1);
+  dispatch_method->handler = handler;
+  dispatch_method->stats = performance_stats_register_method(method);
+  if (lane != nullptr) {
+    dispatch_method->lane =
+        static_cast<DispatchLane*>(g_hash_table_lookup(self->lanes, lane));
+    if (dispatch_method->lane == nullptr) {
+      g_warning("Unknown lane %s for %s, handling inline", lane, method);
+    }
+  }
+  g_hash_table_replace(self->methods, g_strdup(method), dispatch_method);
+}
+
+gboolean method_dispatcher_dispatch(MethodDispatcher* self,
+                                    FlMethodCall* method_call) {
+  DispatchMethod* dispatch_method = static_cast<DispatchMethod*>(
+      g_hash_table_lookup(self->methods, fl_method_call_get_name(method_call)));
+  if (dispatch_method == nullptr) {
+    return FALSE;
+  }
+
+  if (dispatch_method->lane == nullptr) {
+    gint64 start = performance_stats_begin();
+    g_autoptr(FlMethodResponse) response =
+        dispatch_method->handler(method_call, self->owner);
+    performance_stats_end_method(dispatch_method->stats, start, start,
+                                 FL_IS_METHOD_ERROR_RESPONSE(response));
+    fl_method_call_respond(method_call, response, nullptr);
+    return TRUE;
+  }
+
+  DispatchJob* job = g_new0(DispatchJob, 1);
+  job->handler = dispatch_method->handler;
+  job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  job->owner = G_OBJECT(g_object_ref(self->owner));
+  job->context = g_main_context_ref(self->context);
+  job->stats = dispatch_method->stats;
+  job->queued = performance_stats_begin();
+
+  // |job| belongs to the lane once pushed and may be gone by the time this
+  // returns.
+  gint64 queued = job->queued;
+  DispatchLane* lane = dispatch_method->lane;
+  g_autoptr(GError) error = nullptr;
+  if (!g_thread_pool_push(lane->pool, job, &error)) {
+    g_warning("Failed to queue %s: %s", fl_method_call_get_name(method_call),
+              error->message);
+    dispatch_job_free(job);
+    fl_method_call_respond_error(method_call, "DISPATCH_ERROR",
+                                 "Failed to schedule method call", nullptr,
+                                 nullptr);
+  } else if (queued != 0) {
+    performance_stats_sample_queue(lane->queue_stats,
+                                   g_thread_pool_unprocessed(lane->pool));
+  }
+  return TRUE;
+}
+
+guint method_dispatcher_get_queue_depth(MethodDispatcher* self,
+                                        const gchar* lane) {
+  DispatchLane* dispatch_lane =
+      static_cast<DispatchLane*>(g_hash_table_lookup(self->lanes, lane));
+  return dispatch_lane != nullptr
+             ? g_thread_pool_unprocessed(dispatch_lane->pool)
+             : 0;
+}
+
+void method_dispatcher_free(MethodDispatcher* self) {
+  g_hash_table_unref(self->methods);
+  g_hash_table_unref(self->lanes);
+  g_main_context_unref(self->context);
+  g_free(self);
+}
@@ -0,0 +1,53 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_METHOD_DISPATCHER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_METHOD_DISPATCHER_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+// Routes method calls to handlers running on bounded worker pools.
+//
+// Every method belongs to a "lane". Each lane owns its own GThreadPool whose
+// thread count is the lane's concurrency cap, so a burst of calls on one lane
+// (e.g. thumbnails) can never occupy the threads of another lane (e.g. album
+// listing). Handlers run on a worker thread and their response is delivered
+// back on the main context the dispatcher was created on, which is where
+// fl_method_call_respond() must be called.
+//
+// Every call's wait for a thread and run time are counted in the
+// performance stats under its method, and each lane's backlog under the
+// lane's name.
+typedef struct _MethodDispatcher MethodDispatcher;
+
+// Produces the response for |method_call|. Runs on a worker thread unless the
+// method was registered without a lane. |user_data| is the dispatcher owner.
+typedef FlMethodResponse* (*MethodDispatcherHandler)(FlMethodCall* method_call,
+                                                     gpointer user_data);
+
+// Creates a dispatcher bound to the thread-default main context. |owner| is
+// passed to every handler and kept alive while its calls are in flight.
+MethodDispatcher* method_dispatcher_new(GObject* owner);
+
+// Adds a lane named |lane| that runs at most |max_threads| handlers at once.
+void method_dispatcher_add_lane(MethodDispatcher* self,
+                                const gchar* lane,
+                                gint max_threads);
+
+// Routes |method| to |handler| on |lane|. A NULL |lane| runs the handler
+// inline on the main thread, which is only suitable for trivial methods.
+void method_dispatcher_add_method(MethodDispatcher* self,
+                                  const gchar* method,
+                                  MethodDispatcherHandler handler,
+                                  const gchar* lane);
+
+// Queues |method_call| on its lane. Returns FALSE if the method is unknown,
+// in which case the caller is responsible for responding.
+gboolean method_dispatcher_dispatch(MethodDispatcher* self,
+                                    FlMethodCall* method_call);
+
+// Returns the number of calls waiting for a free thread on |lane|.
+guint method_dispatcher_get_queue_depth(MethodDispatcher* self,
+                                        const gchar* lane);
+
+// Waits for running handlers to finish and releases the dispatcher.
+void method_dispatcher_free(MethodDispatcher* self);
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_METHOD_DISPATCHER_H_
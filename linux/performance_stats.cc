@@ -0,0 +1,378 @@
+#include "performance_stats.h"
+
+#include <math.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct _PerformanceMethod {
+  const gchar* name;  // Interned.
+  guint64 errors;
+  PerformanceHistogram latency;
+  PerformanceHistogram queue_wait;
+};
+
+struct _PerformanceQueue {
+  const gchar* name;  // Interned.
+  guint depth;
+  guint peak_depth;
+};
+
+// One timed section. |sequence| is odd while the slot is being written and
+// 2 * (index + 1) once span |index| is complete, so the trace writer can
+// skip slots that are being reused under it.
+typedef struct {
+  guint64 sequence;
+  const gchar* name;
+  const gchar* category;
+  gint64 start;
+  gint64 duration;
+  gint64 thread;
+} TraceSpan;
+
+static gint enabled = TRUE;
+
+static PerformanceHistogram stages[PERFORMANCE_N_STAGES];
+
+// Registration is rare and takes the lock; entries below the counts are
+// complete and never move, so recording and reading need no lock.
+static GMutex registry_mutex;
+static PerformanceMethod methods[PERFORMANCE_MAX_METHODS];
+static gint n_methods = 0;
+static PerformanceQueue queues[PERFORMANCE_MAX_QUEUES];
+static gint n_queues = 0;
+
+static TraceSpan trace_spans[PERFORMANCE_TRACE_SPANS];
+static guint64 trace_next = 0;
+// Spans before this one were dropped by a reset.
+static guint64 trace_first = 0;
+
+static const gchar* kStageNames[PERFORMANCE_N_STAGES] = {
+    "decode",
+    "scale",
+    "encode",
+    "filesystem",
+};
+
+static guint histogram_bucket(guint64 value) {
+  if (value < PERFORMANCE_HISTOGRAM_SUB_BUCKETS) return value;
+  value = MIN(value, (G_GUINT64_CONSTANT(1)
+                      << (PERFORMANCE_HISTOGRAM_MAX_EXPONENT + 1)) -
+                         1);
+  guint exponent = 63 - __builtin_clzll(value);
+  guint shift = exponent - 4;
+  return PERFORMANCE_HISTOGRAM_SUB_BUCKETS * (shift + 1) +
+         (guint)(value >> shift) - PERFORMANCE_HISTOGRAM_SUB_BUCKETS;
+}
+
+// Returns the highest value counted into |bucket|.
+static guint64 histogram_bucket_max(guint bucket) {
+  if (bucket < PERFORMANCE_HISTOGRAM_SUB_BUCKETS) return bucket;
+  guint shift = bucket / PERFORMANCE_HISTOGRAM_SUB_BUCKETS - 1;
+  guint64 sub = bucket % PERFORMANCE_HISTOGRAM_SUB_BUCKETS +
+                PERFORMANCE_HISTOGRAM_SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+static void atomic_max(guint64* target, guint64 value) {
+  guint64 current = __atomic_load_n(target, __ATOMIC_RELAXED);
+  while (value > current &&
+         !__atomic_compare_exchange_n(target, &current, value, TRUE,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+void performance_histogram_record(PerformanceHistogram* histogram,
+                                  guint64 value_us) {
+  __atomic_fetch_add(&histogram->counts[histogram_bucket(value_us)], 1,
+                     __ATOMIC_RELAXED);
+  __atomic_fetch_add(&histogram->total_us, value_us, __ATOMIC_RELAXED);
+  atomic_max(&histogram->max_us, value_us);
+}
+
+void performance_histogram_summarize(const PerformanceHistogram* histogram,
+                                     PerformanceSummary* summary) {
+  // Buckets are read one at a time while other threads add to them, so the
+  // count is their own total.
+  guint64 counts[PERFORMANCE_HISTOGRAM_BUCKETS];
+  guint64 count = 0;
+  for (guint i = 0; i < PERFORMANCE_HISTOGRAM_BUCKETS; i++) {
+    counts[i] = __atomic_load_n(&histogram->counts[i], __ATOMIC_RELAXED);
+    count += counts[i];
+  }
+  guint64 total_us = __atomic_load_n(&histogram->total_us, __ATOMIC_RELAXED);
+  guint64 max_us = __atomic_load_n(&histogram->max_us, __ATOMIC_RELAXED);
+
+  *summary = {};
+  summary->count = count;
+  summary->max_us = max_us;
+  if (count == 0) return;
+  summary->mean_us = (gdouble)total_us / count;
+
+  static const gdouble kQuantiles[] = {0.50, 0.90, 0.99};
+  guint64* percentiles[] = {&summary->p50_us, &summary->p90_us,
+                            &summary->p99_us};
+  guint64 seen = 0;
+  guint q = 0;
+  for (guint i = 0; i < PERFORMANCE_HISTOGRAM_BUCKETS && q < 3; i++) {
+    seen += counts[i];
+    // Nearest rank
+    while (q < 3 && seen > 0 &&
+           seen >= (guint64)ceil(kQuantiles[q] * count)) {
+      *percentiles[q++] = MIN(histogram_bucket_max(i), max_us);
+    }
+  }
+}
+
+void performance_stats_set_enabled(gboolean value) {
+  g_atomic_int_set(&enabled, value ? TRUE : FALSE);
+}
+
+gboolean performance_stats_get_enabled() {
+  return g_atomic_int_get(&enabled);
+}
+
+gint64 performance_stats_begin() {
+  return __atomic_load_n(&enabled, __ATOMIC_RELAXED) ? g_get_monotonic_time()
+                                                     : 0;
+}
+
+// Returns the kernel's ID for the calling thread, as trace viewers expect.
+static gint64 get_thread_id() {
+  static GPrivate thread_id;
+  gpointer id = g_private_get(&thread_id);
+  if (id == nullptr) {
+    id = GSIZE_TO_POINTER(syscall(SYS_gettid));
+    g_private_set(&thread_id, id);
+  }
+  return GPOINTER_TO_SIZE(id);
+}
+
+static void trace_add(const gchar* name,
+                      const gchar* category,
+                      gint64 start,
+                      gint64 duration) {
+  guint64 index = __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+  TraceSpan* span = &trace_spans[index % PERFORMANCE_TRACE_SPANS];
+  __atomic_store_n(&span->sequence, 2 * index + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&span->name, name, __ATOMIC_RELAXED);
+  __atomic_store_n(&span->category, category, __ATOMIC_RELAXED);
+  __atomic_store_n(&span->start, start, __ATOMIC_RELAXED);
+  __atomic_store_n(&span->duration, duration, __ATOMIC_RELAXED);
+  __atomic_store_n(&span->thread, get_thread_id(), __ATOMIC_RELAXED);
+  __atomic_store_n(&span->sequence, 2 * index + 2, __ATOMIC_RELEASE);
+}
+
+void performance_stats_end_stage(PerformanceStage stage, gint64 start) {
+  if (start == 0) return;
+  gint64 duration = g_get_monotonic_time() - start;
+  performance_histogram_record(&stages[stage], duration);
+  trace_add(kStageNames[stage], "stage", start, duration);
+}
+
+const gchar* performance_stats_stage_name(PerformanceStage stage) {
+  return kStageNames[stage];
+}
+
+PerformanceMethod* performance_stats_register_method(const gchar* method) {
+  const gchar* name = g_intern_string(method);
+  g_mutex_lock(&registry_mutex);
+  PerformanceMethod* result = nullptr;
+  for (gint i = 0; i < n_methods && result == nullptr; i++) {
+    if (methods[i].name == name) result = &methods[i];
+  }
+  if (result == nullptr && n_methods < PERFORMANCE_MAX_METHODS) {
+    result = &methods[n_methods];
+    result->name = name;
+    g_atomic_int_set(&n_methods, n_methods + 1);
+  }
+  g_mutex_unlock(&registry_mutex);
+  return result;
+}
+
+void performance_stats_end_method(PerformanceMethod* method,
+                                  gint64 queued,
+                                  gint64 start,
+                                  gboolean failed) {
+  if (method == nullptr || queued == 0 || start == 0) return;
+  gint64 duration = g_get_monotonic_time() - start;
+  performance_histogram_record(&method->latency, duration);
+  performance_histogram_record(&method->queue_wait, MAX(start - queued, 0));
+  if (failed) __atomic_fetch_add(&method->errors, 1, __ATOMIC_RELAXED);
+  trace_add(method->name, "method", start, duration);
+}
+
+PerformanceQueue* performance_stats_register_queue(const gchar* queue) {
+  const gchar* name = g_intern_string(queue);
+  g_mutex_lock(&registry_mutex);
+  PerformanceQueue* result = nullptr;
+  for (gint i = 0; i < n_queues && result == nullptr; i++) {
+    if (queues[i].name == name) result = &queues[i];
+  }
+  if (result == nullptr && n_queues < PERFORMANCE_MAX_QUEUES) {
+    result = &queues[n_queues];
+    result->name = name;
+    g_atomic_int_set(&n_queues, n_queues + 1);
+  }
+  g_mutex_unlock(&registry_mutex);
+  return result;
+}
+
+void performance_stats_sample_queue(PerformanceQueue* queue, guint depth) {
+  if (queue == nullptr || !__atomic_load_n(&enabled, __ATOMIC_RELAXED)) {
+    return;
+  }
+  __atomic_store_n(&queue->depth, depth, __ATOMIC_RELAXED);
+  guint peak = __atomic_load_n(&queue->peak_depth, __ATOMIC_RELAXED);
+  while (depth > peak &&
+         !__atomic_compare_exchange_n(&queue->peak_depth, &peak, depth, TRUE,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+void performance_stats_get_stage(PerformanceStage stage,
+                                 PerformanceSummary* summary) {
+  performance_histogram_summarize(&stages[stage], summary);
+}
+
+GArray* performance_stats_get_methods() {
+  GArray* result =
+      g_array_new(FALSE, FALSE, sizeof(PerformanceMethodStats));
+  gint n = g_atomic_int_get(&n_methods);
+  for (gint i = 0; i < n; i++) {
+    PerformanceMethodStats stats;
+    stats.name = methods[i].name;
+    stats.errors = __atomic_load_n(&methods[i].errors, __ATOMIC_RELAXED);
+    performance_histogram_summarize(&methods[i].latency, &stats.latency);
+    performance_histogram_summarize(&methods[i].queue_wait,
+                                    &stats.queue_wait);
+    if (stats.latency.count > 0) g_array_append_val(result, stats);
+  }
+  return result;
+}
+
+GArray* performance_stats_get_queues() {
+  GArray* result = g_array_new(FALSE, FALSE, sizeof(PerformanceQueueStats));
+  gint n = g_atomic_int_get(&n_queues);
+  for (gint i = 0; i < n; i++) {
+    PerformanceQueueStats stats;
+    stats.name = queues[i].name;
+    stats.depth = __atomic_load_n(&queues[i].depth, __ATOMIC_RELAXED);
+    stats.peak_depth =
+        __atomic_load_n(&queues[i].peak_depth, __ATOMIC_RELAXED);
+    g_array_append_val(result, stats);
+  }
+  return result;
+}
+
+static void histogram_clear(PerformanceHistogram* histogram) {
+  for (guint i = 0; i < PERFORMANCE_HISTOGRAM_BUCKETS; i++) {
+    __atomic_store_n(&histogram->counts[i], 0, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&histogram->total_us, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&histogram->max_us, 0, __ATOMIC_RELAXED);
+}
+
+void performance_stats_reset() {
+  for (guint i = 0; i < PERFORMANCE_N_STAGES; i++) histogram_clear(&stages[i]);
+  gint n = g_atomic_int_get(&n_methods);
+  for (gint i = 0; i < n; i++) {
+    __atomic_store_n(&methods[i].errors, 0, __ATOMIC_RELAXED);
+    histogram_clear(&methods[i].latency);
+    histogram_clear(&methods[i].queue_wait);
+  }
+  n = g_atomic_int_get(&n_queues);
+  for (gint i = 0; i < n; i++) {
+    __atomic_store_n(&queues[i].peak_depth,
+                     __atomic_load_n(&queues[i].depth, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&trace_first,
+                   __atomic_load_n(&trace_next, __ATOMIC_RELAXED),
+                   __ATOMIC_RELAXED);
+}
+
+// Appends |value| as a JSON string.
+static void append_json_string(GString* json, const gchar* value) {
+  g_string_append_c(json, '"');
+  for (const gchar* c = value; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      g_string_append_c(json, '\\');
+      g_string_append_c(json, *c);
+    } else if ((guchar)*c < 0x20) {
+      g_string_append_printf(json, "\\u%04x", (guchar)*c);
+    } else {
+      g_string_append_c(json, *c);
+    }
+  }
+  g_string_append_c(json, '"');
+}
+
+// Appends a metadata event naming |thread| after its kernel name, which
+// GLib sets from the name given to g_thread_new() or the pool.
+static void append_thread_name(GString* json, gint pid, gint64 thread) {
+  g_autofree gchar* path = g_strdup_printf(
+      "/proc/self/task/%" G_GINT64_FORMAT "/comm", thread);
+  g_autofree gchar* name = nullptr;
+  if (!g_file_get_contents(path, &name, nullptr, nullptr)) return;
+  g_strchomp(name);
+  g_string_append_printf(json,
+                         ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                         "\"pid\":%d,\"tid\":%" G_GINT64_FORMAT
+                         ",\"args\":{\"name\":",
+                         pid, thread);
+  append_json_string(json, name);
+  g_string_append(json, "}}");
+}
+
+gboolean performance_stats_write_trace(const gchar* path, GError** error) {
+  gint pid = getpid();
+  g_autoptr(GString) json = g_string_new(nullptr);
+  g_string_append_printf(json,
+                         "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                         "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                         "\"args\":{\"name\":\"photo_gallery_pro\"}}",
+                         pid);
+
+  g_autoptr(GHashTable) threads = g_hash_table_new(nullptr, nullptr);
+  g_autoptr(GArray) thread_ids = g_array_new(FALSE, FALSE, sizeof(gint64));
+  guint64 next = __atomic_load_n(&trace_next, __ATOMIC_ACQUIRE);
+  guint64 first = __atomic_load_n(&trace_first, __ATOMIC_RELAXED);
+  if (next > PERFORMANCE_TRACE_SPANS) {
+    first = MAX(first, next - PERFORMANCE_TRACE_SPANS);
+  }
+  for (guint64 index = first; index < next; index++) {
+    TraceSpan* slot = &trace_spans[index % PERFORMANCE_TRACE_SPANS];
+    guint64 sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (sequence != 2 * index + 2) continue;
+    TraceSpan span;
+    span.name = __atomic_load_n(&slot->name, __ATOMIC_RELAXED);
+    span.category = __atomic_load_n(&slot->category, __ATOMIC_RELAXED);
+    span.start = __atomic_load_n(&slot->start, __ATOMIC_RELAXED);
+    span.duration = __atomic_load_n(&slot->duration, __ATOMIC_RELAXED);
+    span.thread = __atomic_load_n(&slot->thread, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    // Overwritten by a newer span while it was being read
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence) {
+      continue;
+    }
+
+    g_string_append(json, ",\n{\"name\":");
+    append_json_string(json, span.name);
+    g_string_append_printf(json,
+                           ",\"cat\":\"%s\",\"ph\":\"X\","
+                           "\"ts\":%" G_GINT64_FORMAT
+                           ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,"
+                           "\"tid\":%" G_GINT64_FORMAT "}",
+                           span.category, span.start, span.duration, pid,
+                           span.thread);
+    if (g_hash_table_add(threads, GSIZE_TO_POINTER(span.thread))) {
+      g_array_append_val(thread_ids, span.thread);
+    }
+  }
+  for (guint i = 0; i < thread_ids->len; i++) {
+    append_thread_name(json, pid, g_array_index(thread_ids, gint64, i));
+  }
+  g_string_append(json, "\n]}\n");
+  return g_file_set_contents(path, json->str, json->len, error);
+}
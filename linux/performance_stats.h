@@ -0,0 +1,141 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_PERFORMANCE_STATS_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_PERFORMANCE_STATS_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Process-wide latency counters, cheap enough to leave on in production.
+//
+// Method calls, the stages of producing a thumbnail and the depth of the
+// work queues are counted into fixed histograms that are only ever updated
+// with relaxed atomic adds, so recording takes no lock and never allocates.
+// Each timed section is also kept in a ring of the most recent spans, which
+// can be written out as a Chrome trace and opened in Perfetto or
+// chrome://tracing.
+//
+// Histograms are log-linear like HdrHistogram's: each power of two of
+// microseconds is split into PERFORMANCE_HISTOGRAM_SUB_BUCKETS buckets, so
+// percentiles are exact below that many microseconds and within 1/16 of the
+// value above.
+
+#define PERFORMANCE_HISTOGRAM_SUB_BUCKETS 16
+
+// Covers values up to 2^36 us, about 19 hours; longer ones count as that.
+#define PERFORMANCE_HISTOGRAM_MAX_EXPONENT 35
+#define PERFORMANCE_HISTOGRAM_BUCKETS \
+  (PERFORMANCE_HISTOGRAM_SUB_BUCKETS * (PERFORMANCE_HISTOGRAM_MAX_EXPONENT - 2))
+
+// Distinct methods and queues that can be counted. Later ones are ignored.
+#define PERFORMANCE_MAX_METHODS 64
+#define PERFORMANCE_MAX_QUEUES 16
+
+// Spans kept for the trace.
+#define PERFORMANCE_TRACE_SPANS 8192
+
+typedef enum {
+  // Reading and decoding a source image or video frame.
+  PERFORMANCE_STAGE_DECODE,
+  // Resampling a decoded image to the requested box.
+  PERFORMANCE_STAGE_SCALE,
+  // Encoding a thumbnail for the channel.
+  PERFORMANCE_STAGE_ENCODE,
+  // Stat and header batches of the index, and reading or writing the disk
+  // thumbnail tier, PNG coding included.
+  PERFORMANCE_STAGE_FILESYSTEM,
+  PERFORMANCE_N_STAGES,
+} PerformanceStage;
+
+typedef struct {
+  guint64 counts[PERFORMANCE_HISTOGRAM_BUCKETS];
+  guint64 total_us;
+  guint64 max_us;
+} PerformanceHistogram;
+
+typedef struct {
+  guint64 count;
+  gdouble mean_us;
+  guint64 p50_us;
+  guint64 p90_us;
+  guint64 p99_us;
+  guint64 max_us;
+} PerformanceSummary;
+
+typedef struct {
+  const gchar* name;
+  guint64 errors;
+  // From the handler starting to it returning its response.
+  PerformanceSummary latency;
+  // From the call arriving to its handler starting.
+  PerformanceSummary queue_wait;
+} PerformanceMethodStats;
+
+typedef struct {
+  const gchar* name;
+  guint depth;  // When last sampled.
+  guint peak_depth;
+} PerformanceQueueStats;
+
+// Handle of a method or queue registered for counting, or NULL when the
+// table is full, which every function taking one accepts.
+typedef struct _PerformanceMethod PerformanceMethod;
+typedef struct _PerformanceQueue PerformanceQueue;
+
+// Adds |value_us| to |histogram|. Safe to call from any thread.
+void performance_histogram_record(PerformanceHistogram* histogram,
+                                  guint64 value_us);
+
+// Fills |summary| from |histogram|. Percentiles are the highest value of
+// their bucket, so they never understate a latency.
+void performance_histogram_summarize(const PerformanceHistogram* histogram,
+                                     PerformanceSummary* summary);
+
+// Counting is on by default. Turning it off makes every call below return
+// straight away.
+void performance_stats_set_enabled(gboolean enabled);
+gboolean performance_stats_get_enabled(void);
+
+// Returns the start of a timed section, or 0 while counting is off.
+gint64 performance_stats_begin(void);
+
+// Counts the time since |start| towards |stage|, unless |start| is 0.
+void performance_stats_end_stage(PerformanceStage stage, gint64 start);
+
+const gchar* performance_stats_stage_name(PerformanceStage stage);
+
+// Returns the counters of |method|, shared by every caller registering the
+// same name.
+PerformanceMethod* performance_stats_register_method(const gchar* method);
+
+// Counts a call of |method| that arrived at |queued|, started at |start|
+// and has just returned. |queued| and |start| come from
+// performance_stats_begin(); the call is not counted if either is 0.
+void performance_stats_end_method(PerformanceMethod* method,
+                                  gint64 queued,
+                                  gint64 start,
+                                  gboolean failed);
+
+PerformanceQueue* performance_stats_register_queue(const gchar* queue);
+
+// Records that |queue| holds |depth| items.
+void performance_stats_sample_queue(PerformanceQueue* queue, guint depth);
+
+// Returns the summary of |stage|.
+void performance_stats_get_stage(PerformanceStage stage,
+                                 PerformanceSummary* summary);
+
+// Returns a PerformanceMethodStats for every method called at least once.
+GArray* performance_stats_get_methods(void);
+
+// Returns a PerformanceQueueStats for every registered queue.
+GArray* performance_stats_get_queues(void);
+
+// Zeroes every counter and drops the recorded spans.
+void performance_stats_reset(void);
+
+// Writes the recent spans to |path| as a Chrome trace event file.
+gboolean performance_stats_write_trace(const gchar* path, GError** error);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_PERFORMANCE_STATS_H_
@@ -4,11 +4,31 @@
 #include <gtk/gtk.h>
 #include <sys/utsname.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <dirent.h>
 
+#include "media_encoder.h"
+#include "media_exif.h"
+#include "media_hash.h"
+#include "media_index.h"
+#include "media_library.h"
+#include "media_probe.h"
+#include "media_stream.h"
+#include "media_timeline.h"
+#include "media_video.h"
+#include "method_dispatcher.h"
+#include "performance_stats.h"
+#include "photo_gallery_pro_plugin_private.h"
+#include "thumbnail_cache.h"
+#include "thumbnail_encoder.h"
+#include "thumbnail_generator.h"
+#include "thumbnail_prefetcher.h"
+#include "thumbnail_queue.h"
+#include "thumbnail_texture_pool.h"
+
 #define PHOTO_GALLERY_PRO_PLUGIN(obj) \
   (G_TYPE_CHECK_INSTANCE_CAST((obj), photo_gallery_pro_plugin_get_type(), \
                              PhotoGalleryProPlugin))
@@ -16,186 +36,186 @@
 // Plugin class structure
 struct _PhotoGalleryProPlugin {
   GObject parent_instance;
+
+  // Runs method handlers off the GTK main thread.
+  MethodDispatcher* dispatcher;
+
+  // Albums and media under the library roots, the Pictures directory unless
+  // setLibraryRoots says otherwise.
+  MediaLibrary* media_library;
+
+  // Streams streamMediaInAlbum chunks back to Dart.
+  FlEventChannel* media_events;
+  MediaStreamer* media_streamer;
+
+  // Memory and freedesktop disk cache for generated thumbnails.
+  ThumbnailCache* thumbnail_cache;
+
+  // Fills the cache ahead of the grid reported by setViewport.
+  ThumbnailPrefetcher* thumbnail_prefetcher;
+
+  // Pixel budget and timeout for decoding one image, set by
+  // setDecodeLimits and read by every thumbnail lane.
+  GMutex decode_limits_mutex;
+  ThumbnailDecodeLimits decode_limits;
+
+  // Sends findDuplicates progress back to Dart.
+  FlEventChannel* duplicate_events;
+  // findDuplicates calls in progress, for cancelFindDuplicates.
+  GMutex duplicates_mutex;
+  GHashTable* duplicate_searches;  // gchar* token -> GCancellable*
+
+  // Where events produced on worker threads are sent from.
+  GMainContext* main_context;
+
+  // Streams getThumbnails results back to Dart as they complete.
+  FlEventChannel* thumbnail_events;
+  ThumbnailQueue* thumbnail_queue;
+
+  // Pixel buffer textures for getThumbnailTexture. NULL until the plugin is
+  // registered with an engine.
+  ThumbnailTexturePool* texture_pool;
 };
 
+// Pixel bytes kept in the in-memory thumbnail cache.
+#define THUMBNAIL_CACHE_MEMORY_BUDGET (64 * 1024 * 1024)
+
+// Pixel bytes held by thumbnail textures, in use or pooled. Roughly two
+// hundred 512x512 RGBA thumbnails.
+#define THUMBNAIL_TEXTURE_MEMORY_BUDGET (192 * 1024 * 1024)
+
 G_DEFINE_TYPE(PhotoGalleryProPlugin, photo_gallery_pro_plugin, g_object_get_type())
 
 // Forward declarations of helper functions
-static int get_media_count(const gchar* dir_path, const gchar* media_type);
-static void process_directory(const gchar* dir_path, const gchar* media_type, FlValue* albums);
-static gchar* get_first_media_in_album(const gchar* album_id, const gchar* media_type);
-static GdkPixbuf* generate_thumbnail(const gchar* file_path, int width, int height, GError** error);
-static FlMethodResponse* get_album_thumbnail(FlMethodCall* method_call);
-static FlMethodResponse* get_thumbnail(FlMethodCall* method_call);
-
-// Helper function to count media files in a directory
-static int get_media_count(const gchar* dir_path, const gchar* media_type) {
-    DIR* dir = opendir(dir_path);
-    if (!dir) return 0;
-
-    int count = 0;
-    struct dirent* entry;
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_REG) {  // Regular file
-            gchar* file_path = g_build_filename(dir_path, entry->d_name, NULL);
-            
-            // Check file extension
-            const gchar* extension = strrchr(entry->d_name, '.');
-            if (extension) {
-                extension++; // Skip the dot
-                if (g_strcmp0(media_type, "image") == 0) {
-                    if (g_ascii_strcasecmp(extension, "jpg") == 0 ||
-                        g_ascii_strcasecmp(extension, "jpeg") == 0 ||
-                        g_ascii_strcasecmp(extension, "png") == 0) {
-                        count++;
-                    }
-                } else if (g_strcmp0(media_type, "video") == 0) {
-                    if (g_ascii_strcasecmp(extension, "mp4") == 0 ||
-                        g_ascii_strcasecmp(extension, "avi") == 0 ||
-                        g_ascii_strcasecmp(extension, "mkv") == 0) {
-                        count++;
-                    }
-                }
-            }
-            g_free(file_path);
-        }
-    }
-    
-    closedir(dir);
-    return count;
+static FlMethodResponse* get_album_thumbnail(FlMethodCall* method_call, gpointer user_data);
+static FlMethodResponse* get_thumbnail(FlMethodCall* method_call, gpointer user_data);
+
+// Maps the "mediaType" argument to the index's media kinds
+static guint32 media_kind_for_type(const gchar* media_type) {
+    if (g_strcmp0(media_type, "image") == 0) return MEDIA_KIND_IMAGE;
+    if (g_strcmp0(media_type, "video") == 0) return MEDIA_KIND_VIDEO;
+    return 0;
 }
 
-// Process directory to find albums
-static void process_directory(const gchar* dir_path, const gchar* media_type, FlValue* albums) {
-    DIR* dir = opendir(dir_path);
-    if (!dir) return;
+// Maps a thumbnail failure to the error code reported to Dart
+static const gchar* thumbnail_error_code(const GError* error) {
+    if (g_error_matches(error, THUMBNAIL_GENERATOR_ERROR,
+                        THUMBNAIL_GENERATOR_ERROR_TOO_LARGE)) {
+        return "IMAGE_TOO_LARGE";
+    }
+    if (g_error_matches(error, THUMBNAIL_GENERATOR_ERROR,
+                        THUMBNAIL_GENERATOR_ERROR_TIMED_OUT)) {
+        return "DECODE_TIMEOUT";
+    }
+    return "THUMBNAIL_ERROR";
+}
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // Skip . and ..
-        if (g_strcmp0(entry->d_name, ".") == 0 || 
-            g_strcmp0(entry->d_name, "..") == 0) {
-            continue;
-        }
+// Find first media file in an album, in name order
+static gchar* get_first_media_in_album(PhotoGalleryProPlugin* self, const gchar* album_id,
+                                       const gchar* media_type) {
+    const MediaAlbumRecord* album = nullptr;
+    g_autoptr(MediaIndexSnapshot) snapshot =
+        media_library_find_album(self->media_library, album_id, &album);
+    if (snapshot == nullptr) return NULL;
 
-        if (entry->d_type == DT_DIR) {
-            gchar* full_path = g_build_filename(dir_path, entry->d_name, NULL);
-            int count = get_media_count(full_path, media_type);
-            
-            if (count > 0) {
-                // Create album object
-                g_autoptr(FlValue) album = fl_value_new_map();
-                
-                // Set album properties
-                fl_value_set(album, fl_value_new_string("id"), 
-                            fl_value_new_string(entry->d_name));
-                fl_value_set(album, fl_value_new_string("name"), 
-                            fl_value_new_string(entry->d_name));
-                fl_value_set(album, fl_value_new_string("type"), 
-                            fl_value_new_string(media_type));
-                fl_value_set(album, fl_value_new_string("count"), 
-                            fl_value_new_int(count));
-                
-                // Add to albums list
-                fl_value_append(albums, album);
-            }
-            
-            g_free(full_path);
-        }
-    }
-    
-    closedir(dir);
+    guint32 kind = media_kind_for_type(media_type);
+    guint32 cover = kind == MEDIA_KIND_IMAGE   ? album->image_cover
+                    : kind == MEDIA_KIND_VIDEO ? album->video_cover
+                                               : MEDIA_INDEX_NO_RECORD;
+    if (cover == MEDIA_INDEX_NO_RECORD) return NULL;
+    return g_strdup(media_index_snapshot_string(snapshot, snapshot->records[cover].path));
 }
 
-// Find first media file in an album
-static gchar* get_first_media_in_album(const gchar* album_id, const gchar* media_type) {
-    const gchar* base_dir = g_get_user_special_dir(G_USER_DIRECTORY_PICTURES);
-    if (!base_dir) return NULL;
+// Generates a thumbnail fitting in |width|x|height| and stores it in the
+// thumbnail cache
+static GdkPixbuf* generate_cached_thumbnail(PhotoGalleryProPlugin* self, const gchar* file_path,
+                                            int width, int height, GError** error) {
+    ThumbnailDecodeLimits limits;
+    g_mutex_lock(&self->decode_limits_mutex);
+    limits = self->decode_limits;
+    g_mutex_unlock(&self->decode_limits_mutex);
 
-    gchar* album_path = g_build_filename(base_dir, album_id, NULL);
-    DIR* dir = opendir(album_path);
-    if (!dir) {
-        g_free(album_path);
-        return NULL;
+    // A JPEG preview embedded in the file is enough for small boxes such as
+    // album covers. It is below the bucket size, so it stays in memory.
+    g_autoptr(GdkPixbuf) preview = generate_thumbnail_from_preview(file_path,
+                                                                   width, height,
+                                                                   &limits);
+    if (preview) {
+        return thumbnail_cache_insert_memory(self->thumbnail_cache, file_path,
+                                             width, height, preview);
     }
 
-    gchar* result = NULL;
-    struct dirent* entry;
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_REG) {
-            const gchar* extension = strrchr(entry->d_name, '.');
-            if (extension) {
-                extension++; // Skip the dot
-                if (g_strcmp0(media_type, "image") == 0) {
-                    if (g_ascii_strcasecmp(extension, "jpg") == 0 ||
-                        g_ascii_strcasecmp(extension, "jpeg") == 0 ||
-                        g_ascii_strcasecmp(extension, "png") == 0) {
-                        result = g_build_filename(album_path, entry->d_name, NULL);
-                        break;
-                    }
-                } else if (g_strcmp0(media_type, "video") == 0) {
-                    if (g_ascii_strcasecmp(extension, "mp4") == 0 ||
-                        g_ascii_strcasecmp(extension, "avi") == 0 ||
-                        g_ascii_strcasecmp(extension, "mkv") == 0) {
-                        result = g_build_filename(album_path, entry->d_name, NULL);
-                        break;
-                    }
-                }
-            }
-        }
+    // Generate at the shared cache's bucket size so the result can be
+    // stored on disk; the cache scales it down to the requested box.
+    int source_size = thumbnail_cache_get_source_size(width, height);
+    g_autoptr(GdkPixbuf) generated = generate_thumbnail(file_path, source_size,
+                                                        source_size, &limits, error);
+    if (!generated) {
+        return NULL;
     }
-    
-    closedir(dir);
-    g_free(album_path);
-    return result;
+    return thumbnail_cache_insert(self->thumbnail_cache, file_path,
+                                  width, height, generated);
 }
 
-// Helper function to generate thumbnails
-static GdkPixbuf* generate_thumbnail(const gchar* file_path, int width, int height, GError** error) {
-    // Validate input dimensions
-    if (width <= 0) width = 512;  // Default width if invalid
-    if (height <= 0) height = 512; // Default height if invalid
+// Returns a thumbnail fitting in the options' box, served from the thumbnail
+// cache when possible and generated (then cached) otherwise
+static GdkPixbuf* load_thumbnail(PhotoGalleryProPlugin* self, const gchar* file_path,
+                                 const ThumbnailOptions* options, GError** error) {
+    int width = options->width;
+    int height = options->height;
 
-    GdkPixbuf* pixbuf = gdk_pixbuf_new_from_file(file_path, error);
-    if (!pixbuf) {
-        return NULL;
+    // A chosen video frame is a one-off, so it bypasses the cache, which
+    // only knows one thumbnail per file. The pipeline scales it already.
+    if (options->video_position_ms >= 0 && media_video_is_video_file(file_path)) {
+        gint64 start = performance_stats_begin();
+        GdkPixbuf* frame = media_video_extract_frame(file_path, width, height,
+                                                     options->video_position_ms, error);
+        performance_stats_end_stage(PERFORMANCE_STAGE_DECODE, start);
+        return frame;
     }
 
-    // Calculate aspect ratio
-    int orig_width = gdk_pixbuf_get_width(pixbuf);
-    int orig_height = gdk_pixbuf_get_height(pixbuf);
-    
-    // Maintain aspect ratio
-    double scale;
-    if (width == 0 || height == 0) {
-        scale = 1.0;
-    } else {
-        scale = MIN((double)width / orig_width, (double)height / orig_height);
+    // Prefetching pauses while the UI waits for a thumbnail
+    thumbnail_prefetcher_begin_request(self->thumbnail_prefetcher, file_path);
+    GdkPixbuf* thumbnail = thumbnail_cache_lookup(self->thumbnail_cache,
+                                                  file_path, width, height);
+    if (!thumbnail) {
+        thumbnail = generate_cached_thumbnail(self, file_path, width, height, error);
     }
-
-    int new_width = MAX((int)(orig_width * scale), 1);  // Ensure minimum size of 1
-    int new_height = MAX((int)(orig_height * scale), 1);
-
-    // Create scaled thumbnail
-    GdkPixbuf* thumbnail = gdk_pixbuf_scale_simple(pixbuf,
-                                                  new_width,
-                                                  new_height,
-                                                  GDK_INTERP_BILINEAR);
-    g_object_unref(pixbuf);
-    
+    thumbnail_prefetcher_end_request(self->thumbnail_prefetcher);
     return thumbnail;
 }
 
+// Produces a thumbnail for setViewport. Runs on the prefetch thread.
+static gboolean prefetch_thumbnail(const gchar* path, const ThumbnailOptions* options,
+                                   gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    // The UI may have loaded it since the item was queued
+    g_autoptr(GdkPixbuf) cached = thumbnail_cache_peek(
+        self->thumbnail_cache, path, options->width, options->height);
+    if (cached != nullptr) return TRUE;
+    g_autoptr(GdkPixbuf) thumbnail = generate_cached_thumbnail(
+        self, path, options->width, options->height, nullptr);
+    return thumbnail != nullptr;
+}
+
 // Method to get album thumbnail
-static FlMethodResponse* get_album_thumbnail(FlMethodCall* method_call) {
+static FlMethodResponse* get_album_thumbnail(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
     FlValue* args = fl_method_call_get_args(method_call);
     const gchar* album_id = fl_value_get_string(fl_value_lookup_string(args, "albumId"));
     const gchar* media_type = fl_value_get_string(fl_value_lookup_string(args, "mediaType"));
+
+    ThumbnailOptions options;
+    GError* error = NULL;
+    if (!thumbnail_options_parse(&options, args, 200, &error)) {
+        FlMethodResponse* response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", error->message, nullptr));
+        g_error_free(error);
+        return response;
+    }
     
     // Find first media file in album
-    gchar* media_path = get_first_media_in_album(album_id, media_type);
+    gchar* media_path = get_first_media_in_album(self, album_id, media_type);
     if (!media_path) {
         return FL_METHOD_RESPONSE(fl_method_error_response_new(
             "THUMBNAIL_ERROR",
@@ -204,29 +224,28 @@ static FlMethodResponse* get_album_thumbnail(FlMethodCall* method_call) {
     }
 
     // Generate thumbnail
-    GError* error = NULL;
-    GdkPixbuf* thumbnail = generate_thumbnail(media_path, 200, 200, &error);
+    GdkPixbuf* thumbnail = load_thumbnail(self, media_path, &options, &error);
     g_free(media_path);
 
-    if (error != NULL) {
+    if (thumbnail == NULL) {
         g_autoptr(FlValue) error_details = fl_value_new_map();
         fl_value_set(error_details, 
                     fl_value_new_string("message"),
-                    fl_value_new_string(error->message));
-        g_error_free(error);
+                    fl_value_new_string(error ? error->message : "Unknown error"));
+        const gchar* code = thumbnail_error_code(error);
+        g_clear_error(&error);
         return FL_METHOD_RESPONSE(fl_method_error_response_new(
-            "THUMBNAIL_ERROR",
+            code,
             "Failed to generate thumbnail",
             error_details));
     }
 
-    // Convert to bytes
-    gchar* buffer;
-    gsize buffer_size;
-    gdk_pixbuf_save_to_buffer(thumbnail, &buffer, &buffer_size, "png", &error, NULL);
+    // Convert to the requested format
+    g_autoptr(FlValue) result = fl_value_new_map();
+    gboolean encoded = thumbnail_encode(thumbnail, &options, result, &error);
     g_object_unref(thumbnail);
 
-    if (error != NULL) {
+    if (!encoded) {
         g_autoptr(FlValue) error_details = fl_value_new_map();
         fl_value_set(error_details,
                     fl_value_new_string("message"),
@@ -238,32 +257,40 @@ static FlMethodResponse* get_album_thumbnail(FlMethodCall* method_call) {
             error_details));
     }
 
-    // Create response
-    g_autoptr(FlValue) result = fl_value_new_uint8_list((const uint8_t*)buffer, buffer_size);
-    g_free(buffer);
-
+    // PNG keeps the bare byte list older clients expect; other formats need
+    // their dimensions, so they get the map
+    if (options.format == THUMBNAIL_FORMAT_PNG) {
+        return FL_METHOD_RESPONSE(fl_method_success_response_new(
+            fl_value_lookup_string(result, "data")));
+    }
     return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
 // Method to get media thumbnail
-static FlMethodResponse* get_thumbnail(FlMethodCall* method_call) {
+static FlMethodResponse* get_thumbnail(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
     FlValue* args = fl_method_call_get_args(method_call);
     const gchar* media_id = fl_value_get_string(fl_value_lookup_string(args, "mediaId"));
     
     GError* error = nullptr;
-    // Set default dimensions if not provided
-    int width = 512;   // Default width
-    int height = 512;  // Default height
+    // Defaults to a 512x512 PNG when no size or format is given
+    ThumbnailOptions options;
+    if (!thumbnail_options_parse(&options, args, 512, &error)) {
+        FlMethodResponse* response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", error->message, nullptr));
+        g_error_free(error);
+        return response;
+    }
 
-    // Generate the thumbnail
-    GdkPixbuf* thumbnail = generate_thumbnail(media_id, width, height, &error);
+    // Generate the thumbnail, or reuse a cached one
+    GdkPixbuf* thumbnail = load_thumbnail(self, media_id, &options, &error);
     if (thumbnail == nullptr) {
-        g_autoptr(FlMethodResponse) response = FL_METHOD_RESPONSE(fl_method_error_response_new(
-            "THUMBNAIL_ERROR",
+        FlMethodResponse* response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+            thumbnail_error_code(error),
             "Failed to generate thumbnail",
             fl_value_new_string(error ? error->message : "Unknown error")));
         if (error) g_error_free(error);
-        return FL_METHOD_RESPONSE(response);
+        return response;
     }
 
     // Get the actual dimensions after scaling
@@ -279,67 +306,400 @@ static FlMethodResponse* get_thumbnail(FlMethodCall* method_call) {
             nullptr));
     }
 
-    // Convert to PNG format
-    gchar* buffer;
-    gsize buffer_size;
-    GError* png_error = nullptr;
-    gdk_pixbuf_save_to_buffer(thumbnail, &buffer, &buffer_size, "png", &png_error, nullptr);
+    // Convert to the requested format
+    g_autoptr(FlValue) result = fl_value_new_map();
+    GError* encode_error = nullptr;
+    gboolean encoded = thumbnail_encode(thumbnail, &options, result, &encode_error);
     g_object_unref(thumbnail);
 
-    if (png_error != nullptr) {
-        g_error_free(png_error);
-        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+    if (!encoded) {
+        FlMethodResponse* response = FL_METHOD_RESPONSE(fl_method_error_response_new(
             "CONVERSION_ERROR",
-            "Failed to convert thumbnail to PNG",
-            nullptr));
+            "Failed to convert thumbnail",
+            fl_value_new_string(encode_error->message)));
+        g_error_free(encode_error);
+        return response;
+    }
+
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Fills a getThumbnails event for one media item. Runs on a thumbnail queue
+// worker thread.
+static void produce_queued_thumbnail(const gchar* media_id, const ThumbnailOptions* options,
+                                     FlValue* event, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+
+    GError* error = nullptr;
+    g_autoptr(GdkPixbuf) thumbnail = load_thumbnail(self, media_id, options, &error);
+    if (thumbnail == nullptr || !thumbnail_encode(thumbnail, options, event, &error)) {
+        fl_value_set_string_take(event, "error",
+                                 fl_value_new_string(error ? error->message : "Unknown error"));
+        fl_value_set_string_take(event, "errorCode",
+                                 fl_value_new_string(thumbnail_error_code(error)));
+        g_clear_error(&error);
+    }
+}
+
+// Sends a {token, mediaId, placeholder} event for each of |media_ids| whose
+// placeholder has been computed. Runs on the main thread, so roots still on
+// their first scan are skipped rather than waited for.
+static void send_placeholders(PhotoGalleryProPlugin* self, const gchar* token,
+                              FlValue* media_ids) {
+    for (size_t i = 0; i < fl_value_get_length(media_ids); i++) {
+        FlValue* media_id = fl_value_get_list_value(media_ids, i);
+        if (fl_value_get_type(media_id) != FL_VALUE_TYPE_STRING) continue;
+        const MediaRecord* record = nullptr;
+        g_autoptr(MediaIndexSnapshot) snapshot = media_library_peek_record(
+            self->media_library, fl_value_get_string(media_id), &record);
+        if (snapshot == nullptr) continue;
+        const gchar* placeholder = media_index_snapshot_string(snapshot, record->placeholder);
+        if (placeholder[0] == '\0') continue;
+
+        g_autoptr(FlValue) event = fl_value_new_map();
+        fl_value_set_string_take(event, "token", fl_value_new_string(token));
+        fl_value_set_string_take(event, "mediaId", fl_value_new_string(fl_value_get_string(media_id)));
+        fl_value_set_string_take(event, "placeholder", fl_value_new_string(placeholder));
+        fl_event_channel_send(self->thumbnail_events, event, nullptr, nullptr);
+    }
+}
+
+// Method to queue thumbnails for many media items in one call. Results are
+// streamed back over the thumbnail event channel as they complete.
+static FlMethodResponse* get_thumbnails(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+    if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "Expected a map of arguments", nullptr));
+    }
+
+    FlValue* media_ids = fl_value_lookup_string(args, "mediaIds");
+    FlValue* token = fl_value_lookup_string(args, "token");
+    if (media_ids == nullptr || fl_value_get_type(media_ids) != FL_VALUE_TYPE_LIST ||
+        token == nullptr || fl_value_get_type(token) != FL_VALUE_TYPE_STRING) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "mediaIds and token are required", nullptr));
+    }
+
+    ThumbnailOptions options;
+    g_autoptr(GError) error = nullptr;
+    if (!thumbnail_options_parse(&options, args, 512, &error)) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", error->message, nullptr));
+    }
+
+    int priority = 0;
+    FlValue* value = fl_value_lookup_string(args, "priority");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+        priority = fl_value_get_int(value);
+    }
+
+    // Placeholders come straight from the index, so they are sent before
+    // any thumbnail has been queued
+    FlValue* placeholders = fl_value_lookup_string(args, "placeholders");
+    if (placeholders != nullptr && fl_value_get_type(placeholders) == FL_VALUE_TYPE_BOOL &&
+        fl_value_get_bool(placeholders)) {
+        send_placeholders(self, fl_value_get_string(token), media_ids);
+    }
+
+    guint queued = thumbnail_queue_push(self->thumbnail_queue,
+                                        fl_value_get_string(token), media_ids,
+                                        &options, priority);
+    g_autoptr(FlValue) result = fl_value_new_int(queued);
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Method to drop queued getThumbnails jobs that have not started yet
+static FlMethodResponse* cancel_thumbnails(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+    FlValue* token = nullptr;
+    if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+        token = fl_value_lookup_string(args, "token");
+    }
+    if (token == nullptr || fl_value_get_type(token) != FL_VALUE_TYPE_STRING) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "token is required", nullptr));
+    }
+
+    g_autoptr(FlValue) result = fl_value_new_bool(
+        thumbnail_queue_cancel(self->thumbnail_queue, fl_value_get_string(token)));
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Method to show a thumbnail in a pooled pixel buffer texture. Only the
+// texture ID crosses the channel; the engine reads the pixels directly.
+static FlMethodResponse* get_thumbnail_texture(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+    FlValue* media_id = nullptr;
+    if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+        media_id = fl_value_lookup_string(args, "mediaId");
+    }
+    if (media_id == nullptr || fl_value_get_type(media_id) != FL_VALUE_TYPE_STRING) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "mediaId is required", nullptr));
+    }
+    if (self->texture_pool == nullptr) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "TEXTURE_ERROR", "Textures are not available", nullptr));
+    }
+
+    // Only the size and video position apply; textures always hold raw RGBA
+    // pixels
+    ThumbnailOptions options;
+    thumbnail_options_parse(&options, args, 512, nullptr);
+
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(GdkPixbuf) thumbnail = load_thumbnail(self, fl_value_get_string(media_id),
+                                                    &options, &error);
+    if (thumbnail == nullptr) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            thumbnail_error_code(error),
+            "Failed to generate thumbnail",
+            fl_value_new_string(error ? error->message : "Unknown error")));
+    }
+
+    gint64 texture_id = thumbnail_texture_pool_acquire(self->texture_pool, thumbnail, &error);
+    if (texture_id < 0) {
+        const gchar* code = g_error_matches(error, THUMBNAIL_TEXTURE_POOL_ERROR,
+                                            THUMBNAIL_TEXTURE_POOL_ERROR_BUDGET_EXCEEDED)
+                                ? "TEXTURE_BUDGET_EXCEEDED"
+                                : "TEXTURE_ERROR";
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(code, error->message, nullptr));
     }
 
-    // Create response with dimensions
     g_autoptr(FlValue) result = fl_value_new_map();
-    fl_value_set(result, 
-                 fl_value_new_string("data"),
-                 fl_value_new_uint8_list((const uint8_t*)buffer, buffer_size));
-    fl_value_set(result,
-                 fl_value_new_string("width"),
-                 fl_value_new_int(final_width));
-    fl_value_set(result,
-                 fl_value_new_string("height"),
-                 fl_value_new_int(final_height));
-
-    g_free(buffer);
+    fl_value_set_string_take(result, "textureId", fl_value_new_int(texture_id));
+    fl_value_set_string_take(result, "width", fl_value_new_int(gdk_pixbuf_get_width(thumbnail)));
+    fl_value_set_string_take(result, "height", fl_value_new_int(gdk_pixbuf_get_height(thumbnail)));
     return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
+// Method to hand a thumbnail texture back to the pool for reuse
+static FlMethodResponse* release_thumbnail_texture(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+    FlValue* texture_id = nullptr;
+    if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+        texture_id = fl_value_lookup_string(args, "textureId");
+    }
+    if (texture_id == nullptr || fl_value_get_type(texture_id) != FL_VALUE_TYPE_INT) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "textureId is required", nullptr));
+    }
+
+    g_autoptr(FlValue) result = fl_value_new_bool(
+        self->texture_pool != nullptr &&
+        thumbnail_texture_pool_release(self->texture_pool, fl_value_get_int(texture_id)));
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Method to drop cached thumbnails
+static FlMethodResponse* clear_thumbnail_cache(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+
+    gboolean include_disk = FALSE;
+    if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+        FlValue* include_disk_value = fl_value_lookup_string(args, "includeDisk");
+        if (include_disk_value != nullptr &&
+            fl_value_get_type(include_disk_value) == FL_VALUE_TYPE_BOOL) {
+            include_disk = fl_value_get_bool(include_disk_value);
+        }
+    }
+
+    thumbnail_cache_clear(self->thumbnail_cache, include_disk);
+    thumbnail_prefetcher_clear(self->thumbnail_prefetcher);
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Method to report thumbnail cache hit/miss counters
+static FlMethodResponse* get_thumbnail_cache_stats(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+
+    ThumbnailCacheStats stats;
+    thumbnail_cache_get_stats(self->thumbnail_cache, &stats);
+
+    g_autoptr(FlValue) result = fl_value_new_map();
+    fl_value_set_string_take(result, "memoryHits", fl_value_new_int(stats.memory_hits));
+    fl_value_set_string_take(result, "diskHits", fl_value_new_int(stats.disk_hits));
+    fl_value_set_string_take(result, "misses", fl_value_new_int(stats.misses));
+    fl_value_set_string_take(result, "memoryBytes", fl_value_new_int(stats.memory_bytes));
+    fl_value_set_string_take(result, "memoryEntries", fl_value_new_int(stats.memory_entries));
+
+    ThumbnailPrefetchStats prefetch_stats;
+    thumbnail_prefetcher_get_stats(self->thumbnail_prefetcher, &prefetch_stats);
+    FlValue* prefetch = fl_value_new_map();
+    fl_value_set_string_take(prefetch, "prefetched", fl_value_new_int(prefetch_stats.prefetched));
+    fl_value_set_string_take(prefetch, "hits", fl_value_new_int(prefetch_stats.hits));
+    fl_value_set_string_take(prefetch, "late", fl_value_new_int(prefetch_stats.late));
+    fl_value_set_string_take(prefetch, "alreadyCached",
+                             fl_value_new_int(prefetch_stats.already_cached));
+    fl_value_set_string_take(prefetch, "cancelled", fl_value_new_int(prefetch_stats.cancelled));
+    fl_value_set_string_take(result, "prefetch", prefetch);
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Converts a latency summary for getPerformanceStats
+static FlValue* performance_summary_to_value(const PerformanceSummary* summary) {
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "count", fl_value_new_int(summary->count));
+  fl_value_set_string_take(value, "meanUs", fl_value_new_float(summary->mean_us));
+  fl_value_set_string_take(value, "p50Us", fl_value_new_int(summary->p50_us));
+  fl_value_set_string_take(value, "p90Us", fl_value_new_int(summary->p90_us));
+  fl_value_set_string_take(value, "p99Us", fl_value_new_int(summary->p99_us));
+  fl_value_set_string_take(value, "maxUs", fl_value_new_int(summary->max_us));
+  return value;
+}
+
+// Method to report per-method latencies, thumbnail stage times, queue
+// depths and cache hit rates. Optionally writes the recent spans to
+// "tracePath" as a Chrome trace, and zeroes the counters with "reset".
+static FlMethodResponse* get_performance_stats(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+  const gchar* trace_path = nullptr;
+  gboolean reset = FALSE;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    FlValue* value = fl_value_lookup_string(args, "tracePath");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+      trace_path = fl_value_get_string(value);
+    }
+    value = fl_value_lookup_string(args, "reset");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_BOOL) {
+      reset = fl_value_get_bool(value);
+    }
+  }
+
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "enabled",
+                           fl_value_new_bool(performance_stats_get_enabled()));
+
+  FlValue* methods = fl_value_new_map();
+  g_autoptr(GArray) method_stats = performance_stats_get_methods();
+  for (guint i = 0; i < method_stats->len; i++) {
+    const PerformanceMethodStats* stats =
+        &g_array_index(method_stats, PerformanceMethodStats, i);
+    FlValue* method = fl_value_new_map();
+    fl_value_set_string_take(method, "calls", fl_value_new_int(stats->latency.count));
+    fl_value_set_string_take(method, "errors", fl_value_new_int(stats->errors));
+    fl_value_set_string_take(method, "latency",
+                             performance_summary_to_value(&stats->latency));
+    fl_value_set_string_take(method, "queueWait",
+                             performance_summary_to_value(&stats->queue_wait));
+    fl_value_set_string_take(methods, stats->name, method);
+  }
+  fl_value_set_string_take(result, "methods", methods);
+
+  FlValue* stages = fl_value_new_map();
+  for (gint stage = 0; stage < PERFORMANCE_N_STAGES; stage++) {
+    PerformanceSummary summary;
+    performance_stats_get_stage(static_cast<PerformanceStage>(stage), &summary);
+    fl_value_set_string_take(
+        stages, performance_stats_stage_name(static_cast<PerformanceStage>(stage)),
+        performance_summary_to_value(&summary));
+  }
+  fl_value_set_string_take(result, "stages", stages);
+
+  FlValue* queues = fl_value_new_map();
+  g_autoptr(GArray) queue_stats = performance_stats_get_queues();
+  for (guint i = 0; i < queue_stats->len; i++) {
+    const PerformanceQueueStats* stats =
+        &g_array_index(queue_stats, PerformanceQueueStats, i);
+    FlValue* queue = fl_value_new_map();
+    fl_value_set_string_take(queue, "depth", fl_value_new_int(stats->depth));
+    fl_value_set_string_take(queue, "peakDepth", fl_value_new_int(stats->peak_depth));
+    fl_value_set_string_take(queues, stats->name, queue);
+  }
+  fl_value_set_string_take(result, "queues", queues);
+
+  // The counters behind these are in getThumbnailCacheStats
+  ThumbnailCacheStats cache_stats;
+  thumbnail_cache_get_stats(self->thumbnail_cache, &cache_stats);
+  guint64 lookups = cache_stats.memory_hits + cache_stats.disk_hits + cache_stats.misses;
+  ThumbnailPrefetchStats prefetch_stats;
+  thumbnail_prefetcher_get_stats(self->thumbnail_prefetcher, &prefetch_stats);
+  FlValue* hit_rates = fl_value_new_map();
+  fl_value_set_string_take(
+      hit_rates, "thumbnail",
+      fl_value_new_float(lookups > 0 ? (gdouble)(cache_stats.memory_hits + cache_stats.disk_hits) /
+                                           lookups
+                                     : 0));
+  fl_value_set_string_take(
+      hit_rates, "prefetch",
+      fl_value_new_float(prefetch_stats.prefetched > 0
+                             ? (gdouble)prefetch_stats.hits / prefetch_stats.prefetched
+                             : 0));
+  fl_value_set_string_take(result, "cacheHitRates", hit_rates);
+
+  if (trace_path != nullptr) {
+    g_autoptr(GError) error = nullptr;
+    if (!performance_stats_write_trace(trace_path, &error)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "TRACE_ERROR", error->message, nullptr));
+    }
+  }
+  if (reset) performance_stats_reset();
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Turns performance counting on or off
+static FlMethodResponse* set_performance_stats_enabled(FlMethodCall* method_call,
+                                                       gpointer user_data) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* enabled = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    enabled = fl_value_lookup_string(args, "enabled");
+  }
+  if (enabled == nullptr || fl_value_get_type(enabled) != FL_VALUE_TYPE_BOOL) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "enabled is required", nullptr));
+  }
+  performance_stats_set_enabled(fl_value_get_bool(enabled));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
 // Method to check permissions (Linux doesn't require explicit permissions)
-static FlMethodResponse* has_permission(FlMethodCall* method_call) {
+static FlMethodResponse* has_permission(FlMethodCall* method_call, gpointer user_data) {
     g_autoptr(FlValue) result = fl_value_new_bool(TRUE);
     return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
 // Method to request permissions (Linux doesn't require explicit permissions)
-static FlMethodResponse* request_permission(FlMethodCall* method_call) {
+static FlMethodResponse* request_permission(FlMethodCall* method_call, gpointer user_data) {
     g_autoptr(FlValue) result = fl_value_new_bool(TRUE);
     return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
-// Method to get media items in an album
-static FlMethodResponse* get_media_in_album(FlMethodCall* method_call) {
-    FlValue* args = fl_method_call_get_args(method_call);
-    const gchar* album_id = fl_value_get_string(fl_value_lookup_string(args, "albumId"));
-    const gchar* media_type = fl_value_get_string(fl_value_lookup_string(args, "mediaType"));
-    
-    g_autoptr(FlValue) media_list = fl_value_new_list();
+// Receives each media entry found by enumerate_media_in_directory, taking
+// ownership. Returns FALSE to stop the enumeration.
+typedef gboolean (*MediaVisitFunc)(FlValue* media_info, gpointer user_data);
+
+// Enumerates media in a directory outside the index, in enumeration order,
+// skipping the first |offset| matches and stopping after |limit| (if not
+// negative) or once |cancellable| is cancelled.
+static void enumerate_media_in_directory(const gchar* album_id, const gchar* media_type,
+                                         gint64 offset, gint64 limit,
+                                         GCancellable* cancellable,
+                                         MediaVisitFunc visit, gpointer user_data) {
     g_autoptr(GFile) directory = g_file_new_for_path(album_id);
     
     g_autoptr(GFileEnumerator) enumerator = 
         g_file_enumerate_children(directory,
-                                "standard::*",
+                                "standard::*,time::modified",
                                 G_FILE_QUERY_INFO_NONE,
-                                nullptr,
+                                cancellable,
                                 nullptr);
+    if (enumerator == nullptr) {
+        return;
+    }
 
+    gint64 matched = 0;
     while (true) {
-        g_autoptr(GFileInfo) info = g_file_enumerator_next_file(enumerator, nullptr, nullptr);
+        g_autoptr(GFileInfo) info = g_file_enumerator_next_file(enumerator, cancellable,
+                                                                nullptr);
         if (!info) break;
 
         const char* name = g_file_info_get_name(info);
@@ -353,21 +713,18 @@ static FlMethodResponse* get_media_in_album(FlMethodCall* method_call) {
         }
 
         if (is_valid_type) {
+            if (matched++ < offset) continue;
+            if (limit >= 0 && matched - offset > limit) break;
+
             g_autoptr(GFile) file = g_file_get_child(directory, name);
             g_autofree char* path = g_file_get_path(file);
             
-            g_autoptr(FlValue) media_info = fl_value_new_map();
+            FlValue* media_info = fl_value_new_map();
             
-            // Get file info
-            g_autoptr(GFileInfo) file_info = 
-                g_file_query_info(file,
-                                "standard::*,time::modified",
-                                G_FILE_QUERY_INFO_NONE,
-                                nullptr,
-                                nullptr);
-                                
-            guint64 size = g_file_info_get_size(file_info);
-            guint64 mtime = g_file_info_get_attribute_uint64(file_info, "time::modified");
+            // The enumerator already fetched size and mtime; asking again
+            // per file doubled the round trips on network mounts.
+            guint64 size = g_file_info_get_size(info);
+            guint64 mtime = g_file_info_get_attribute_uint64(info, "time::modified");
             
             // Add basic file information
             fl_value_set(media_info, 
@@ -389,35 +746,281 @@ static FlMethodResponse* get_media_in_album(FlMethodCall* method_call) {
                         fl_value_new_string("type"),
                         fl_value_new_string(media_type));
             
-            // Get image dimensions using GdkPixbuf
+            // Read image dimensions from the file header; decoding the
+            // whole image here made listing cost scale with pixel count.
             if (g_content_type_is_a(content_type, "image/*")) {
-                g_autoptr(GdkPixbuf) pixbuf = gdk_pixbuf_new_from_file(path, nullptr);
-                if (pixbuf) {
-                    fl_value_set(media_info, 
-                                fl_value_new_string("width"),
-                                fl_value_new_int(gdk_pixbuf_get_width(pixbuf)));
-                    fl_value_set(media_info,
-                                fl_value_new_string("height"), 
-                                fl_value_new_int(gdk_pixbuf_get_height(pixbuf)));
-                } else {
-                    fl_value_set(media_info,
-                                fl_value_new_string("width"),
-                                fl_value_new_int(0));
-                    fl_value_set(media_info,
-                                fl_value_new_string("height"),
-                                fl_value_new_int(0));
+                gint width = 0;
+                gint height = 0;
+                media_probe_image_size(path, &width, &height);
+                fl_value_set(media_info,
+                            fl_value_new_string("width"),
+                            fl_value_new_int(width));
+                fl_value_set(media_info,
+                            fl_value_new_string("height"),
+                            fl_value_new_int(height));
+
+                MediaExif exif;
+                if (media_exif_read(path, &exif)) {
+                    gdouble location[] = {exif.latitude, exif.longitude};
+                    media_encoder_set_capture_metadata(media_info, exif.date_taken, exif.orientation,
+                                                       exif.camera_model,
+                                                       exif.has_location ? location : nullptr);
+                }
+            } else {
+                MediaVideoInfo video;
+                if (media_video_probe(path, &video, nullptr)) {
+                    fl_value_set_string_take(media_info, "width", fl_value_new_int(video.width));
+                    fl_value_set_string_take(media_info, "height", fl_value_new_int(video.height));
+                    if (video.duration_ms > 0) {
+                        fl_value_set_string_take(media_info, "duration",
+                                                 fl_value_new_int(video.duration_ms));
+                    }
                 }
             }
             
-            fl_value_append(media_list, media_info);
+            if (!visit(media_info, user_data)) break;
         }
     }
+}
 
+static gboolean append_media(FlValue* media_info, gpointer user_data) {
+    fl_value_append_take(static_cast<FlValue*>(user_data), media_info);
+    return TRUE;
+}
+
+// Lists media in a directory outside the index by enumerating it directly.
+// Paging applies in enumeration order; sorting needs the index.
+static FlValue* list_media_in_directory(const gchar* album_id, const gchar* media_type,
+                                        gint64 offset, gint64 limit) {
+    FlValue* media_list = fl_value_new_list();
+    enumerate_media_in_directory(album_id, media_type, offset, limit, nullptr,
+                                 append_media, media_list);
+    return media_list;
+}
+
+// Reads the "sortBy" and "descending" arguments; by name, ascending when
+// absent. Returns FALSE for an unknown sort key
+static gboolean parse_media_sort(FlValue* args, MediaSortKey* sort, gboolean* descending) {
+    *sort = MEDIA_SORT_NAME;
+    *descending = FALSE;
+    FlValue* value = fl_value_lookup_string(args, "descending");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_BOOL) {
+        *descending = fl_value_get_bool(value);
+    }
+    value = fl_value_lookup_string(args, "sortBy");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+        const gchar* sort_by = fl_value_get_string(value);
+        if (g_strcmp0(sort_by, "dateAdded") == 0) {
+            *sort = MEDIA_SORT_DATE_ADDED;
+        } else if (g_strcmp0(sort_by, "dateTaken") == 0) {
+            *sort = MEDIA_SORT_DATE_TAKEN;
+        } else if (g_strcmp0(sort_by, "size") == 0) {
+            *sort = MEDIA_SORT_SIZE;
+        } else if (g_strcmp0(sort_by, "name") != 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Method to get media items in an album, optionally one sorted page at a time
+static FlMethodResponse* get_media_in_album(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+    const gchar* album_id = fl_value_get_string(fl_value_lookup_string(args, "albumId"));
+    const gchar* media_type = fl_value_get_string(fl_value_lookup_string(args, "mediaType"));
+
+    // Paging and sorting; without them the whole album comes back by name
+    gint64 offset = 0;
+    gint64 limit = -1;
+    MediaSortKey sort;
+    gboolean descending;
+    FlValue* value = fl_value_lookup_string(args, "offset");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+        offset = MAX(fl_value_get_int(value), 0);
+    }
+    value = fl_value_lookup_string(args, "limit");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+        limit = fl_value_get_int(value);
+    }
+    if (!parse_media_sort(args, &sort, &descending)) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "sortBy must be name, dateAdded, dateTaken or size", nullptr));
+    }
+    MediaEncoding encoding;
+    if (!media_encoding_parse(args, &encoding)) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "encoding must be maps or packed", nullptr));
+    }
+
+    // Indexed albums are answered from memory without touching the disk.
+    // Albums outside the index always come back as maps.
+    const MediaAlbumRecord* album = nullptr;
+    g_autoptr(MediaIndexSnapshot) snapshot =
+        media_library_find_album(self->media_library, album_id, &album);
+    if (snapshot == nullptr) {
+        g_autoptr(FlValue) media_list = list_media_in_directory(album_id, media_type,
+                                                                offset, limit);
+        return FL_METHOD_RESPONSE(fl_method_success_response_new(media_list));
+    }
+
+    // Only the requested page is turned into FlValues
+    guint n_records = 0;
+    const guint32* order = media_index_snapshot_get_order(
+        snapshot, album, media_kind_for_type(media_type), sort, &n_records);
+    // Clamped before adding, as offset + limit can overflow
+    offset = MIN(offset, (gint64)n_records);
+    gint64 end = limit >= 0 ? offset + MIN(limit, (gint64)n_records - offset) : n_records;
+    if (encoding == MEDIA_ENCODING_PACKED) {
+        guint n_page = end - offset;
+        g_autofree guint32* reversed = nullptr;
+        const guint32* page = order + offset;
+        if (descending) {
+            reversed = g_new(guint32, MAX(n_page, 1));
+            for (guint i = 0; i < n_page; i++) reversed[i] = order[n_records - 1 - offset - i];
+            page = reversed;
+        }
+        g_autoptr(FlValue) packed = media_encoder_encode_packed(snapshot, page, n_page);
+        return FL_METHOD_RESPONSE(fl_method_success_response_new(packed));
+    }
+    g_autoptr(FlValue) media_list = fl_value_new_list();
+    for (gint64 i = offset; i < end; i++) {
+        guint32 position = order[descending ? n_records - 1 - i : i];
+        fl_value_append_take(media_list,
+                             media_encoder_encode_record(snapshot, &snapshot->records[position]));
+    }
     return FL_METHOD_RESPONSE(fl_method_success_response_new(media_list));
 }
 
-// Method handler implementation
-static FlMethodResponse* get_albums(FlMethodCall* method_call) {
+// Arguments of one streamMediaInAlbum call, parsed on the main thread
+typedef struct {
+    gchar* album_id;
+    gchar* media_type;
+    MediaSortKey sort;
+    gboolean descending;
+} MediaStreamRequest;
+
+static void media_stream_request_free(gpointer data) {
+    MediaStreamRequest* request = static_cast<MediaStreamRequest*>(data);
+    g_free(request->album_id);
+    g_free(request->media_type);
+    g_free(request);
+}
+
+static gboolean add_streamed_media(FlValue* media_info, gpointer user_data) {
+    MediaStreamSink* sink = static_cast<MediaStreamSink*>(user_data);
+    media_stream_sink_add(sink, media_info);
+    return !g_cancellable_is_cancelled(media_stream_sink_get_cancellable(sink));
+}
+
+// Produces the entries of a streamMediaInAlbum stream. Runs on a media
+// streamer worker thread.
+static void produce_media_stream(gpointer data, MediaStreamSink* sink, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    MediaStreamRequest* request = static_cast<MediaStreamRequest*>(data);
+    GCancellable* cancellable = media_stream_sink_get_cancellable(sink);
+
+    const MediaAlbumRecord* album = nullptr;
+    g_autoptr(MediaIndexSnapshot) snapshot =
+        media_library_find_album(self->media_library, request->album_id, &album);
+    if (snapshot == nullptr) {
+        enumerate_media_in_directory(request->album_id, request->media_type, 0, -1,
+                                     cancellable, add_streamed_media, sink);
+        return;
+    }
+
+    guint n_records = 0;
+    const guint32* order = media_index_snapshot_get_order(
+        snapshot, album, media_kind_for_type(request->media_type), request->sort, &n_records);
+    for (guint i = 0; i < n_records; i++) {
+        if (g_cancellable_is_cancelled(cancellable)) return;
+        guint32 position = order[request->descending ? n_records - 1 - i : i];
+        media_stream_sink_add(sink, media_encoder_encode_record(snapshot, &snapshot->records[position]));
+    }
+}
+
+// Method to stream the media of an album in chunks over the media event
+// channel instead of returning them all at once
+static FlMethodResponse* stream_media_in_album(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+    if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "Expected a map of arguments", nullptr));
+    }
+
+    FlValue* album_id = fl_value_lookup_string(args, "albumId");
+    FlValue* media_type = fl_value_lookup_string(args, "mediaType");
+    FlValue* token = fl_value_lookup_string(args, "token");
+    if (album_id == nullptr || fl_value_get_type(album_id) != FL_VALUE_TYPE_STRING ||
+        media_type == nullptr || fl_value_get_type(media_type) != FL_VALUE_TYPE_STRING ||
+        token == nullptr || fl_value_get_type(token) != FL_VALUE_TYPE_STRING) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "albumId, mediaType and token are required", nullptr));
+    }
+
+    MediaStreamRequest* request = g_new0(MediaStreamRequest, 1);
+    if (!parse_media_sort(args, &request->sort, &request->descending)) {
+        g_free(request);
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "sortBy must be name, dateAdded, dateTaken or size", nullptr));
+    }
+    request->album_id = g_strdup(fl_value_get_string(album_id));
+    request->media_type = g_strdup(fl_value_get_string(media_type));
+
+    guint chunk_size = MEDIA_STREAM_DEFAULT_CHUNK_SIZE;
+    FlValue* value = fl_value_lookup_string(args, "chunkSize");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+        chunk_size = CLAMP(fl_value_get_int(value), 1, 4096);
+    }
+
+    if (!media_streamer_start(self->media_streamer, fl_value_get_string(token), request,
+                              media_stream_request_free, chunk_size)) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "A stream with this token is already running", nullptr));
+    }
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Method to stop a streamMediaInAlbum stream
+static FlMethodResponse* cancel_media_stream(FlMethodCall* method_call, gpointer user_data) {
+    PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+    FlValue* args = fl_method_call_get_args(method_call);
+    FlValue* token = nullptr;
+    if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+        token = fl_value_lookup_string(args, "token");
+    }
+    if (token == nullptr || fl_value_get_type(token) != FL_VALUE_TYPE_STRING) {
+        return FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "INVALID_ARGUMENTS", "token is required", nullptr));
+    }
+
+    g_autoptr(FlValue) result = fl_value_new_bool(
+        media_streamer_cancel(self->media_streamer, fl_value_get_string(token)));
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Adds one album entry of the given media type
+static void append_album(FlValue* albums, const MediaIndexSnapshot* snapshot,
+                         const MediaAlbumRecord* album, const gchar* media_type,
+                         guint32 count) {
+  g_autofree gchar* id = g_strdup_printf(MEDIA_INDEX_ALBUM_ID_FORMAT, album->id);
+  const gchar* name = media_index_snapshot_string(snapshot, album->name);
+  const gchar* slash = strrchr(name, '/');
+
+  FlValue* entry = fl_value_new_map();
+  fl_value_set_string_take(entry, "id", fl_value_new_string(id));
+  fl_value_set_string_take(entry, "name", fl_value_new_string(slash ? slash + 1 : name));
+  fl_value_set_string_take(entry, "path",
+                           fl_value_new_string(media_index_snapshot_string(snapshot, album->path)));
+  fl_value_set_string_take(entry, "type", fl_value_new_string(media_type));
+  fl_value_set_string_take(entry, "count", fl_value_new_int(count));
+  fl_value_set_string_take(entry, "lastModified", fl_value_new_int(album->newest_mtime));
+  fl_value_append_take(albums, entry);
+}
+
+static FlMethodResponse* get_albums(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
   FlValue* args = fl_method_call_get_args(method_call);
   const gchar* media_type = nullptr;
   
@@ -429,49 +1032,572 @@ static FlMethodResponse* get_albums(FlMethodCall* method_call) {
     }
   }
   
-  // Get Pictures directory path
-  const gchar* pictures_dir = g_get_user_special_dir(G_USER_DIRECTORY_PICTURES);
-  if (!pictures_dir) {
-    return FL_METHOD_RESPONSE(fl_method_error_response_new(
-      "DIRECTORY_ERROR",
-      "Could not locate Pictures directory",
-      nullptr));
-  }
-  
-  // Create albums array
+  // Create albums array from the index of every root, in root order.
+  // Without a media type, albums are listed once per type they contain.
+  g_autoptr(GPtrArray) snapshots = media_library_get_snapshots(self->media_library, nullptr);
   g_autoptr(FlValue) albums = fl_value_new_list();
-  
-  // Process directories with media type filter
-  process_directory(pictures_dir, media_type, albums);
+  for (guint r = 0; r < snapshots->len; r++) {
+    const MediaIndexSnapshot* snapshot =
+        static_cast<const MediaIndexSnapshot*>(snapshots->pdata[r]);
+    for (guint i = 0; i < snapshot->n_albums; i++) {
+      const MediaAlbumRecord* album = &snapshot->albums[i];
+      if (media_type == nullptr || g_strcmp0(media_type, "image") == 0) {
+        if (album->image_count > 0) {
+          append_album(albums, snapshot, album, "image", album->image_count);
+        }
+      }
+      if (media_type == nullptr || g_strcmp0(media_type, "video") == 0) {
+        if (album->video_count > 0) {
+          append_album(albums, snapshot, album, "video", album->video_count);
+        }
+      }
+    }
+  }
   
   return FL_METHOD_RESPONSE(fl_method_success_response_new(albums));
 }
 
+// Changes how deep the library is walked and whether dot-directories are
+// skipped; the index rescans in the background
+static FlMethodResponse* set_scan_options(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+
+  MediaScanOptions options = {MEDIA_SCAN_DEFAULT_MAX_DEPTH, TRUE};
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    FlValue* max_depth = fl_value_lookup_string(args, "maxDepth");
+    if (max_depth != nullptr && fl_value_get_type(max_depth) == FL_VALUE_TYPE_INT) {
+      options.max_depth = fl_value_get_int(max_depth);
+    }
+    FlValue* skip_hidden = fl_value_lookup_string(args, "skipHidden");
+    if (skip_hidden != nullptr && fl_value_get_type(skip_hidden) == FL_VALUE_TYPE_BOOL) {
+      options.skip_hidden = fl_value_get_bool(skip_hidden);
+    }
+  }
+  media_library_set_scan_options(self->media_library, &options);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Changes the pixel budget and timeout for decoding one image. Missing
+// arguments restore the defaults; 0 disables a bound
+static FlMethodResponse* set_decode_limits(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+
+  ThumbnailDecodeLimits limits = {THUMBNAIL_DEFAULT_MAX_PIXELS,
+                                  THUMBNAIL_DEFAULT_TIMEOUT_MS};
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    FlValue* max_pixels = fl_value_lookup_string(args, "maxPixels");
+    if (max_pixels != nullptr && fl_value_get_type(max_pixels) == FL_VALUE_TYPE_INT) {
+      limits.max_pixels = MAX(fl_value_get_int(max_pixels), 0);
+    }
+    FlValue* timeout = fl_value_lookup_string(args, "timeoutMs");
+    if (timeout != nullptr && fl_value_get_type(timeout) == FL_VALUE_TYPE_INT) {
+      limits.timeout_ms = MAX(fl_value_get_int(timeout), 0);
+    }
+  }
+  g_mutex_lock(&self->decode_limits_mutex);
+  self->decode_limits = limits;
+  g_mutex_unlock(&self->decode_limits_mutex);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Collects the strings of an optional list argument as a NULL-terminated
+// array. Returns FALSE if it is not a list of strings.
+static gboolean get_string_list(FlValue* map, const gchar* key, GPtrArray* strings) {
+  FlValue* list = fl_value_lookup_string(map, key);
+  if (list != nullptr && fl_value_get_type(list) != FL_VALUE_TYPE_NULL) {
+    if (fl_value_get_type(list) != FL_VALUE_TYPE_LIST) return FALSE;
+    for (size_t i = 0; i < fl_value_get_length(list); i++) {
+      FlValue* item = fl_value_get_list_value(list, i);
+      if (fl_value_get_type(item) != FL_VALUE_TYPE_STRING) return FALSE;
+      g_ptr_array_add(strings, (gpointer)fl_value_get_string(item));
+    }
+  }
+  g_ptr_array_add(strings, nullptr);
+  return TRUE;
+}
+
+// Replaces the folders albums come from. Roots that are given again
+// unchanged keep their index; the others are indexed in the background
+static FlMethodResponse* set_library_roots(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* list = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    list = fl_value_lookup_string(args, "roots");
+  }
+  if (list == nullptr || fl_value_get_type(list) != FL_VALUE_TYPE_LIST) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "roots must be a list", nullptr));
+  }
+
+  // The arrays only borrow strings from |args|, which outlives the call.
+  guint n_roots = fl_value_get_length(list);
+  g_autofree MediaLibraryRoot* roots = g_new0(MediaLibraryRoot, n_roots);
+  g_autoptr(GPtrArray) patterns = g_ptr_array_new_with_free_func(
+      reinterpret_cast<GDestroyNotify>(g_ptr_array_unref));
+  for (guint i = 0; i < n_roots; i++) {
+    FlValue* root = fl_value_get_list_value(list, i);
+    FlValue* path = fl_value_get_type(root) == FL_VALUE_TYPE_MAP
+                        ? fl_value_lookup_string(root, "path")
+                        : nullptr;
+    GPtrArray* include = g_ptr_array_new();
+    GPtrArray* exclude = g_ptr_array_new();
+    g_ptr_array_add(patterns, include);
+    g_ptr_array_add(patterns, exclude);
+    if (path == nullptr || fl_value_get_type(path) != FL_VALUE_TYPE_STRING ||
+        !get_string_list(root, "include", include) ||
+        !get_string_list(root, "exclude", exclude)) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS",
+        "Each root needs a path and optional include and exclude lists of strings",
+        nullptr));
+    }
+    roots[i].path = fl_value_get_string(path);
+    roots[i].include = reinterpret_cast<const gchar* const*>(include->pdata);
+    roots[i].exclude = reinterpret_cast<const gchar* const*>(exclude->pdata);
+  }
+
+  g_autoptr(GError) error = nullptr;
+  if (!media_library_set_roots(self->media_library, roots, n_roots, &error)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", error->message, nullptr));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Reads the optional "mediaType" argument of the timeline methods; without
+// it both kinds are included. Returns 0 for an unknown type.
+static guint32 get_timeline_kinds(FlValue* args) {
+  FlValue* value = fl_value_lookup_string(args, "mediaType");
+  if (value == nullptr || fl_value_get_type(value) == FL_VALUE_TYPE_NULL) {
+    return MEDIA_KIND_ANY;
+  }
+  if (fl_value_get_type(value) != FL_VALUE_TYPE_STRING) return 0;
+  return media_kind_for_type(fl_value_get_string(value));
+}
+
+// Counts the media of every root per local day, month or year, newest
+// first. The buckets are sent as parallel lists rather than a map each:
+// {starts, ends (seconds), counts, covers (the newest item's ID)}
+static FlMethodResponse* get_timeline(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "Expected a map of arguments", nullptr));
+  }
+  MediaTimelineGranularity granularity = MEDIA_TIMELINE_DAY;
+  FlValue* value = fl_value_lookup_string(args, "granularity");
+  if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+    const gchar* name = fl_value_get_string(value);
+    if (g_strcmp0(name, "month") == 0) {
+      granularity = MEDIA_TIMELINE_MONTH;
+    } else if (g_strcmp0(name, "year") == 0) {
+      granularity = MEDIA_TIMELINE_YEAR;
+    } else if (g_strcmp0(name, "day") != 0) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "granularity must be day, month or year", nullptr));
+    }
+  }
+  guint32 kinds = get_timeline_kinds(args);
+  if (kinds == 0) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "mediaType must be image or video", nullptr));
+  }
+
+  g_autoptr(GPtrArray) snapshots = media_library_get_snapshots(self->media_library, nullptr);
+  g_autoptr(GArray) buckets = media_timeline_build(snapshots, kinds, granularity);
+  g_autofree int64_t* starts = g_new(int64_t, MAX(buckets->len, 1));
+  g_autofree int64_t* ends = g_new(int64_t, MAX(buckets->len, 1));
+  g_autofree int32_t* counts = g_new(int32_t, MAX(buckets->len, 1));
+  FlValue* covers = fl_value_new_list();
+  for (guint i = 0; i < buckets->len; i++) {
+    const MediaTimelineBucket* bucket = &g_array_index(buckets, MediaTimelineBucket, i);
+    const MediaIndexSnapshot* snapshot =
+        static_cast<const MediaIndexSnapshot*>(snapshots->pdata[bucket->cover_snapshot]);
+    starts[i] = bucket->start;
+    ends[i] = bucket->end;
+    counts[i] = bucket->count;
+    fl_value_append_take(covers, fl_value_new_string(media_index_snapshot_string(
+                                     snapshot, snapshot->records[bucket->cover].path)));
+  }
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "starts", fl_value_new_int64_list(starts, buckets->len));
+  fl_value_set_string_take(result, "ends", fl_value_new_int64_list(ends, buckets->len));
+  fl_value_set_string_take(result, "counts", fl_value_new_int32_list(counts, buckets->len));
+  fl_value_set_string_take(result, "covers", covers);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Returns a page of the media of every root dated within [start, end),
+// newest first, so a timeline can fill each bucket as it scrolls into view
+static FlMethodResponse* get_media_in_range(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* start = nullptr;
+  FlValue* end = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    start = fl_value_lookup_string(args, "start");
+    end = fl_value_lookup_string(args, "end");
+  }
+  if (start == nullptr || fl_value_get_type(start) != FL_VALUE_TYPE_INT ||
+      end == nullptr || fl_value_get_type(end) != FL_VALUE_TYPE_INT) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "start and end are required", nullptr));
+  }
+  gint64 offset = 0;
+  gint64 limit = -1;
+  FlValue* value = fl_value_lookup_string(args, "offset");
+  if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+    offset = CLAMP(fl_value_get_int(value), 0, G_MAXUINT);
+  }
+  value = fl_value_lookup_string(args, "limit");
+  if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+    limit = fl_value_get_int(value);
+  }
+  guint32 kinds = get_timeline_kinds(args);
+  if (kinds == 0) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "mediaType must be image or video", nullptr));
+  }
+
+  g_autoptr(GPtrArray) snapshots = media_library_get_snapshots(self->media_library, nullptr);
+  g_autoptr(GArray) entries = media_timeline_get_range(
+      snapshots, kinds, fl_value_get_int(start), fl_value_get_int(end), offset, limit);
+  g_autoptr(FlValue) media_list = fl_value_new_list();
+  for (guint i = 0; i < entries->len; i++) {
+    const MediaTimelineEntry* entry = &g_array_index(entries, MediaTimelineEntry, i);
+    const MediaIndexSnapshot* snapshot =
+        static_cast<const MediaIndexSnapshot*>(snapshots->pdata[entry->snapshot]);
+    fl_value_append_take(media_list,
+                         media_encoder_encode_record(snapshot, &snapshot->records[entry->record]));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(media_list));
+}
+
+// Method to report the part of an album a grid shows, which prefetches
+// thumbnails for where it is scrolling. Returns the number of items queued.
+static FlMethodResponse* set_viewport(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* album_id = nullptr;
+  FlValue* first = nullptr;
+  FlValue* last = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    album_id = fl_value_lookup_string(args, "albumId");
+    first = fl_value_lookup_string(args, "firstIndex");
+    last = fl_value_lookup_string(args, "lastIndex");
+  }
+  if (album_id == nullptr || fl_value_get_type(album_id) != FL_VALUE_TYPE_STRING ||
+      first == nullptr || fl_value_get_type(first) != FL_VALUE_TYPE_INT ||
+      last == nullptr || fl_value_get_type(last) != FL_VALUE_TYPE_INT) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "albumId, firstIndex and lastIndex are required", nullptr));
+  }
+  // Items per second, positive towards the end of the album
+  gdouble velocity = 0;
+  FlValue* value = fl_value_lookup_string(args, "velocity");
+  if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_FLOAT) {
+    velocity = fl_value_get_float(value);
+  } else if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+    velocity = fl_value_get_int(value);
+  }
+  const gchar* media_type = "image";
+  value = fl_value_lookup_string(args, "mediaType");
+  if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+    media_type = fl_value_get_string(value);
+  }
+  MediaSortKey sort;
+  gboolean descending;
+  if (!parse_media_sort(args, &sort, &descending)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "sortBy must be name, dateAdded, dateTaken or size", nullptr));
+  }
+  ThumbnailOptions options;
+  g_autoptr(GError) error = nullptr;
+  if (!thumbnail_options_parse(&options, args, 512, &error)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", error->message, nullptr));
+  }
+
+  // Positions are only meaningful in the index's order, so albums outside
+  // it are not prefetched.
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func(g_free);
+  const MediaAlbumRecord* album = nullptr;
+  g_autoptr(MediaIndexSnapshot) snapshot = media_library_find_album(
+      self->media_library, fl_value_get_string(album_id), &album);
+  if (snapshot != nullptr && fl_value_get_int(first) >= 0 &&
+      fl_value_get_int(last) >= fl_value_get_int(first)) {
+    guint n_records = 0;
+    const guint32* order = media_index_snapshot_get_order(
+        snapshot, album, media_kind_for_type(media_type), sort, &n_records);
+    guint positions[THUMBNAIL_PREFETCH_MAX_ITEMS];
+    guint n_positions = thumbnail_prefetch_plan(
+        MIN(fl_value_get_int(first), G_MAXUINT), MIN(fl_value_get_int(last), G_MAXUINT),
+        velocity, n_records, positions);
+    for (guint i = 0; i < n_positions; i++) {
+      guint32 record = order[descending ? n_records - 1 - positions[i] : positions[i]];
+      g_ptr_array_add(paths, g_strdup(media_index_snapshot_string(
+                                 snapshot, snapshot->records[record].path)));
+    }
+  }
+
+  // An empty window still stops prefetching for the previous viewport
+  guint n_paths = paths->len;
+  thumbnail_prefetcher_set_window(self->thumbnail_prefetcher,
+                                  static_cast<GPtrArray*>(g_steal_pointer(&paths)), &options);
+  g_autoptr(FlValue) result = fl_value_new_int(n_paths);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+typedef struct {
+  FlEventChannel* channel;
+  FlValue* event;
+} PendingEvent;
+
+static gboolean pending_event_send(gpointer data) {
+  PendingEvent* pending = static_cast<PendingEvent*>(data);
+  fl_event_channel_send(pending->channel, pending->event, nullptr, nullptr);
+  return G_SOURCE_REMOVE;
+}
+
+static void pending_event_free(gpointer data) {
+  PendingEvent* pending = static_cast<PendingEvent*>(data);
+  g_object_unref(pending->channel);
+  fl_value_unref(pending->event);
+  g_free(pending);
+}
+
+// Sends |event| on |channel| from the main context, taking ownership of
+// |event|. Safe to call from any thread.
+static void send_event_from_worker(PhotoGalleryProPlugin* self, FlEventChannel* channel,
+                                   FlValue* event) {
+  PendingEvent* pending = g_new(PendingEvent, 1);
+  pending->channel = static_cast<FlEventChannel*>(g_object_ref(channel));
+  pending->event = event;
+  g_main_context_invoke_full(self->main_context, G_PRIORITY_DEFAULT, pending_event_send,
+                             pending, pending_event_free);
+}
+
+// How long findDuplicates waits by default for the index to hash the images
+// in scope before returning the groups among those hashed so far
+#define DUPLICATES_DEFAULT_TIMEOUT_MS (2 * 60 * 1000)
+
+// Where a findDuplicates candidate came from
+typedef struct {
+  guint snapshot;
+  guint record;
+} DuplicateCandidate;
+
+// Sets [first, end) to the records of |album| in |snapshot|, or to all of
+// them when |album| is NULL
+static void get_record_range(const MediaIndexSnapshot* snapshot, const MediaAlbumRecord* album,
+                             guint* first, guint* end) {
+  *first = album != nullptr ? album->first : 0;
+  *end = album != nullptr ? album->first + album->count : snapshot->n_records;
+}
+
+// Sets |snapshots| to those holding the images in scope and waits for the
+// index to hash all of them, reporting {token, hashed, total} as it goes.
+// Each root publishes its hashes a few hundred at a time, so this sleeps
+// until a root that is not done yet publishes again, or one still on its
+// first scan publishes at all. Returns FALSE if
+// |album_id| names no album; otherwise sets |complete| to FALSE when
+// |end_time| passed or |cancellable| was cancelled first
+static gboolean wait_for_hashes(PhotoGalleryProPlugin* self, const gchar* album_id,
+                                const gchar* token, gint64 end_time,
+                                GCancellable* cancellable, GPtrArray** snapshots,
+                                const MediaAlbumRecord** album, gboolean* complete) {
+  guint reported = G_MAXUINT;
+  while (TRUE) {
+    guint pending = 0;
+    g_clear_pointer(snapshots, g_ptr_array_unref);
+    if (album_id != nullptr) {
+      MediaIndexSnapshot* snapshot =
+          media_library_find_album(self->media_library, album_id, album);
+      if (snapshot == nullptr) return FALSE;
+      *snapshots = g_ptr_array_new_with_free_func(
+          reinterpret_cast<GDestroyNotify>(media_index_snapshot_unref));
+      g_ptr_array_add(*snapshots, snapshot);
+    } else {
+      *snapshots = media_library_get_snapshots(self->media_library, &pending);
+    }
+
+    // Files that could not be decoded are done too; they just get no hash
+    guint total = 0;
+    guint hashed = 0;
+    const MediaIndexSnapshot* unfinished = nullptr;
+    for (guint s = 0; s < (*snapshots)->len; s++) {
+      const MediaIndexSnapshot* snapshot =
+          static_cast<const MediaIndexSnapshot*>((*snapshots)->pdata[s]);
+      guint first, end;
+      get_record_range(snapshot, *album, &first, &end);
+      for (guint r = first; r < end; r++) {
+        if (snapshot->records[r].kind != MEDIA_KIND_IMAGE) continue;
+        total++;
+        if (snapshot->records[r].flags & MEDIA_RECORD_HAS_PLACEHOLDER) {
+          hashed++;
+        } else if (unfinished == nullptr) {
+          unfinished = snapshot;
+        }
+      }
+    }
+    if (token != nullptr && self->duplicate_events != nullptr && hashed != reported) {
+      FlValue* event = fl_value_new_map();
+      fl_value_set_string_take(event, "token", fl_value_new_string(token));
+      fl_value_set_string_take(event, "hashed", fl_value_new_int(hashed));
+      fl_value_set_string_take(event, "total", fl_value_new_int(total));
+      send_event_from_worker(self, self->duplicate_events, event);
+      reported = hashed;
+    }
+    *complete = hashed == total && pending == 0;
+    if (*complete) return TRUE;
+    if (!media_library_wait_for_update(self->media_library, unfinished, end_time,
+                                       cancellable)) {
+      return TRUE;
+    }
+  }
+}
+
+// Groups the images of an album, or of the whole library, that are
+// duplicates or near duplicates of each other. The index hashes images in
+// the background along with their placeholders, so this waits for it to get
+// through the ones in scope, for at most timeoutMs or until
+// cancelFindDuplicates is called with the same token. Returns {groups,
+// complete}, where groups only cover the images hashed so far unless
+// complete is true
+static FlMethodResponse* find_duplicates(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+  const gchar* token = nullptr;
+  const gchar* album_id = nullptr;
+  gint64 max_distance = MEDIA_HASH_DEFAULT_MAX_DISTANCE;
+  gint64 timeout_ms = DUPLICATES_DEFAULT_TIMEOUT_MS;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    FlValue* value = fl_value_lookup_string(args, "token");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+      token = fl_value_get_string(value);
+    }
+    value = fl_value_lookup_string(args, "albumId");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_STRING) {
+      album_id = fl_value_get_string(value);
+    }
+    value = fl_value_lookup_string(args, "maxDistance");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+      max_distance = fl_value_get_int(value);
+    }
+    value = fl_value_lookup_string(args, "timeoutMs");
+    if (value != nullptr && fl_value_get_type(value) == FL_VALUE_TYPE_INT) {
+      timeout_ms = MAX(fl_value_get_int(value), 0);
+    }
+  }
+  if (max_distance < 0 || max_distance > 64) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "maxDistance must be between 0 and 64", nullptr));
+  }
+
+  g_autoptr(GCancellable) cancellable = g_cancellable_new();
+  if (token != nullptr) {
+    g_mutex_lock(&self->duplicates_mutex);
+    gboolean running = g_hash_table_contains(self->duplicate_searches, token);
+    if (!running) {
+      g_hash_table_insert(self->duplicate_searches, g_strdup(token),
+                          g_object_ref(cancellable));
+    }
+    g_mutex_unlock(&self->duplicates_mutex);
+    if (running) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "A search with this token is already running", nullptr));
+    }
+  }
+
+  g_autoptr(GPtrArray) snapshots = nullptr;
+  const MediaAlbumRecord* album = nullptr;
+  gboolean complete = FALSE;
+  gboolean found = wait_for_hashes(self, album_id, token,
+                                   g_get_monotonic_time() + timeout_ms * 1000, cancellable,
+                                   &snapshots, &album, &complete);
+  if (token != nullptr) {
+    g_mutex_lock(&self->duplicates_mutex);
+    g_hash_table_remove(self->duplicate_searches, token);
+    g_mutex_unlock(&self->duplicates_mutex);
+  }
+  if (!found) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "No such album", nullptr));
+  }
+
+  g_autoptr(GArray) hashes = g_array_new(FALSE, FALSE, sizeof(guint64));
+  g_autoptr(GArray) candidates = g_array_new(FALSE, FALSE, sizeof(DuplicateCandidate));
+  for (guint s = 0; s < snapshots->len; s++) {
+    const MediaIndexSnapshot* snapshot =
+        static_cast<const MediaIndexSnapshot*>(snapshots->pdata[s]);
+    guint first, end;
+    get_record_range(snapshot, album, &first, &end);
+    for (guint r = first; r < end; r++) {
+      if (!(snapshot->records[r].flags & MEDIA_RECORD_HAS_HASH)) continue;
+      DuplicateCandidate candidate = {s, r};
+      g_array_append_val(hashes, snapshot->records[r].hash);
+      g_array_append_val(candidates, candidate);
+    }
+  }
+
+  g_autoptr(GPtrArray) groups = media_hash_group(
+      reinterpret_cast<const guint64*>(hashes->data), hashes->len, max_distance);
+  FlValue* groups_value = fl_value_new_list();
+  for (guint g = 0; g < groups->len; g++) {
+    GArray* members = static_cast<GArray*>(groups->pdata[g]);
+    FlValue* group = fl_value_new_list();
+    for (guint m = 0; m < members->len; m++) {
+      const DuplicateCandidate* candidate = &g_array_index(
+          candidates, DuplicateCandidate, g_array_index(members, guint, m));
+      const MediaIndexSnapshot* snapshot =
+          static_cast<const MediaIndexSnapshot*>(snapshots->pdata[candidate->snapshot]);
+      fl_value_append_take(group, media_encoder_encode_record(
+                                      snapshot, &snapshot->records[candidate->record]));
+    }
+    fl_value_append_take(groups_value, group);
+  }
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "groups", groups_value);
+  fl_value_set_string_take(result, "complete", fl_value_new_bool(complete));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// Stops a findDuplicates call waiting for the index, which then returns the
+// groups found so far
+static FlMethodResponse* cancel_find_duplicates(FlMethodCall* method_call, gpointer user_data) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(user_data);
+  FlValue* args = fl_method_call_get_args(method_call);
+  FlValue* token = nullptr;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    token = fl_value_lookup_string(args, "token");
+  }
+  if (token == nullptr || fl_value_get_type(token) != FL_VALUE_TYPE_STRING) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_ARGUMENTS", "token is required", nullptr));
+  }
+
+  g_mutex_lock(&self->duplicates_mutex);
+  GCancellable* cancellable = static_cast<GCancellable*>(
+      g_hash_table_lookup(self->duplicate_searches, fl_value_get_string(token)));
+  if (cancellable != nullptr) g_cancellable_cancel(cancellable);
+  g_mutex_unlock(&self->duplicates_mutex);
+  g_autoptr(FlValue) result = fl_value_new_bool(cancellable != nullptr);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
 // Called when a method call is received from Flutter.
 static void photo_gallery_pro_plugin_handle_method_call(
     PhotoGalleryProPlugin* self,
     FlMethodCall* method_call) {
-  g_autoptr(FlMethodResponse) response = nullptr;
-
-  const gchar* method = fl_method_call_get_name(method_call);
-
-  if (strcmp(method, "getAlbums") == 0) {
-    response = get_albums(method_call);
-  } else if (strcmp(method, "getAlbumThumbnail") == 0) {
-    response = get_album_thumbnail(method_call);
-  } else if (strcmp(method, "getThumbnail") == 0) {
-    response = get_thumbnail(method_call);
-  } else if (strcmp(method, "getMediaInAlbum") == 0) {
-    response = get_media_in_album(method_call);
-  } else if (strcmp(method, "hasPermission") == 0) {
-    response = has_permission(method_call);
-  } else if (strcmp(method, "requestPermission") == 0) {
-    response = request_permission(method_call);
-  } else {
-    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  if (!method_dispatcher_dispatch(self->dispatcher, method_call)) {
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+    fl_method_call_respond(method_call, response, nullptr);
   }
-
-  fl_method_call_respond(method_call, response, nullptr);
 }
 
 FlMethodResponse* get_platform_version() {
@@ -483,14 +1609,136 @@ FlMethodResponse* get_platform_version() {
 }
 
 static void photo_gallery_pro_plugin_dispose(GObject* object) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(object);
+  g_clear_pointer(&self->dispatcher, method_dispatcher_free);
+  g_clear_pointer(&self->media_streamer, media_streamer_free);
+  g_clear_object(&self->media_events);
+  g_clear_pointer(&self->media_library, media_library_free);
+  g_clear_pointer(&self->thumbnail_queue, thumbnail_queue_free);
+  g_clear_pointer(&self->thumbnail_prefetcher, thumbnail_prefetcher_free);
+  g_clear_object(&self->thumbnail_events);
+  g_clear_object(&self->duplicate_events);
+  g_clear_pointer(&self->texture_pool, thumbnail_texture_pool_free);
+  g_clear_pointer(&self->thumbnail_cache, thumbnail_cache_free);
+
   G_OBJECT_CLASS(photo_gallery_pro_plugin_parent_class)->dispose(object);
 }
 
+static void photo_gallery_pro_plugin_finalize(GObject* object) {
+  PhotoGalleryProPlugin* self = PHOTO_GALLERY_PRO_PLUGIN(object);
+  g_mutex_clear(&self->decode_limits_mutex);
+  g_hash_table_unref(self->duplicate_searches);
+  g_mutex_clear(&self->duplicates_mutex);
+  g_main_context_unref(self->main_context);
+
+  G_OBJECT_CLASS(photo_gallery_pro_plugin_parent_class)->finalize(object);
+}
+
 static void photo_gallery_pro_plugin_class_init(PhotoGalleryProPluginClass* klass) {
   G_OBJECT_CLASS(klass)->dispose = photo_gallery_pro_plugin_dispose;
+  G_OBJECT_CLASS(klass)->finalize = photo_gallery_pro_plugin_finalize;
 }
 
-static void photo_gallery_pro_plugin_init(PhotoGalleryProPlugin* self) {}
+// Decoding is CPU bound; leave a core for the UI and cap the pool so large
+// machines do not decode dozens of images at once.
+static gint get_thumbnail_thread_count() {
+  return CLAMP((gint)g_get_num_processors() - 1, 1, 4);
+}
+
+static void photo_gallery_pro_plugin_init(PhotoGalleryProPlugin* self) {
+  // Listing and thumbnail work get separate lanes so a grid full of
+  // thumbnail requests cannot hold up album listing, and vice versa.
+  gint thumbnail_threads = get_thumbnail_thread_count();
+
+  self->main_context = g_main_context_ref_thread_default();
+  self->thumbnail_cache = thumbnail_cache_new(THUMBNAIL_CACHE_MEMORY_BUDGET);
+  self->thumbnail_prefetcher = thumbnail_prefetcher_new(
+      self->thumbnail_cache, prefetch_thumbnail, self);
+  g_mutex_init(&self->decode_limits_mutex);
+  self->decode_limits.max_pixels = THUMBNAIL_DEFAULT_MAX_PIXELS;
+  self->decode_limits.timeout_ms = THUMBNAIL_DEFAULT_TIMEOUT_MS;
+  g_mutex_init(&self->duplicates_mutex);
+  self->duplicate_searches =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  // Starts indexing in the background; the first listing waits for it only
+  // when there is no saved index to serve from.
+  g_autofree gchar* cache_dir = media_library_get_default_cache_dir();
+  self->media_library = media_library_new(cache_dir);
+  const gchar* pictures_dir = g_get_user_special_dir(G_USER_DIRECTORY_PICTURES);
+  if (pictures_dir != nullptr) {
+    MediaLibraryRoot pictures = {pictures_dir, nullptr, nullptr};
+    media_library_set_roots(self->media_library, &pictures, 1, nullptr);
+  }
+  // Left behind by versions that indexed only the Pictures directory
+  g_autofree gchar* legacy_cache_file =
+      g_build_filename(cache_dir, "media_index.bin", nullptr);
+  g_unlink(legacy_cache_file);
+
+  self->dispatcher = method_dispatcher_new(G_OBJECT(self));
+  method_dispatcher_add_lane(self->dispatcher, "library", 2);
+  method_dispatcher_add_lane(self->dispatcher, "thumbnail", thumbnail_threads);
+  method_dispatcher_add_lane(self->dispatcher, "album_thumbnail", 2);
+  // findDuplicates may wait for the index until its timeout, so it gets a
+  // lane of its own.
+  method_dispatcher_add_lane(self->dispatcher, "duplicates", 1);
+  // setViewport resolves album positions to paths, which must not wait
+  // behind thumbnails or listings.
+  method_dispatcher_add_lane(self->dispatcher, "prefetch", 1);
+  // Writing a trace can take a while, so getPerformanceStats runs off the
+  // main thread without queueing behind real work.
+  method_dispatcher_add_lane(self->dispatcher, "diagnostics", 1);
+
+  method_dispatcher_add_method(self->dispatcher, "getAlbums",
+                               get_albums, "library");
+  method_dispatcher_add_method(self->dispatcher, "getMediaInAlbum",
+                               get_media_in_album, "library");
+  method_dispatcher_add_method(self->dispatcher, "streamMediaInAlbum",
+                               stream_media_in_album, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "cancelMediaStream",
+                               cancel_media_stream, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "getTimeline",
+                               get_timeline, "library");
+  method_dispatcher_add_method(self->dispatcher, "getMediaInRange",
+                               get_media_in_range, "library");
+  method_dispatcher_add_method(self->dispatcher, "setScanOptions",
+                               set_scan_options, nullptr);
+  // Replacing a root stops its index, which waits for its thread
+  method_dispatcher_add_method(self->dispatcher, "setLibraryRoots",
+                               set_library_roots, "library");
+  method_dispatcher_add_method(self->dispatcher, "setDecodeLimits",
+                               set_decode_limits, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "getThumbnail",
+                               get_thumbnail, "thumbnail");
+  method_dispatcher_add_method(self->dispatcher, "getAlbumThumbnail",
+                               get_album_thumbnail, "album_thumbnail");
+  method_dispatcher_add_method(self->dispatcher, "getThumbnails",
+                               get_thumbnails, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "cancelThumbnails",
+                               cancel_thumbnails, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "getThumbnailTexture",
+                               get_thumbnail_texture, "thumbnail");
+  method_dispatcher_add_method(self->dispatcher, "releaseThumbnailTexture",
+                               release_thumbnail_texture, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "clearThumbnailCache",
+                               clear_thumbnail_cache, "library");
+  method_dispatcher_add_method(self->dispatcher, "getThumbnailCacheStats",
+                               get_thumbnail_cache_stats, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "setViewport",
+                               set_viewport, "prefetch");
+  method_dispatcher_add_method(self->dispatcher, "findDuplicates",
+                               find_duplicates, "duplicates");
+  method_dispatcher_add_method(self->dispatcher, "cancelFindDuplicates",
+                               cancel_find_duplicates, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "getPerformanceStats",
+                               get_performance_stats, "diagnostics");
+  method_dispatcher_add_method(self->dispatcher, "setPerformanceStatsEnabled",
+                               set_performance_stats_enabled, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "hasPermission",
+                               has_permission, nullptr);
+  method_dispatcher_add_method(self->dispatcher, "requestPermission",
+                               request_permission, nullptr);
+}
 
 static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
                            gpointer user_data) {
@@ -498,13 +1746,32 @@ static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
   photo_gallery_pro_plugin_handle_method_call(plugin, method_call);
 }
 
+static FlMethodErrorResponse* event_listen_cb(FlEventChannel* channel,
+                                              FlValue* args,
+                                              gpointer user_data) {
+  return nullptr;
+}
+
+static FlMethodErrorResponse* event_cancel_cb(FlEventChannel* channel,
+                                              FlValue* args,
+                                              gpointer user_data) {
+  return nullptr;
+}
+
 void photo_gallery_pro_plugin_register_with_registrar(FlPluginRegistrar* registrar) {
+  photo_gallery_pro_plugin_register_with_messenger(
+      fl_plugin_registrar_get_messenger(registrar),
+      fl_plugin_registrar_get_texture_registrar(registrar));
+}
+
+void photo_gallery_pro_plugin_register_with_messenger(
+    FlBinaryMessenger* messenger, FlTextureRegistrar* texture_registrar) {
   PhotoGalleryProPlugin* plugin = PHOTO_GALLERY_PRO_PLUGIN(
       g_object_new(photo_gallery_pro_plugin_get_type(), nullptr));
       
   g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
   g_autoptr(FlMethodChannel) channel =
-      fl_method_channel_new(fl_plugin_registrar_get_messenger(registrar),
+      fl_method_channel_new(messenger,
                            "photo_gallery_pro",
                            FL_METHOD_CODEC(codec));
                            
@@ -512,5 +1779,46 @@ void photo_gallery_pro_plugin_register_with_registrar(FlPluginRegistrar* registr
                                            g_object_ref(plugin),
                                            g_object_unref);
 
+  // getThumbnails results are pushed on their own event channel. Dart
+  // listens once and demultiplexes events by request token.
+  plugin->thumbnail_events =
+      fl_event_channel_new(messenger,
+                           "photo_gallery_pro/thumbnails",
+                           FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->thumbnail_events,
+                                       event_listen_cb, event_cancel_cb,
+                                       nullptr, nullptr);
+  plugin->thumbnail_queue = thumbnail_queue_new(
+      G_OBJECT(plugin), plugin->thumbnail_events, produce_queued_thumbnail,
+      get_thumbnail_thread_count());
+
+  // findDuplicates progress is demultiplexed by token in the same way.
+  plugin->duplicate_events =
+      fl_event_channel_new(messenger,
+                           "photo_gallery_pro/duplicates",
+                           FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->duplicate_events,
+                                       event_listen_cb, event_cancel_cb,
+                                       nullptr, nullptr);
+
+  // streamMediaInAlbum chunks get their own event channel, demultiplexed by
+  // token in the same way.
+  plugin->media_events =
+      fl_event_channel_new(messenger,
+                           "photo_gallery_pro/media",
+                           FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(plugin->media_events,
+                                       event_listen_cb, event_cancel_cb,
+                                       nullptr, nullptr);
+  plugin->media_streamer = media_streamer_new(
+      G_OBJECT(plugin), plugin->media_events, produce_media_stream, 2);
+
+  // The texture registrar is thread-safe, so textures are filled straight
+  // from the thumbnail workers.
+  if (texture_registrar != nullptr) {
+    plugin->texture_pool = thumbnail_texture_pool_new(
+        texture_registrar, THUMBNAIL_TEXTURE_MEMORY_BUDGET);
+  }
+
   g_object_unref(plugin);
 }
@@ -8,3 +8,11 @@
 
 // Handles the getPlatformVersion method call.
 FlMethodResponse *get_platform_version();
+
+// Creates the plugin and its channels on |messenger|, as
+// photo_gallery_pro_plugin_register_with_registrar() does; the channels keep
+// the plugin alive. Without a |texture_registrar|, getThumbnailTexture
+// fails. Lets the benchmark drive the plugin through real method calls
+// without an engine.
+void photo_gallery_pro_plugin_register_with_messenger(
+    FlBinaryMessenger *messenger, FlTextureRegistrar *texture_registrar);
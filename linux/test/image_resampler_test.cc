@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "image_resampler.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+const ImageResamplerKernel kKernels[] = {
+    IMAGE_RESAMPLER_KERNEL_SCALAR,
+    IMAGE_RESAMPLER_KERNEL_SSE41,
+    IMAGE_RESAMPLER_KERNEL_AVX2,
+    IMAGE_RESAMPLER_KERNEL_NEON,
+};
+
+// Random pixels, the worst case for aliasing and rounding.
+GdkPixbuf* NoisePixbuf(gint width, gint height, gboolean has_alpha) {
+  GdkPixbuf* pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+  gint channels = gdk_pixbuf_get_n_channels(pixbuf);
+  guint8* pixels = gdk_pixbuf_get_pixels(pixbuf);
+  GRand* rand = g_rand_new_with_seed(7);
+  for (gint y = 0; y < height; y++) {
+    guint8* row = pixels + (gsize)y * gdk_pixbuf_get_rowstride(pixbuf);
+    for (gint i = 0; i < width * channels; i++) row[i] = g_rand_int(rand);
+  }
+  g_rand_free(rand);
+  return pixbuf;
+}
+
+GdkPixbuf* PixbufFromRow(const std::vector<guint8>& pixels,
+                         gboolean has_alpha) {
+  gint channels = has_alpha ? 4 : 3;
+  gint width = pixels.size() / channels;
+  GdkPixbuf* pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, 1);
+  memcpy(gdk_pixbuf_get_pixels(pixbuf), pixels.data(), pixels.size());
+  return pixbuf;
+}
+
+std::vector<guint8> Pixels(GdkPixbuf* pixbuf) {
+  gint row_bytes = gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_n_channels(pixbuf);
+  std::vector<guint8> pixels;
+  for (gint y = 0; y < gdk_pixbuf_get_height(pixbuf); y++) {
+    const guint8* row = gdk_pixbuf_read_pixels(pixbuf) +
+                        (gsize)y * gdk_pixbuf_get_rowstride(pixbuf);
+    pixels.insert(pixels.end(), row, row + row_bytes);
+  }
+  return pixels;
+}
+
+// The exact area average in double precision, with colour weighted by
+// alpha.
+std::vector<guint8> ReferenceResample(GdkPixbuf* source,
+                                      gint width,
+                                      gint height) {
+  gint source_width = gdk_pixbuf_get_width(source);
+  gint source_height = gdk_pixbuf_get_height(source);
+  gint channels = gdk_pixbuf_get_n_channels(source);
+  gboolean has_alpha = gdk_pixbuf_get_has_alpha(source);
+  std::vector<guint8> pixels = Pixels(source);
+  gdouble scale_x = (gdouble)source_width / width;
+  gdouble scale_y = (gdouble)source_height / height;
+
+  std::vector<guint8> result;
+  for (gint y = 0; y < height; y++) {
+    for (gint x = 0; x < width; x++) {
+      gdouble totals[4] = {0, 0, 0, 0};
+      gdouble area = 0;
+      for (gint sy = (gint)(y * scale_y); sy < ceil((y + 1) * scale_y); sy++) {
+        gdouble wy = MIN((y + 1) * scale_y, sy + 1.0) - MAX(y * scale_y, (gdouble)sy);
+        for (gint sx = (gint)(x * scale_x); sx < ceil((x + 1) * scale_x); sx++) {
+          gdouble w = wy * (MIN((x + 1) * scale_x, sx + 1.0) -
+                            MAX(x * scale_x, (gdouble)sx));
+          const guint8* pixel = &pixels[((gsize)sy * source_width + sx) * channels];
+          gdouble alpha = has_alpha ? pixel[3] / 255.0 : 1.0;
+          for (gint c = 0; c < 3; c++) totals[c] += pixel[c] * alpha * w;
+          totals[3] += alpha * w;
+          area += w;
+        }
+      }
+      for (gint c = 0; c < 3; c++) {
+        result.push_back(totals[3] > 0 ? (guint8)lround(totals[c] / totals[3]) : 0);
+      }
+      if (has_alpha) result.push_back((guint8)lround(totals[3] / area * 255));
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(ImageResampler, KnownValues) {
+  // Three pixels into two: each target pixel covers one and a half.
+  g_autoptr(GdkPixbuf) row = PixbufFromRow({0, 0, 0, 90, 90, 90, 180, 180, 180},
+                                           FALSE);
+  g_autoptr(GdkPixbuf) scaled = image_resample(row, 2, 1);
+  EXPECT_EQ(Pixels(scaled), std::vector<guint8>({30, 30, 30, 150, 150, 150}));
+}
+
+TEST(ImageResampler, TransparentPixelsDoNotBleed) {
+  g_autoptr(GdkPixbuf) row = PixbufFromRow({255, 0, 0, 255, 0, 255, 0, 0}, TRUE);
+  g_autoptr(GdkPixbuf) scaled = image_resample(row, 1, 1);
+  EXPECT_EQ(Pixels(scaled), std::vector<guint8>({255, 0, 0, 128}));
+}
+
+TEST(ImageResampler, MatchesReferenceAverage) {
+  static const gint kSizes[][4] = {
+      {300, 200, 64, 43}, {257, 131, 100, 37}, {1000, 750, 256, 192},
+      {640, 480, 1, 1},   {97, 400, 97, 13},
+  };
+  for (gboolean has_alpha : {FALSE, TRUE}) {
+    for (const auto& size : kSizes) {
+      g_autoptr(GdkPixbuf) source = NoisePixbuf(size[0], size[1], has_alpha);
+      std::vector<guint8> expected = ReferenceResample(source, size[2], size[3]);
+      g_autoptr(GdkPixbuf) scaled = image_resample(source, size[2], size[3]);
+      ASSERT_EQ(gdk_pixbuf_get_width(scaled), size[2]);
+      ASSERT_EQ(gdk_pixbuf_get_height(scaled), size[3]);
+      ASSERT_EQ(gdk_pixbuf_get_has_alpha(scaled), has_alpha);
+      std::vector<guint8> actual = Pixels(scaled);
+      ASSERT_EQ(actual.size(), expected.size());
+      for (gsize i = 0; i < actual.size(); i++) {
+        ASSERT_NEAR(actual[i], expected[i], 1)
+            << size[0] << "x" << size[1] << " -> " << size[2] << "x"
+            << size[3] << " at byte " << i;
+      }
+    }
+  }
+}
+
+TEST(ImageResampler, KernelsAgree) {
+  g_autoptr(GdkPixbuf) source = NoisePixbuf(1001, 333, TRUE);
+  g_autoptr(GdkPixbuf) expected = image_resample_with_kernel(
+      source, 123, 45, IMAGE_RESAMPLER_KERNEL_SCALAR);
+  for (ImageResamplerKernel kernel : kKernels) {
+    if (!image_resampler_kernel_is_supported(kernel)) continue;
+    g_autoptr(GdkPixbuf) scaled =
+        image_resample_with_kernel(source, 123, 45, kernel);
+    EXPECT_EQ(Pixels(scaled), Pixels(expected))
+        << image_resampler_kernel_name(kernel);
+  }
+}
+
+TEST(ImageResampler, HonoursRowstride) {
+  // A sub-pixbuf shares its parent's wider rows.
+  g_autoptr(GdkPixbuf) parent = NoisePixbuf(400, 300, FALSE);
+  g_autoptr(GdkPixbuf) region = gdk_pixbuf_new_subpixbuf(parent, 13, 7, 201, 150);
+  g_autoptr(GdkPixbuf) copy = gdk_pixbuf_copy(region);
+  ASSERT_NE(gdk_pixbuf_get_rowstride(region), gdk_pixbuf_get_rowstride(copy));
+
+  g_autoptr(GdkPixbuf) from_region = image_resample(region, 50, 37);
+  g_autoptr(GdkPixbuf) from_copy = image_resample(copy, 50, 37);
+  EXPECT_EQ(Pixels(from_region), Pixels(from_copy));
+}
+
+TEST(ImageResampler, FitKeepsAspectRatio) {
+  g_autoptr(GdkPixbuf) source = NoisePixbuf(400, 300, FALSE);
+  g_autoptr(GdkPixbuf) scaled = image_resample_to_fit(source, 200, 200);
+  EXPECT_EQ(gdk_pixbuf_get_width(scaled), 200);
+  EXPECT_EQ(gdk_pixbuf_get_height(scaled), 150);
+
+  g_autoptr(GdkPixbuf) unchanged = image_resample_to_fit(source, 512, 512);
+  EXPECT_EQ(unchanged, source);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <ftw.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "media_encoder.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+const guint8 kPngHeader[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00,
+    0x0d, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00,
+    0x00, 0x20, 0x08, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+int remove_entry(const char* path, const struct stat* st, int flag,
+                 struct FTW* ftw) {
+  return remove(path);
+}
+
+guint32 read_uint32(const guint8* data, gsize offset) {
+  guint32 value;
+  memcpy(&value, data + offset, sizeof(value));
+  return GUINT32_FROM_LE(value);
+}
+
+gint64 read_int64(const guint8* data, gsize offset) {
+  gint64 value;
+  memcpy(&value, data + offset, sizeof(value));
+  return GINT64_FROM_LE(value);
+}
+
+gdouble read_float64(const guint8* data, gsize offset) {
+  guint64 bits = read_int64(data, offset);
+  gdouble value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+class MediaEncoderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = g_dir_make_tmp("media-encoder-XXXXXX", nullptr);
+    ASSERT_NE(root_, nullptr);
+    g_autofree gchar* trip = g_build_filename(root_, "Trip", nullptr);
+    ASSERT_EQ(g_mkdir(trip, 0755), 0);
+    for (const gchar* name : {"a.png", "b.png"}) {
+      g_autofree gchar* path = g_build_filename(trip, name, nullptr);
+      ASSERT_TRUE(g_file_set_contents(
+          path, reinterpret_cast<const gchar*>(kPngHeader), sizeof(kPngHeader),
+          nullptr));
+    }
+    g_autofree gchar* cache_file =
+        g_build_filename(root_, ".media_index.bin", nullptr);
+    index_ = media_index_new(root_, cache_file, nullptr, nullptr);
+    snapshot_ = media_index_get_snapshot(index_);
+  }
+
+  void TearDown() override {
+    g_clear_pointer(&snapshot_, media_index_snapshot_unref);
+    g_clear_pointer(&index_, media_index_free);
+    nftw(root_, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    g_free(root_);
+  }
+
+  gchar* root_ = nullptr;
+  MediaIndex* index_ = nullptr;
+  MediaIndexSnapshot* snapshot_ = nullptr;
+};
+
+}  // namespace
+
+TEST(MediaEncodingTest, ParsesEncodingArgument) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  MediaEncoding encoding = MEDIA_ENCODING_PACKED;
+  EXPECT_TRUE(media_encoding_parse(args, &encoding));
+  EXPECT_EQ(encoding, MEDIA_ENCODING_MAPS);
+
+  fl_value_set_string_take(args, "encoding", fl_value_new_string("packed"));
+  EXPECT_TRUE(media_encoding_parse(args, &encoding));
+  EXPECT_EQ(encoding, MEDIA_ENCODING_PACKED);
+
+  fl_value_set_string_take(args, "encoding", fl_value_new_string("json"));
+  EXPECT_FALSE(media_encoding_parse(args, &encoding));
+}
+
+TEST_F(MediaEncoderTest, PacksColumnsInRequestedOrder) {
+  const MediaAlbumRecord* album =
+      media_index_snapshot_find_album(snapshot_, "Trip");
+  ASSERT_NE(album, nullptr);
+  ASSERT_EQ(album->count, 2u);
+  guint32 positions[] = {album->first + 1, album->first};
+
+  g_autoptr(FlValue) value =
+      media_encoder_encode_packed(snapshot_, positions, 2);
+  ASSERT_EQ(fl_value_get_type(value), FL_VALUE_TYPE_UINT8_LIST);
+  const guint8* data = fl_value_get_uint8_list(value);
+  gsize size = fl_value_get_length(value);
+  ASSERT_GE(size, MEDIA_PACKED_HEADER_FIELDS * sizeof(guint32));
+  EXPECT_EQ(read_uint32(data, 0), (guint32)MEDIA_PACKED_MAGIC);
+  EXPECT_EQ(read_uint32(data, 4), (guint32)MEDIA_PACKED_VERSION);
+  EXPECT_EQ(read_uint32(data, 8), 2u);
+  guint32 strings = read_uint32(data, 12);
+  EXPECT_EQ(strings, 32u + 2 * 96);
+  EXPECT_EQ(strings + read_uint32(data, 16), size);
+
+  // Widths are the fourth int64 column, latitudes follow the six of them.
+  EXPECT_EQ(read_int64(data, 32 + (3 * 2) * 8), 64);
+  EXPECT_TRUE(isnan(read_float64(data, 32 + (6 * 2) * 8)));
+
+  const gchar* string_table = reinterpret_cast<const gchar*>(data + strings);
+  gsize uint32s = 32 + 2 * 64;
+  for (guint i = 0; i < 2; i++) {
+    const MediaRecord* record = &snapshot_->records[positions[i]];
+    guint32 path_offset = read_uint32(data, uint32s + i * 4);
+    guint32 path_length = read_uint32(data, uint32s + (2 + i) * 4);
+    guint32 name_offset = read_uint32(data, uint32s + (4 + i) * 4);
+    g_autofree gchar* path = g_strndup(string_table + path_offset, path_length);
+    g_autofree gchar* name = g_strndup(string_table + name_offset,
+                                       path_offset + path_length - name_offset);
+    EXPECT_STREQ(path, media_index_snapshot_string(snapshot_, record->path));
+    EXPECT_STREQ(name, media_index_snapshot_string(snapshot_, record->name));
+    EXPECT_EQ(read_uint32(data, uint32s + (14 + i) * 4) & 0xff,
+              (guint32)MEDIA_KIND_IMAGE);
+  }
+}
+
+TEST_F(MediaEncoderTest, EncodesRecordAsMap) {
+  const MediaAlbumRecord* album =
+      media_index_snapshot_find_album(snapshot_, "Trip");
+  ASSERT_NE(album, nullptr);
+  const MediaRecord* record = &snapshot_->records[album->first];
+  g_autoptr(FlValue) value = media_encoder_encode_record(snapshot_, record);
+  EXPECT_STREQ(fl_value_get_string(fl_value_lookup_string(value, "name")),
+               "a.png");
+  EXPECT_STREQ(fl_value_get_string(fl_value_lookup_string(value, "type")),
+               "image");
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(value, "width")), 64);
+  EXPECT_EQ(fl_value_lookup_string(value, "latitude"), nullptr);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
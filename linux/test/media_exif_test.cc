@@ -0,0 +1,339 @@
+#include <gtest/gtest.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "media_exif.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// Builds TIFF structures in either byte order.
+class TiffWriter {
+ public:
+  explicit TiffWriter(bool big_endian) : big_endian_(big_endian) {
+    if (big_endian_) {
+      bytes_ = {'M', 'M', 0, '*'};
+    } else {
+      bytes_ = {'I', 'I', '*', 0};
+    }
+    U32(8);
+  }
+
+  void U16(guint16 value) {
+    if (big_endian_) {
+      bytes_.push_back(value >> 8);
+      bytes_.push_back(value & 0xff);
+    } else {
+      bytes_.push_back(value & 0xff);
+      bytes_.push_back(value >> 8);
+    }
+  }
+
+  void U32(guint32 value) {
+    if (big_endian_) {
+      U16(value >> 16);
+      U16(value & 0xffff);
+    } else {
+      U16(value & 0xffff);
+      U16(value >> 16);
+    }
+  }
+
+  // Writes an entry whose value fits in the entry itself.
+  void Entry(guint16 tag, guint16 type, guint32 value) {
+    U16(tag);
+    U16(type);
+    U32(1);
+    if (type == 3) {
+      U16(value);
+      U16(0);
+    } else {
+      U32(value);
+    }
+  }
+
+  // Writes an entry whose |count| values are stored at |offset|.
+  void OffsetEntry(guint16 tag, guint16 type, guint32 count, guint32 offset) {
+    U16(tag);
+    U16(type);
+    U32(count);
+    U32(offset);
+  }
+
+  // Appends |string| with its terminator.
+  void Ascii(const char* string) {
+    bytes_.insert(bytes_.end(), string, string + strlen(string) + 1);
+  }
+
+  void Rational(guint32 numerator, guint32 denominator) {
+    U32(numerator);
+    U32(denominator);
+  }
+
+  void Append(const std::vector<guint8>& data) {
+    bytes_.insert(bytes_.end(), data.begin(), data.end());
+  }
+
+  guint32 size() const { return bytes_.size(); }
+  const std::vector<guint8>& bytes() const { return bytes_; }
+
+ private:
+  bool big_endian_;
+  std::vector<guint8> bytes_;
+};
+
+const std::vector<guint8> kSmallPreview = {0xff, 0xd8, 's', 'm', 'a',
+                                           'l',  'l',  '!', 0xff, 0xd9};
+const std::vector<guint8> kLargePreview = {0xff, 0xd8, 'l', 'a', 'r', 'g',
+                                           'e',  ' ',  'p', 'r', 'e', 'v',
+                                           'i',  'e',  'w', 0xff, 0xd9};
+
+// A TIFF block with the orientation in IFD0 and an EXIF thumbnail in IFD1.
+std::vector<guint8> ExifTiff(guint16 orientation) {
+  TiffWriter tiff(false);
+  tiff.U16(1);
+  tiff.Entry(0x0112, 3, orientation);
+  tiff.U32(26);  // IFD1
+  tiff.U16(2);
+  tiff.Entry(0x0201, 4, 56);
+  tiff.Entry(0x0202, 4, kSmallPreview.size());
+  tiff.U32(0);
+  tiff.Append(kSmallPreview);
+  return tiff.bytes();
+}
+
+// Wraps |payload| in an APP1 segment.
+std::vector<guint8> App1(const std::vector<guint8>& payload) {
+  guint16 length = 2 + payload.size();
+  std::vector<guint8> segment = {0xff, 0xe1, (guint8)(length >> 8),
+                                 (guint8)(length & 0xff)};
+  segment.insert(segment.end(), payload.begin(), payload.end());
+  return segment;
+}
+
+// A JPEG holding |segments| between its APP0 segment and the scan.
+std::vector<guint8> Jpeg(const std::vector<std::vector<guint8>>& segments) {
+  std::vector<guint8> jpeg = {0xff, 0xd8, 0xff, 0xe0, 0x00, 0x04, 'J', 'F'};
+  for (const auto& segment : segments) {
+    jpeg.insert(jpeg.end(), segment.begin(), segment.end());
+  }
+  jpeg.insert(jpeg.end(), {0xff, 0xda, 0x00, 0x02, 0xff, 0xd9});
+  return jpeg;
+}
+
+std::vector<guint8> ExifSegment(const std::vector<guint8>& tiff) {
+  std::vector<guint8> payload = {'E', 'x', 'i', 'f', 0, 0};
+  payload.insert(payload.end(), tiff.begin(), tiff.end());
+  return App1(payload);
+}
+
+std::vector<guint8> ExifJpeg(guint16 orientation) {
+  return Jpeg({ExifSegment(ExifTiff(orientation))});
+}
+
+class MediaExifTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    if (path_ != nullptr) g_unlink(path_);
+    g_free(path_);
+  }
+
+  const gchar* Write(const std::vector<guint8>& bytes) {
+    gint fd = g_file_open_tmp("media-exif-XXXXXX", &path_, nullptr);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(write(fd, bytes.data(), bytes.size()), (ssize_t)bytes.size());
+    close(fd);
+    return path_;
+  }
+
+  // Returns TRUE if |preview| in the file holds exactly |expected|.
+  bool PreviewEquals(const MediaExifPreview* preview,
+                     const std::vector<guint8>& expected) {
+    g_autoptr(GBytes) bytes = media_exif_load_preview(path_, preview);
+    if (bytes == nullptr) return false;
+    gsize length = 0;
+    const void* data = g_bytes_get_data(bytes, &length);
+    return length == expected.size() &&
+           memcmp(data, expected.data(), length) == 0;
+  }
+
+  gchar* path_ = nullptr;
+};
+
+}  // namespace
+
+TEST_F(MediaExifTest, JpegThumbnailAndOrientation) {
+  const gchar* path = Write(ExifJpeg(6));
+  MediaExif exif;
+  ASSERT_TRUE(media_exif_read(path, &exif));
+  EXPECT_EQ(exif.orientation, 6);
+  ASSERT_EQ(exif.n_previews, 1u);
+  EXPECT_TRUE(PreviewEquals(&exif.previews[0], kSmallPreview));
+}
+
+TEST_F(MediaExifTest, JpegWithoutExif) {
+  const gchar* path = Write({0xff, 0xd8, 0xff, 0xe0, 0x00, 0x04, 'J', 'F',
+                             0xff, 0xc0, 0x00, 0x02, 0xff, 0xd9});
+  MediaExif exif;
+  EXPECT_FALSE(media_exif_read(path, &exif));
+  EXPECT_EQ(exif.n_previews, 0u);
+}
+
+TEST_F(MediaExifTest, InvalidOrientationIsIgnored) {
+  const gchar* path = Write(ExifJpeg(42));
+  MediaExif exif;
+  ASSERT_TRUE(media_exif_read(path, &exif));
+  EXPECT_EQ(exif.orientation, 0);
+}
+
+TEST_F(MediaExifTest, RawPreviewsInSubIfds) {
+  // A big-endian TIFF-based RAW file: IFD0 points to two sub-IFDs, one a
+  // JPEG strip preview and one the compressed sensor data.
+  TiffWriter tiff(true);
+  tiff.U16(2);
+  tiff.Entry(0x0112, 3, 8);
+  tiff.U16(0x014a);  // SubIFDs, two LONG offsets stored out of line.
+  tiff.U16(4);
+  tiff.U32(2);
+  tiff.U32(38);
+  tiff.U32(0);  // No IFD1.
+  tiff.U32(46);
+  tiff.U32(88);
+
+  // Sub-IFD 1 at 46: a JPEG-compressed single-strip preview.
+  tiff.U16(3);
+  tiff.Entry(0x0103, 3, 7);
+  tiff.Entry(0x0111, 4, 130);
+  tiff.Entry(0x0117, 4, kLargePreview.size());
+  tiff.U32(0);
+
+  // Sub-IFD 2 at 88: uncompressed raw data, not a preview.
+  tiff.U16(3);
+  tiff.Entry(0x0103, 3, 1);
+  tiff.Entry(0x0111, 4, 130);
+  tiff.Entry(0x0117, 4, kLargePreview.size());
+  tiff.U32(0);
+
+  ASSERT_EQ(tiff.size(), 130u);
+  tiff.Append(kLargePreview);
+
+  const gchar* path = Write(tiff.bytes());
+  MediaExif exif;
+  ASSERT_TRUE(media_exif_read(path, &exif));
+  EXPECT_EQ(exif.orientation, 8);
+  ASSERT_EQ(exif.n_previews, 1u);
+  EXPECT_TRUE(PreviewEquals(&exif.previews[0], kLargePreview));
+}
+
+TEST_F(MediaExifTest, PreviewsAreSortedBySize) {
+  // IFD0 carries a large JPEG strip and IFD1 the small EXIF thumbnail.
+  TiffWriter tiff(false);
+  tiff.U16(3);
+  tiff.Entry(0x0103, 3, 6);
+  tiff.Entry(0x0111, 4, 80);
+  tiff.Entry(0x0117, 4, kLargePreview.size());
+  tiff.U32(50);  // IFD1
+  tiff.U16(2);
+  tiff.Entry(0x0201, 4, 80 + kLargePreview.size());
+  tiff.Entry(0x0202, 4, kSmallPreview.size());
+  tiff.U32(0);
+  ASSERT_EQ(tiff.size(), 80u);
+  tiff.Append(kLargePreview);
+  tiff.Append(kSmallPreview);
+
+  const gchar* path = Write(tiff.bytes());
+  MediaExif exif;
+  ASSERT_TRUE(media_exif_read(path, &exif));
+  ASSERT_EQ(exif.n_previews, 2u);
+  EXPECT_TRUE(PreviewEquals(&exif.previews[0], kSmallPreview));
+  EXPECT_TRUE(PreviewEquals(&exif.previews[1], kLargePreview));
+}
+
+TEST_F(MediaExifTest, TruncatedThumbnailIsSkipped) {
+  std::vector<guint8> jpeg = ExifJpeg(1);
+  // Claim a thumbnail longer than the APP1 segment holds.
+  guint8 length_field[] = {(guint8)kSmallPreview.size(), 0, 0, 0};
+  auto it = std::search(jpeg.begin(), jpeg.end(), length_field,
+                        length_field + 4);
+  ASSERT_NE(it, jpeg.end());
+  *it = 0xff;
+
+  const gchar* path = Write(jpeg);
+  MediaExif exif;
+  ASSERT_TRUE(media_exif_read(path, &exif));
+  EXPECT_EQ(exif.orientation, 1);
+  EXPECT_EQ(exif.n_previews, 0u);
+}
+
+TEST_F(MediaExifTest, CaptureMetadata) {
+  TiffWriter tiff(false);
+  tiff.U16(5);  // IFD0 at 8.
+  tiff.OffsetEntry(0x010f, 2, 6, 74);
+  tiff.OffsetEntry(0x0110, 2, 13, 80);
+  tiff.Entry(0x0112, 3, 1);
+  tiff.Entry(0x8769, 4, 94);
+  tiff.Entry(0x8825, 4, 152);
+  tiff.U32(0);
+  ASSERT_EQ(tiff.size(), 74u);
+  tiff.Ascii("Canon");
+  tiff.Ascii("Canon EOS R5");
+  tiff.Append({0});
+
+  ASSERT_EQ(tiff.size(), 94u);  // EXIF IFD.
+  tiff.U16(2);
+  tiff.OffsetEntry(0x9003, 2, 20, 124);
+  tiff.OffsetEntry(0x9011, 2, 7, 144);
+  tiff.U32(0);
+  tiff.Ascii("2021:06:15 14:30:00");
+  tiff.Ascii("+02:00");
+  tiff.Append({0});
+
+  ASSERT_EQ(tiff.size(), 152u);  // GPS IFD.
+  tiff.U16(4);
+  tiff.Entry(0x0001, 2, 'N');
+  tiff.OffsetEntry(0x0002, 5, 3, 206);
+  tiff.Entry(0x0003, 2, 'W');
+  tiff.OffsetEntry(0x0004, 5, 3, 230);
+  tiff.U32(0);
+  tiff.Rational(48, 1);
+  tiff.Rational(51, 1);
+  tiff.Rational(2940, 100);
+  tiff.Rational(2, 1);
+  tiff.Rational(17, 1);
+  tiff.Rational(4020, 100);
+
+  const gchar* path = Write(Jpeg({ExifSegment(tiff.bytes())}));
+  MediaExif exif;
+  ASSERT_TRUE(media_exif_read(path, &exif));
+  EXPECT_EQ(exif.orientation, 1);
+  // 14:30 at UTC+2.
+  EXPECT_EQ(exif.date_taken, 1623760200);
+  EXPECT_STREQ(exif.camera_model, "Canon EOS R5");
+  ASSERT_TRUE(exif.has_location);
+  EXPECT_NEAR(exif.latitude, 48.858167, 1e-6);
+  EXPECT_NEAR(exif.longitude, -2.2945, 1e-6);
+}
+
+TEST_F(MediaExifTest, XmpCaptureDate) {
+  const char kXmp[] =
+      "http://ns.adobe.com/xap/1.0/\0<x:xmpmeta><rdf:Description "
+      "exif:DateTimeOriginal=\"2020-01-02T03:04:05Z\"/></x:xmpmeta>";
+  std::vector<guint8> payload(kXmp, kXmp + sizeof(kXmp) - 1);
+
+  const gchar* path = Write(Jpeg({App1(payload)}));
+  MediaExif exif;
+  ASSERT_TRUE(media_exif_read(path, &exif));
+  EXPECT_EQ(exif.date_taken, 1577934245);
+  EXPECT_EQ(exif.n_previews, 0u);
+  EXPECT_FALSE(exif.has_location);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "media_hash.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// A diagonal gradient with a bright square, which has structure in both
+// directions.
+GdkPixbuf* make_scene(gint width, gint height) {
+  GdkPixbuf* pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+  gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  guchar* pixels = gdk_pixbuf_get_pixels(pixbuf);
+  for (gint y = 0; y < height; y++) {
+    for (gint x = 0; x < width; x++) {
+      guchar* pixel = pixels + y * rowstride + x * 3;
+      gboolean square = x > width / 2 && x < width * 3 / 4 && y < height / 2;
+      guint8 value = square ? 250 : (x * 160 / width + y * 80 / height);
+      pixel[0] = pixel[1] = pixel[2] = value;
+    }
+  }
+  return pixbuf;
+}
+
+}  // namespace
+
+TEST(MediaHash, RescaledCopiesHashAlike) {
+  g_autoptr(GdkPixbuf) original = make_scene(64, 48);
+  g_autoptr(GdkPixbuf) smaller = make_scene(32, 24);
+  g_autoptr(GdkPixbuf) flipped = gdk_pixbuf_flip(original, TRUE);
+
+  guint64 hash = media_hash_compute(original);
+  EXPECT_LE(media_hash_distance(hash, media_hash_compute(smaller)), 4u);
+  EXPECT_GT(media_hash_distance(hash, media_hash_compute(flipped)),
+            (guint)MEDIA_HASH_DEFAULT_MAX_DISTANCE);
+
+  // Images smaller than the hash grid still hash.
+  g_autoptr(GdkPixbuf) tiny = make_scene(3, 2);
+  media_hash_compute(tiny);
+}
+
+TEST(MediaHash, GroupsMatchPairwiseComparison) {
+  // Clusters of hashes a few bits apart, plus unrelated ones.
+  g_autoptr(GRand) rand = g_rand_new_with_seed(7);
+  const guint kCount = 600;
+  guint64 hashes[kCount];
+  for (guint i = 0; i < kCount; i++) {
+    if (i % 3 == 0 || i < 3) {
+      hashes[i] = (guint64)g_rand_int(rand) << 32 | g_rand_int(rand);
+    } else {
+      hashes[i] = hashes[i - 1 - g_rand_int_range(rand, 0, 2)] ^
+                  (1ull << g_rand_int_range(rand, 0, 64));
+    }
+  }
+  hashes[kCount - 1] = hashes[5];
+
+  const guint kMaxDistance = 3;
+  g_autoptr(GPtrArray) groups =
+      media_hash_group(hashes, kCount, kMaxDistance);
+
+  // Expected clusters, by brute-force union of every close pair.
+  guint parents[kCount];
+  for (guint i = 0; i < kCount; i++) parents[i] = i;
+  auto find = [&parents](guint i) {
+    while (parents[i] != i) i = parents[i];
+    return i;
+  };
+  for (guint i = 0; i < kCount; i++) {
+    for (guint j = i + 1; j < kCount; j++) {
+      if (media_hash_distance(hashes[i], hashes[j]) <= kMaxDistance) {
+        parents[find(j)] = find(i);
+      }
+    }
+  }
+
+  guint grouped = 0;
+  gint group_of[kCount];
+  for (guint i = 0; i < kCount; i++) group_of[i] = -1;
+  guint previous_first = 0;
+  for (guint g = 0; g < groups->len; g++) {
+    GArray* members = static_cast<GArray*>(groups->pdata[g]);
+    ASSERT_GE(members->len, 2u);
+    guint first = g_array_index(members, guint, 0);
+    EXPECT_TRUE(g == 0 || first > previous_first);
+    previous_first = first;
+    for (guint m = 0; m < members->len; m++) {
+      guint index = g_array_index(members, guint, m);
+      if (m > 0) {
+        EXPECT_GT(index, g_array_index(members, guint, m - 1));
+      }
+      EXPECT_EQ(find(index), find(first));
+      group_of[index] = g;
+      grouped++;
+    }
+  }
+  // Every member of a brute-force cluster of two or more is grouped.
+  guint expected = 0;
+  for (guint i = 0; i < kCount; i++) {
+    guint size = 0;
+    for (guint j = 0; j < kCount; j++) size += find(j) == find(i);
+    if (size > 1) expected++;
+  }
+  EXPECT_EQ(grouped, expected);
+  EXPECT_EQ(group_of[kCount - 1], group_of[5]);
+}
+
+TEST(MediaHash, ZeroDistanceOnlyGroupsIdenticalHashes) {
+  const guint64 hashes[] = {1, 3, 1, 7, 3, 1};
+  g_autoptr(GPtrArray) groups =
+      media_hash_group(hashes, G_N_ELEMENTS(hashes), 0);
+  ASSERT_EQ(groups->len, 2u);
+  GArray* ones = static_cast<GArray*>(groups->pdata[0]);
+  ASSERT_EQ(ones->len, 3u);
+  EXPECT_EQ(g_array_index(ones, guint, 0), 0u);
+  EXPECT_EQ(g_array_index(ones, guint, 1), 2u);
+  EXPECT_EQ(g_array_index(ones, guint, 2), 5u);
+  GArray* threes = static_cast<GArray*>(groups->pdata[1]);
+  ASSERT_EQ(threes->len, 2u);
+  EXPECT_EQ(g_array_index(threes, guint, 0), 1u);
+  EXPECT_EQ(g_array_index(threes, guint, 1), 4u);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
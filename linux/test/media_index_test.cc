@@ -0,0 +1,506 @@
+#include <gtest/gtest.h>
+#include <ftw.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "media_index.h"
+#include "media_placeholder.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// PNG signature and IHDR for a 64x32 image; enough for the header probe.
+const guint8 kPngHeader[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00,
+    0x0d, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00,
+    0x00, 0x20, 0x08, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// A JPEG whose EXIF data names a "Pixel 7" and a capture time of
+// 2019-03-04 11:00:00 at UTC+1.
+const guint8 kExifJpeg[] = {
+    0xff, 0xd8, 0xff, 0xe1, 0x00, 0x6f, 0x45, 0x78, 0x69, 0x66, 0x00, 0x00,
+    0x49, 0x49, 0x2a, 0x00, 0x08, 0x00, 0x00, 0x00, 0x02, 0x00, 0x10, 0x01,
+    0x02, 0x00, 0x08, 0x00, 0x00, 0x00, 0x26, 0x00, 0x00, 0x00, 0x69, 0x87,
+    0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x2e, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x50, 0x69, 0x78, 0x65, 0x6c, 0x20, 0x37, 0x00, 0x02, 0x00,
+    0x03, 0x90, 0x02, 0x00, 0x14, 0x00, 0x00, 0x00, 0x4c, 0x00, 0x00, 0x00,
+    0x11, 0x90, 0x02, 0x00, 0x07, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x32, 0x30, 0x31, 0x39, 0x3a, 0x30, 0x33, 0x3a,
+    0x30, 0x34, 0x20, 0x31, 0x31, 0x3a, 0x30, 0x30, 0x3a, 0x30, 0x30, 0x00,
+    0x2b, 0x30, 0x31, 0x3a, 0x30, 0x30, 0x00, 0xff, 0xd9,
+};
+
+int remove_entry(const char* path, const struct stat* st, int flag,
+                 struct FTW* ftw) {
+  return remove(path);
+}
+
+class MediaIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = g_dir_make_tmp("media-index-XXXXXX", nullptr);
+    cache_dir_ = g_dir_make_tmp("media-index-cache-XXXXXX", nullptr);
+    ASSERT_NE(root_, nullptr);
+    ASSERT_NE(cache_dir_, nullptr);
+    cache_file_ = g_build_filename(cache_dir_, "media_index.bin", nullptr);
+
+    MakeDir("Trip");
+    MakeDir("Empty");
+    WriteFile("Trip/a.png", kPngHeader, sizeof(kPngHeader));
+    WriteFile("Trip/b.mp4", reinterpret_cast<const guint8*>("video"), 5);
+    WriteFile("Trip/notes.txt", reinterpret_cast<const guint8*>("text"), 4);
+  }
+
+  void TearDown() override {
+    g_clear_pointer(&index_, media_index_free);
+    nftw(root_, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    nftw(cache_dir_, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    g_free(cache_file_);
+    g_free(cache_dir_);
+    g_free(root_);
+  }
+
+  gchar* Path(const gchar* relative) {
+    return g_build_filename(root_, relative, nullptr);
+  }
+
+  void MakeDir(const gchar* relative) {
+    g_autofree gchar* path = Path(relative);
+    ASSERT_EQ(g_mkdir(path, 0755), 0);
+  }
+
+  void WriteFile(const gchar* relative, const guint8* data, gsize size) {
+    g_autofree gchar* path = Path(relative);
+    ASSERT_TRUE(g_file_set_contents(path, reinterpret_cast<const gchar*>(data),
+                                    size, nullptr));
+  }
+
+  // Waits for the index to publish a snapshot in which album |album_id|
+  // holds |count| media files.
+  MediaIndexSnapshot* WaitForCount(const gchar* album_id, guint count) {
+    gint64 deadline = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+    while (TRUE) {
+      MediaIndexSnapshot* snapshot = media_index_get_snapshot(index_);
+      const MediaAlbumRecord* album =
+          media_index_snapshot_find_album(snapshot, album_id);
+      guint found = album != nullptr ? album->count : 0;
+      if (found == count || g_get_monotonic_time() > deadline) {
+        return snapshot;
+      }
+      media_index_snapshot_unref(snapshot);
+      g_usleep(20 * 1000);
+    }
+  }
+
+  // Waits for the index to publish a snapshot in which every record of
+  // album |album_id| has its capture metadata, or another |flag|.
+  MediaIndexSnapshot* WaitForMetadata(
+      const gchar* album_id,
+      guint16 flag = MEDIA_RECORD_HAS_METADATA) {
+    gint64 deadline = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+    while (TRUE) {
+      MediaIndexSnapshot* snapshot = media_index_get_snapshot(index_);
+      const MediaAlbumRecord* album =
+          media_index_snapshot_find_album(snapshot, album_id);
+      gboolean complete = album != nullptr;
+      for (guint i = 0; complete && i < album->count; i++) {
+        complete = snapshot->records[album->first + i].flags & flag;
+      }
+      if (complete || g_get_monotonic_time() > deadline) return snapshot;
+      media_index_snapshot_unref(snapshot);
+      g_usleep(20 * 1000);
+    }
+  }
+
+  gchar* root_ = nullptr;
+  gchar* cache_dir_ = nullptr;
+  gchar* cache_file_ = nullptr;
+  MediaIndex* index_ = nullptr;
+};
+
+}  // namespace
+
+TEST_F(MediaIndexTest, IndexesAlbumsAndMedia) {
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index_);
+
+  const MediaAlbumRecord* album =
+      media_index_snapshot_find_album(snapshot, "Trip");
+  ASSERT_NE(album, nullptr);
+  EXPECT_EQ(album->count, 2u);
+  EXPECT_EQ(album->image_count, 1u);
+  EXPECT_EQ(album->video_count, 1u);
+
+  const MediaRecord* image = &snapshot->records[album->first];
+  EXPECT_STREQ(media_index_snapshot_string(snapshot, image->name), "a.png");
+  EXPECT_EQ(image->kind, (guint32)MEDIA_KIND_IMAGE);
+  EXPECT_EQ(image->width, 64);
+  EXPECT_EQ(image->height, 32);
+  const MediaRecord* video = &snapshot->records[album->first + 1];
+  EXPECT_STREQ(media_index_snapshot_string(snapshot, video->name), "b.mp4");
+  EXPECT_EQ(video->kind, (guint32)MEDIA_KIND_VIDEO);
+
+  EXPECT_EQ(album->image_cover, album->first);
+  EXPECT_EQ(album->video_cover, album->first + 1);
+  EXPECT_EQ(album->newest_mtime, MAX(image->mtime, video->mtime));
+
+  g_autofree gchar* path = Path("Trip");
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, path), album);
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, "Missing"), nullptr);
+
+  const MediaAlbumRecord* empty =
+      media_index_snapshot_find_album(snapshot, "Empty");
+  ASSERT_NE(empty, nullptr);
+  EXPECT_EQ(empty->count, 0u);
+  EXPECT_EQ(empty->image_cover, MEDIA_INDEX_NO_RECORD);
+}
+
+TEST_F(MediaIndexTest, IndexesNestedAlbums) {
+  MakeDir("2024");
+  MakeDir("2024/Trip");
+  MakeDir("2024/Trip/Day1");
+  MakeDir(".cache");
+  MakeDir("Private");
+  WriteFile("top.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile("2024/Trip/a.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile("2024/Trip/Day1/b.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile(".cache/c.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile("Private/d.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile("Private/.nomedia", nullptr, 0);
+
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index_);
+
+  const MediaAlbumRecord* trip =
+      media_index_snapshot_find_album(snapshot, "2024/Trip");
+  ASSERT_NE(trip, nullptr);
+  EXPECT_EQ(trip->count, 1u);
+  const MediaAlbumRecord* day =
+      media_index_snapshot_find_album(snapshot, "2024/Trip/Day1");
+  ASSERT_NE(day, nullptr);
+  EXPECT_EQ(day->count, 1u);
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, "2024")->count, 0u);
+
+  // Dot-directories and directories holding .nomedia are skipped, and files
+  // directly in the root belong to no album.
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, ".cache"), nullptr);
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, "Private"), nullptr);
+  EXPECT_EQ(snapshot->n_records, 4u);
+}
+
+TEST_F(MediaIndexTest, HonoursScanOptions) {
+  MakeDir("2024");
+  MakeDir("2024/Trip");
+  MakeDir(".cache");
+  WriteFile("2024/Trip/a.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile(".cache/c.png", kPngHeader, sizeof(kPngHeader));
+
+  MediaScanOptions options = {1, TRUE};
+  index_ = media_index_new(root_, cache_file_, &options, nullptr);
+  g_autoptr(MediaIndexSnapshot) shallow = media_index_get_snapshot(index_);
+  EXPECT_NE(media_index_snapshot_find_album(shallow, "2024"), nullptr);
+  EXPECT_EQ(media_index_snapshot_find_album(shallow, "2024/Trip"), nullptr);
+
+  options = {-1, FALSE};
+  media_index_set_scan_options(index_, &options);
+  g_autoptr(MediaIndexSnapshot) deep = WaitForCount(".cache", 1);
+  EXPECT_NE(media_index_snapshot_find_album(deep, ".cache"), nullptr);
+  EXPECT_EQ(media_index_snapshot_find_album(deep, "2024/Trip")->count, 1u);
+}
+
+TEST_F(MediaIndexTest, HonoursFilter) {
+  MakeDir("Screenshots");
+  MakeDir("Trip/Raw");
+  WriteFile("Screenshots/s.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile("Trip/c.PNG", kPngHeader, sizeof(kPngHeader));
+  WriteFile("Trip/Raw/d.png", kPngHeader, sizeof(kPngHeader));
+
+  const gchar* include[] = {"*.png", nullptr};
+  const gchar* exclude[] = {"screenshots", "Trip/Raw", nullptr};
+  index_ = media_index_new(root_, cache_file_, nullptr,
+                           media_filter_new(include, exclude));
+  g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index_);
+
+  // Only PNGs, matched case-insensitively, and excluded folders are not
+  // albums at all.
+  const MediaAlbumRecord* trip =
+      media_index_snapshot_find_album(snapshot, "Trip");
+  ASSERT_NE(trip, nullptr);
+  EXPECT_EQ(trip->count, 2u);
+  EXPECT_EQ(trip->video_count, 0u);
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, "Screenshots"), nullptr);
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, "Trip/Raw"), nullptr);
+
+  // Excluded folders created later stay out too.
+  MakeDir("Trip/Raw/Later");
+  MakeDir("New");
+  MakeDir("New/Screenshots");
+  WriteFile("New/Screenshots/e.png", kPngHeader, sizeof(kPngHeader));
+  WriteFile("New/f.png", kPngHeader, sizeof(kPngHeader));
+  g_autoptr(MediaIndexSnapshot) later = WaitForCount("New", 1);
+  EXPECT_NE(media_index_snapshot_find_album(later, "New"), nullptr);
+  EXPECT_EQ(media_index_snapshot_find_album(later, "New/Screenshots"),
+            nullptr);
+  EXPECT_EQ(media_index_snapshot_find_album(later, "Trip/Raw/Later"), nullptr);
+}
+
+TEST_F(MediaIndexTest, AlbumIdsAreStable) {
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index_);
+  const MediaAlbumRecord* trip =
+      media_index_snapshot_find_album(snapshot, "Trip");
+  const MediaAlbumRecord* empty =
+      media_index_snapshot_find_album(snapshot, "Empty");
+  ASSERT_NE(trip, nullptr);
+  ASSERT_NE(empty, nullptr);
+  EXPECT_NE(trip->id, empty->id);
+
+  g_autofree gchar* id = g_strdup_printf(MEDIA_INDEX_ALBUM_ID_FORMAT, trip->id);
+  EXPECT_EQ(strlen(id), 16u);
+  EXPECT_EQ(media_index_snapshot_find_album(snapshot, id), trip);
+
+  // A new folder sorting first shifts the table but not the IDs, and a
+  // fresh index of the same tree derives the same ones.
+  MakeDir("Aardvark");
+  g_clear_pointer(&index_, media_index_free);
+  g_autofree gchar* other_cache = g_build_filename(cache_dir_, "other.bin",
+                                                   nullptr);
+  index_ = media_index_new(root_, other_cache, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) rebuilt = media_index_get_snapshot(index_);
+  const MediaAlbumRecord* again = media_index_snapshot_find_album(rebuilt, id);
+  ASSERT_NE(again, nullptr);
+  EXPECT_STREQ(media_index_snapshot_string(rebuilt, again->name), "Trip");
+  EXPECT_NE(again - rebuilt->albums, trip - snapshot->albums);
+}
+
+TEST_F(MediaIndexTest, FollowsFilesystemChanges) {
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  media_index_snapshot_unref(media_index_get_snapshot(index_));
+
+  WriteFile("Trip/c.png", kPngHeader, sizeof(kPngHeader));
+  g_autoptr(MediaIndexSnapshot) added = WaitForCount("Trip", 3);
+  EXPECT_EQ(media_index_snapshot_find_album(added, "Trip")->image_count, 2u);
+
+  g_autofree gchar* path = Path("Trip/a.png");
+  ASSERT_EQ(g_unlink(path), 0);
+  g_autoptr(MediaIndexSnapshot) removed = WaitForCount("Trip", 2);
+  EXPECT_EQ(media_index_snapshot_find_album(removed, "Trip")->image_count, 1u);
+
+  MakeDir("New");
+  WriteFile("New/d.png", kPngHeader, sizeof(kPngHeader));
+  g_autoptr(MediaIndexSnapshot) album = WaitForCount("New", 1);
+  EXPECT_NE(media_index_snapshot_find_album(album, "New"), nullptr);
+
+  MakeDir("New/Nested");
+  WriteFile("New/Nested/e.png", kPngHeader, sizeof(kPngHeader));
+  g_autoptr(MediaIndexSnapshot) nested = WaitForCount("New/Nested", 1);
+  EXPECT_NE(media_index_snapshot_find_album(nested, "New/Nested"), nullptr);
+
+  WriteFile("New/.nomedia", nullptr, 0);
+  g_autoptr(MediaIndexSnapshot) hidden = WaitForCount("New/Nested", 0);
+  EXPECT_EQ(media_index_snapshot_find_album(hidden, "New"), nullptr);
+  EXPECT_EQ(media_index_snapshot_find_album(hidden, "New/Nested"), nullptr);
+}
+
+TEST_F(MediaIndexTest, SortsAlbumOrders) {
+  // c.png: largest and oldest; a.png: smallest and newest.
+  WriteFile("Trip/c.png", kPngHeader, sizeof(kPngHeader));
+  g_autofree gchar* big = Path("Trip/c.png");
+  ASSERT_EQ(truncate(big, 4096), 0);
+  const gchar* names[] = {"Trip/a.png", "Trip/b.mp4", "Trip/c.png"};
+  const time_t mtimes[] = {3000, 2000, 1000};
+  for (int i = 0; i < 3; i++) {
+    g_autofree gchar* path = Path(names[i]);
+    struct utimbuf times = {mtimes[i], mtimes[i]};
+    ASSERT_EQ(utime(path, &times), 0);
+  }
+
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index_);
+  const MediaAlbumRecord* album =
+      media_index_snapshot_find_album(snapshot, "Trip");
+  ASSERT_NE(album, nullptr);
+
+  auto name_at = [&](const guint32* order, guint i) {
+    return media_index_snapshot_string(
+        snapshot, snapshot->records[order[i]].name);
+  };
+
+  guint n = 0;
+  const guint32* by_name = media_index_snapshot_get_order(
+      snapshot, album, MEDIA_KIND_ANY, MEDIA_SORT_NAME, &n);
+  ASSERT_EQ(n, 3u);
+  EXPECT_STREQ(name_at(by_name, 0), "a.png");
+  EXPECT_STREQ(name_at(by_name, 2), "c.png");
+
+  const guint32* by_date = media_index_snapshot_get_order(
+      snapshot, album, MEDIA_KIND_ANY, MEDIA_SORT_DATE_ADDED, &n);
+  ASSERT_EQ(n, 3u);
+  EXPECT_STREQ(name_at(by_date, 0), "c.png");
+  EXPECT_STREQ(name_at(by_date, 2), "a.png");
+
+  const guint32* images = media_index_snapshot_get_order(
+      snapshot, album, MEDIA_KIND_IMAGE, MEDIA_SORT_SIZE, &n);
+  ASSERT_EQ(n, 2u);
+  EXPECT_STREQ(name_at(images, 0), "a.png");
+  EXPECT_STREQ(name_at(images, 1), "c.png");
+
+  // Orders are cached per snapshot.
+  EXPECT_EQ(media_index_snapshot_get_order(snapshot, album, MEDIA_KIND_IMAGE,
+                                           MEDIA_SORT_SIZE, &n),
+            images);
+}
+
+TEST_F(MediaIndexTest, ReadsCaptureMetadata) {
+  WriteFile("Trip/photo.jpg", kExifJpeg, sizeof(kExifJpeg));
+  // a.png has no EXIF data and sorts by its mtime instead.
+  const gchar* names[] = {"Trip/a.png", "Trip/photo.jpg"};
+  const time_t mtimes[] = {1600000000, 2000000000};
+  for (int i = 0; i < 2; i++) {
+    g_autofree gchar* path = Path(names[i]);
+    struct utimbuf times = {mtimes[i], mtimes[i]};
+    ASSERT_EQ(utime(path, &times), 0);
+  }
+
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot = WaitForMetadata("Trip");
+  const MediaAlbumRecord* album =
+      media_index_snapshot_find_album(snapshot, "Trip");
+  ASSERT_NE(album, nullptr);
+  ASSERT_EQ(album->count, 3u);
+
+  const MediaRecord* png = &snapshot->records[album->first];
+  EXPECT_TRUE(png->flags & MEDIA_RECORD_HAS_METADATA);
+  EXPECT_EQ(png->date_taken, 0);
+  EXPECT_STREQ(media_index_snapshot_string(snapshot, png->camera_model), "");
+  const MediaRecord* photo = &snapshot->records[album->first + 2];
+  ASSERT_STREQ(media_index_snapshot_string(snapshot, photo->name),
+               "photo.jpg");
+  EXPECT_TRUE(photo->flags & MEDIA_RECORD_HAS_METADATA);
+  EXPECT_FALSE(photo->flags & MEDIA_RECORD_HAS_LOCATION);
+  EXPECT_EQ(photo->date_taken, 1551693600);
+  EXPECT_STREQ(media_index_snapshot_string(snapshot, photo->camera_model),
+               "Pixel 7");
+
+  guint n = 0;
+  const guint32* by_added = media_index_snapshot_get_order(
+      snapshot, album, MEDIA_KIND_IMAGE, MEDIA_SORT_DATE_ADDED, &n);
+  ASSERT_EQ(n, 2u);
+  EXPECT_EQ(by_added[0], album->first);
+  const guint32* by_taken = media_index_snapshot_get_order(
+      snapshot, album, MEDIA_KIND_IMAGE, MEDIA_SORT_DATE_TAKEN, &n);
+  ASSERT_EQ(n, 2u);
+  EXPECT_EQ(by_taken[0], album->first + 2);
+
+  // The metadata is saved with the index and survives a restart.
+  g_clear_pointer(&index_, media_index_free);
+  g_autoptr(MediaIndexSnapshot) loaded =
+      media_index_snapshot_load(cache_file_, root_, nullptr);
+  ASSERT_NE(loaded, nullptr);
+  const MediaRecord* saved = &loaded->records[album->first + 2];
+  EXPECT_EQ(saved->date_taken, photo->date_taken);
+  EXPECT_STREQ(media_index_snapshot_string(loaded, saved->camera_model),
+               "Pixel 7");
+}
+
+TEST_F(MediaIndexTest, ComputesPlaceholders) {
+  g_autoptr(GdkPixbuf) pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, 48, 32);
+  gdk_pixbuf_fill(pixbuf, 0x3366ccff);
+  g_autofree gchar* photo_path = Path("Trip/photo.png");
+  ASSERT_TRUE(gdk_pixbuf_save(pixbuf, photo_path, "png", nullptr, nullptr));
+
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot =
+      WaitForMetadata("Trip", MEDIA_RECORD_HAS_PLACEHOLDER);
+  const MediaRecord* photo =
+      media_index_snapshot_find_record(snapshot, photo_path);
+  ASSERT_NE(photo, nullptr);
+  EXPECT_TRUE(photo->flags & MEDIA_RECORD_HAS_PLACEHOLDER);
+  EXPECT_EQ(strlen(media_index_snapshot_string(snapshot, photo->placeholder)),
+            (gsize)MEDIA_PLACEHOLDER_MAX_LENGTH);
+  // The same decode hashes it; a flat fill has no edges to set bits.
+  EXPECT_TRUE(photo->flags & MEDIA_RECORD_HAS_HASH);
+  EXPECT_EQ(photo->hash, 0u);
+
+  // a.png is only a header, so it gets neither.
+  g_autofree gchar* header_only = Path("Trip/a.png");
+  const MediaRecord* png =
+      media_index_snapshot_find_record(snapshot, header_only);
+  ASSERT_NE(png, nullptr);
+  EXPECT_TRUE(png->flags & MEDIA_RECORD_HAS_PLACEHOLDER);
+  EXPECT_STREQ(media_index_snapshot_string(snapshot, png->placeholder), "");
+  EXPECT_FALSE(png->flags & MEDIA_RECORD_HAS_HASH);
+
+  g_autofree gchar* missing = Path("Trip/missing.png");
+  EXPECT_EQ(media_index_snapshot_find_record(snapshot, missing), nullptr);
+}
+
+TEST_F(MediaIndexTest, WaitsForUpdates) {
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) idle =
+      WaitForMetadata("Trip", MEDIA_RECORD_HAS_PLACEHOLDER);
+
+  // Nothing left to do, so nothing is published
+  EXPECT_FALSE(media_index_wait_for_update(
+      index_, idle, g_get_monotonic_time() + 100 * 1000, nullptr));
+  g_autoptr(GCancellable) cancellable = g_cancellable_new();
+  g_cancellable_cancel(cancellable);
+  gint64 start = g_get_monotonic_time();
+  EXPECT_FALSE(media_index_wait_for_update(
+      index_, idle, start + 10 * G_TIME_SPAN_SECOND, cancellable));
+  EXPECT_LT(g_get_monotonic_time() - start, G_TIME_SPAN_SECOND);
+
+  WriteFile("Trip/c.png", kPngHeader, sizeof(kPngHeader));
+  EXPECT_TRUE(media_index_wait_for_update(
+      index_, idle, g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND, nullptr));
+}
+
+TEST_F(MediaIndexTest, SavedSnapshotRoundTrips) {
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index_);
+  g_autofree gchar* path = g_build_filename(cache_dir_, "copy.bin", nullptr);
+  ASSERT_TRUE(media_index_snapshot_save(snapshot, path, nullptr));
+
+  g_autoptr(MediaIndexSnapshot) loaded =
+      media_index_snapshot_load(path, root_, nullptr);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(loaded->n_albums, snapshot->n_albums);
+  ASSERT_EQ(loaded->n_records, snapshot->n_records);
+  for (guint i = 0; i < loaded->n_records; i++) {
+    EXPECT_STREQ(media_index_snapshot_string(loaded, loaded->records[i].path),
+                 media_index_snapshot_string(snapshot,
+                                             snapshot->records[i].path));
+    EXPECT_EQ(loaded->records[i].mtime, snapshot->records[i].mtime);
+    EXPECT_EQ(loaded->records[i].hash, snapshot->records[i].hash);
+  }
+}
+
+TEST_F(MediaIndexTest, LoadRejectsOtherRootsAndDamage) {
+  index_ = media_index_new(root_, cache_file_, nullptr, nullptr);
+  g_autoptr(MediaIndexSnapshot) snapshot = media_index_get_snapshot(index_);
+  g_autofree gchar* path = g_build_filename(cache_dir_, "copy.bin", nullptr);
+  ASSERT_TRUE(media_index_snapshot_save(snapshot, path, nullptr));
+
+  g_autoptr(GError) error = nullptr;
+  EXPECT_EQ(media_index_snapshot_load(path, "/elsewhere", &error), nullptr);
+  EXPECT_NE(error, nullptr);
+
+  gchar* data = nullptr;
+  gsize size = 0;
+  ASSERT_TRUE(g_file_get_contents(path, &data, &size, nullptr));
+  ASSERT_TRUE(g_file_set_contents(path, data, size / 2, nullptr));
+  g_free(data);
+  EXPECT_EQ(media_index_snapshot_load(path, root_, nullptr), nullptr);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include <ftw.h>
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+#include "media_library.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+const guint8 kPngHeader[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00,
+    0x0d, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00,
+    0x00, 0x20, 0x08, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+int remove_entry(const char* path, const struct stat* st, int flag,
+                 struct FTW* ftw) {
+  return remove(path);
+}
+
+// Two roots, each with a "Trip" album, so only the IDs tell them apart.
+class MediaLibraryTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    base_ = g_dir_make_tmp("media-library-XXXXXX", nullptr);
+    ASSERT_NE(base_, nullptr);
+    cache_dir_ = g_build_filename(base_, "cache", nullptr);
+    photos_ = g_build_filename(base_, "photos", nullptr);
+    camera_ = g_build_filename(base_, "camera", nullptr);
+    for (const gchar* root : {photos_, camera_}) {
+      g_autofree gchar* trip = g_build_filename(root, "Trip", nullptr);
+      ASSERT_EQ(g_mkdir_with_parents(trip, 0755), 0);
+      g_autofree gchar* image = g_build_filename(trip, "a.png", nullptr);
+      ASSERT_TRUE(g_file_set_contents(
+          image, reinterpret_cast<const gchar*>(kPngHeader),
+          sizeof(kPngHeader), nullptr));
+    }
+    library_ = media_library_new(cache_dir_);
+  }
+
+  void TearDown() override {
+    g_clear_pointer(&library_, media_library_free);
+    nftw(base_, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    g_free(camera_);
+    g_free(photos_);
+    g_free(cache_dir_);
+    g_free(base_);
+  }
+
+  gchar* base_ = nullptr;
+  gchar* cache_dir_ = nullptr;
+  gchar* photos_ = nullptr;
+  gchar* camera_ = nullptr;
+  MediaLibrary* library_ = nullptr;
+};
+
+}  // namespace
+
+TEST_F(MediaLibraryTest, ListsAlbumsOfEveryRoot) {
+  const gchar* exclude[] = {"Trip", nullptr};
+  MediaLibraryRoot roots[] = {{photos_, nullptr, nullptr},
+                              {camera_, nullptr, exclude}};
+  ASSERT_TRUE(media_library_set_roots(library_, roots, 1, nullptr));
+  g_autoptr(GPtrArray) one = media_library_get_snapshots(library_, nullptr);
+  ASSERT_EQ(one->len, 1u);
+  const MediaIndexSnapshot* photos =
+      static_cast<const MediaIndexSnapshot*>(one->pdata[0]);
+  ASSERT_EQ(photos->n_albums, 1u);
+  g_autofree gchar* id =
+      g_strdup_printf(MEDIA_INDEX_ALBUM_ID_FORMAT, photos->albums[0].id);
+
+  // The new root honours its filter.
+  ASSERT_TRUE(media_library_set_roots(library_, roots, 2, nullptr));
+  guint pending = G_MAXUINT;
+  g_autoptr(GPtrArray) two = media_library_get_snapshots(library_, &pending);
+  ASSERT_EQ(two->len, 2u);
+  EXPECT_EQ(pending, 0u);
+  EXPECT_EQ(static_cast<const MediaIndexSnapshot*>(two->pdata[1])->n_albums,
+            0u);
+  // Neither root is still on its first scan, so there is nothing to wait for.
+  EXPECT_TRUE(media_library_wait_for_update(library_, nullptr,
+                                            g_get_monotonic_time(), nullptr));
+
+  const MediaAlbumRecord* album = nullptr;
+  g_autoptr(MediaIndexSnapshot) found =
+      media_library_find_album(library_, id, &album);
+  ASSERT_NE(found, nullptr);
+  EXPECT_STREQ(media_index_snapshot_string(found, album->path),
+               media_index_snapshot_string(photos, photos->albums[0].path));
+}
+
+TEST_F(MediaLibraryTest, AlbumIdsAreUniqueAcrossRoots) {
+  MediaLibraryRoot roots[] = {{photos_, nullptr, nullptr},
+                              {camera_, nullptr, nullptr}};
+  ASSERT_TRUE(media_library_set_roots(library_, roots, 2, nullptr));
+  g_autoptr(GPtrArray) snapshots =
+      media_library_get_snapshots(library_, nullptr);
+  ASSERT_EQ(snapshots->len, 2u);
+  const MediaIndexSnapshot* photos =
+      static_cast<const MediaIndexSnapshot*>(snapshots->pdata[0]);
+  const MediaIndexSnapshot* camera =
+      static_cast<const MediaIndexSnapshot*>(snapshots->pdata[1]);
+  ASSERT_EQ(photos->n_albums, 1u);
+  ASSERT_EQ(camera->n_albums, 1u);
+  EXPECT_NE(photos->albums[0].id, camera->albums[0].id);
+
+  g_autofree gchar* id =
+      g_strdup_printf(MEDIA_INDEX_ALBUM_ID_FORMAT, camera->albums[0].id);
+  const MediaAlbumRecord* album = nullptr;
+  g_autoptr(MediaIndexSnapshot) found =
+      media_library_find_album(library_, id, &album);
+  ASSERT_NE(found, nullptr);
+  EXPECT_STREQ(media_index_snapshot_string(found, album->path),
+               media_index_snapshot_string(camera, camera->albums[0].path));
+  EXPECT_EQ(media_library_find_album(library_, "0000000000000000", &album),
+            nullptr);
+
+  g_autofree gchar* image =
+      g_build_filename(camera_, "Trip", "a.png", nullptr);
+  const MediaRecord* record = nullptr;
+  g_autoptr(MediaIndexSnapshot) holder =
+      media_library_find_record(library_, image, &record);
+  ASSERT_NE(holder, nullptr);
+  EXPECT_STREQ(media_index_snapshot_string(holder, record->path), image);
+
+  // The root has published, so peeking finds the same record.
+  const MediaRecord* peeked = nullptr;
+  g_autoptr(MediaIndexSnapshot) peek_holder =
+      media_library_peek_record(library_, image, &peeked);
+  ASSERT_NE(peek_holder, nullptr);
+  EXPECT_STREQ(media_index_snapshot_string(peek_holder, peeked->path), image);
+}
+
+TEST_F(MediaLibraryTest, RejectsOverlappingAndRelativeRoots) {
+  MediaLibraryRoot photos = {photos_, nullptr, nullptr};
+  ASSERT_TRUE(media_library_set_roots(library_, &photos, 1, nullptr));
+
+  g_autofree gchar* nested = g_build_filename(photos_, "Trip", nullptr);
+  MediaLibraryRoot overlapping[] = {{photos_, nullptr, nullptr},
+                                    {nested, nullptr, nullptr}};
+  g_autoptr(GError) error = nullptr;
+  EXPECT_FALSE(media_library_set_roots(library_, overlapping, 2, &error));
+  EXPECT_TRUE(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT));
+
+  MediaLibraryRoot relative[] = {{"photos", nullptr, nullptr}};
+  g_autoptr(GError) relative_error = nullptr;
+  EXPECT_FALSE(media_library_set_roots(library_, relative, 1,
+                                       &relative_error));
+  EXPECT_NE(relative_error, nullptr);
+
+  // A failed call leaves the roots alone.
+  g_autoptr(GPtrArray) snapshots =
+      media_library_get_snapshots(library_, nullptr);
+  EXPECT_EQ(snapshots->len, 1u);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
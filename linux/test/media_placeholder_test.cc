@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <string.h>
+
+#include "media_placeholder.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+const char kBase83[] =
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+    "#$%*+,-.:;=?@[]^_{|}~";
+
+guint decode_base83(const gchar* digits, gint length) {
+  guint value = 0;
+  for (gint i = 0; i < length; i++) {
+    value = value * 83 + (strchr(kBase83, digits[i]) - kBase83);
+  }
+  return value;
+}
+
+}  // namespace
+
+TEST(MediaPlaceholder, EncodesAverageColour) {
+  g_autoptr(GdkPixbuf) pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, 32, 24);
+  gdk_pixbuf_fill(pixbuf, 0xff8000ff);
+  gchar hash[MEDIA_PLACEHOLDER_MAX_LENGTH + 1];
+  media_placeholder_encode(pixbuf, hash);
+
+  ASSERT_EQ(strlen(hash), (gsize)MEDIA_PLACEHOLDER_MAX_LENGTH);
+  // 4x3 components for a landscape image.
+  EXPECT_EQ(decode_base83(hash, 1), 3u + 2u * 9);
+  EXPECT_EQ(decode_base83(hash + 2, 4), 0xff8000u);
+}
+
+TEST(MediaPlaceholder, PortraitImagesGetMoreRows) {
+  g_autoptr(GdkPixbuf) pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, 12, 32);
+  gdk_pixbuf_fill(pixbuf, 0x000000ff);
+  gchar hash[MEDIA_PLACEHOLDER_MAX_LENGTH + 1];
+  media_placeholder_encode(pixbuf, hash);
+
+  EXPECT_EQ(strlen(hash), (gsize)MEDIA_PLACEHOLDER_MAX_LENGTH);
+  EXPECT_EQ(decode_base83(hash, 1), 2u + 3u * 9);
+  EXPECT_EQ(decode_base83(hash + 2, 4), 0u);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
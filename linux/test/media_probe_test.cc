@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "media_probe.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// Writes |bytes| to a temporary file and probes it.
+bool ProbeBytes(const std::vector<guint8>& bytes, gint* width, gint* height) {
+  g_autofree gchar* path = nullptr;
+  gint fd = g_file_open_tmp("media-probe-XXXXXX", &path, nullptr);
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(write(fd, bytes.data(), bytes.size()), (ssize_t)bytes.size());
+  close(fd);
+  gboolean result = media_probe_image_size(path, width, height);
+  g_unlink(path);
+  return result;
+}
+
+}  // namespace
+
+TEST(MediaProbe, Png) {
+  std::vector<guint8> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+                             0, 0, 0, 13, 'I', 'H', 'D', 'R',
+                             0, 0, 0x0f, 0xa0, 0, 0, 0x0b, 0xb8,
+                             8, 6, 0, 0, 0};
+  gint width = 0, height = 0;
+  ASSERT_TRUE(ProbeBytes(png, &width, &height));
+  EXPECT_EQ(width, 4000);
+  EXPECT_EQ(height, 3000);
+}
+
+TEST(MediaProbe, JpegWithLargeExifSegment) {
+  // SOI, an APP1 segment larger than the probe head, then SOF0.
+  std::vector<guint8> jpeg = {0xff, 0xd8, 0xff, 0xe1, 0x27, 0x10};
+  jpeg.resize(jpeg.size() + 0x2710 - 2, 0);
+  std::vector<guint8> sof = {0xff, 0xc0, 0x00, 0x11, 0x08,
+                             0x0f, 0xc0, 0x17, 0xd0, 0x03};
+  jpeg.insert(jpeg.end(), sof.begin(), sof.end());
+  jpeg.resize(jpeg.size() + 16, 0);
+  gint width = 0, height = 0;
+  ASSERT_TRUE(ProbeBytes(jpeg, &width, &height));
+  EXPECT_EQ(width, 6096);
+  EXPECT_EQ(height, 4032);
+}
+
+TEST(MediaProbe, JpegWithoutFrameHeader) {
+  std::vector<guint8> jpeg = {0xff, 0xd8, 0xff, 0xda, 0x00, 0x02, 0xff, 0xd9};
+  gint width = 0, height = 0;
+  EXPECT_FALSE(ProbeBytes(jpeg, &width, &height));
+}
+
+TEST(MediaProbe, Gif) {
+  std::vector<guint8> gif = {'G', 'I', 'F', '8', '9', 'a', 0x40, 0x01,
+                             0xf0, 0x00, 0, 0, 0};
+  gint width = 0, height = 0;
+  ASSERT_TRUE(ProbeBytes(gif, &width, &height));
+  EXPECT_EQ(width, 320);
+  EXPECT_EQ(height, 240);
+}
+
+TEST(MediaProbe, TopDownBmp) {
+  std::vector<guint8> bmp(54, 0);
+  bmp[0] = 'B';
+  bmp[1] = 'M';
+  bmp[14] = 40;
+  bmp[18] = 0x80;  // width 640
+  bmp[19] = 0x02;
+  bmp[22] = 0x20;  // height -480
+  bmp[23] = 0xfe;
+  bmp[24] = 0xff;
+  bmp[25] = 0xff;
+  gint width = 0, height = 0;
+  ASSERT_TRUE(ProbeBytes(bmp, &width, &height));
+  EXPECT_EQ(width, 640);
+  EXPECT_EQ(height, 480);
+}
+
+TEST(MediaProbe, WebpVariants) {
+  std::vector<guint8> header = {'R', 'I', 'F', 'F', 0, 0, 0, 0,
+                                'W', 'E', 'B', 'P'};
+  gint width = 0, height = 0;
+
+  std::vector<guint8> lossy = header;
+  std::vector<guint8> vp8 = {'V', 'P', '8', ' ', 0, 0, 0, 0,
+                             0, 0, 0, 0x9d, 0x01, 0x2a,
+                             0x80, 0x07, 0x38, 0x04, 0, 0};
+  lossy.insert(lossy.end(), vp8.begin(), vp8.end());
+  ASSERT_TRUE(ProbeBytes(lossy, &width, &height));
+  EXPECT_EQ(width, 1920);
+  EXPECT_EQ(height, 1080);
+
+  // 100x50: (99) | (49 << 14).
+  std::vector<guint8> lossless = header;
+  std::vector<guint8> vp8l = {'V', 'P', '8', 'L', 0, 0, 0, 0,
+                              0x2f, 0x63, 0x40, 0x0c, 0x00,
+                              0, 0, 0, 0, 0, 0, 0};
+  lossless.insert(lossless.end(), vp8l.begin(), vp8l.end());
+  ASSERT_TRUE(ProbeBytes(lossless, &width, &height));
+  EXPECT_EQ(width, 100);
+  EXPECT_EQ(height, 50);
+
+  std::vector<guint8> extended = header;
+  std::vector<guint8> vp8x = {'V', 'P', '8', 'X', 10, 0, 0, 0,
+                              0, 0, 0, 0, 0x1f, 0x4e, 0x00,
+                              0xff, 0x03, 0x00, 0, 0};
+  extended.insert(extended.end(), vp8x.begin(), vp8x.end());
+  ASSERT_TRUE(ProbeBytes(extended, &width, &height));
+  EXPECT_EQ(width, 20000);
+  EXPECT_EQ(height, 1024);
+}
+
+TEST(MediaProbe, RejectsNonImage) {
+  std::vector<guint8> text = {'h', 'e', 'l', 'l', 'o'};
+  gint width = 0, height = 0;
+  EXPECT_FALSE(ProbeBytes(text, &width, &height));
+  EXPECT_FALSE(media_probe_image_size("/nonexistent/image.jpg", &width, &height));
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
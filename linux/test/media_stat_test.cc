@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <string>
+#include <vector>
+
+#include "media_stat.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// More files than the queue is deep, so batches wrap around the ring.
+const guint kFileCount = MEDIA_STAT_QUEUE_DEPTH * 2 + 5;
+
+const gint64 kMtime = 1715299200;
+
+int remove_entry(const char* path, const struct stat* st, int flag,
+                 struct FTW* ftw) {
+  return remove(path);
+}
+
+// Runs every test once per backend the machine offers.
+class MediaStatTest : public ::testing::TestWithParam<MediaStatBackend> {
+ protected:
+  void SetUp() override {
+    previous_backend_ = media_stat_get_backend();
+    if (!media_stat_set_backend(GetParam())) {
+      GTEST_SKIP() << "io_uring is unavailable";
+    }
+    dir_ = g_dir_make_tmp("media-stat-XXXXXX", nullptr);
+    ASSERT_NE(dir_, nullptr);
+    dir_fd_ = open(dir_, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ASSERT_GE(dir_fd_, 0);
+    for (guint i = 0; i < kFileCount; i++) {
+      names_.push_back("file" + std::to_string(i));
+      // File i holds i * 40 copies of one letter, so some are shorter than
+      // a head and some longer.
+      std::string contents(i * 40, 'a' + i % 26);
+      g_autofree gchar* path =
+          g_build_filename(dir_, names_[i].c_str(), nullptr);
+      ASSERT_TRUE(g_file_set_contents(path, contents.data(), contents.size(),
+                                      nullptr));
+      struct utimbuf times = {(time_t)(kMtime + i), (time_t)(kMtime + i)};
+      ASSERT_EQ(utime(path, &times), 0);
+    }
+    ASSERT_EQ(mkdirat(dir_fd_, "album", 0755), 0);
+    pool_ = media_stat_pool_new();
+  }
+
+  void TearDown() override {
+    if (pool_ != nullptr) media_stat_pool_free(pool_);
+    if (dir_fd_ >= 0) close(dir_fd_);
+    if (dir_ != nullptr) nftw(dir_, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    g_free(dir_);
+    media_stat_set_backend(previous_backend_);
+  }
+
+  MediaStatBackend previous_backend_;
+
+  gchar* dir_ = nullptr;
+  int dir_fd_ = -1;
+  std::vector<std::string> names_;
+  MediaStatPool* pool_ = nullptr;
+};
+
+}  // namespace
+
+TEST_P(MediaStatTest, StatsBatch) {
+  std::vector<MediaStatFile> files(kFileCount + 2);
+  for (guint i = 0; i < kFileCount; i++) files[i].name = names_[i].c_str();
+  files[kFileCount].name = "missing.jpg";
+  files[kFileCount + 1].name = "album";
+  media_stat_files(pool_, dir_fd_, files.data(), files.size());
+
+  for (guint i = 0; i < kFileCount; i++) {
+    EXPECT_EQ(files[i].error, 0) << files[i].name;
+    EXPECT_TRUE(files[i].regular) << files[i].name;
+    EXPECT_EQ(files[i].size, i * 40) << files[i].name;
+    EXPECT_EQ(files[i].mtime, kMtime + i) << files[i].name;
+  }
+  EXPECT_EQ(files[kFileCount].error, ENOENT);
+  EXPECT_FALSE(files[kFileCount].regular);
+  EXPECT_EQ(files[kFileCount + 1].error, 0);
+  EXPECT_FALSE(files[kFileCount + 1].regular);
+}
+
+TEST_P(MediaStatTest, StatsByFullPath) {
+  g_autofree gchar* path = g_build_filename(dir_, "file3", nullptr);
+  MediaStatFile file = {};
+  file.name = path;
+  media_stat_files(pool_, AT_FDCWD, &file, 1);
+  EXPECT_EQ(file.error, 0);
+  EXPECT_EQ(file.size, 120);
+}
+
+TEST_P(MediaStatTest, ReadsHeads) {
+  std::vector<MediaStatHead> heads(kFileCount + 1);
+  for (guint i = 0; i < kFileCount; i++) heads[i].name = names_[i].c_str();
+  heads[kFileCount].name = "missing.jpg";
+  media_stat_read_heads(pool_, dir_fd_, heads.data(), heads.size());
+
+  for (guint i = 0; i < kFileCount; i++) {
+    MediaStatHead* head = &heads[i];
+    ASSERT_GE(head->fd, 0) << head->name;
+    gsize expected = MIN((gsize)i * 40, (gsize)MEDIA_PROBE_HEAD_SIZE);
+    EXPECT_EQ(head->head_length, expected) << head->name;
+    if (expected > 0) {
+      EXPECT_EQ(head->head[0], 'a' + i % 26) << head->name;
+      EXPECT_EQ(head->head[expected - 1], 'a' + i % 26) << head->name;
+    }
+    // The descriptor is the file's own.
+    EXPECT_EQ(lseek(head->fd, 0, SEEK_END), (off_t)i * 40) << head->name;
+  }
+  EXPECT_EQ(heads[kFileCount].fd, -1);
+  EXPECT_EQ(heads[kFileCount].head_length, 0u);
+
+  int first_fd = heads[0].fd;
+  media_stat_close_heads(pool_, heads.data(), heads.size());
+  for (const MediaStatHead& head : heads) EXPECT_EQ(head.fd, -1) << head.name;
+  EXPECT_EQ(fcntl(first_fd, F_GETFD), -1);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         MediaStatTest,
+                         ::testing::Values(MEDIA_STAT_BACKEND_IO_URING,
+                                           MEDIA_STAT_BACKEND_THREADS,
+                                           MEDIA_STAT_BACKEND_SYNC));
+
+}  // namespace test
+}  // namespace photo_gallery_pro
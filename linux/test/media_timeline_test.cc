@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <ftw.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <utime.h>
+
+#include "media_library.h"
+#include "media_timeline.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+const guint8 kPngHeader[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00,
+    0x0d, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00,
+    0x00, 0x20, 0x08, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// Times in UTC, which the tests run in.
+const gint64 kMay10 = 1715299200;
+const gint64 kMay11 = 1715385600;
+const gint64 kApril2 = 1712016000;
+const gint64 kApril3 = 1712102400;
+
+int remove_entry(const char* path, const struct stat* st, int flag,
+                 struct FTW* ftw) {
+  return remove(path);
+}
+
+// Two roots whose images fall on two days, one of them shared:
+//   photos/Trip/a.png  May 10 10:00
+//   photos/Trip/b.png  May 10 18:00
+//   camera/Roll/a.png  May 10 12:00
+//   camera/Roll/c.png  April 2 09:00
+// None has EXIF data, so they are dated by mtime.
+class MediaTimelineTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    g_setenv("TZ", "UTC", TRUE);
+    tzset();
+    base_ = g_dir_make_tmp("media-timeline-XXXXXX", nullptr);
+    ASSERT_NE(base_, nullptr);
+    g_autofree gchar* cache_dir = g_build_filename(base_, "cache", nullptr);
+    photos_ = g_build_filename(base_, "photos", nullptr);
+    camera_ = g_build_filename(base_, "camera", nullptr);
+    WriteImage(photos_, "Trip/a.png", kMay10 + 10 * 3600);
+    WriteImage(photos_, "Trip/b.png", kMay10 + 18 * 3600);
+    WriteImage(camera_, "Roll/a.png", kMay10 + 12 * 3600);
+    WriteImage(camera_, "Roll/c.png", kApril2 + 9 * 3600);
+
+    library_ = media_library_new(cache_dir);
+    MediaLibraryRoot roots[] = {{photos_, nullptr, nullptr},
+                                {camera_, nullptr, nullptr}};
+    ASSERT_TRUE(media_library_set_roots(library_, roots, 2, nullptr));
+    snapshots_ = media_library_get_snapshots(library_, nullptr);
+  }
+
+  void TearDown() override {
+    g_clear_pointer(&snapshots_, g_ptr_array_unref);
+    g_clear_pointer(&library_, media_library_free);
+    nftw(base_, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    g_free(camera_);
+    g_free(photos_);
+    g_free(base_);
+    g_unsetenv("TZ");
+    tzset();
+  }
+
+  void WriteImage(const gchar* root, const gchar* relative, gint64 mtime) {
+    g_autofree gchar* path = g_build_filename(root, relative, nullptr);
+    g_autofree gchar* dir = g_path_get_dirname(path);
+    ASSERT_EQ(g_mkdir_with_parents(dir, 0755), 0);
+    ASSERT_TRUE(g_file_set_contents(path,
+                                    reinterpret_cast<const gchar*>(kPngHeader),
+                                    sizeof(kPngHeader), nullptr));
+    struct utimbuf times = {(time_t)mtime, (time_t)mtime};
+    ASSERT_EQ(utime(path, &times), 0);
+  }
+
+  // Returns the path of the record an entry or cover points at.
+  const gchar* PathOf(guint32 snapshot_index, guint32 record) {
+    const MediaIndexSnapshot* snapshot = static_cast<const MediaIndexSnapshot*>(
+        snapshots_->pdata[snapshot_index]);
+    return media_index_snapshot_string(snapshot,
+                                       snapshot->records[record].path);
+  }
+
+  gchar* base_ = nullptr;
+  gchar* photos_ = nullptr;
+  gchar* camera_ = nullptr;
+  MediaLibrary* library_ = nullptr;
+  GPtrArray* snapshots_ = nullptr;
+};
+
+}  // namespace
+
+TEST_F(MediaTimelineTest, MergesDaysAcrossRoots) {
+  g_autoptr(GArray) days =
+      media_timeline_build(snapshots_, MEDIA_KIND_ANY, MEDIA_TIMELINE_DAY);
+  ASSERT_EQ(days->len, 2u);
+  const MediaTimelineBucket* may10 =
+      &g_array_index(days, MediaTimelineBucket, 0);
+  EXPECT_EQ(may10->start, kMay10);
+  EXPECT_EQ(may10->end, kMay11);
+  EXPECT_EQ(may10->count, 3u);
+  g_autofree gchar* newest = g_build_filename(photos_, "Trip/b.png", nullptr);
+  EXPECT_STREQ(PathOf(may10->cover_snapshot, may10->cover), newest);
+
+  const MediaTimelineBucket* april2 =
+      &g_array_index(days, MediaTimelineBucket, 1);
+  EXPECT_EQ(april2->start, kApril2);
+  EXPECT_EQ(april2->end, kApril3);
+  EXPECT_EQ(april2->count, 1u);
+  g_autofree gchar* oldest = g_build_filename(camera_, "Roll/c.png", nullptr);
+  EXPECT_STREQ(PathOf(april2->cover_snapshot, april2->cover), oldest);
+}
+
+TEST_F(MediaTimelineTest, BucketsByMonthAndYear) {
+  g_autoptr(GArray) months =
+      media_timeline_build(snapshots_, MEDIA_KIND_ANY, MEDIA_TIMELINE_MONTH);
+  ASSERT_EQ(months->len, 2u);
+  EXPECT_EQ(g_array_index(months, MediaTimelineBucket, 0).start, 1714521600);
+  EXPECT_EQ(g_array_index(months, MediaTimelineBucket, 0).end, 1717200000);
+  EXPECT_EQ(g_array_index(months, MediaTimelineBucket, 1).start, 1711929600);
+
+  g_autoptr(GArray) years =
+      media_timeline_build(snapshots_, MEDIA_KIND_ANY, MEDIA_TIMELINE_YEAR);
+  ASSERT_EQ(years->len, 1u);
+  EXPECT_EQ(g_array_index(years, MediaTimelineBucket, 0).start, 1704067200);
+  EXPECT_EQ(g_array_index(years, MediaTimelineBucket, 0).end, 1735689600);
+  EXPECT_EQ(g_array_index(years, MediaTimelineBucket, 0).count, 4u);
+
+  g_autoptr(GArray) videos =
+      media_timeline_build(snapshots_, MEDIA_KIND_VIDEO, MEDIA_TIMELINE_DAY);
+  EXPECT_EQ(videos->len, 0u);
+}
+
+TEST_F(MediaTimelineTest, PagesThroughRangeNewestFirst) {
+  g_autoptr(GArray) all = media_timeline_get_range(
+      snapshots_, MEDIA_KIND_IMAGE, kMay10, kMay11, 0, -1);
+  ASSERT_EQ(all->len, 3u);
+  const gchar* expected[] = {"photos/Trip/b.png", "camera/Roll/a.png",
+                             "photos/Trip/a.png"};
+  for (guint i = 0; i < all->len; i++) {
+    const MediaTimelineEntry* entry =
+        &g_array_index(all, MediaTimelineEntry, i);
+    g_autofree gchar* path = g_build_filename(base_, expected[i], nullptr);
+    EXPECT_STREQ(PathOf(entry->snapshot, entry->record), path);
+  }
+
+  g_autoptr(GArray) page = media_timeline_get_range(
+      snapshots_, MEDIA_KIND_IMAGE, kMay10, kMay11, 1, 1);
+  ASSERT_EQ(page->len, 1u);
+  EXPECT_EQ(g_array_index(page, MediaTimelineEntry, 0).snapshot, 1u);
+
+  g_autoptr(GArray) past_end = media_timeline_get_range(
+      snapshots_, MEDIA_KIND_IMAGE, kMay10, kMay11, 3, 10);
+  EXPECT_EQ(past_end->len, 0u);
+  g_autoptr(GArray) reversed = media_timeline_get_range(
+      snapshots_, MEDIA_KIND_IMAGE, kMay11, kMay10, 0, -1);
+  EXPECT_EQ(reversed->len, 0u);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <unistd.h>
+
+#include "media_video.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// A three second 320x240 clip with a keyframe every frame, encoded by
+// videotestsrc so the test needs no fixture files.
+class MediaVideoTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    gst_init(nullptr, nullptr);
+    gint fd = g_file_open_tmp("media-video-XXXXXX.avi", &path_, nullptr);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    g_autofree gchar* description = g_strdup_printf(
+        "videotestsrc num-buffers=30 ! "
+        "video/x-raw,width=320,height=240,framerate=10/1 ! videoconvert ! "
+        "jpegenc ! avimux ! filesink location=\"%s\"",
+        path_);
+    g_autoptr(GError) error = nullptr;
+    g_autoptr(GstElement) pipeline = gst_parse_launch(description, &error);
+    if (pipeline == nullptr) {
+      GTEST_SKIP() << "GStreamer plugins missing: " << error->message;
+    }
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    g_autoptr(GstBus) bus = gst_element_get_bus(pipeline);
+    g_autoptr(GstMessage) message = gst_bus_timed_pop_filtered(
+        bus, 10 * GST_SECOND,
+        static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    ASSERT_NE(message, nullptr);
+    ASSERT_EQ(GST_MESSAGE_TYPE(message), GST_MESSAGE_EOS);
+  }
+
+  void TearDown() override {
+    if (path_ != nullptr) g_unlink(path_);
+    g_free(path_);
+  }
+
+  gchar* path_ = nullptr;
+};
+
+}  // namespace
+
+TEST_F(MediaVideoTest, ProbeReadsDurationAndSize) {
+  MediaVideoInfo info;
+  g_autoptr(GError) error = nullptr;
+  ASSERT_TRUE(media_video_probe(path_, &info, &error));
+  EXPECT_NEAR(info.duration_ms, 3000, 100);
+  EXPECT_EQ(info.width, 320);
+  EXPECT_EQ(info.height, 240);
+}
+
+TEST_F(MediaVideoTest, FrameFitsTheBox) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GdkPixbuf) frame =
+      media_video_extract_frame(path_, 200, 200, -1, &error);
+  ASSERT_NE(frame, nullptr) << error->message;
+  EXPECT_EQ(gdk_pixbuf_get_width(frame), 200);
+  EXPECT_EQ(gdk_pixbuf_get_height(frame), 150);
+
+  // The pipeline goes back to the pool and serves the next request.
+  g_autoptr(GdkPixbuf) again =
+      media_video_extract_frame(path_, 64, 64, 2500, &error);
+  ASSERT_NE(again, nullptr) << error->message;
+  EXPECT_EQ(gdk_pixbuf_get_width(again), 64);
+  EXPECT_EQ(gdk_pixbuf_get_height(again), 48);
+}
+
+TEST_F(MediaVideoTest, PositionPastTheEndUsesTheMiddle) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GdkPixbuf) frame =
+      media_video_extract_frame(path_, 100, 100, 60000, &error);
+  ASSERT_NE(frame, nullptr) << error->message;
+  EXPECT_EQ(gdk_pixbuf_get_width(frame), 100);
+}
+
+TEST_F(MediaVideoTest, NonVideoIsAnError) {
+  g_autofree gchar* path = nullptr;
+  gint fd = g_file_open_tmp("media-video-XXXXXX.txt", &path, nullptr);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, "not a video", 11), 11);
+  close(fd);
+
+  MediaVideoInfo info;
+  g_autoptr(GError) probe_error = nullptr;
+  EXPECT_FALSE(media_video_probe(path, &info, &probe_error));
+  EXPECT_NE(probe_error, nullptr);
+
+  g_autoptr(GError) frame_error = nullptr;
+  EXPECT_EQ(media_video_extract_frame(path, 100, 100, -1, &frame_error),
+            nullptr);
+  EXPECT_NE(frame_error, nullptr);
+  g_unlink(path);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
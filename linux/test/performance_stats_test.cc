@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "performance_stats.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+PerformanceSummary Summarize(const PerformanceHistogram* histogram) {
+  PerformanceSummary summary;
+  performance_histogram_summarize(histogram, &summary);
+  return summary;
+}
+
+const PerformanceMethodStats* FindMethod(GArray* methods, const gchar* name) {
+  for (guint i = 0; i < methods->len; i++) {
+    const PerformanceMethodStats* stats =
+        &g_array_index(methods, PerformanceMethodStats, i);
+    if (g_strcmp0(stats->name, name) == 0) return stats;
+  }
+  return nullptr;
+}
+
+size_t CountOccurrences(const std::string& text, const std::string& needle) {
+  size_t count = 0;
+  for (size_t at = text.find(needle); at != std::string::npos;
+       at = text.find(needle, at + needle.size())) {
+    count++;
+  }
+  return count;
+}
+
+class PerformanceStatsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    performance_stats_set_enabled(TRUE);
+    performance_stats_reset();
+  }
+
+  void TearDown() override {
+    performance_stats_set_enabled(TRUE);
+    performance_stats_reset();
+  }
+
+  // Writes the trace to a temporary file and returns its contents.
+  static std::string WriteTrace() {
+    g_autofree gchar* path = nullptr;
+    gint fd = g_file_open_tmp("performance-trace-XXXXXX.json", &path, nullptr);
+    EXPECT_GE(fd, 0);
+    close(fd);
+    EXPECT_TRUE(performance_stats_write_trace(path, nullptr));
+    g_autofree gchar* contents = nullptr;
+    EXPECT_TRUE(g_file_get_contents(path, &contents, nullptr, nullptr));
+    g_unlink(path);
+    return contents != nullptr ? contents : "";
+  }
+};
+
+gpointer RecordMany(gpointer data) {
+  auto* histogram = static_cast<PerformanceHistogram*>(data);
+  for (guint64 i = 0; i < 10000; i++) {
+    performance_histogram_record(histogram, i % 1000);
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST(PerformanceHistogram, SmallValuesAreExact) {
+  PerformanceHistogram histogram = {};
+  for (guint64 i = 0; i < PERFORMANCE_HISTOGRAM_SUB_BUCKETS; i++) {
+    performance_histogram_record(&histogram, i);
+  }
+  PerformanceSummary summary = Summarize(&histogram);
+  EXPECT_EQ(summary.count, (guint64)PERFORMANCE_HISTOGRAM_SUB_BUCKETS);
+  EXPECT_EQ(summary.p50_us, 7u);
+  EXPECT_EQ(summary.p99_us, 15u);
+  EXPECT_EQ(summary.max_us, 15u);
+  EXPECT_DOUBLE_EQ(summary.mean_us, 7.5);
+}
+
+TEST(PerformanceHistogram, PercentilesWithinBucketPrecision) {
+  PerformanceHistogram histogram = {};
+  for (guint64 i = 1; i <= 100000; i++) {
+    performance_histogram_record(&histogram, i);
+  }
+  PerformanceSummary summary = Summarize(&histogram);
+  EXPECT_EQ(summary.count, 100000u);
+  EXPECT_DOUBLE_EQ(summary.mean_us, 50000.5);
+  EXPECT_EQ(summary.max_us, 100000u);
+  // Never below the true value, and at most one bucket above it
+  EXPECT_GE(summary.p50_us, 50000u);
+  EXPECT_LE(summary.p50_us, 50000u + 50000u / 16);
+  EXPECT_GE(summary.p90_us, 90000u);
+  EXPECT_LE(summary.p90_us, 90000u + 90000u / 16);
+  EXPECT_GE(summary.p99_us, 99000u);
+  EXPECT_LE(summary.p99_us, 100000u);
+}
+
+TEST(PerformanceHistogram, ClampsHugeValues) {
+  PerformanceHistogram histogram = {};
+  performance_histogram_record(&histogram, G_MAXUINT64 / 2);
+  performance_histogram_record(&histogram, 10);
+  PerformanceSummary summary = Summarize(&histogram);
+  EXPECT_EQ(summary.count, 2u);
+  EXPECT_EQ(summary.p50_us, 10u);
+  EXPECT_EQ(summary.max_us, G_MAXUINT64 / 2);
+  EXPECT_LE(summary.p99_us, summary.max_us);
+}
+
+TEST(PerformanceHistogram, CountsConcurrentRecords) {
+  PerformanceHistogram histogram = {};
+  GThread* threads[8];
+  for (GThread*& thread : threads) {
+    thread = g_thread_new("record", RecordMany, &histogram);
+  }
+  for (GThread* thread : threads) g_thread_join(thread);
+  PerformanceSummary summary = Summarize(&histogram);
+  EXPECT_EQ(summary.count, 80000u);
+  EXPECT_EQ(summary.max_us, 999u);
+  EXPECT_DOUBLE_EQ(summary.mean_us, 499.5);
+}
+
+TEST_F(PerformanceStatsTest, CountsMethods) {
+  PerformanceMethod* method = performance_stats_register_method("testMethod");
+  ASSERT_NE(method, nullptr);
+  EXPECT_EQ(performance_stats_register_method("testMethod"), method);
+
+  gint64 start = performance_stats_begin();
+  performance_stats_end_method(method, start - 500, start, FALSE);
+  performance_stats_end_method(method, start, start, TRUE);
+
+  g_autoptr(GArray) methods = performance_stats_get_methods();
+  const PerformanceMethodStats* stats = FindMethod(methods, "testMethod");
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(stats->latency.count, 2u);
+  EXPECT_EQ(stats->errors, 1u);
+  EXPECT_GE(stats->queue_wait.max_us, 500u);
+  EXPECT_EQ(stats->queue_wait.p50_us, 0u);
+
+  // Methods that have not been called since the reset are left out
+  performance_stats_reset();
+  g_autoptr(GArray) after_reset = performance_stats_get_methods();
+  EXPECT_EQ(FindMethod(after_reset, "testMethod"), nullptr);
+}
+
+TEST_F(PerformanceStatsTest, CountsStages) {
+  for (int i = 0; i < 3; i++) {
+    performance_stats_end_stage(PERFORMANCE_STAGE_ENCODE,
+                                performance_stats_begin());
+  }
+  PerformanceSummary summary;
+  performance_stats_get_stage(PERFORMANCE_STAGE_ENCODE, &summary);
+  EXPECT_EQ(summary.count, 3u);
+  performance_stats_get_stage(PERFORMANCE_STAGE_DECODE, &summary);
+  EXPECT_EQ(summary.count, 0u);
+  EXPECT_STREQ(performance_stats_stage_name(PERFORMANCE_STAGE_FILESYSTEM),
+               "filesystem");
+}
+
+TEST_F(PerformanceStatsTest, DisabledRecordsNothing) {
+  PerformanceMethod* method = performance_stats_register_method("testOff");
+  performance_stats_set_enabled(FALSE);
+  EXPECT_FALSE(performance_stats_get_enabled());
+  gint64 start = performance_stats_begin();
+  EXPECT_EQ(start, 0);
+  performance_stats_end_stage(PERFORMANCE_STAGE_SCALE, start);
+  performance_stats_end_method(method, start, start, FALSE);
+
+  PerformanceSummary summary;
+  performance_stats_get_stage(PERFORMANCE_STAGE_SCALE, &summary);
+  EXPECT_EQ(summary.count, 0u);
+  g_autoptr(GArray) methods = performance_stats_get_methods();
+  EXPECT_EQ(FindMethod(methods, "testOff"), nullptr);
+  EXPECT_EQ(CountOccurrences(WriteTrace(), "\"ph\":\"X\""), 0u);
+}
+
+TEST_F(PerformanceStatsTest, TracksQueueDepth) {
+  PerformanceQueue* queue = performance_stats_register_queue("testQueue");
+  performance_stats_sample_queue(queue, 3);
+  performance_stats_sample_queue(queue, 7);
+  performance_stats_sample_queue(queue, 2);
+
+  g_autoptr(GArray) queues = performance_stats_get_queues();
+  const PerformanceQueueStats* stats = nullptr;
+  for (guint i = 0; i < queues->len; i++) {
+    const PerformanceQueueStats* candidate =
+        &g_array_index(queues, PerformanceQueueStats, i);
+    if (g_strcmp0(candidate->name, "testQueue") == 0) stats = candidate;
+  }
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(stats->depth, 2u);
+  EXPECT_EQ(stats->peak_depth, 7u);
+
+  // A reset starts the peak over from the current depth
+  performance_stats_reset();
+  g_autoptr(GArray) after_reset = performance_stats_get_queues();
+  for (guint i = 0; i < after_reset->len; i++) {
+    const PerformanceQueueStats* candidate =
+        &g_array_index(after_reset, PerformanceQueueStats, i);
+    if (g_strcmp0(candidate->name, "testQueue") == 0) {
+      EXPECT_EQ(candidate->peak_depth, 2u);
+    }
+  }
+}
+
+TEST_F(PerformanceStatsTest, WritesChromeTrace) {
+  PerformanceMethod* method = performance_stats_register_method("traced");
+  gint64 start = performance_stats_begin();
+  performance_stats_end_stage(PERFORMANCE_STAGE_DECODE, start);
+  performance_stats_end_method(method, start, start, FALSE);
+
+  std::string trace = WriteTrace();
+  EXPECT_EQ(trace.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0),
+            0u);
+  EXPECT_NE(trace.find("\"name\":\"decode\",\"cat\":\"stage\",\"ph\":\"X\""),
+            std::string::npos);
+  EXPECT_NE(trace.find("\"name\":\"traced\",\"cat\":\"method\",\"ph\":\"X\""),
+            std::string::npos);
+  EXPECT_NE(trace.find("\"thread_name\""), std::string::npos);
+  EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+
+  performance_stats_reset();
+  EXPECT_EQ(CountOccurrences(WriteTrace(), "\"ph\":\"X\""), 0u);
+}
+
+TEST_F(PerformanceStatsTest, TraceKeepsMostRecentSpans) {
+  for (int i = 0; i < PERFORMANCE_TRACE_SPANS + 100; i++) {
+    performance_stats_end_stage(PERFORMANCE_STAGE_SCALE,
+                                performance_stats_begin());
+  }
+  EXPECT_EQ(CountOccurrences(WriteTrace(), "\"ph\":\"X\""),
+            (size_t)PERFORMANCE_TRACE_SPANS);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
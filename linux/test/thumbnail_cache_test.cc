@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "thumbnail_cache.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// Requests above the largest freedesktop bucket stay in the memory tier, so
+// these tests never touch the user's shared thumbnail store.
+constexpr gint kBox = 2048;
+
+class ThumbnailCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    gint fd = g_file_open_tmp("thumbnail-cache-XXXXXX", &source_path_, nullptr);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, "source", 6), 6);
+    close(fd);
+  }
+
+  void TearDown() override {
+    g_unlink(source_path_);
+    g_free(source_path_);
+  }
+
+  static GdkPixbuf* NewPixbuf(gint width, gint height) {
+    GdkPixbuf* pixbuf =
+        gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+    gdk_pixbuf_fill(pixbuf, 0x336699ff);
+    return pixbuf;
+  }
+
+  gchar* source_path_ = nullptr;
+};
+
+}  // namespace
+
+TEST(ThumbnailCacheSourceSize, UsesFreedesktopBuckets) {
+  EXPECT_EQ(thumbnail_cache_get_source_size(100, 100), 128);
+  EXPECT_EQ(thumbnail_cache_get_source_size(200, 200), 256);
+  EXPECT_EQ(thumbnail_cache_get_source_size(512, 300), 512);
+  EXPECT_EQ(thumbnail_cache_get_source_size(1024, 1024), 1024);
+  EXPECT_EQ(thumbnail_cache_get_source_size(1500, 900), 1500);
+}
+
+TEST_F(ThumbnailCacheTest, HitAfterInsert) {
+  ThumbnailCache* cache = thumbnail_cache_new(64 * 1024 * 1024);
+  EXPECT_EQ(thumbnail_cache_lookup(cache, source_path_, kBox, kBox), nullptr);
+
+  g_autoptr(GdkPixbuf) generated = NewPixbuf(kBox, kBox / 2);
+  g_autoptr(GdkPixbuf) inserted =
+      thumbnail_cache_insert(cache, source_path_, kBox, kBox, generated);
+  g_autoptr(GdkPixbuf) cached =
+      thumbnail_cache_lookup(cache, source_path_, kBox, kBox);
+  EXPECT_EQ(cached, inserted);
+
+  ThumbnailCacheStats stats;
+  thumbnail_cache_get_stats(cache, &stats);
+  EXPECT_EQ(stats.memory_hits, 1u);
+  EXPECT_EQ(stats.misses, 1u);
+  EXPECT_EQ(stats.memory_entries, 1u);
+  EXPECT_EQ(stats.memory_bytes, gdk_pixbuf_get_byte_length(inserted));
+
+  thumbnail_cache_clear(cache, FALSE);
+  thumbnail_cache_get_stats(cache, &stats);
+  EXPECT_EQ(stats.memory_entries, 0u);
+  EXPECT_EQ(stats.memory_hits, 0u);
+  thumbnail_cache_free(cache);
+}
+
+TEST_F(ThumbnailCacheTest, PeekLeavesCountersAlone) {
+  ThumbnailCache* cache = thumbnail_cache_new(64 * 1024 * 1024);
+  EXPECT_EQ(thumbnail_cache_peek(cache, source_path_, kBox, kBox), nullptr);
+
+  g_autoptr(GdkPixbuf) generated = NewPixbuf(kBox, kBox);
+  g_autoptr(GdkPixbuf) inserted =
+      thumbnail_cache_insert(cache, source_path_, kBox, kBox, generated);
+  g_autoptr(GdkPixbuf) peeked =
+      thumbnail_cache_peek(cache, source_path_, kBox, kBox);
+  EXPECT_EQ(peeked, inserted);
+
+  ThumbnailCacheStats stats;
+  thumbnail_cache_get_stats(cache, &stats);
+  EXPECT_EQ(stats.memory_hits, 0u);
+  EXPECT_EQ(stats.misses, 0u);
+  thumbnail_cache_free(cache);
+}
+
+TEST_F(ThumbnailCacheTest, ModifiedSourceMisses) {
+  ThumbnailCache* cache = thumbnail_cache_new(64 * 1024 * 1024);
+  g_autoptr(GdkPixbuf) generated = NewPixbuf(kBox, kBox);
+  g_autoptr(GdkPixbuf) inserted =
+      thumbnail_cache_insert(cache, source_path_, kBox, kBox, generated);
+
+  struct utimbuf times = {1000, 1000};
+  ASSERT_EQ(utime(source_path_, &times), 0);
+  EXPECT_EQ(thumbnail_cache_lookup(cache, source_path_, kBox, kBox), nullptr);
+  thumbnail_cache_free(cache);
+}
+
+TEST_F(ThumbnailCacheTest, EvictsLeastRecentlyUsed) {
+  g_autoptr(GdkPixbuf) generated = NewPixbuf(kBox, kBox);
+  // Room for two thumbnails of this size.
+  ThumbnailCache* cache =
+      thumbnail_cache_new(2 * gdk_pixbuf_get_byte_length(generated));
+
+  g_object_unref(thumbnail_cache_insert(cache, source_path_, kBox, kBox, generated));
+  g_object_unref(thumbnail_cache_insert(cache, source_path_, kBox - 1, kBox - 1,
+                                        generated));
+  // Touch the first entry so the second becomes the eviction candidate.
+  g_object_unref(thumbnail_cache_lookup(cache, source_path_, kBox, kBox));
+  g_object_unref(thumbnail_cache_insert(cache, source_path_, kBox - 2, kBox - 2,
+                                        generated));
+
+  g_autoptr(GdkPixbuf) first =
+      thumbnail_cache_lookup(cache, source_path_, kBox, kBox);
+  g_autoptr(GdkPixbuf) second =
+      thumbnail_cache_lookup(cache, source_path_, kBox - 1, kBox - 1);
+  EXPECT_NE(first, nullptr);
+  EXPECT_EQ(second, nullptr);
+  thumbnail_cache_free(cache);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <flutter_linux/flutter_linux.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "thumbnail_encoder.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+TEST(ThumbnailEncoder, OptionsDefaultToPng) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  ThumbnailOptions options;
+  ASSERT_TRUE(thumbnail_options_parse(&options, args, 200, nullptr));
+  EXPECT_EQ(options.width, 200);
+  EXPECT_EQ(options.height, 200);
+  EXPECT_EQ(options.format, THUMBNAIL_FORMAT_PNG);
+  EXPECT_EQ(options.video_position_ms, -1);
+}
+
+TEST(ThumbnailEncoder, OptionsReadFormatSizeAndQuality) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string_take(args, "format", fl_value_new_string("jpeg"));
+  fl_value_set_string_take(args, "width", fl_value_new_int(320));
+  fl_value_set_string_take(args, "height", fl_value_new_int(-1));
+  fl_value_set_string_take(args, "quality", fl_value_new_int(250));
+  fl_value_set_string_take(args, "videoPosition", fl_value_new_int(4500));
+
+  ThumbnailOptions options;
+  ASSERT_TRUE(thumbnail_options_parse(&options, args, 512, nullptr));
+  EXPECT_EQ(options.format, THUMBNAIL_FORMAT_JPEG);
+  EXPECT_EQ(options.width, 320);
+  EXPECT_EQ(options.height, 512);
+  EXPECT_EQ(options.quality, 100);
+  EXPECT_EQ(options.video_position_ms, 4500);
+}
+
+TEST(ThumbnailEncoder, UnknownFormatIsAnError) {
+  g_autoptr(FlValue) args = fl_value_new_map();
+  fl_value_set_string_take(args, "format", fl_value_new_string("tiff"));
+
+  ThumbnailOptions options;
+  g_autoptr(GError) error = nullptr;
+  EXPECT_FALSE(thumbnail_options_parse(&options, args, 512, &error));
+  EXPECT_NE(error, nullptr);
+}
+
+TEST(ThumbnailEncoder, RawReturnsPixelsUnencoded) {
+  g_autoptr(GdkPixbuf) pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, 7, 3);
+  gdk_pixbuf_fill(pixbuf, 0x11223344);
+
+  ThumbnailOptions options = {512, 512, THUMBNAIL_FORMAT_RAW, 85};
+  g_autoptr(FlValue) result = fl_value_new_map();
+  ASSERT_TRUE(thumbnail_encode(pixbuf, &options, result, nullptr));
+
+  FlValue* data = fl_value_lookup_string(result, "data");
+  ASSERT_NE(data, nullptr);
+  ASSERT_EQ(fl_value_get_length(data), gdk_pixbuf_get_byte_length(pixbuf));
+  const uint8_t* bytes = fl_value_get_uint8_list(data);
+  EXPECT_EQ(bytes[0], 0x11);
+  EXPECT_EQ(bytes[3], 0x44);
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(result, "width")), 7);
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(result, "height")), 3);
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(result, "rowstride")),
+            gdk_pixbuf_get_rowstride(pixbuf));
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(result, "channels")), 4);
+  EXPECT_STREQ(fl_value_get_string(fl_value_lookup_string(result, "format")),
+               "raw");
+}
+
+TEST(ThumbnailEncoder, PngIsDecodable) {
+  g_autoptr(GdkPixbuf) pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, 16, 9);
+  gdk_pixbuf_fill(pixbuf, 0x336699ff);
+
+  ThumbnailOptions options = {512, 512, THUMBNAIL_FORMAT_PNG, 85};
+  g_autoptr(FlValue) result = fl_value_new_map();
+  ASSERT_TRUE(thumbnail_encode(pixbuf, &options, result, nullptr));
+
+  FlValue* data = fl_value_lookup_string(result, "data");
+  g_autoptr(GdkPixbufLoader) loader = gdk_pixbuf_loader_new();
+  ASSERT_TRUE(gdk_pixbuf_loader_write(loader, fl_value_get_uint8_list(data),
+                                      fl_value_get_length(data), nullptr));
+  ASSERT_TRUE(gdk_pixbuf_loader_close(loader, nullptr));
+  GdkPixbuf* decoded = gdk_pixbuf_loader_get_pixbuf(loader);
+  EXPECT_EQ(gdk_pixbuf_get_width(decoded), 16);
+  EXPECT_EQ(gdk_pixbuf_get_height(decoded), 9);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <string>
+
+#include "thumbnail_generator.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// 640x480 images in a format that is decoded at full size (PNG) and one
+// that is reduced while decoding (JPEG).
+class ThumbnailGeneratorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = g_dir_make_tmp("thumbnail-generator-XXXXXX", nullptr);
+    ASSERT_NE(dir_, nullptr);
+    g_autoptr(GdkPixbuf) pixbuf =
+        gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, 640, 480);
+    gdk_pixbuf_fill(pixbuf, 0x336699ff);
+    png_ = g_build_filename(dir_, "image.png", nullptr);
+    jpeg_ = g_build_filename(dir_, "image.jpg", nullptr);
+    ASSERT_TRUE(gdk_pixbuf_save(pixbuf, png_, "png", nullptr, nullptr));
+    ASSERT_TRUE(gdk_pixbuf_save(pixbuf, jpeg_, "jpeg", nullptr, nullptr));
+  }
+
+  void TearDown() override {
+    g_unlink(png_);
+    g_unlink(jpeg_);
+    g_rmdir(dir_);
+    g_free(jpeg_);
+    g_free(png_);
+    g_free(dir_);
+  }
+
+  gchar* dir_ = nullptr;
+  gchar* png_ = nullptr;
+  gchar* jpeg_ = nullptr;
+};
+
+}  // namespace
+
+TEST_F(ThumbnailGeneratorTest, RejectsImagesOverThePixelBudget) {
+  ThumbnailDecodeLimits limits = {100 * 1000, 0};
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GdkPixbuf) rejected =
+      generate_thumbnail(png_, 64, 64, &limits, &error);
+  EXPECT_EQ(rejected, nullptr);
+  EXPECT_TRUE(g_error_matches(error, THUMBNAIL_GENERATOR_ERROR,
+                              THUMBNAIL_GENERATOR_ERROR_TOO_LARGE));
+
+  g_autoptr(GdkPixbuf) thumbnail =
+      generate_thumbnail(png_, 64, 64, nullptr, nullptr);
+  ASSERT_NE(thumbnail, nullptr);
+  EXPECT_EQ(gdk_pixbuf_get_width(thumbnail), 64);
+  EXPECT_EQ(gdk_pixbuf_get_height(thumbnail), 48);
+}
+
+TEST_F(ThumbnailGeneratorTest, CountsJpegsAtTheirReducedSize) {
+  // An 80x60 box lets libjpeg decode at 1/8, 4800 pixels.
+  ThumbnailDecodeLimits limits = {10 * 1000, 0};
+  g_autoptr(GdkPixbuf) thumbnail =
+      generate_thumbnail(jpeg_, 80, 60, &limits, nullptr);
+  ASSERT_NE(thumbnail, nullptr);
+  EXPECT_EQ(gdk_pixbuf_get_width(thumbnail), 80);
+
+  limits.max_pixels = 1000;
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GdkPixbuf) rejected =
+      generate_thumbnail(jpeg_, 80, 60, &limits, &error);
+  EXPECT_EQ(rejected, nullptr);
+  EXPECT_TRUE(g_error_matches(error, THUMBNAIL_GENERATOR_ERROR,
+                              THUMBNAIL_GENERATOR_ERROR_TOO_LARGE));
+}
+
+TEST_F(ThumbnailGeneratorTest, FitsRotatedJpegsUpright) {
+  // Orientation 6 stores the upright 480x640 image turned on its side.
+  g_autofree gchar* contents = nullptr;
+  gsize length = 0;
+  ASSERT_TRUE(g_file_get_contents(jpeg_, &contents, &length, nullptr));
+  const char exif[] = {
+      '\xff', '\xe1', 0, 0x22, 'E', 'x', 'i', 'f', 0, 0,
+      'I', 'I', '*', 0, 8, 0, 0, 0,
+      1, 0, 0x12, 0x01, 3, 0, 1, 0, 0, 0, 6, 0, 0, 0,
+      0, 0, 0, 0};
+  std::string rotated(contents, 2);
+  rotated.append(exif, sizeof(exif));
+  rotated.append(contents + 2, length - 2);
+  ASSERT_TRUE(g_file_set_contents(jpeg_, rotated.data(), rotated.size(),
+                                  nullptr));
+
+  g_autoptr(GdkPixbuf) thumbnail =
+      generate_thumbnail(jpeg_, 80, 60, nullptr, nullptr);
+  ASSERT_NE(thumbnail, nullptr);
+  EXPECT_EQ(gdk_pixbuf_get_width(thumbnail), 45);
+  EXPECT_EQ(gdk_pixbuf_get_height(thumbnail), 60);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
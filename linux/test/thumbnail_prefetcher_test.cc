@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+
+#include <string>
+#include <vector>
+
+#include "thumbnail_prefetcher.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// Above the largest freedesktop bucket, so nothing reaches the disk tier.
+constexpr gint kBox = 2048;
+
+std::vector<guint> Plan(guint first, guint last, gdouble velocity,
+                        guint n_items) {
+  guint positions[THUMBNAIL_PREFETCH_MAX_ITEMS];
+  guint n = thumbnail_prefetch_plan(first, last, velocity, n_items, positions);
+  return std::vector<guint>(positions, positions + n);
+}
+
+class ThumbnailPrefetcherTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = g_dir_make_tmp("thumbnail-prefetch-XXXXXX", nullptr);
+    ASSERT_NE(dir_, nullptr);
+    for (int i = 0; i < 6; i++) {
+      gchar name[16];
+      g_snprintf(name, sizeof(name), "%d.jpg", i);
+      g_autofree gchar* path = g_build_filename(dir_, name, nullptr);
+      ASSERT_TRUE(g_file_set_contents(path, "source", -1, nullptr));
+      paths_.push_back(path);
+    }
+    options_.width = kBox;
+    options_.height = kBox;
+    cache_ = thumbnail_cache_new(256 * 1024 * 1024);
+    prefetcher_ = thumbnail_prefetcher_new(cache_, Generate, this);
+  }
+
+  void TearDown() override {
+    thumbnail_prefetcher_free(prefetcher_);
+    thumbnail_cache_free(cache_);
+    for (const std::string& path : paths_) g_unlink(path.c_str());
+    g_rmdir(dir_);
+    g_free(dir_);
+  }
+
+  // Stands in for decoding: stores a blank thumbnail for |path|.
+  static gboolean Generate(const gchar* path,
+                           const ThumbnailOptions* options,
+                           gpointer user_data) {
+    auto* self = static_cast<ThumbnailPrefetcherTest*>(user_data);
+    g_atomic_int_inc(&self->generated_);
+    g_autoptr(GdkPixbuf) thumbnail = NewPixbuf();
+    g_autoptr(GdkPixbuf) inserted = thumbnail_cache_insert_memory(
+        self->cache_, path, options->width, options->height, thumbnail);
+    return TRUE;
+  }
+
+  static GdkPixbuf* NewPixbuf() {
+    GdkPixbuf* pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, 64, 64);
+    gdk_pixbuf_fill(pixbuf, 0x336699ff);
+    return pixbuf;
+  }
+
+  // Hands the first |n| paths to the prefetcher.
+  void SetWindow(guint n) {
+    GPtrArray* window = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < n; i++) {
+      g_ptr_array_add(window, g_strdup(paths_[i].c_str()));
+    }
+    thumbnail_prefetcher_set_window(prefetcher_, window, &options_);
+  }
+
+  // Waits for |n| items to be prefetched or found cached.
+  ThumbnailPrefetchStats WaitForItems(guint64 n) {
+    ThumbnailPrefetchStats stats;
+    for (int i = 0; i < 500; i++) {
+      thumbnail_prefetcher_get_stats(prefetcher_, &stats);
+      if (stats.prefetched + stats.already_cached >= n) break;
+      g_usleep(10000);
+    }
+    return stats;
+  }
+
+  gchar* dir_ = nullptr;
+  std::vector<std::string> paths_;
+  ThumbnailOptions options_ = {};
+  ThumbnailCache* cache_ = nullptr;
+  ThumbnailPrefetcher* prefetcher_ = nullptr;
+  gint generated_ = 0;
+};
+
+}  // namespace
+
+TEST(ThumbnailPrefetchPlan, LooksAheadWhenScrollingDown) {
+  // One screen at low speed, nearest first
+  EXPECT_EQ(Plan(10, 13, 2, 100), (std::vector<guint>{14, 15, 16, 17}));
+  // Faster scrolling looks further ahead, up to four screens
+  EXPECT_EQ(Plan(10, 13, 10, 100).size(), 10u);
+  EXPECT_EQ(Plan(10, 13, 1000, 100).size(), 16u);
+}
+
+TEST(ThumbnailPrefetchPlan, LooksBehindWhenScrollingUp) {
+  EXPECT_EQ(Plan(10, 13, -2, 100), (std::vector<guint>{9, 8, 7, 6}));
+}
+
+TEST(ThumbnailPrefetchPlan, CoversBothSidesAtRest) {
+  EXPECT_EQ(Plan(10, 11, 0, 100), (std::vector<guint>{12, 13, 9, 8}));
+}
+
+TEST(ThumbnailPrefetchPlan, StopsAtAlbumBounds) {
+  EXPECT_EQ(Plan(0, 3, 0, 6), (std::vector<guint>{4, 5}));
+  EXPECT_EQ(Plan(2, 3, -100, 6), (std::vector<guint>{1, 0}));
+  // The last index may run past the album, which clamps it
+  EXPECT_EQ(Plan(4, 9, 0, 6), (std::vector<guint>{3, 2}));
+  EXPECT_TRUE(Plan(6, 9, 0, 6).empty());
+  EXPECT_TRUE(Plan(3, 2, 0, 6).empty());
+  EXPECT_TRUE(Plan(0, 0, 0, 0).empty());
+}
+
+TEST(ThumbnailPrefetchPlan, CapsItems) {
+  EXPECT_EQ(Plan(0, 199, 1e6, 10000).size(),
+            (size_t)THUMBNAIL_PREFETCH_MAX_ITEMS);
+  EXPECT_EQ(Plan(5000, 5199, 0, 10000).size(),
+            (size_t)THUMBNAIL_PREFETCH_MAX_ITEMS);
+}
+
+TEST_F(ThumbnailPrefetcherTest, FillsCacheAndCountsHits) {
+  g_autoptr(GdkPixbuf) thumbnail = NewPixbuf();
+  g_autoptr(GdkPixbuf) inserted = thumbnail_cache_insert_memory(
+      cache_, paths_[0].c_str(), kBox, kBox, thumbnail);
+
+  SetWindow(4);
+  ThumbnailPrefetchStats stats = WaitForItems(4);
+  EXPECT_EQ(stats.already_cached, 1u);
+  EXPECT_EQ(stats.prefetched, 3u);
+  EXPECT_EQ(g_atomic_int_get(&generated_), 3);
+  for (guint i = 0; i < 4; i++) {
+    g_autoptr(GdkPixbuf) cached =
+        thumbnail_cache_peek(cache_, paths_[i].c_str(), kBox, kBox);
+    EXPECT_NE(cached, nullptr) << paths_[i];
+  }
+
+  // Only the first request for a prefetched item is a hit
+  for (int i = 0; i < 2; i++) {
+    thumbnail_prefetcher_begin_request(prefetcher_, paths_[1].c_str());
+    thumbnail_prefetcher_end_request(prefetcher_);
+  }
+  thumbnail_prefetcher_begin_request(prefetcher_, paths_[0].c_str());
+  thumbnail_prefetcher_end_request(prefetcher_);
+  thumbnail_prefetcher_get_stats(prefetcher_, &stats);
+  EXPECT_EQ(stats.hits, 1u);
+  EXPECT_EQ(stats.late, 0u);
+
+  thumbnail_prefetcher_clear(prefetcher_);
+  thumbnail_prefetcher_get_stats(prefetcher_, &stats);
+  EXPECT_EQ(stats.prefetched, 0u);
+  EXPECT_EQ(stats.hits, 0u);
+}
+
+TEST_F(ThumbnailPrefetcherTest, YieldsToRequests) {
+  thumbnail_prefetcher_begin_request(prefetcher_, paths_[5].c_str());
+  SetWindow(3);
+  g_usleep(50000);
+  EXPECT_EQ(g_atomic_int_get(&generated_), 0);
+
+  // A request for an item still waiting is late
+  thumbnail_prefetcher_begin_request(prefetcher_, paths_[2].c_str());
+  thumbnail_prefetcher_end_request(prefetcher_);
+  EXPECT_EQ(g_atomic_int_get(&generated_), 0);
+
+  // Replacing the window drops what it had not started
+  SetWindow(4);
+  ThumbnailPrefetchStats stats;
+  thumbnail_prefetcher_get_stats(prefetcher_, &stats);
+  EXPECT_EQ(stats.late, 1u);
+  EXPECT_EQ(stats.cancelled, 3u);
+
+  thumbnail_prefetcher_end_request(prefetcher_);
+  stats = WaitForItems(4);
+  EXPECT_EQ(stats.prefetched, 4u);
+  EXPECT_EQ(g_atomic_int_get(&generated_), 4);
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
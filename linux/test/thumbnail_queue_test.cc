@@ -0,0 +1,171 @@
+#include <flutter_linux/flutter_linux.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "thumbnail_queue.h"
+
+namespace photo_gallery_pro {
+namespace test {
+
+namespace {
+
+// Held back by the produce function until Release(), so later pushes are
+// queued behind it on the single worker.
+constexpr char kGate[] = "gate";
+
+FlValue* NewIdList(std::initializer_list<const gchar*> ids) {
+  FlValue* list = fl_value_new_list();
+  for (const gchar* id : ids) {
+    fl_value_append_take(list, fl_value_new_string(id));
+  }
+  return list;
+}
+
+// The queue runs one job at a time. The test thread owns the context events
+// are delivered on and never iterates it, so no event reaches the (absent)
+// channel; the jobs are released when the context goes away.
+class ThumbnailQueueTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    g_mutex_init(&mutex_);
+    g_cond_init(&cond_);
+    context_ = g_main_context_new();
+    g_main_context_push_thread_default(context_);
+    ASSERT_TRUE(g_main_context_acquire(context_));
+    owner_ = G_OBJECT(g_object_new(G_TYPE_OBJECT, nullptr));
+    g_object_set_data(owner_, "test", this);
+    options_.width = 64;
+    options_.height = 64;
+    queue_ = thumbnail_queue_new(owner_, nullptr, Produce, 1);
+  }
+
+  void TearDown() override {
+    Release();
+    g_clear_pointer(&queue_, thumbnail_queue_free);
+    g_main_context_release(context_);
+    g_main_context_pop_thread_default(context_);
+    g_main_context_unref(context_);
+    g_object_unref(owner_);
+    g_cond_clear(&cond_);
+    g_mutex_clear(&mutex_);
+  }
+
+  // Stands in for decoding: records |media_id| and waits at the gate.
+  static void Produce(const gchar* media_id,
+                      const ThumbnailOptions* options,
+                      FlValue* event,
+                      gpointer user_data) {
+    auto* self = static_cast<ThumbnailQueueTest*>(
+        g_object_get_data(G_OBJECT(user_data), "test"));
+    g_mutex_lock(&self->mutex_);
+    self->started_.push_back(media_id);
+    g_cond_broadcast(&self->cond_);
+    while (g_strcmp0(media_id, kGate) == 0 && !self->released_) {
+      g_cond_wait(&self->cond_, &self->mutex_);
+    }
+    g_mutex_unlock(&self->mutex_);
+  }
+
+  // Pushes the gate job and waits until the worker is held in it.
+  void Hold() {
+    g_autoptr(FlValue) ids = NewIdList({kGate});
+    ASSERT_EQ(thumbnail_queue_push(queue_, kGate, ids, &options_, 0), 1u);
+    WaitForStarted(1);
+  }
+
+  void Release() {
+    g_mutex_lock(&mutex_);
+    released_ = TRUE;
+    g_cond_broadcast(&cond_);
+    g_mutex_unlock(&mutex_);
+  }
+
+  void WaitForStarted(size_t count) {
+    g_mutex_lock(&mutex_);
+    while (started_.size() < count) g_cond_wait(&cond_, &mutex_);
+    g_mutex_unlock(&mutex_);
+  }
+
+  // Runs every queued job to completion and returns the IDs produced.
+  std::vector<std::string> Drain() {
+    Release();
+    g_clear_pointer(&queue_, thumbnail_queue_free);
+    return started_;
+  }
+
+  GMutex mutex_;
+  GCond cond_;
+  gboolean released_ = FALSE;
+  std::vector<std::string> started_;
+
+  GMainContext* context_ = nullptr;
+  GObject* owner_ = nullptr;
+  ThumbnailOptions options_ = {};
+  ThumbnailQueue* queue_ = nullptr;
+};
+
+}  // namespace
+
+TEST_F(ThumbnailQueueTest, RunsHigherPriorityFirst) {
+  Hold();
+  g_autoptr(FlValue) low = NewIdList({"low-1", "low-2"});
+  g_autoptr(FlValue) high = NewIdList({"high-1", "high-2"});
+  g_autoptr(FlValue) middle = NewIdList({"middle"});
+  ASSERT_EQ(thumbnail_queue_push(queue_, "low", low, &options_, 0), 2u);
+  ASSERT_EQ(thumbnail_queue_push(queue_, "high", high, &options_, 10), 2u);
+  ASSERT_EQ(thumbnail_queue_push(queue_, "middle", middle, &options_, 5), 1u);
+
+  // Equal priorities keep the order they were pushed in.
+  EXPECT_EQ(Drain(),
+            (std::vector<std::string>{kGate, "high-1", "high-2", "middle",
+                                      "low-1", "low-2"}));
+}
+
+TEST_F(ThumbnailQueueTest, CancelledJobsNeverStart) {
+  Hold();
+  g_autoptr(FlValue) ids = NewIdList({"a", "b"});
+  g_autoptr(FlValue) other = NewIdList({"c"});
+  ASSERT_EQ(thumbnail_queue_push(queue_, "scroll", ids, &options_, 0), 2u);
+  ASSERT_EQ(thumbnail_queue_push(queue_, "other", other, &options_, 0), 1u);
+  EXPECT_TRUE(thumbnail_queue_cancel(queue_, "scroll"));
+
+  // Pushing the token again starts a new batch that is not cancelled.
+  g_autoptr(FlValue) again = NewIdList({"d"});
+  ASSERT_EQ(thumbnail_queue_push(queue_, "scroll", again, &options_, 0), 1u);
+
+  EXPECT_EQ(Drain(), (std::vector<std::string>{kGate, "c", "d"}));
+}
+
+TEST_F(ThumbnailQueueTest, RetiresTokenOnceEveryJobIsDone) {
+  Hold();
+  g_autoptr(FlValue) ids = NewIdList({"a", "b"});
+  ASSERT_EQ(thumbnail_queue_push(queue_, "batch", ids, &options_, 0), 2u);
+  g_autoptr(FlValue) last = NewIdList({"last"});
+  ASSERT_EQ(thumbnail_queue_push(queue_, "last", last, &options_, 0), 1u);
+
+  // The single worker only starts "last" once "b" has counted down, so the
+  // batch has queued its done event and has nothing left to cancel.
+  Release();
+  WaitForStarted(4);
+  EXPECT_FALSE(thumbnail_queue_cancel(queue_, "batch"));
+  EXPECT_EQ(Drain(), (std::vector<std::string>{kGate, "a", "b", "last"}));
+}
+
+TEST_F(ThumbnailQueueTest, IgnoresBatchesWithoutValidIds) {
+  g_autoptr(FlValue) ids = fl_value_new_list();
+  fl_value_append_take(ids, fl_value_new_int(42));
+  fl_value_append_take(ids, fl_value_new_null());
+  EXPECT_EQ(thumbnail_queue_push(queue_, "empty", ids, &options_, 0), 0u);
+  g_autoptr(FlValue) not_a_list = fl_value_new_string("a");
+  EXPECT_EQ(thumbnail_queue_push(queue_, "empty", not_a_list, &options_, 0),
+            0u);
+
+  // No token is left behind waiting for jobs that will never run.
+  EXPECT_FALSE(thumbnail_queue_cancel(queue_, "empty"));
+  EXPECT_TRUE(Drain().empty());
+}
+
+}  // namespace test
+}  // namespace photo_gallery_pro
@@ -0,0 +1,412 @@
+#include "thumbnail_cache.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image_resampler.h"
+#include "performance_stats.h"
+
+// Written to tEXt::Software so clearing the disk tier only removes our own
+// thumbnails from the shared store.
+#define THUMBNAIL_SOFTWARE "photo_gallery_pro"
+
+// Size buckets defined by the freedesktop.org thumbnail specification.
+static const struct {
+  const gchar* name;
+  gint size;
+} kBuckets[] = {
+    {"normal", 128},
+    {"large", 256},
+    {"x-large", 512},
+    {"xx-large", 1024},
+};
+
+typedef struct {
+  gchar* key;
+  GdkPixbuf* pixbuf;
+  gsize bytes;
+  GList* link;  // Position in the LRU queue, most recently used first.
+} CacheEntry;
+
+struct _ThumbnailCache {
+  GMutex mutex;
+  gsize memory_budget;
+  gsize memory_bytes;
+  GHashTable* entries;  // gchar* key -> CacheEntry*
+  GQueue lru;
+  gchar* disk_root;  // NULL if there is no usable cache directory.
+
+  guint64 memory_hits;
+  guint64 disk_hits;
+  guint64 misses;
+};
+
+static void cache_entry_free(gpointer data) {
+  CacheEntry* entry = static_cast<CacheEntry*>(data);
+  g_object_unref(entry->pixbuf);
+  g_free(entry->key);
+  g_free(entry);
+}
+
+// Returns the index of the bucket whose size matches a |width|x|height|
+// request, or -1 if the request is larger than every bucket.
+static gint bucket_for_request(gint width, gint height) {
+  gint size = MAX(width, height);
+  for (gsize i = 0; i < G_N_ELEMENTS(kBuckets); i++) {
+    if (size <= kBuckets[i].size) return i;
+  }
+  return -1;
+}
+
+static gchar* memory_key(const gchar* path,
+                         const struct stat* st,
+                         gint width,
+                         gint height) {
+  return g_strdup_printf("%s\n%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT "\n%dx%d",
+                         path, (gint64)st->st_mtime, (gint64)st->st_size,
+                         width, height);
+}
+
+static gchar* disk_path(ThumbnailCache* self, gint bucket, const gchar* uri) {
+  g_autofree gchar* hash = g_compute_checksum_for_string(G_CHECKSUM_MD5, uri, -1);
+  g_autofree gchar* name = g_strconcat(hash, ".png", nullptr);
+  return g_build_filename(self->disk_root, kBuckets[bucket].name, name, nullptr);
+}
+
+// Checks the metadata the spec requires before a thumbnail may be used.
+static gboolean disk_thumbnail_is_valid(GdkPixbuf* pixbuf,
+                                        const gchar* uri,
+                                        const struct stat* st) {
+  const gchar* thumb_uri = gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::URI");
+  const gchar* thumb_mtime = gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::MTime");
+  if (g_strcmp0(thumb_uri, uri) != 0 || thumb_mtime == nullptr ||
+      g_ascii_strtoll(thumb_mtime, nullptr, 10) != (gint64)st->st_mtime) {
+    return FALSE;
+  }
+  // Thumb::Size is optional, but must match when present.
+  const gchar* thumb_size = gdk_pixbuf_get_option(pixbuf, "tEXt::Thumb::Size");
+  return thumb_size == nullptr ||
+         g_ascii_strtoll(thumb_size, nullptr, 10) == (gint64)st->st_size;
+}
+
+static GdkPixbuf* disk_lookup(ThumbnailCache* self,
+                              const gchar* uri,
+                              const struct stat* st,
+                              gint width,
+                              gint height) {
+  gint first_bucket = bucket_for_request(width, height);
+  if (self->disk_root == nullptr || first_bucket < 0) {
+    return nullptr;
+  }
+
+  // Larger buckets can be scaled down; smaller ones would have to be
+  // upscaled, so they are never used.
+  for (gint i = first_bucket; i < (gint)G_N_ELEMENTS(kBuckets); i++) {
+    g_autofree gchar* path = disk_path(self, i, uri);
+    gint64 start = performance_stats_begin();
+    g_autoptr(GdkPixbuf) pixbuf = gdk_pixbuf_new_from_file(path, nullptr);
+    performance_stats_end_stage(PERFORMANCE_STAGE_FILESYSTEM, start);
+    if (pixbuf != nullptr && disk_thumbnail_is_valid(pixbuf, uri, st)) {
+      return image_resample_to_fit(pixbuf, width, height);
+    }
+  }
+  return nullptr;
+}
+
+// Writes |thumbnail| into |bucket| atomically, as required by the spec, so
+// other readers never observe a partially written file.
+static void disk_store(ThumbnailCache* self,
+                       gint bucket,
+                       const gchar* uri,
+                       const struct stat* st,
+                       GdkPixbuf* thumbnail) {
+  gint64 start = performance_stats_begin();
+  g_autofree gchar* dir =
+      g_build_filename(self->disk_root, kBuckets[bucket].name, nullptr);
+  if (g_mkdir_with_parents(dir, 0700) != 0) {
+    return;
+  }
+
+  g_autofree gchar* path = disk_path(self, bucket, uri);
+  g_autofree gchar* tmp_path = g_strconcat(path, ".XXXXXX", nullptr);
+  gint fd = g_mkstemp(tmp_path);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+
+  g_autofree gchar* mtime = g_strdup_printf("%" G_GINT64_FORMAT, (gint64)st->st_mtime);
+  g_autofree gchar* size = g_strdup_printf("%" G_GINT64_FORMAT, (gint64)st->st_size);
+  g_autoptr(GError) error = nullptr;
+  if (!gdk_pixbuf_save(thumbnail, tmp_path, "png", &error,
+                       "tEXt::Thumb::URI", uri,
+                       "tEXt::Thumb::MTime", mtime,
+                       "tEXt::Thumb::Size", size,
+                       "tEXt::Software", THUMBNAIL_SOFTWARE,
+                       nullptr) ||
+      g_rename(tmp_path, path) != 0) {
+    g_unlink(tmp_path);
+  }
+  performance_stats_end_stage(PERFORMANCE_STAGE_FILESYSTEM, start);
+}
+
+// Must be called with the mutex held.
+static void memory_touch(ThumbnailCache* self, CacheEntry* entry) {
+  g_queue_unlink(&self->lru, entry->link);
+  g_queue_push_head_link(&self->lru, entry->link);
+}
+
+// Must be called with the mutex held.
+static void memory_remove(ThumbnailCache* self, CacheEntry* entry) {
+  g_queue_delete_link(&self->lru, entry->link);
+  self->memory_bytes -= entry->bytes;
+  g_hash_table_remove(self->entries, entry->key);
+}
+
+static void memory_insert(ThumbnailCache* self, gchar* key, GdkPixbuf* pixbuf) {
+  CacheEntry* entry = g_new0(CacheEntry, 1);
+  entry->key = key;
+  entry->pixbuf = GDK_PIXBUF(g_object_ref(pixbuf));
+  entry->bytes = gdk_pixbuf_get_byte_length(pixbuf);
+
+  g_mutex_lock(&self->mutex);
+  CacheEntry* existing =
+      static_cast<CacheEntry*>(g_hash_table_lookup(self->entries, key));
+  if (existing != nullptr) {
+    memory_remove(self, existing);
+  }
+  g_hash_table_insert(self->entries, entry->key, entry);
+  g_queue_push_head(&self->lru, entry);
+  entry->link = self->lru.head;
+  self->memory_bytes += entry->bytes;
+
+  // Evict least recently used entries, but never the one just added.
+  while (self->memory_bytes > self->memory_budget && self->lru.length > 1) {
+    memory_remove(self,
+                  static_cast<CacheEntry*>(g_queue_peek_tail(&self->lru)));
+  }
+  g_mutex_unlock(&self->mutex);
+}
+
+ThumbnailCache* thumbnail_cache_new(gsize memory_budget) {
+  ThumbnailCache* self = g_new0(ThumbnailCache, 1);
+  g_mutex_init(&self->mutex);
+  self->memory_budget = memory_budget;
+  self->entries = g_hash_table_new_full(g_str_hash, g_str_equal, nullptr,
+                                        cache_entry_free);
+  g_queue_init(&self->lru);
+
+  const gchar* cache_dir = g_get_user_cache_dir();
+  if (cache_dir != nullptr) {
+    self->disk_root = g_build_filename(cache_dir, "thumbnails", nullptr);
+  }
+  return self;
+}
+
+void thumbnail_cache_free(ThumbnailCache* self) {
+  g_queue_clear(&self->lru);
+  g_hash_table_unref(self->entries);
+  g_mutex_clear(&self->mutex);
+  g_free(self->disk_root);
+  g_free(self);
+}
+
+gint thumbnail_cache_get_source_size(gint width, gint height) {
+  gint bucket = bucket_for_request(width, height);
+  return bucket >= 0 ? kBuckets[bucket].size : MAX(width, height);
+}
+
+// Looks in both tiers, counting the outcome when |count| is TRUE.
+static GdkPixbuf* cache_lookup(ThumbnailCache* self,
+                               const gchar* path,
+                               gint width,
+                               gint height,
+                               gboolean count) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    if (count) {
+      g_mutex_lock(&self->mutex);
+      self->misses++;
+      g_mutex_unlock(&self->mutex);
+    }
+    return nullptr;
+  }
+
+  gchar* key = memory_key(path, &st, width, height);
+  g_mutex_lock(&self->mutex);
+  CacheEntry* entry =
+      static_cast<CacheEntry*>(g_hash_table_lookup(self->entries, key));
+  if (entry != nullptr) {
+    memory_touch(self, entry);
+    if (count) self->memory_hits++;
+    GdkPixbuf* result = GDK_PIXBUF(g_object_ref(entry->pixbuf));
+    g_mutex_unlock(&self->mutex);
+    g_free(key);
+    return result;
+  }
+  g_mutex_unlock(&self->mutex);
+
+  g_autofree gchar* uri = g_filename_to_uri(path, nullptr, nullptr);
+  GdkPixbuf* result =
+      uri != nullptr ? disk_lookup(self, uri, &st, width, height) : nullptr;
+
+  if (count) {
+    g_mutex_lock(&self->mutex);
+    if (result != nullptr) {
+      self->disk_hits++;
+    } else {
+      self->misses++;
+    }
+    g_mutex_unlock(&self->mutex);
+  }
+
+  if (result != nullptr) {
+    memory_insert(self, key, result);
+  } else {
+    g_free(key);
+  }
+  return result;
+}
+
+GdkPixbuf* thumbnail_cache_lookup(ThumbnailCache* self,
+                                  const gchar* path,
+                                  gint width,
+                                  gint height) {
+  return cache_lookup(self, path, width, height, TRUE);
+}
+
+GdkPixbuf* thumbnail_cache_peek(ThumbnailCache* self,
+                                const gchar* path,
+                                gint width,
+                                gint height) {
+  return cache_lookup(self, path, width, height, FALSE);
+}
+
+static GdkPixbuf* cache_insert(ThumbnailCache* self,
+                               const gchar* path,
+                               gint width,
+                               gint height,
+                               GdkPixbuf* thumbnail,
+                               gboolean to_disk) {
+  GdkPixbuf* result = image_resample_to_fit(thumbnail, width, height);
+
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return result;
+  }
+
+  gint bucket = bucket_for_request(width, height);
+  g_autofree gchar* uri = g_filename_to_uri(path, nullptr, nullptr);
+  if (to_disk && self->disk_root != nullptr && bucket >= 0 && uri != nullptr) {
+    disk_store(self, bucket, uri, &st, thumbnail);
+  }
+
+  memory_insert(self, memory_key(path, &st, width, height), result);
+  return result;
+}
+
+GdkPixbuf* thumbnail_cache_insert(ThumbnailCache* self,
+                                  const gchar* path,
+                                  gint width,
+                                  gint height,
+                                  GdkPixbuf* thumbnail) {
+  return cache_insert(self, path, width, height, thumbnail, TRUE);
+}
+
+GdkPixbuf* thumbnail_cache_insert_memory(ThumbnailCache* self,
+                                         const gchar* path,
+                                         gint width,
+                                         gint height,
+                                         GdkPixbuf* thumbnail) {
+  return cache_insert(self, path, width, height, thumbnail, FALSE);
+}
+
+// Returns TRUE if the PNG at |path| has a tEXt::Software chunk holding
+// THUMBNAIL_SOFTWARE. Writers put their text before the image data, so only
+// the chunk headers up to the first IDAT are read and nothing is decoded.
+static gboolean disk_is_own_thumbnail(const gchar* path) {
+  static const guchar kSignature[8] = {0x89, 'P',  'N',  'G',
+                                       '\r', '\n', 0x1a, '\n'};
+  static const gchar kKeyword[] = "Software";
+  FILE* file = g_fopen(path, "rb");
+  if (file == nullptr) return FALSE;
+
+  gboolean own = FALSE;
+  guchar header[8];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, kSignature, sizeof(kSignature)) != 0) {
+    fclose(file);
+    return FALSE;
+  }
+  while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+    guint32 length = (guint32)header[0] << 24 | (guint32)header[1] << 16 |
+                     (guint32)header[2] << 8 | header[3];
+    const gchar* type = reinterpret_cast<const gchar*>(header + 4);
+    if (memcmp(type, "IDAT", 4) == 0 || memcmp(type, "IEND", 4) == 0) break;
+    if (memcmp(type, "tEXt", 4) == 0 &&
+        length == sizeof(kKeyword) + strlen(THUMBNAIL_SOFTWARE)) {
+      gchar text[sizeof(kKeyword) + sizeof(THUMBNAIL_SOFTWARE)];
+      if (fread(text, 1, length, file) != length) break;
+      if (memcmp(text, kKeyword, sizeof(kKeyword)) == 0 &&
+          memcmp(text + sizeof(kKeyword), THUMBNAIL_SOFTWARE,
+                 strlen(THUMBNAIL_SOFTWARE)) == 0) {
+        own = TRUE;
+        break;
+      }
+      length = 0;
+    }
+    // Skips the rest of the chunk and its CRC.
+    if (fseek(file, (long)length + 4, SEEK_CUR) != 0) break;
+  }
+  fclose(file);
+  return own;
+}
+
+// Removes the thumbnails in |bucket| that were written by this plugin.
+static void disk_clear_bucket(ThumbnailCache* self, gint bucket) {
+  g_autofree gchar* dir_path =
+      g_build_filename(self->disk_root, kBuckets[bucket].name, nullptr);
+  GDir* dir = g_dir_open(dir_path, 0, nullptr);
+  if (dir == nullptr) {
+    return;
+  }
+
+  const gchar* name;
+  while ((name = g_dir_read_name(dir)) != nullptr) {
+    if (!g_str_has_suffix(name, ".png")) continue;
+    g_autofree gchar* path = g_build_filename(dir_path, name, nullptr);
+    if (disk_is_own_thumbnail(path)) g_unlink(path);
+  }
+  g_dir_close(dir);
+}
+
+void thumbnail_cache_clear(ThumbnailCache* self, gboolean include_disk) {
+  g_mutex_lock(&self->mutex);
+  g_queue_clear(&self->lru);
+  g_hash_table_remove_all(self->entries);
+  self->memory_bytes = 0;
+  self->memory_hits = 0;
+  self->disk_hits = 0;
+  self->misses = 0;
+  g_mutex_unlock(&self->mutex);
+
+  if (include_disk && self->disk_root != nullptr) {
+    for (gsize i = 0; i < G_N_ELEMENTS(kBuckets); i++) {
+      disk_clear_bucket(self, i);
+    }
+  }
+}
+
+void thumbnail_cache_get_stats(ThumbnailCache* self,
+                               ThumbnailCacheStats* stats) {
+  g_mutex_lock(&self->mutex);
+  stats->memory_hits = self->memory_hits;
+  stats->disk_hits = self->disk_hits;
+  stats->misses = self->misses;
+  stats->memory_bytes = self->memory_bytes;
+  stats->memory_entries = g_hash_table_size(self->entries);
+  g_mutex_unlock(&self->mutex);
+}
@@ -0,0 +1,84 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_CACHE_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_CACHE_H_
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Two-tier thumbnail cache.
+//
+// The first tier is an in-memory LRU of scaled pixbufs, bounded by the number
+// of pixel bytes it holds and keyed by (path, mtime, size, requested box), so
+// edits to a file never serve a stale thumbnail.
+//
+// The second tier is the shared freedesktop.org thumbnail store
+// ($XDG_CACHE_HOME/thumbnails/{normal,large,x-large,xx-large}). Entries are
+// validated against Thumb::URI and Thumb::MTime, which lets us reuse the
+// thumbnails other desktop applications (e.g. GNOME Files) already created.
+//
+// All functions are thread-safe.
+typedef struct _ThumbnailCache ThumbnailCache;
+
+typedef struct {
+  guint64 memory_hits;
+  guint64 disk_hits;
+  guint64 misses;
+  gsize memory_bytes;
+  guint memory_entries;
+} ThumbnailCacheStats;
+
+// Creates a cache whose memory tier holds at most |memory_budget| bytes of
+// pixel data.
+ThumbnailCache* thumbnail_cache_new(gsize memory_budget);
+
+void thumbnail_cache_free(ThumbnailCache* self);
+
+// Returns the size of the square box thumbnails for a |width|x|height|
+// request should be generated at. This is the matching freedesktop size
+// bucket when there is one, so that the result can also go to disk.
+gint thumbnail_cache_get_source_size(gint width, gint height);
+
+// Looks up a thumbnail of |path| fitting in |width|x|height|, first in memory
+// and then on disk. Returns a new reference, or NULL on a miss.
+GdkPixbuf* thumbnail_cache_lookup(ThumbnailCache* self,
+                                  const gchar* path,
+                                  gint width,
+                                  gint height);
+
+// Like thumbnail_cache_lookup(), but leaves the hit and miss counters alone,
+// so background work such as prefetching does not skew them.
+GdkPixbuf* thumbnail_cache_peek(ThumbnailCache* self,
+                                const gchar* path,
+                                gint width,
+                                gint height);
+
+// Stores |thumbnail|, generated at thumbnail_cache_get_source_size(), for a
+// |width|x|height| request. Writes it to the disk tier when it matches a
+// freedesktop bucket. Returns a new reference to the thumbnail scaled to fit
+// the requested box.
+GdkPixbuf* thumbnail_cache_insert(ThumbnailCache* self,
+                                  const gchar* path,
+                                  gint width,
+                                  gint height,
+                                  GdkPixbuf* thumbnail);
+
+// Like thumbnail_cache_insert(), but keeps |thumbnail| in the memory tier
+// only. Used for thumbnails below the freedesktop bucket size, such as
+// embedded EXIF previews, which must not be shared with other applications.
+GdkPixbuf* thumbnail_cache_insert_memory(ThumbnailCache* self,
+                                         const gchar* path,
+                                         gint width,
+                                         gint height,
+                                         GdkPixbuf* thumbnail);
+
+// Drops every entry from the memory tier and resets the counters. When
+// |include_disk| is TRUE, disk thumbnails written by this plugin are removed
+// as well; thumbnails created by other applications are left alone.
+void thumbnail_cache_clear(ThumbnailCache* self, gboolean include_disk);
+
+void thumbnail_cache_get_stats(ThumbnailCache* self,
+                               ThumbnailCacheStats* stats);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_CACHE_H_
@@ -0,0 +1,119 @@
+#include "thumbnail_encoder.h"
+
+#include "performance_stats.h"
+
+#define DEFAULT_QUALITY 85
+
+static const struct {
+  const gchar* name;
+  ThumbnailFormat format;
+} kFormats[] = {
+    {"png", THUMBNAIL_FORMAT_PNG},
+    {"raw", THUMBNAIL_FORMAT_RAW},
+    {"jpeg", THUMBNAIL_FORMAT_JPEG},
+    {"webp", THUMBNAIL_FORMAT_WEBP},
+};
+
+static const gchar* format_name(ThumbnailFormat format) {
+  for (gsize i = 0; i < G_N_ELEMENTS(kFormats); i++) {
+    if (kFormats[i].format == format) return kFormats[i].name;
+  }
+  return "png";
+}
+
+static gint lookup_int(FlValue* args, const gchar* key, gint fallback) {
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_INT) {
+    return fallback;
+  }
+  return fl_value_get_int(value);
+}
+
+gboolean thumbnail_options_parse(ThumbnailOptions* options,
+                                 FlValue* args,
+                                 gint default_size,
+                                 GError** error) {
+  options->width = default_size;
+  options->height = default_size;
+  options->format = THUMBNAIL_FORMAT_PNG;
+  options->quality = DEFAULT_QUALITY;
+  options->video_position_ms = -1;
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return TRUE;
+  }
+
+  gint width = lookup_int(args, "width", default_size);
+  gint height = lookup_int(args, "height", default_size);
+  options->width = width > 0 ? width : default_size;
+  options->height = height > 0 ? height : default_size;
+  options->quality = CLAMP(lookup_int(args, "quality", DEFAULT_QUALITY), 0, 100);
+  FlValue* position = fl_value_lookup_string(args, "videoPosition");
+  if (position != nullptr && fl_value_get_type(position) == FL_VALUE_TYPE_INT &&
+      fl_value_get_int(position) >= 0) {
+    options->video_position_ms = fl_value_get_int(position);
+  }
+
+  FlValue* format = fl_value_lookup_string(args, "format");
+  if (format == nullptr || fl_value_get_type(format) != FL_VALUE_TYPE_STRING) {
+    return TRUE;
+  }
+  for (gsize i = 0; i < G_N_ELEMENTS(kFormats); i++) {
+    if (g_strcmp0(fl_value_get_string(format), kFormats[i].name) == 0) {
+      options->format = kFormats[i].format;
+      return TRUE;
+    }
+  }
+  g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+              "Unsupported thumbnail format: %s", fl_value_get_string(format));
+  return FALSE;
+}
+
+gboolean thumbnail_encode(GdkPixbuf* thumbnail,
+                          const ThumbnailOptions* options,
+                          FlValue* result,
+                          GError** error) {
+  gint64 start = performance_stats_begin();
+  if (options->format == THUMBNAIL_FORMAT_RAW) {
+    // The last row of a pixbuf is not padded to the rowstride, so the byte
+    // length is what is actually allocated.
+    fl_value_set_string_take(
+        result, "data",
+        fl_value_new_uint8_list(gdk_pixbuf_read_pixels(thumbnail),
+                                gdk_pixbuf_get_byte_length(thumbnail)));
+    fl_value_set_string_take(result, "rowstride",
+                             fl_value_new_int(gdk_pixbuf_get_rowstride(thumbnail)));
+    fl_value_set_string_take(result, "channels",
+                             fl_value_new_int(gdk_pixbuf_get_n_channels(thumbnail)));
+  } else {
+    gchar* buffer = nullptr;
+    gsize buffer_size = 0;
+    gboolean saved;
+    if (options->format == THUMBNAIL_FORMAT_PNG) {
+      saved = gdk_pixbuf_save_to_buffer(thumbnail, &buffer, &buffer_size,
+                                        "png", error, nullptr);
+    } else {
+      // WebP needs webp-pixbuf-loader; without it this fails cleanly with an
+      // unknown-format error.
+      g_autofree gchar* quality = g_strdup_printf("%d", options->quality);
+      saved = gdk_pixbuf_save_to_buffer(thumbnail, &buffer, &buffer_size,
+                                        format_name(options->format), error,
+                                        "quality", quality, nullptr);
+    }
+    if (!saved) {
+      return FALSE;
+    }
+    fl_value_set_string_take(
+        result, "data",
+        fl_value_new_uint8_list((const uint8_t*)buffer, buffer_size));
+    g_free(buffer);
+  }
+  performance_stats_end_stage(PERFORMANCE_STAGE_ENCODE, start);
+
+  fl_value_set_string_take(result, "width",
+                           fl_value_new_int(gdk_pixbuf_get_width(thumbnail)));
+  fl_value_set_string_take(result, "height",
+                           fl_value_new_int(gdk_pixbuf_get_height(thumbnail)));
+  fl_value_set_string_take(result, "format",
+                           fl_value_new_string(format_name(options->format)));
+  return TRUE;
+}
@@ -0,0 +1,48 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_ENCODER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_ENCODER_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  // PNG, lossless. The default and the only format older clients know.
+  THUMBNAIL_FORMAT_PNG,
+  // Pixbuf pixels as-is with their rowstride and channel count. No encode
+  // step at all, so this is the cheapest format to produce and consume.
+  THUMBNAIL_FORMAT_RAW,
+  // Lossy formats that trade CPU for a smaller channel payload.
+  THUMBNAIL_FORMAT_JPEG,
+  THUMBNAIL_FORMAT_WEBP,
+} ThumbnailFormat;
+
+// How a thumbnail request should be produced and returned.
+typedef struct {
+  gint width;
+  gint height;
+  ThumbnailFormat format;
+  gint quality;  // 0-100, used by the lossy formats.
+  // Frame of a video to use, in milliseconds, or -1 for the default one.
+  gint64 video_position_ms;
+} ThumbnailOptions;
+
+// Reads the optional "width", "height", "format", "quality" and
+// "videoPosition" arguments from the |args| map, using a |default_size| box when no size is given.
+// Returns FALSE and sets |error| for an unknown format.
+gboolean thumbnail_options_parse(ThumbnailOptions* options,
+                                 FlValue* args,
+                                 gint default_size,
+                                 GError** error);
+
+// Stores |thumbnail| in the |result| map as "data" in the requested format,
+// together with "width", "height" and "format". Raw output additionally
+// carries "rowstride" and "channels".
+gboolean thumbnail_encode(GdkPixbuf* thumbnail,
+                          const ThumbnailOptions* options,
+                          FlValue* result,
+                          GError** error);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_ENCODER_H_
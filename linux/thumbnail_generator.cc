@@ -0,0 +1,338 @@
+#include "thumbnail_generator.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+#include "image_resampler.h"
+#include "media_exif.h"
+#include "media_video.h"
+#include "performance_stats.h"
+
+// Embedded previews are used down to this fraction of the requested box, so
+// the usual 160x120 EXIF thumbnail still serves a 200x200 album cover.
+#define PREVIEW_MIN_COVERAGE 0.75
+
+G_DEFINE_QUARK(thumbnail-generator-error-quark, thumbnail_generator_error)
+
+static const ThumbnailDecodeLimits kDefaultLimits = {
+    THUMBNAIL_DEFAULT_MAX_PIXELS, THUMBNAIL_DEFAULT_TIMEOUT_MS};
+
+// Whether a loader producing |width|x|height| pixels stays within |limits|.
+static gboolean within_pixel_budget(const ThumbnailDecodeLimits* limits,
+                                    int width,
+                                    int height) {
+  return limits->max_pixels == 0 ||
+         (guint64)width * (guint64)height <= limits->max_pixels;
+}
+
+// Makes the loader give up before allocating any pixels. Every loader
+// rejects a zero size from the size-prepared handler.
+static void cancel_decode(GdkPixbufLoader* loader) {
+  gdk_pixbuf_loader_set_size(loader, 0, 0);
+}
+
+// Returns |pixbuf| turned upright according to an EXIF |orientation|, taking
+// ownership of it. Mirrors gdk_pixbuf_apply_embedded_orientation().
+static GdkPixbuf* apply_orientation(GdkPixbuf* pixbuf, guint16 orientation) {
+  GdkPixbuf* rotated = nullptr;
+  switch (orientation) {
+    case 2:
+      rotated = gdk_pixbuf_flip(pixbuf, TRUE);
+      break;
+    case 3:
+      rotated = gdk_pixbuf_rotate_simple(pixbuf, GDK_PIXBUF_ROTATE_UPSIDEDOWN);
+      break;
+    case 4:
+      rotated = gdk_pixbuf_flip(pixbuf, FALSE);
+      break;
+    case 5:
+    case 7: {
+      g_autoptr(GdkPixbuf) turned =
+          gdk_pixbuf_rotate_simple(pixbuf, GDK_PIXBUF_ROTATE_CLOCKWISE);
+      rotated = gdk_pixbuf_flip(turned, orientation == 5);
+      break;
+    }
+    case 6:
+      rotated = gdk_pixbuf_rotate_simple(pixbuf, GDK_PIXBUF_ROTATE_CLOCKWISE);
+      break;
+    case 8:
+      rotated =
+          gdk_pixbuf_rotate_simple(pixbuf, GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE);
+      break;
+    default:
+      return pixbuf;
+  }
+  g_object_unref(pixbuf);
+  return rotated;
+}
+
+// Orientations 5-8 store the image transposed, so a box for the upright
+// image has its sides swapped in stored coordinates.
+static gboolean orientation_transposes(guint16 orientation) {
+  return orientation >= 5 && orientation <= 8;
+}
+
+// Has a JPEG loader decode a |source_width|x|source_height| image with the
+// largest libjpeg DCT reduction (1/2, 1/4 or 1/8) that still covers
+// |width|x|height| at the fitted scale. The size asked for is exactly what
+// libjpeg produces, so the loader has nothing left to scale and the rest of
+// the reduction is left to image_resample(). Returns whether the reduced
+// size is within |limits|; if not, the decode is cancelled instead.
+static gboolean set_jpeg_decode_size(GdkPixbufLoader* loader,
+                                     int source_width,
+                                     int source_height,
+                                     int width,
+                                     int height,
+                                     const ThumbnailDecodeLimits* limits) {
+  double scale = MIN((double)width / source_width,
+                     (double)height / source_height);
+  int denominator = 1;
+  while (denominator < 8 && scale * denominator * 2 <= 1.0) denominator *= 2;
+  int decode_width = (source_width + denominator - 1) / denominator;
+  int decode_height = (source_height + denominator - 1) / denominator;
+  if (!within_pixel_budget(limits, decode_width, decode_height)) {
+    cancel_decode(loader);
+    return FALSE;
+  }
+  if (denominator > 1) {
+    gdk_pixbuf_loader_set_size(loader, decode_width, decode_height);
+  }
+  return TRUE;
+}
+
+typedef struct {
+  int width;
+  int height;
+  double min_coverage;
+  const ThumbnailDecodeLimits* limits;
+  gboolean rejected;
+} PreviewFit;
+
+// Decides from the preview's header whether it is large enough and, if it
+// is larger than needed, has the loader reduce it while decoding.
+static void preview_size_prepared(GdkPixbufLoader* loader,
+                                  int width,
+                                  int height,
+                                  gpointer user_data) {
+  PreviewFit* fit = static_cast<PreviewFit*>(user_data);
+  double scale = MIN((double)fit->width / width, (double)fit->height / height);
+  if (scale * fit->min_coverage > 1.0) {
+    fit->rejected = TRUE;
+  } else if (!set_jpeg_decode_size(loader, width, height, fit->width,
+                                   fit->height, fit->limits)) {
+    fit->rejected = TRUE;
+  }
+}
+
+static GdkPixbuf* decode_preview(GBytes* bytes, PreviewFit* fit) {
+  g_autoptr(GdkPixbufLoader) loader =
+      gdk_pixbuf_loader_new_with_type("jpeg", nullptr);
+  if (loader == nullptr) return nullptr;
+  g_signal_connect(loader, "size-prepared", G_CALLBACK(preview_size_prepared),
+                   fit);
+
+  gsize length = 0;
+  const guchar* data =
+      static_cast<const guchar*>(g_bytes_get_data(bytes, &length));
+  gint64 start = performance_stats_begin();
+  gboolean written = gdk_pixbuf_loader_write(loader, data, length, nullptr);
+  gboolean closed = gdk_pixbuf_loader_close(loader, nullptr);
+  performance_stats_end_stage(PERFORMANCE_STAGE_DECODE, start);
+  if (!written || !closed || fit->rejected) return nullptr;
+
+  GdkPixbuf* pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+  return pixbuf != nullptr
+             ? image_resample_to_fit(pixbuf, fit->width, fit->height)
+             : nullptr;
+}
+
+GdkPixbuf* generate_thumbnail_from_preview(const gchar* file_path,
+                                           int width,
+                                           int height,
+                                           const ThumbnailDecodeLimits* limits) {
+  MediaExif exif;
+  if (!media_exif_read(file_path, &exif)) return nullptr;
+
+  PreviewFit fit = {width, height, PREVIEW_MIN_COVERAGE,
+                    limits != nullptr ? limits : &kDefaultLimits, FALSE};
+  if (orientation_transposes(exif.orientation)) {
+    fit.width = height;
+    fit.height = width;
+  }
+
+  // Smallest first, so the first preview that is large enough is also the
+  // cheapest to decode.
+  for (guint i = 0; i < exif.n_previews; i++) {
+    g_autoptr(GBytes) bytes =
+        media_exif_load_preview(file_path, &exif.previews[i]);
+    if (bytes == nullptr) continue;
+    fit.rejected = FALSE;
+    GdkPixbuf* pixbuf = decode_preview(bytes, &fit);
+    if (pixbuf != nullptr) return apply_orientation(pixbuf, exif.orientation);
+  }
+  return nullptr;
+}
+
+typedef struct {
+  int width;
+  int height;
+  const ThumbnailDecodeLimits* limits;
+  // The declared size, when it was over the pixel budget.
+  int rejected_width;
+  int rejected_height;
+  gboolean timed_out;
+} DecodeFit;
+
+// Decides how far the loader reduces the image while decoding, or cancels
+// the decode when even the reduced image is over the pixel budget or the
+// file took too long to read.
+static void decode_size_prepared(GdkPixbufLoader* loader,
+                                 int width,
+                                 int height,
+                                 gpointer user_data) {
+  DecodeFit* fit = static_cast<DecodeFit*>(user_data);
+  // Loaders that buffer the whole file only get here when closed.
+  if (fit->timed_out) {
+    cancel_decode(loader);
+    return;
+  }
+  GdkPixbufFormat* format = gdk_pixbuf_loader_get_format(loader);
+  g_autofree gchar* name =
+      format != nullptr ? gdk_pixbuf_format_get_name(format) : nullptr;
+  gboolean within_budget;
+  if (g_strcmp0(name, "jpeg") == 0) {
+    within_budget = set_jpeg_decode_size(loader, width, height, fit->width,
+                                         fit->height, fit->limits);
+  } else if (g_strcmp0(name, "svg") == 0) {
+    // Vector images are rendered straight at the fitted size.
+    double scale = MIN((double)fit->width / width, (double)fit->height / height);
+    gdk_pixbuf_loader_set_size(loader, MAX((int)(width * scale), 1),
+                               MAX((int)(height * scale), 1));
+    within_budget = TRUE;
+  } else {
+    within_budget = within_pixel_budget(fit->limits, width, height);
+    if (!within_budget) cancel_decode(loader);
+  }
+  if (!within_budget) {
+    fit->rejected_width = width;
+    fit->rejected_height = height;
+  }
+}
+
+// Decodes |file_path|, reduced while decoding where the format allows it
+// but never below what a |width|x|height| thumbnail needs.
+static GdkPixbuf* decode_for_box(const gchar* file_path,
+                                 int width,
+                                 int height,
+                                 const ThumbnailDecodeLimits* limits,
+                                 GError** error) {
+  FILE* file = g_fopen(file_path, "rb");
+  if (file == nullptr) {
+    int saved_errno = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "Failed to open %s: %s", file_path, g_strerror(saved_errno));
+    return nullptr;
+  }
+
+  DecodeFit fit = {width, height, limits, 0, 0, FALSE};
+  g_autoptr(GdkPixbufLoader) loader = gdk_pixbuf_loader_new();
+  g_signal_connect(loader, "size-prepared", G_CALLBACK(decode_size_prepared),
+                   &fit);
+  gint64 deadline = limits->timeout_ms > 0
+                        ? g_get_monotonic_time() + limits->timeout_ms * 1000
+                        : G_MAXINT64;
+  guchar buffer[65536];
+  g_autoptr(GError) load_error = nullptr;
+  gboolean written = TRUE;
+  size_t length;
+  while (written && (length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    written = gdk_pixbuf_loader_write(loader, buffer, length, &load_error);
+    if (written && g_get_monotonic_time() > deadline) {
+      fit.timed_out = TRUE;
+      break;
+    }
+  }
+  fclose(file);
+  // A loader must be closed before it is dropped. After a timeout, closing
+  // only ends what an incremental loader already decoded, and a buffering
+  // loader is cancelled from size-prepared before it decodes anything.
+  gboolean closed = gdk_pixbuf_loader_close(
+      loader, written && !fit.timed_out ? &load_error : nullptr);
+
+  // Cancelling makes the loader fail with its own message; report why.
+  if (fit.rejected_width > 0) {
+    g_set_error(error, THUMBNAIL_GENERATOR_ERROR,
+                THUMBNAIL_GENERATOR_ERROR_TOO_LARGE,
+                "%s is %dx%d, over the decode budget of %" G_GUINT64_FORMAT
+                " pixels",
+                file_path, fit.rejected_width, fit.rejected_height,
+                limits->max_pixels);
+    return nullptr;
+  }
+  if (fit.timed_out) {
+    g_set_error(error, THUMBNAIL_GENERATOR_ERROR,
+                THUMBNAIL_GENERATOR_ERROR_TIMED_OUT,
+                "Decoding %s took longer than %" G_GINT64_FORMAT " ms",
+                file_path, limits->timeout_ms);
+    return nullptr;
+  }
+  if (!written || !closed) {
+    g_propagate_error(error, g_steal_pointer(&load_error));
+    return nullptr;
+  }
+
+  GdkPixbuf* pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+  if (pixbuf == nullptr) {
+    g_set_error(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED,
+                "Failed to load image %s", file_path);
+    return nullptr;
+  }
+  return GDK_PIXBUF(g_object_ref(pixbuf));
+}
+
+GdkPixbuf* generate_thumbnail(const gchar* file_path,
+                              int width,
+                              int height,
+                              const ThumbnailDecodeLimits* limits,
+                              GError** error) {
+  // Validate input dimensions
+  if (width <= 0) width = 512;
+  if (height <= 0) height = 512;
+
+  gint64 start = performance_stats_begin();
+  if (media_video_is_video_file(file_path)) {
+    GdkPixbuf* frame =
+        media_video_extract_frame(file_path, width, height, -1, error);
+    performance_stats_end_stage(PERFORMANCE_STAGE_DECODE, start);
+    return frame;
+  }
+
+  // The image is fitted as stored and turned upright afterwards, so for
+  // orientations 5-8 the box has its sides swapped, as for previews.
+  MediaExif exif;
+  int box_width = width;
+  int box_height = height;
+  if (media_exif_read(file_path, &exif) &&
+      orientation_transposes(exif.orientation)) {
+    box_width = height;
+    box_height = width;
+  }
+
+  g_autoptr(GdkPixbuf) decoded =
+      decode_for_box(file_path, box_width, box_height,
+                     limits != nullptr ? limits : &kDefaultLimits, error);
+  performance_stats_end_stage(PERFORMANCE_STAGE_DECODE, start);
+  if (decoded == nullptr) {
+    return nullptr;
+  }
+  GdkPixbuf* pixbuf = image_resample_to_fit(decoded, box_width, box_height);
+  if (pixbuf != decoded) {
+    gdk_pixbuf_copy_options(decoded, pixbuf);
+  }
+
+  // Loaders record the EXIF orientation as the "orientation" option.
+  GdkPixbuf* upright = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+  g_object_unref(pixbuf);
+  return upright;
+}
@@ -0,0 +1,76 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_GENERATOR_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_GENERATOR_H_
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+#define THUMBNAIL_GENERATOR_ERROR thumbnail_generator_error_quark()
+
+typedef enum {
+  // The image would decode to more pixels than the budget allows.
+  THUMBNAIL_GENERATOR_ERROR_TOO_LARGE,
+  // Decoding took longer than the timeout.
+  THUMBNAIL_GENERATOR_ERROR_TIMED_OUT,
+} ThumbnailGeneratorError;
+
+GQuark thumbnail_generator_error_quark(void);
+
+// About 200 MB of RGBA, enough for a full-size 50 MP photo in a format that
+// cannot be reduced while decoding.
+#define THUMBNAIL_DEFAULT_MAX_PIXELS (50 * 1000 * 1000)
+#define THUMBNAIL_DEFAULT_TIMEOUT_MS 10000
+
+// Bounds on decoding one image; zero disables a bound. Pass NULL for the
+// defaults above.
+//
+// The pixel budget applies to the decoded size. It is checked when the
+// loader has read the declared dimensions from the header and before it
+// allocates any pixels, so a panorama or decompression bomb fails without
+// allocating. JPEGs count at their DCT-reduced size and SVGs at the
+// thumbnail size, since neither is decoded at full size.
+//
+// The timeout is checked between the reads that feed the loader, so it
+// bounds incremental loaders such as JPEG, PNG, GIF and WebP. Loaders that
+// buffer the whole file (TIFF, HEIF, AVIF) decode it in one go once it is
+// read: if reading timed out they are stopped before decoding, but a decode
+// that has started runs to the end, bounded only by the pixel budget.
+typedef struct {
+  guint64 max_pixels;
+  gint64 timeout_ms;
+} ThumbnailDecodeLimits;
+
+// Decodes |file_path| into a thumbnail that fits in |width|x|height| while
+// keeping the aspect ratio. Non-positive sizes default to 512; smaller
+// images are returned at their own size.
+//
+// JPEGs are reduced by libjpeg's DCT scaling while decoding, so peak memory
+// is bounded by the target size instead of the source resolution; the rest
+// of the reduction uses the area filter in image_resampler.h. Videos yield a
+// frame near MEDIA_VIDEO_DEFAULT_POSITION_MS, scaled by the decode pipeline.
+//
+// Images over |limits| fail with a THUMBNAIL_GENERATOR_ERROR.
+GdkPixbuf* generate_thumbnail(const gchar* file_path,
+                              int width,
+                              int height,
+                              const ThumbnailDecodeLimits* limits,
+                              GError** error);
+
+// Returns a thumbnail fitting in |width|x|height| decoded from a JPEG preview
+// embedded in the EXIF data of |file_path|, such as the EXIF thumbnail of a
+// camera JPEG or the previews of a RAW file. This reads a few KB instead of
+// the whole image. Returns NULL when there is no preview at least about as
+// large as the box, in which case the caller falls back to
+// generate_thumbnail(), or when the preview is over the pixel budget of
+// |limits|.
+//
+// Both functions return the image turned upright according to its EXIF
+// orientation.
+GdkPixbuf* generate_thumbnail_from_preview(const gchar* file_path,
+                                           int width,
+                                           int height,
+                                           const ThumbnailDecodeLimits* limits);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_GENERATOR_H_
@@ -0,0 +1,292 @@
+#include "thumbnail_prefetcher.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// How far ahead a scrolling grid is prefetched, as time at its current
+// speed, between one and THUMBNAIL_PREFETCH_MAX_SCREENS screens.
+#define THUMBNAIL_PREFETCH_LOOKAHEAD_SECONDS 1.0
+#define THUMBNAIL_PREFETCH_MAX_SCREENS 4
+
+// Below this many items per second the grid counts as at rest.
+#define THUMBNAIL_PREFETCH_IDLE_VELOCITY 1.0
+
+// Bytes of each source read ahead. Enough for a typical JPEG and for the
+// embedded previews of RAW files, without pulling in whole videos.
+#define THUMBNAIL_PREFETCH_READAHEAD_BYTES (16 * 1024 * 1024)
+
+// Prefetched paths remembered for counting hits.
+#define THUMBNAIL_PREFETCH_TRACKED_PATHS 1024
+
+// From linux/ioprio.h, which older kernel headers do not install.
+#define PREFETCH_IOPRIO_WHO_PROCESS 1
+#define PREFETCH_IOPRIO_CLASS_IDLE (3 << 13)
+
+struct _ThumbnailPrefetcher {
+  ThumbnailCache* cache;
+  ThumbnailPrefetchFunc func;
+  gpointer user_data;
+  GThread* thread;
+
+  GMutex mutex;
+  GCond cond;
+  gboolean stopping;
+  // Bumped by every new window; older windows stop at their next item.
+  guint generation;
+  GPtrArray* window;  // Not yet picked up by the thread, or NULL.
+  ThumbnailOptions options;
+  guint foreground;  // UI requests in progress.
+
+  // Paths of the current window not prefetched yet.
+  GHashTable* pending;
+  // Prefetched paths the UI has not asked for yet. The strings belong to
+  // |prefetched_order|, oldest first, which bounds how many are kept.
+  GHashTable* prefetched;
+  GQueue prefetched_order;
+  ThumbnailPrefetchStats stats;
+};
+
+guint thumbnail_prefetch_plan(guint first,
+                              guint last,
+                              gdouble velocity,
+                              guint n_items,
+                              guint* positions) {
+  if (n_items == 0 || first > last || first >= n_items) return 0;
+  last = MIN(last, n_items - 1);
+  guint screen = last - first + 1;
+
+  gdouble speed = fabs(velocity);
+  gboolean idle = speed < THUMBNAIL_PREFETCH_IDLE_VELOCITY;
+  gdouble lookahead =
+      CLAMP(speed * THUMBNAIL_PREFETCH_LOOKAHEAD_SECONDS, (gdouble)screen,
+            (gdouble)screen * THUMBNAIL_PREFETCH_MAX_SCREENS);
+  guint ahead = MIN((guint)lookahead, THUMBNAIL_PREFETCH_MAX_ITEMS);
+  guint behind = idle ? MIN(screen, THUMBNAIL_PREFETCH_MAX_ITEMS - ahead) : 0;
+
+  // A grid at rest is assumed to move on towards the end.
+  gboolean backward = velocity < 0 && !idle;
+  guint n_positions = 0;
+  for (guint i = 1; i <= ahead; i++) {
+    if (backward ? first < i : last + i >= n_items) break;
+    positions[n_positions++] = backward ? first - i : last + i;
+  }
+  for (guint i = 1; i <= behind; i++) {
+    if (backward ? last + i >= n_items : first < i) break;
+    positions[n_positions++] = backward ? last + i : first - i;
+  }
+  return n_positions;
+}
+
+// Runs the calling thread at the lowest CPU and I/O priority. Both apply
+// to the thread alone on Linux.
+static void prefetch_lower_priority() {
+  pid_t tid = syscall(SYS_gettid);
+  setpriority(PRIO_PROCESS, tid, 19);
+  syscall(SYS_ioprio_set, PREFETCH_IOPRIO_WHO_PROCESS, tid,
+          PREFETCH_IOPRIO_CLASS_IDLE);
+}
+
+// Asks the kernel to start reading the start of |path| in the background.
+static void prefetch_readahead(const gchar* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+  posix_fadvise(fd, 0, THUMBNAIL_PREFETCH_READAHEAD_BYTES,
+                POSIX_FADV_WILLNEED);
+  close(fd);
+}
+
+// Waits until no UI request is in progress. Returns FALSE if the window of
+// |generation| has been replaced meanwhile, or the prefetcher is stopping.
+static gboolean prefetch_wait_turn(ThumbnailPrefetcher* self,
+                                   guint generation) {
+  g_mutex_lock(&self->mutex);
+  while (self->foreground > 0 && !self->stopping &&
+         self->generation == generation) {
+    g_cond_wait(&self->cond, &self->mutex);
+  }
+  gboolean current = !self->stopping && self->generation == generation;
+  g_mutex_unlock(&self->mutex);
+  return current;
+}
+
+// Called with the mutex held.
+static void prefetch_track(ThumbnailPrefetcher* self, const gchar* path) {
+  if (g_hash_table_contains(self->prefetched, path)) return;
+  gchar* tracked = g_strdup(path);
+  g_hash_table_add(self->prefetched, tracked);
+  g_queue_push_tail(&self->prefetched_order, tracked);
+  while (self->prefetched_order.length > THUMBNAIL_PREFETCH_TRACKED_PATHS) {
+    gchar* oldest =
+        static_cast<gchar*>(g_queue_pop_head(&self->prefetched_order));
+    // A hit removes the path from the table only, and it may have been
+    // prefetched again since, under a newer string.
+    gpointer stored = nullptr;
+    if (g_hash_table_lookup_extended(self->prefetched, oldest, &stored,
+                                     nullptr) &&
+        stored == oldest) {
+      g_hash_table_remove(self->prefetched, oldest);
+    }
+    g_free(oldest);
+  }
+}
+
+// Called with the mutex held.
+static void prefetch_forget(ThumbnailPrefetcher* self) {
+  g_hash_table_remove_all(self->prefetched);
+  g_queue_clear_full(&self->prefetched_order, g_free);
+}
+
+// Prefetches |window| in order, keeping the sources of the next few misses
+// on their way in while one decodes.
+static void prefetch_window(ThumbnailPrefetcher* self,
+                            GPtrArray* window,
+                            guint generation,
+                            const ThumbnailOptions* options) {
+  g_autoptr(GArray) misses = g_array_new(FALSE, FALSE, sizeof(guint));
+  guint next_miss = 0;
+  guint next_check = 0;
+  while (TRUE) {
+    while (misses->len - next_miss < THUMBNAIL_PREFETCH_READAHEAD &&
+           next_check < window->len) {
+      if (!prefetch_wait_turn(self, generation)) return;
+      const gchar* path = static_cast<const gchar*>(window->pdata[next_check]);
+      // Also brings thumbnails from the disk tier into memory.
+      g_autoptr(GdkPixbuf) cached = thumbnail_cache_peek(
+          self->cache, path, options->width, options->height);
+      if (cached != nullptr) {
+        g_mutex_lock(&self->mutex);
+        self->stats.already_cached++;
+        g_hash_table_remove(self->pending, path);
+        g_mutex_unlock(&self->mutex);
+      } else {
+        prefetch_readahead(path);
+        g_array_append_val(misses, next_check);
+      }
+      next_check++;
+    }
+    if (next_miss == misses->len) return;
+
+    if (!prefetch_wait_turn(self, generation)) return;
+    const gchar* path = static_cast<const gchar*>(
+        window->pdata[g_array_index(misses, guint, next_miss++)]);
+    gboolean produced = self->func(path, options, self->user_data);
+    g_mutex_lock(&self->mutex);
+    g_hash_table_remove(self->pending, path);
+    if (produced) {
+      self->stats.prefetched++;
+      prefetch_track(self, path);
+    }
+    g_mutex_unlock(&self->mutex);
+  }
+}
+
+static gpointer prefetch_thread_run(gpointer data) {
+  ThumbnailPrefetcher* self = static_cast<ThumbnailPrefetcher*>(data);
+  prefetch_lower_priority();
+
+  g_mutex_lock(&self->mutex);
+  while (!self->stopping) {
+    if (self->window == nullptr) {
+      g_cond_wait(&self->cond, &self->mutex);
+      continue;
+    }
+    GPtrArray* window = self->window;
+    self->window = nullptr;
+    guint generation = self->generation;
+    ThumbnailOptions options = self->options;
+    g_mutex_unlock(&self->mutex);
+
+    prefetch_window(self, window, generation, &options);
+    g_ptr_array_unref(window);
+    g_mutex_lock(&self->mutex);
+  }
+  g_mutex_unlock(&self->mutex);
+  return nullptr;
+}
+
+ThumbnailPrefetcher* thumbnail_prefetcher_new(ThumbnailCache* cache,
+                                              ThumbnailPrefetchFunc func,
+                                              gpointer user_data) {
+  ThumbnailPrefetcher* self = g_new0(ThumbnailPrefetcher, 1);
+  self->cache = cache;
+  self->func = func;
+  self->user_data = user_data;
+  g_mutex_init(&self->mutex);
+  g_cond_init(&self->cond);
+  self->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        nullptr);
+  self->prefetched = g_hash_table_new(g_str_hash, g_str_equal);
+  g_queue_init(&self->prefetched_order);
+  self->thread =
+      g_thread_new("thumbnail-prefetch", prefetch_thread_run, self);
+  return self;
+}
+
+void thumbnail_prefetcher_free(ThumbnailPrefetcher* self) {
+  g_mutex_lock(&self->mutex);
+  self->stopping = TRUE;
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->mutex);
+  g_thread_join(self->thread);
+
+  g_clear_pointer(&self->window, g_ptr_array_unref);
+  g_hash_table_unref(self->pending);
+  prefetch_forget(self);
+  g_hash_table_unref(self->prefetched);
+  g_cond_clear(&self->cond);
+  g_mutex_clear(&self->mutex);
+  g_free(self);
+}
+
+void thumbnail_prefetcher_set_window(ThumbnailPrefetcher* self,
+                                     GPtrArray* paths,
+                                     const ThumbnailOptions* options) {
+  g_mutex_lock(&self->mutex);
+  self->stats.cancelled += g_hash_table_size(self->pending);
+  g_hash_table_remove_all(self->pending);
+  for (guint i = 0; i < paths->len; i++) {
+    g_hash_table_add(self->pending,
+                     g_strdup(static_cast<const gchar*>(paths->pdata[i])));
+  }
+  g_clear_pointer(&self->window, g_ptr_array_unref);
+  self->window = paths;
+  self->options = *options;
+  self->generation++;
+  g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->mutex);
+}
+
+void thumbnail_prefetcher_begin_request(ThumbnailPrefetcher* self,
+                                        const gchar* path) {
+  g_mutex_lock(&self->mutex);
+  self->foreground++;
+  if (g_hash_table_remove(self->prefetched, path)) {
+    self->stats.hits++;
+  } else if (g_hash_table_contains(self->pending, path)) {
+    self->stats.late++;
+  }
+  g_mutex_unlock(&self->mutex);
+}
+
+void thumbnail_prefetcher_end_request(ThumbnailPrefetcher* self) {
+  g_mutex_lock(&self->mutex);
+  if (--self->foreground == 0) g_cond_broadcast(&self->cond);
+  g_mutex_unlock(&self->mutex);
+}
+
+void thumbnail_prefetcher_clear(ThumbnailPrefetcher* self) {
+  g_mutex_lock(&self->mutex);
+  prefetch_forget(self);
+  self->stats = {};
+  g_mutex_unlock(&self->mutex);
+}
+
+void thumbnail_prefetcher_get_stats(ThumbnailPrefetcher* self,
+                                    ThumbnailPrefetchStats* stats) {
+  g_mutex_lock(&self->mutex);
+  *stats = self->stats;
+  g_mutex_unlock(&self->mutex);
+}
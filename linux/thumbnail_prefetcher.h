@@ -0,0 +1,97 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_PREFETCHER_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_PREFETCHER_H_
+
+#include <glib.h>
+
+#include "thumbnail_cache.h"
+#include "thumbnail_encoder.h"
+
+G_BEGIN_DECLS
+
+// Scroll-aware thumbnail prefetching.
+//
+// A grid reports the items it shows and how fast it scrolls, and the
+// prefetcher fills the thumbnail cache for the next screens in the scroll
+// direction on a background thread, so a fling lands on cells that are
+// ready. The sources of the next few items are read ahead with
+// posix_fadvise() while the current one decodes, which overlaps disk or
+// network reads with decoding.
+//
+// Prefetching always yields to thumbnails the UI asks for: it pauses between
+// items while any are being produced, and its thread runs at the lowest CPU
+// and I/O priority, so a decode it has already started does not compete
+// with them either.
+typedef struct _ThumbnailPrefetcher ThumbnailPrefetcher;
+
+// Most items prefetched for one viewport, so the memory tier keeps the
+// thumbnails on screen.
+#define THUMBNAIL_PREFETCH_MAX_ITEMS 96
+
+// Items ahead of the one decoding whose sources are being read ahead.
+#define THUMBNAIL_PREFETCH_READAHEAD 8
+
+typedef struct {
+  // Thumbnails generated ahead of the UI.
+  guint64 prefetched;
+  // Of those, how many the UI then asked for.
+  guint64 hits;
+  // UI requests for items still waiting to be prefetched.
+  guint64 late;
+  // Items found in the cache already, which needed no work.
+  guint64 already_cached;
+  // Items dropped because the viewport moved on first.
+  guint64 cancelled;
+} ThumbnailPrefetchStats;
+
+// Generates the thumbnail of |path| as described by |options| and stores it
+// in the cache. Returns FALSE if it could not be produced. Runs on the
+// prefetch thread.
+typedef gboolean (*ThumbnailPrefetchFunc)(const gchar* path,
+                                          const ThumbnailOptions* options,
+                                          gpointer user_data);
+
+// Fills |positions|, which must hold THUMBNAIL_PREFETCH_MAX_ITEMS entries,
+// with the positions worth prefetching while a grid of |n_items| shows
+// |first| to |last| and scrolls at |velocity| items per second, positive
+// towards higher positions. They run nearest first in the scroll
+// direction, which looks further ahead the faster it scrolls; a grid at
+// rest gets a screen on either side. Returns the number of positions.
+guint thumbnail_prefetch_plan(guint first,
+                              guint last,
+                              gdouble velocity,
+                              guint n_items,
+                              guint* positions);
+
+// Starts the prefetch thread, which finds cached thumbnails in |cache| and
+// has |func| produce the rest.
+ThumbnailPrefetcher* thumbnail_prefetcher_new(ThumbnailCache* cache,
+                                              ThumbnailPrefetchFunc func,
+                                              gpointer user_data);
+
+// Stops prefetching, waiting for an item in progress.
+void thumbnail_prefetcher_free(ThumbnailPrefetcher* self);
+
+// Replaces what is being prefetched with the source files |paths|, in the
+// order given, taking ownership of the array. Items of the previous window
+// that have not started are dropped.
+void thumbnail_prefetcher_set_window(ThumbnailPrefetcher* self,
+                                     GPtrArray* paths,
+                                     const ThumbnailOptions* options);
+
+// Bracket the production of a thumbnail the UI asked for. Prefetching waits
+// until no such request is in progress. |path| is checked against what was
+// prefetched, for the statistics.
+void thumbnail_prefetcher_begin_request(ThumbnailPrefetcher* self,
+                                        const gchar* path);
+void thumbnail_prefetcher_end_request(ThumbnailPrefetcher* self);
+
+// Forgets what was prefetched and resets the counters, for when the cache
+// is cleared.
+void thumbnail_prefetcher_clear(ThumbnailPrefetcher* self);
+
+void thumbnail_prefetcher_get_stats(ThumbnailPrefetcher* self,
+                                    ThumbnailPrefetchStats* stats);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_PREFETCHER_H_
@@ -0,0 +1,203 @@
+#include "thumbnail_queue.h"
+
+#include "performance_stats.h"
+
+typedef struct {
+  GCancellable* cancellable;
+  guint pending;
+} QueueToken;
+
+struct _ThumbnailQueue {
+  GObject* owner;  // Not owned; each queued job holds its own reference.
+  FlEventChannel* channel;
+  ThumbnailQueueFunc func;
+  GMainContext* context;
+  GThreadPool* pool;
+  PerformanceQueue* queue_stats;
+
+  GMutex mutex;
+  GHashTable* tokens;  // gchar* token -> QueueToken*
+  guint64 next_sequence;
+};
+
+typedef struct {
+  ThumbnailQueue* queue;
+  GObject* owner;
+  GCancellable* cancellable;
+  gchar* token;
+  gchar* media_id;
+  ThumbnailOptions options;
+  gint priority;
+  guint64 sequence;
+
+  // Set on the worker thread, sent on the main context.
+  FlValue* event;
+  FlValue* done_event;
+} QueueJob;
+
+static void queue_token_free(gpointer data) {
+  QueueToken* token = static_cast<QueueToken*>(data);
+  g_object_unref(token->cancellable);
+  g_free(token);
+}
+
+static void queue_job_free(gpointer data) {
+  QueueJob* job = static_cast<QueueJob*>(data);
+  g_clear_pointer(&job->event, fl_value_unref);
+  g_clear_pointer(&job->done_event, fl_value_unref);
+  g_object_unref(job->cancellable);
+  g_object_unref(job->owner);
+  g_free(job->token);
+  g_free(job->media_id);
+  g_free(job);
+}
+
+// Higher priority first; equal priorities keep submission order.
+static gint queue_job_compare(gconstpointer a,
+                              gconstpointer b,
+                              gpointer user_data) {
+  const QueueJob* job_a = static_cast<const QueueJob*>(a);
+  const QueueJob* job_b = static_cast<const QueueJob*>(b);
+  if (job_a->priority != job_b->priority) {
+    return job_a->priority > job_b->priority ? -1 : 1;
+  }
+  return job_a->sequence < job_b->sequence ? -1 : 1;
+}
+
+// Runs on the queue's main context.
+static gboolean queue_job_deliver(gpointer data) {
+  QueueJob* job = static_cast<QueueJob*>(data);
+  if (job->event != nullptr) {
+    fl_event_channel_send(job->queue->channel, job->event, nullptr, nullptr);
+  }
+  if (job->done_event != nullptr) {
+    fl_event_channel_send(job->queue->channel, job->done_event, nullptr,
+                          nullptr);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+// Runs on a worker thread.
+static void queue_job_run(gpointer data, gpointer user_data) {
+  QueueJob* job = static_cast<QueueJob*>(data);
+  ThumbnailQueue* self = job->queue;
+  if (performance_stats_get_enabled()) {
+    performance_stats_sample_queue(self->queue_stats,
+                                   g_thread_pool_unprocessed(self->pool));
+  }
+
+  if (!g_cancellable_is_cancelled(job->cancellable)) {
+    job->event = fl_value_new_map();
+    fl_value_set_string_take(job->event, "token",
+                             fl_value_new_string(job->token));
+    fl_value_set_string_take(job->event, "mediaId",
+                             fl_value_new_string(job->media_id));
+    self->func(job->media_id, &job->options, job->event, job->owner);
+  }
+
+  g_mutex_lock(&self->mutex);
+  QueueToken* token =
+      static_cast<QueueToken*>(g_hash_table_lookup(self->tokens, job->token));
+  // A token pushed again after being cancelled gets a fresh cancellable, so
+  // only count down the state this job was queued under.
+  if (token != nullptr && token->cancellable == job->cancellable &&
+      --token->pending == 0) {
+    g_hash_table_remove(self->tokens, job->token);
+    job->done_event = fl_value_new_map();
+    fl_value_set_string_take(job->done_event, "token",
+                             fl_value_new_string(job->token));
+    fl_value_set_string_take(job->done_event, "done", fl_value_new_bool(true));
+  }
+  g_mutex_unlock(&self->mutex);
+
+  // Always hop to the main context, even for dropped jobs, so the owner
+  // reference is released there.
+  g_main_context_invoke_full(self->context, G_PRIORITY_DEFAULT,
+                             queue_job_deliver, job, queue_job_free);
+}
+
+ThumbnailQueue* thumbnail_queue_new(GObject* owner,
+                                    FlEventChannel* channel,
+                                    ThumbnailQueueFunc func,
+                                    gint max_threads) {
+  ThumbnailQueue* self = g_new0(ThumbnailQueue, 1);
+  self->owner = owner;
+  self->channel = channel;
+  self->func = func;
+  self->context = g_main_context_ref_thread_default();
+  g_mutex_init(&self->mutex);
+  self->tokens = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                       queue_token_free);
+  self->pool = g_thread_pool_new(queue_job_run, self, MAX(max_threads, 1),
+                                 FALSE, nullptr);
+  g_thread_pool_set_sort_function(self->pool, queue_job_compare, nullptr);
+  self->queue_stats = performance_stats_register_queue("getThumbnails");
+  return self;
+}
+
+guint thumbnail_queue_push(ThumbnailQueue* self,
+                           const gchar* token,
+                           FlValue* media_ids,
+                           const ThumbnailOptions* options,
+                           gint priority) {
+  if (media_ids == nullptr || fl_value_get_type(media_ids) != FL_VALUE_TYPE_LIST) {
+    return 0;
+  }
+
+  g_mutex_lock(&self->mutex);
+  QueueToken* state =
+      static_cast<QueueToken*>(g_hash_table_lookup(self->tokens, token));
+  if (state == nullptr || g_cancellable_is_cancelled(state->cancellable)) {
+    state = g_new0(QueueToken, 1);
+    state->cancellable = g_cancellable_new();
+    g_hash_table_replace(self->tokens, g_strdup(token), state);
+  }
+
+  guint queued = 0;
+  for (size_t i = 0; i < fl_value_get_length(media_ids); i++) {
+    FlValue* media_id = fl_value_get_list_value(media_ids, i);
+    if (fl_value_get_type(media_id) != FL_VALUE_TYPE_STRING) continue;
+
+    QueueJob* job = g_new0(QueueJob, 1);
+    job->queue = self;
+    job->owner = G_OBJECT(g_object_ref(self->owner));
+    job->cancellable = G_CANCELLABLE(g_object_ref(state->cancellable));
+    job->token = g_strdup(token);
+    job->media_id = g_strdup(fl_value_get_string(media_id));
+    job->options = *options;
+    job->priority = priority;
+    job->sequence = self->next_sequence++;
+    state->pending++;
+    queued++;
+    g_thread_pool_push(self->pool, job, nullptr);
+  }
+
+  if (state->pending == 0) {
+    g_hash_table_remove(self->tokens, token);
+  }
+  g_mutex_unlock(&self->mutex);
+  if (performance_stats_get_enabled()) {
+    performance_stats_sample_queue(self->queue_stats,
+                                   g_thread_pool_unprocessed(self->pool));
+  }
+  return queued;
+}
+
+gboolean thumbnail_queue_cancel(ThumbnailQueue* self, const gchar* token) {
+  g_mutex_lock(&self->mutex);
+  QueueToken* state =
+      static_cast<QueueToken*>(g_hash_table_lookup(self->tokens, token));
+  if (state != nullptr) {
+    g_cancellable_cancel(state->cancellable);
+  }
+  g_mutex_unlock(&self->mutex);
+  return state != nullptr;
+}
+
+void thumbnail_queue_free(ThumbnailQueue* self) {
+  g_thread_pool_free(self->pool, FALSE, TRUE);
+  g_hash_table_unref(self->tokens);
+  g_mutex_clear(&self->mutex);
+  g_main_context_unref(self->context);
+  g_free(self);
+}
@@ -0,0 +1,51 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_QUEUE_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_QUEUE_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include "thumbnail_encoder.h"
+
+// Prioritised, cancellable queue for batched thumbnail requests.
+//
+// A batch of media IDs is queued under a caller-chosen token. Jobs run on a
+// worker pool ordered by priority (highest first, then FIFO), and each result
+// is sent over an event channel as soon as it is ready rather than when the
+// whole batch is done. Cancelling a token drops its queued jobs before they
+// start. Once every job of a token has finished or been dropped, a final
+// {token, done: true} event is sent.
+typedef struct _ThumbnailQueue ThumbnailQueue;
+
+// Fills |event| with the result for |media_id| produced as described by
+// |options|, e.g. "data", "width" and "height", or "error" on failure. Runs on a worker thread. |user_data| is
+// the queue owner.
+typedef void (*ThumbnailQueueFunc)(const gchar* media_id,
+                                   const ThumbnailOptions* options,
+                                   FlValue* event,
+                                   gpointer user_data);
+
+// Creates a queue running at most |max_threads| jobs at once. Events are sent
+// on |channel| from the thread-default main context. |owner| is passed to
+// |func| and kept alive while jobs are queued; it must also keep |channel|
+// alive.
+ThumbnailQueue* thumbnail_queue_new(GObject* owner,
+                                    FlEventChannel* channel,
+                                    ThumbnailQueueFunc func,
+                                    gint max_threads);
+
+// Queues one job per string in the |media_ids| list under |token|, each
+// producing a thumbnail as described by |options|. Returns the number of jobs
+// queued.
+guint thumbnail_queue_push(ThumbnailQueue* self,
+                           const gchar* token,
+                           FlValue* media_ids,
+                           const ThumbnailOptions* options,
+                           gint priority);
+
+// Drops the jobs of |token| that have not started yet. Returns FALSE if the
+// token has no pending jobs.
+gboolean thumbnail_queue_cancel(ThumbnailQueue* self, const gchar* token);
+
+// Waits for running jobs to finish and releases the queue.
+void thumbnail_queue_free(ThumbnailQueue* self);
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_QUEUE_H_
@@ -0,0 +1,209 @@
+#include "thumbnail_texture_pool.h"
+
+G_DECLARE_FINAL_TYPE(PoolTexture,
+                     pool_texture,
+                     POOL,
+                     TEXTURE,
+                     FlPixelBufferTexture)
+
+struct _PoolTexture {
+  FlPixelBufferTexture parent_instance;
+
+  GMutex mutex;
+  // Pixels shown the next time the engine copies the texture.
+  GdkPixbuf* pixbuf;
+  // Pixels last handed to the engine. Only touched on the raster thread and
+  // kept alive until the next copy, since the engine reads them after
+  // copy_pixels returns.
+  GdkPixbuf* displayed;
+
+  // Guarded by the pool mutex.
+  gsize bytes;
+};
+
+G_DEFINE_TYPE(PoolTexture, pool_texture, fl_pixel_buffer_texture_get_type())
+
+static gboolean pool_texture_copy_pixels(FlPixelBufferTexture* texture,
+                                         const uint8_t** out_buffer,
+                                         uint32_t* width,
+                                         uint32_t* height,
+                                         GError** error) {
+  PoolTexture* self = POOL_TEXTURE(texture);
+  g_mutex_lock(&self->mutex);
+  g_clear_object(&self->displayed);
+  if (self->pixbuf != nullptr) {
+    self->displayed = GDK_PIXBUF(g_object_ref(self->pixbuf));
+  }
+  g_mutex_unlock(&self->mutex);
+
+  if (self->displayed == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+                "Texture has no pixels");
+    return FALSE;
+  }
+  *out_buffer = gdk_pixbuf_read_pixels(self->displayed);
+  *width = gdk_pixbuf_get_width(self->displayed);
+  *height = gdk_pixbuf_get_height(self->displayed);
+  return TRUE;
+}
+
+static void pool_texture_dispose(GObject* object) {
+  PoolTexture* self = POOL_TEXTURE(object);
+  g_clear_object(&self->pixbuf);
+  g_clear_object(&self->displayed);
+  G_OBJECT_CLASS(pool_texture_parent_class)->dispose(object);
+}
+
+static void pool_texture_finalize(GObject* object) {
+  g_mutex_clear(&POOL_TEXTURE(object)->mutex);
+  G_OBJECT_CLASS(pool_texture_parent_class)->finalize(object);
+}
+
+static void pool_texture_class_init(PoolTextureClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = pool_texture_dispose;
+  G_OBJECT_CLASS(klass)->finalize = pool_texture_finalize;
+  FL_PIXEL_BUFFER_TEXTURE_CLASS(klass)->copy_pixels = pool_texture_copy_pixels;
+}
+
+static void pool_texture_init(PoolTexture* self) {
+  g_mutex_init(&self->mutex);
+}
+
+static void pool_texture_set_pixbuf(PoolTexture* self, GdkPixbuf* pixbuf) {
+  g_mutex_lock(&self->mutex);
+  g_set_object(&self->pixbuf, pixbuf);
+  g_mutex_unlock(&self->mutex);
+}
+
+struct _ThumbnailTexturePool {
+  GMutex mutex;
+  FlTextureRegistrar* registrar;
+  gsize memory_budget;
+  gsize memory_bytes;
+  GHashTable* in_use;  // gint64* texture ID -> PoolTexture*
+  GQueue idle;         // PoolTexture*, least recently released first.
+};
+
+G_DEFINE_QUARK(thumbnail-texture-pool-error-quark, thumbnail_texture_pool_error)
+
+// Returns |pixbuf| as tightly packed 8-bit RGBA, which is the only layout
+// pixel buffer textures accept.
+static GdkPixbuf* to_rgba(GdkPixbuf* pixbuf) {
+  if (gdk_pixbuf_get_has_alpha(pixbuf) &&
+      gdk_pixbuf_get_rowstride(pixbuf) == gdk_pixbuf_get_width(pixbuf) * 4) {
+    return GDK_PIXBUF(g_object_ref(pixbuf));
+  }
+  return gdk_pixbuf_add_alpha(pixbuf, FALSE, 0, 0, 0);
+}
+
+// Called with the pool mutex held.
+static void pool_discard(ThumbnailTexturePool* self, PoolTexture* texture) {
+  fl_texture_registrar_unregister_texture(self->registrar, FL_TEXTURE(texture));
+  self->memory_bytes -= texture->bytes;
+  g_object_unref(texture);
+}
+
+ThumbnailTexturePool* thumbnail_texture_pool_new(FlTextureRegistrar* registrar,
+                                                 gsize memory_budget) {
+  ThumbnailTexturePool* self = g_new0(ThumbnailTexturePool, 1);
+  g_mutex_init(&self->mutex);
+  self->registrar = FL_TEXTURE_REGISTRAR(g_object_ref(registrar));
+  self->memory_budget = memory_budget;
+  self->in_use = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                       nullptr);
+  g_queue_init(&self->idle);
+  return self;
+}
+
+gint64 thumbnail_texture_pool_acquire(ThumbnailTexturePool* self,
+                                      GdkPixbuf* pixbuf,
+                                      GError** error) {
+  g_autoptr(GdkPixbuf) rgba = to_rgba(pixbuf);
+  gsize bytes = gdk_pixbuf_get_byte_length(rgba);
+
+  g_mutex_lock(&self->mutex);
+  // Reuse the idle texture that has been unused the longest, then make room
+  // by dropping further idle textures.
+  PoolTexture* texture = static_cast<PoolTexture*>(g_queue_pop_head(&self->idle));
+  if (texture != nullptr) {
+    self->memory_bytes -= texture->bytes;
+    texture->bytes = 0;
+  }
+  while (self->memory_bytes + bytes > self->memory_budget &&
+         !g_queue_is_empty(&self->idle)) {
+    pool_discard(self, static_cast<PoolTexture*>(g_queue_pop_head(&self->idle)));
+  }
+  if (self->memory_bytes + bytes > self->memory_budget) {
+    if (texture != nullptr) pool_discard(self, texture);
+    g_mutex_unlock(&self->mutex);
+    g_set_error(error, THUMBNAIL_TEXTURE_POOL_ERROR,
+                THUMBNAIL_TEXTURE_POOL_ERROR_BUDGET_EXCEEDED,
+                "Texture memory budget of %" G_GSIZE_FORMAT " bytes exceeded",
+                self->memory_budget);
+    return -1;
+  }
+
+  if (texture == nullptr) {
+    texture = POOL_TEXTURE(g_object_new(pool_texture_get_type(), nullptr));
+    if (!fl_texture_registrar_register_texture(self->registrar,
+                                               FL_TEXTURE(texture))) {
+      g_object_unref(texture);
+      g_mutex_unlock(&self->mutex);
+      g_set_error(error, THUMBNAIL_TEXTURE_POOL_ERROR,
+                  THUMBNAIL_TEXTURE_POOL_ERROR_REGISTRATION_FAILED,
+                  "Failed to register texture");
+      return -1;
+    }
+  }
+
+  pool_texture_set_pixbuf(texture, rgba);
+  texture->bytes = bytes;
+  self->memory_bytes += bytes;
+  fl_texture_registrar_mark_texture_frame_available(self->registrar,
+                                                    FL_TEXTURE(texture));
+
+  gint64 texture_id = fl_texture_get_id(FL_TEXTURE(texture));
+  gint64* key = g_new(gint64, 1);
+  *key = texture_id;
+  g_hash_table_insert(self->in_use, key, texture);
+  g_mutex_unlock(&self->mutex);
+  return texture_id;
+}
+
+gboolean thumbnail_texture_pool_release(ThumbnailTexturePool* self,
+                                        gint64 texture_id) {
+  g_mutex_lock(&self->mutex);
+  gpointer key = nullptr;
+  gpointer texture = nullptr;
+  gboolean found = g_hash_table_steal_extended(self->in_use, &texture_id, &key,
+                                               &texture);
+  if (found) {
+    g_free(key);
+    g_queue_push_tail(&self->idle, texture);
+  }
+  g_mutex_unlock(&self->mutex);
+  return found;
+}
+
+gsize thumbnail_texture_pool_get_memory_bytes(ThumbnailTexturePool* self) {
+  g_mutex_lock(&self->mutex);
+  gsize bytes = self->memory_bytes;
+  g_mutex_unlock(&self->mutex);
+  return bytes;
+}
+
+void thumbnail_texture_pool_free(ThumbnailTexturePool* self) {
+  GHashTableIter iter;
+  gpointer texture;
+  g_hash_table_iter_init(&iter, self->in_use);
+  while (g_hash_table_iter_next(&iter, nullptr, &texture)) {
+    pool_discard(self, static_cast<PoolTexture*>(texture));
+  }
+  while (!g_queue_is_empty(&self->idle)) {
+    pool_discard(self, static_cast<PoolTexture*>(g_queue_pop_head(&self->idle)));
+  }
+  g_hash_table_unref(self->in_use);
+  g_object_unref(self->registrar);
+  g_mutex_clear(&self->mutex);
+  g_free(self);
+}
@@ -0,0 +1,53 @@
+#ifndef FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_TEXTURE_POOL_H_
+#define FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_TEXTURE_POOL_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+// Pool of pixel buffer textures that hand decoded thumbnails to the engine
+// without copying them through the method channel.
+//
+// Each acquired texture shows one thumbnail until it is released. Released
+// textures stay registered and are reused by later acquires, so a scrolling
+// grid recycles a steady set of texture IDs. The pixel memory held by all
+// textures, in use or idle, is kept under a budget by unregistering the
+// least recently released idle textures. All functions are thread-safe.
+typedef struct _ThumbnailTexturePool ThumbnailTexturePool;
+
+#define THUMBNAIL_TEXTURE_POOL_ERROR thumbnail_texture_pool_error_quark()
+
+typedef enum {
+  // The textures in use already hold the whole memory budget.
+  THUMBNAIL_TEXTURE_POOL_ERROR_BUDGET_EXCEEDED,
+  THUMBNAIL_TEXTURE_POOL_ERROR_REGISTRATION_FAILED,
+} ThumbnailTexturePoolError;
+
+GQuark thumbnail_texture_pool_error_quark(void);
+
+// Creates a pool registering textures with |registrar| and holding at most
+// |memory_budget| bytes of pixels.
+ThumbnailTexturePool* thumbnail_texture_pool_new(FlTextureRegistrar* registrar,
+                                                 gsize memory_budget);
+
+// Shows |pixbuf| in a pooled texture and returns its ID, or -1 with |error|
+// set. The texture stays in use until released.
+gint64 thumbnail_texture_pool_acquire(ThumbnailTexturePool* self,
+                                      GdkPixbuf* pixbuf,
+                                      GError** error);
+
+// Returns the texture |texture_id| to the pool. Returns FALSE if it is not
+// in use.
+gboolean thumbnail_texture_pool_release(ThumbnailTexturePool* self,
+                                        gint64 texture_id);
+
+// Returns the pixel bytes held by in-use and idle textures.
+gsize thumbnail_texture_pool_get_memory_bytes(ThumbnailTexturePool* self);
+
+// Unregisters every texture and releases the pool.
+void thumbnail_texture_pool_free(ThumbnailTexturePool* self);
+
+G_END_DECLS
+
+#endif  // FLUTTER_PLUGIN_PHOTO_GALLERY_PRO_THUMBNAIL_TEXTURE_POOL_H_
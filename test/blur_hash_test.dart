@@ -0,0 +1,25 @@
+import 'package:flutter_test/flutter_test.dart';
+import 'package:photo_gallery_pro/photo_gallery_pro.dart';
+
+void main() {
+  test('decodes the average colour', () {
+    // One component, #ff0000
+    final pixels = BlurHash.decode('00TI:j', 4, 3);
+    expect(pixels.length, 4 * 3 * 4);
+    for (var i = 0; i < pixels.length; i += 4) {
+      expect(pixels.sublist(i, i + 4), [255, 0, 0, 255]);
+    }
+  });
+
+  test('decodes every component', () {
+    final pixels = BlurHash.decode('LEHV6nWB2yk8pyo0adR*.7kCMdnj', 32, 32);
+    expect(pixels.length, 32 * 32 * 4);
+    expect(pixels.sublist(0, 4), isNot(pixels.sublist(pixels.length - 4)));
+  });
+
+  test('rejects malformed hashes', () {
+    expect(() => BlurHash.decode('L0', 4, 4), throwsFormatException);
+    expect(() => BlurHash.decode('LEHV6nWB2yk8', 4, 4), throwsFormatException);
+    expect(() => BlurHash.decode('00TI:"', 4, 4), throwsFormatException);
+  });
+}
@@ -0,0 +1,177 @@
+import 'dart:convert';
+import 'dart:typed_data';
+
+import 'package:flutter_test/flutter_test.dart';
+import 'package:photo_gallery_pro/photo_gallery_pro.dart';
+
+class _Item {
+  final String path;
+  final int nameOffset;
+  final int size;
+  final int dateAdded;
+  final int dateTaken;
+  final int width;
+  final int height;
+  final int duration;
+  final double latitude;
+  final double longitude;
+  final String? cameraModel;
+  final String? placeholder;
+  final int kind;
+  final int orientation;
+
+  const _Item(
+    this.path,
+    this.nameOffset, {
+    this.size = 0,
+    this.dateAdded = 0,
+    this.dateTaken = 0,
+    this.width = 0,
+    this.height = 0,
+    this.duration = 0,
+    this.latitude = double.nan,
+    this.longitude = double.nan,
+    this.cameraModel,
+    this.placeholder,
+    this.kind = 1,
+    this.orientation = 0,
+  });
+}
+
+// Lays items out the way the Linux plugin's packed encoding does.
+Uint8List _pack(List<_Item> items) {
+  final n = items.length;
+  final strings = BytesBuilder();
+  final pathOffsets = <int>[];
+  final cameraOffsets = <int>[];
+  final placeholderOffsets = <int>[];
+  for (final item in items) {
+    pathOffsets.add(strings.length);
+    strings.add(utf8.encode(item.path));
+    placeholderOffsets.add(strings.length);
+    if (item.placeholder != null) strings.add(utf8.encode(item.placeholder!));
+    cameraOffsets.add(strings.length);
+    if (item.cameraModel != null) strings.add(utf8.encode(item.cameraModel!));
+  }
+  final stringsOffset = 32 + n * 96;
+  final data = ByteData(stringsOffset + strings.length);
+  data.setUint32(0, 0x4c4d4750, Endian.little);
+  data.setUint32(4, 2, Endian.little);
+  data.setUint32(8, n, Endian.little);
+  data.setUint32(12, stringsOffset, Endian.little);
+  data.setUint32(16, strings.length, Endian.little);
+  for (var i = 0; i < n; i++) {
+    final item = items[i];
+    final int64s = [
+      item.size,
+      item.dateAdded,
+      item.dateTaken,
+      item.width,
+      item.height,
+      item.duration,
+    ];
+    for (var c = 0; c < int64s.length; c++) {
+      data.setInt64(32 + (c * n + i) * 8, int64s[c], Endian.little);
+    }
+    data.setFloat64(32 + (6 * n + i) * 8, item.latitude, Endian.little);
+    data.setFloat64(32 + (7 * n + i) * 8, item.longitude, Endian.little);
+    final path = utf8.encode(item.path);
+    final camera = item.cameraModel != null ? utf8.encode(item.cameraModel!) : [];
+    final uint32s = [
+      pathOffsets[i],
+      path.length,
+      pathOffsets[i] + item.nameOffset,
+      cameraOffsets[i],
+      camera.length,
+      placeholderOffsets[i],
+      item.placeholder?.length ?? 0,
+      item.kind | item.orientation << 8,
+    ];
+    for (var c = 0; c < uint32s.length; c++) {
+      data.setUint32(32 + n * 64 + (c * n + i) * 4, uint32s[c], Endian.little);
+    }
+  }
+  final bytes = data.buffer.asUint8List();
+  bytes.setRange(stringsOffset, bytes.length, strings.toBytes());
+  return bytes;
+}
+
+void main() {
+  final bytes = _pack(const [
+    _Item(
+      '/photos/Trip/café.jpg',
+      13,
+      size: 1234,
+      dateAdded: 1700000000,
+      dateTaken: 1551693600,
+      width: 4000,
+      height: 3000,
+      latitude: 48.5,
+      longitude: -2.25,
+      cameraModel: 'Pixel 7',
+      placeholder: 'LEHV6nWB2yk8pyo0adR*.7kCMdnj',
+      orientation: 6,
+    ),
+    _Item(
+      '/photos/Trip/clip.mp4',
+      13,
+      size: 99,
+      dateAdded: 1700000001,
+      width: 1920,
+      height: 1080,
+      duration: 3000,
+      kind: 2,
+    ),
+  ]);
+
+  test('decodes items lazily from the columns', () {
+    final list = PackedMediaList.fromBytes(bytes);
+    expect(list.length, 2);
+    expect(list.sizeAt(1), 99);
+    expect(list.typeAt(1), MediaType.video);
+    expect(list.nameAt(0), 'café.jpg');
+
+    final image = list[0];
+    expect(image, isA<ImageMedia>());
+    expect(image.path, '/photos/Trip/café.jpg');
+    expect(image.id, image.path);
+    expect(image.name, 'café.jpg');
+    expect(image.size, 1234);
+    expect(image.width, 4000);
+    expect(image.height, 3000);
+    expect(image.dateAdded.millisecondsSinceEpoch, 1700000000 * 1000);
+    expect(image.dateTaken!.millisecondsSinceEpoch, 1551693600 * 1000);
+    expect(image.orientation, 6);
+    expect(image.cameraModel, 'Pixel 7');
+    expect(image.latitude, 48.5);
+    expect(image.longitude, -2.25);
+    expect(image.placeholder, 'LEHV6nWB2yk8pyo0adR*.7kCMdnj');
+    expect(identical(list[0], image), isTrue);
+
+    final video = list[1] as VideoMedia;
+    expect(video.name, 'clip.mp4');
+    expect(video.duration, const Duration(seconds: 3));
+    expect(video.dateTaken, isNull);
+    expect(video.orientation, isNull);
+    expect(video.cameraModel, isNull);
+    expect(video.latitude, isNull);
+    expect(video.placeholder, isNull);
+    expect(list.placeholderAt(1), isNull);
+  });
+
+  test('rejects other payloads', () {
+    expect(
+      () => PackedMediaList.fromBytes(Uint8List(8)),
+      throwsFormatException,
+    );
+    expect(
+      () => PackedMediaList.fromBytes(Uint8List.sublistView(bytes, 0, 40)),
+      throwsFormatException,
+    );
+  });
+
+  test('is read-only', () {
+    final list = PackedMediaList.fromBytes(bytes);
+    expect(() => list.add(list[0]), throwsUnsupportedError);
+  });
+}